@@ -0,0 +1,162 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Multi-stage image pipeline benchmark: every image in a directory is loaded,
+    decoded and compressed to BC1. The stages are executed with three strategies:
+
+    serial   - one image at a time, stages one after another
+    blocking - one task per image; each task runs all stages (blocking style)
+    graph    - each stage is a TaskGraph node which depends on the previous stage,
+               stages of different images overlap freely
+
+    The decoders and the block compressor use parallel_for internally so even
+    the serial strategy uses the ThreadPool; the difference is how well the
+    pool is kept busy between the stages.
+*/
+
+struct Job
+{
+    std::string filename;
+    std::unique_ptr<File> file;
+    std::unique_ptr<Bitmap> bitmap;
+    Buffer compressed;
+};
+
+static const Format g_format(32, Format::UNORM, Format::RGBA, 8, 8, 8, 8);
+
+void load(Job& job)
+{
+    job.file.reset(new File(job.filename));
+}
+
+void decode(Job& job)
+{
+    ConstMemory memory = *job.file;
+    job.bitmap.reset(new Bitmap(memory, getExtension(job.filename), g_format));
+    job.file.reset();
+}
+
+void compress(Job& job)
+{
+    Bitmap& bitmap = *job.bitmap;
+    TextureCompressionInfo info(TextureCompression::BC1_UNORM);
+
+    int xblocks = (bitmap.width + info.width - 1) / info.width;
+    int yblocks = (bitmap.height + info.height - 1) / info.height;
+
+    job.compressed.resize(size_t(xblocks) * yblocks * info.bytes);
+    info.compress(job.compressed, bitmap);
+    job.bitmap.reset();
+}
+
+u64 serial(std::vector<Job>& jobs)
+{
+    u64 time0 = Time::us();
+
+    for (auto& job : jobs)
+    {
+        load(job);
+        decode(job);
+        compress(job);
+    }
+
+    return Time::us() - time0;
+}
+
+u64 blocking(std::vector<Job>& jobs)
+{
+    u64 time0 = Time::us();
+
+    ConcurrentQueue q;
+
+    for (auto& job : jobs)
+    {
+        q.enqueue([&job]
+        {
+            load(job);
+            decode(job);
+            compress(job);
+        });
+    }
+
+    q.wait();
+
+    return Time::us() - time0;
+}
+
+u64 graph(std::vector<Job>& jobs)
+{
+    u64 time0 = Time::us();
+
+    TaskGraph graph("pipeline");
+
+    for (auto& job : jobs)
+    {
+        auto* a = graph.add([&job] { load(job); });
+        auto* b = graph.add([&job] { decode(job); }, { a });
+        graph.add([&job] { compress(job); }, { b });
+    }
+
+    graph.wait();
+
+    return Time::us() - time0;
+}
+
+void print(const char* name, u64 time, const std::vector<Job>& jobs)
+{
+    size_t bytes = 0;
+    for (auto& job : jobs)
+    {
+        bytes += job.compressed.size();
+    }
+
+    printf("%-10s %8d ms (%d images, %d KB compressed)\n", name, int(time / 1000),
+        int(jobs.size()), int(bytes / 1024));
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <folder>\n", argv[0]);
+        return 1;
+    }
+
+    Path path(argv[1]);
+
+    std::vector<std::string> filenames;
+
+    for (auto& node : path)
+    {
+        if (node.isDirectory())
+            continue;
+
+        if (isImageDecoder(getExtension(node.name)))
+        {
+            filenames.push_back(path.pathname() + node.name);
+        }
+    }
+
+    auto run = [&] (const char* name, u64 (*func)(std::vector<Job>&))
+    {
+        std::vector<Job> jobs(filenames.size());
+        for (size_t i = 0; i < filenames.size(); ++i)
+        {
+            jobs[i].filename = filenames[i];
+        }
+
+        u64 time = func(jobs);
+        print(name, time, jobs);
+    };
+
+    run("serial", serial);
+    run("blocking", blocking);
+    run("graph", graph);
+}
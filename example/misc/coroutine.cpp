@@ -0,0 +1,111 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Coroutine image loader: every image in a folder is mapped and decoded by a
+    coroutine. The main thread starts all of the loads and waits for them once;
+    the coroutines do not block any thread while the files are mapped and the
+    images decoded in the ThreadPool.
+
+    NOTE: Requires a C++20 compiler; see MANGO_ENABLE_COROUTINES.
+*/
+
+#if defined(MANGO_ENABLE_COROUTINES)
+
+struct Image
+{
+    std::string filename;
+    std::unique_ptr<Bitmap> bitmap;
+};
+
+AsyncTask<bool> load(Image& image)
+{
+    std::unique_ptr<File> file = co_await mapFileAsync(image.filename);
+
+    ImageDecoder decoder(*file, getExtension(image.filename));
+    if (!decoder.isDecoder())
+        co_return false;
+
+    ImageHeader header = decoder.header();
+    image.bitmap.reset(new Bitmap(header.width, header.height, header.format));
+
+    ImageDecodeStatus status = co_await decodeAsync(decoder, *image.bitmap);
+    co_return status.success;
+}
+
+AsyncTask<int> loadAll(std::vector<Image>& images)
+{
+    std::vector<AsyncTask<bool>> tasks;
+
+    for (auto& image : images)
+    {
+        tasks.push_back(load(image));
+    }
+
+    std::vector<bool> results = co_await whenAll(std::move(tasks));
+
+    int count = 0;
+    for (bool success : results)
+    {
+        count += success;
+    }
+
+    co_return count;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <folder>\n", argv[0]);
+        return 1;
+    }
+
+    Path path(argv[1]);
+
+    std::vector<Image> images;
+
+    for (auto& node : path)
+    {
+        if (node.isDirectory())
+            continue;
+
+        if (isImageDecoder(getExtension(node.name)))
+        {
+            Image image;
+            image.filename = path.pathname() + node.name;
+            images.push_back(std::move(image));
+        }
+    }
+
+    u64 time0 = Time::us();
+    int count = syncWait(loadAll(images));
+    u64 time1 = Time::us();
+
+    size_t pixels = 0;
+    for (auto& image : images)
+    {
+        if (image.bitmap)
+        {
+            pixels += size_t(image.bitmap->width) * image.bitmap->height;
+        }
+    }
+
+    printf("decoded %d / %d images (%d Mpixels) in %d ms\n", count, int(images.size()),
+        int(pixels / 1000000), int((time1 - time0) / 1000));
+}
+
+#else
+
+int main()
+{
+    printf("Coroutines are not supported by the compiler.\n");
+}
+
+#endif
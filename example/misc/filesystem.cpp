@@ -148,6 +148,52 @@ void example7()
     Bitmap bitmap3(memory, filename);
 }
 
+void example8()
+{
+    // Examples 5 and 6 walk the folders one at a time. When the whole tree is
+    // needed the walk() method does the same in parallel and returns a flat index
+    // with the names relative to the path. The filters skip folders (and everything
+    // in them) and files we are not interested in; the size is not looked up for
+    // the files which are skipped so filtering is much cheaper than listing everything.
+
+    WalkFilter filter;
+    filter.folder = [] (const std::string& folder) { return folder.find(".git/") == std::string::npos; };
+    filter.file = [] (const std::string& file) { return getExtension(file) == ".jpg"; };
+
+    Path path("data/");
+    FileIndex index = path.walk(filter);
+
+    for (auto& node : index)
+    {
+        if (!node.isDirectory())
+        {
+            // node.name: "images/test.jpg"
+            File file(path, node.name);
+            Bitmap bitmap(file, node.name);
+        }
+    }
+}
+
+void example9(const std::vector<std::string>& filenames)
+{
+    // Memory mapped files are read one page fault at a time when they are accessed
+    // for the first time. When we know which files are needed next we can have them
+    // read into memory in the background while we are busy decoding the previous ones.
+
+    FilePrefetch prefetch;
+    prefetch.enqueue(filenames);
+
+    for (auto& filename : filenames)
+    {
+        File file(filename);
+
+        // The access hints tell the operating system how we are going to read the file
+        file.advise(AccessHint::SEQUENTIAL);
+
+        Bitmap bitmap(file, filename);
+    }
+}
+
 /*
     Generally, the MANGO(tm) always parses from memory when reading image files,
     decompresses textures or does anything I/O related. This way it is possible
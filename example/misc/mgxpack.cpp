@@ -0,0 +1,89 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    MGX packer: stores a folder (recursively) into a .mgx container which can be
+    accessed with the mango filesystem like any other folder:
+
+        Path path("assets.mgx/");
+        File file(path, "textures/wall.jpg");
+
+    usage: mgxpack <output.mgx> <folder> [method] [level] [block size in KB]
+*/
+
+void scan(MGXWriter& writer, const std::string& folder, const std::string& prefix)
+{
+    Path path(folder);
+
+    for (auto& node : path)
+    {
+        if (node.isDirectory())
+        {
+            writer.addFolder(prefix + node.name);
+            scan(writer, folder + node.name, prefix + node.name);
+        }
+        else
+        {
+            writer.addFile(prefix + node.name, folder + node.name);
+        }
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s <output.mgx> <folder> [method] [level] [block size in KB]\n", argv[0]);
+        printf("Methods:");
+        for (auto& compressor : getCompressors())
+        {
+            printf(" %s", compressor.name.c_str());
+        }
+        printf("\n");
+        return 1;
+    }
+
+    MGXWriterOptions options;
+
+    if (argc > 3)
+    {
+        options.method = getCompressor(argv[3]).method;
+    }
+
+    if (argc > 4)
+    {
+        options.level = std::atoi(argv[4]);
+    }
+
+    if (argc > 5)
+    {
+        options.block_size = size_t(std::atoi(argv[5])) * 1024;
+    }
+
+    std::string folder = argv[2];
+    if (folder.empty() || folder.back() != '/')
+    {
+        folder += '/';
+    }
+
+    u64 time0 = Time::ms();
+
+    MGXWriter writer(argv[1], options);
+    scan(writer, folder, "");
+    writer.finalize();
+
+    u64 time1 = Time::ms();
+
+    const MGXWriter::Statistics& statistics = writer.getStatistics();
+
+    printf("%s: %d files, %d blocks, %d KB -> %d KB in %d ms\n", argv[1],
+        int(statistics.files), int(statistics.blocks),
+        int(statistics.uncompressed / 1024), int(statistics.compressed / 1024),
+        int(time1 - time0));
+}
@@ -0,0 +1,209 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <random>
+#include <algorithm>
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Archive index benchmark: creates synthetic ZIP and MGX archives with one
+    million entries in memory and measures how long it takes to build the index
+    when the archive is opened and the lookup throughput of the index.
+
+    The ZIP archive only has the central directory (there is no file data) since
+    only the index is measured.
+
+    When a cache folder is given the ZIP archive is also written into it and
+    opened twice from the filesystem with the persistent index cache enabled; the
+    first open parses the archive and stores the index, the second maps it.
+
+    usage: archiveindex [number of entries] [cache folder]
+*/
+
+std::vector<std::string> createNames(size_t count)
+{
+    std::vector<std::string> names;
+
+    const size_t files_per_folder = 1000;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        char name[64];
+        std::sprintf(name, "data/folder%04d/file%06d.dat", int(i / files_per_folder), int(i));
+        names.push_back(name);
+    }
+
+    return names;
+}
+
+void createZIP(MemoryStream& stream, const std::vector<std::string>& names)
+{
+    LittleEndianStream s = stream;
+
+    // central directory
+    for (const std::string& name : names)
+    {
+        s.write32(0x02014b50);
+        s.write16(20); // version used
+        s.write16(20); // version needed
+        s.write16(0);  // flags
+        s.write16(0);  // compression
+        s.write16(0);  // time
+        s.write16(0);  // date
+        s.write32(0);  // crc
+        s.write32(0);  // compressed size
+        s.write32(0);  // uncompressed size
+        s.write16(u16(name.length()));
+        s.write16(0);  // extra field length
+        s.write16(0);  // comment length
+        s.write16(0);  // disk start
+        s.write16(0);  // internal attributes
+        s.write32(0);  // external attributes
+        s.write32(0);  // local header offset
+        s.write(name.data(), name.length());
+    }
+
+    const u64 size = stream.offset();
+    const u64 count = names.size();
+
+    // ZIP64 end of central directory record
+    s.write32(0x06064b50);
+    s.write64(44); // size of the remaining record
+    s.write16(45); // version used
+    s.write16(45); // version needed
+    s.write32(0);  // this disk
+    s.write32(0);  // central directory disk
+    s.write64(count);
+    s.write64(count);
+    s.write64(size);
+    s.write64(0); // central directory offset
+
+    // ZIP64 end of central directory locator
+    s.write32(0x07064b50);
+    s.write32(0);
+    s.write64(size);
+    s.write32(1);
+
+    // end of central directory record
+    s.write32(0x06054b50);
+    s.write16(0);
+    s.write16(0);
+    s.write16(0xffff);
+    s.write16(0xffff);
+    s.write32(0xffffffff);
+    s.write32(0xffffffff); // the ZIP64 record has the offset
+    s.write16(0);
+}
+
+void createMGX(MemoryStream& stream, const std::vector<std::string>& names)
+{
+    MGXWriter writer(stream);
+
+    for (const std::string& name : names)
+    {
+        writer.addFile(name, ConstMemory());
+    }
+
+    writer.finalize();
+}
+
+void test(const char* name, const Path& path, u64 time0, const std::vector<std::string>& names)
+{
+    AbstractMapper* mapper = path.getMapper();
+
+    u64 time1 = Time::us();
+
+    // look up the files in random order so that the access pattern is not cache friendly
+    std::vector<const std::string*> order;
+    for (const std::string& name : names)
+    {
+        order.push_back(&name);
+    }
+
+    std::shuffle(order.begin(), order.end(), std::mt19937(7));
+
+    u64 time2 = Time::us();
+
+    size_t found = 0;
+    for (const std::string* name : order)
+    {
+        found += mapper->isFile(*name);
+    }
+
+    u64 time3 = Time::us();
+
+    // list every folder
+    size_t listed = 0;
+    size_t folders = 0;
+
+    FileIndex root;
+    mapper->getIndex(root, "data/");
+
+    for (const FileInfo& folder : root)
+    {
+        FileIndex index;
+        mapper->getIndex(index, "data/" + folder.name);
+        listed += index.size();
+        ++folders;
+    }
+
+    u64 time4 = Time::us();
+
+    bool success = found == names.size() && listed == names.size();
+
+    printf("%s: %d entries %s\n", name, int(names.size()), success ? "" : "[FAILED]");
+    printf("  open:   %8.1f ms\n", double(time1 - time0) / 1000.0);
+    printf("  lookup: %8.1f ns/file\n", double(time3 - time2) * 1000.0 / names.size());
+    printf("  list:   %8.1f ms (%d folders)\n", double(time4 - time3) / 1000.0, int(folders));
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t count = 1000000;
+
+    if (argc > 1)
+    {
+        count = std::max(std::atoi(argv[1]), 1);
+    }
+
+    std::vector<std::string> names = createNames(count);
+
+    MemoryStream zip;
+    createZIP(zip, names);
+
+    u64 time = Time::us();
+    test("zip", Path(zip, ".zip"), time, names);
+
+    MemoryStream mgx;
+    createMGX(mgx, names);
+
+    time = Time::us();
+    test("mgx", Path(mgx, ".mgx"), time, names);
+
+    if (argc > 2)
+    {
+        std::string folder = argv[2];
+        if (folder.back() != '/')
+        {
+            folder += '/';
+        }
+
+        const std::string filename = folder + "archiveindex.zip";
+        {
+            FileStream file(filename, Stream::WRITE);
+            file.write(zip);
+        }
+
+        setArchiveIndexCache(folder);
+
+        time = Time::us();
+        test("zip (parse and store the index)", Path(filename + "/"), time, names);
+
+        time = Time::us();
+        test("zip (cached index)", Path(filename + "/"), time, names);
+    }
+}
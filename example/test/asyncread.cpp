@@ -0,0 +1,181 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <atomic>
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+using namespace mango::image;
+
+/*
+    Bulk loading benchmark: loads every file in a directory tree with memory mapped
+    File objects in the ThreadPool and with the AsyncFileReader (io_uring and the
+    ThreadPool engines). The files are evicted from the page cache before each run
+    (the eviction is a hint; files with dirty pages or mapped by other processes may
+    stay in the cache). The content checksums of the runs are compared.
+
+    With "decode" the images are decoded in the completion callbacks; the other
+    files are only checksummed.
+
+    usage: asyncread <folder> [decode]
+*/
+
+struct Result
+{
+    std::atomic<u64> checksum { 0 };
+    std::atomic<u64> bytes { 0 };
+    std::atomic<u32> images { 0 };
+    std::atomic<u32> errors { 0 };
+};
+
+void process(Result& result, const std::string& filename, ConstMemory memory, bool decode)
+{
+    result.checksum += xx3hash64(0, memory);
+    result.bytes += memory.size;
+
+    const std::string extension = getExtension(filename);
+    if (decode && isImageDecoder(extension))
+    {
+        try
+        {
+            Bitmap bitmap(memory, extension);
+            ++result.images;
+        }
+        catch (...)
+        {
+            ++result.errors;
+        }
+    }
+}
+
+void evict(const std::vector<std::string>& filenames)
+{
+    for (const std::string& filename : filenames)
+    {
+        try
+        {
+            File file(filename);
+            file.advise(AccessHint::DONTNEED);
+        }
+        catch (...)
+        {
+        }
+    }
+}
+
+u64 testMap(Result& result, const std::vector<std::string>& filenames, bool decode)
+{
+    u64 time0 = Time::us();
+
+    ConcurrentQueue queue;
+
+    for (const std::string& filename : filenames)
+    {
+        queue.enqueue([&result, &filename, decode]
+        {
+            try
+            {
+                File file(filename);
+                process(result, filename, file, decode);
+            }
+            catch (...)
+            {
+                ++result.errors;
+            }
+        });
+    }
+
+    queue.wait();
+
+    return Time::us() - time0;
+}
+
+u64 testReader(Result& result, const std::vector<std::string>& filenames, bool decode, ReadEngine engine, u32 depth)
+{
+    u64 time0 = Time::us();
+
+    AsyncFileReader reader(engine, depth);
+
+    for (const std::string& filename : filenames)
+    {
+        reader.read(filename, [&result, decode] (const std::string& filename, ConstMemory memory, const Status& status)
+        {
+            if (status)
+            {
+                process(result, filename, memory, decode);
+            }
+            else
+            {
+                ++result.errors;
+            }
+        });
+    }
+
+    reader.wait();
+
+    return Time::us() - time0;
+}
+
+void print(const char* name, u64 time, const Result& result, const Result& reference)
+{
+    bool success = result.checksum == reference.checksum && result.bytes == reference.bytes;
+    double mbs = double(result.bytes) / std::max(u64(1), time);
+
+    printf("%-12s %8.1f ms %8.1f MB/s  %d images %d errors %s\n", name, time / 1000.0, mbs,
+        int(result.images), int(result.errors), success ? "" : "[FAILED]");
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <folder> [decode]\n", argv[0]);
+        return 1;
+    }
+
+    std::string folder = argv[1];
+    if (folder.back() != '/')
+    {
+        folder += '/';
+    }
+
+    bool decode = argc > 2 && std::string(argv[2]) == "decode";
+
+    std::vector<std::string> filenames;
+    u64 total = 0;
+
+    for (const FileInfo& node : Path(folder).walk())
+    {
+        if (!node.isDirectory())
+        {
+            filenames.push_back(folder + node.name);
+            total += node.size;
+        }
+    }
+
+    printf("%d files, %.1f MB\n", int(filenames.size()), total / (1024.0 * 1024.0));
+
+    Result map;
+    evict(filenames);
+    u64 time = testMap(map, filenames, decode);
+    print("mmap:", time, map, map);
+
+    if (AsyncFileReader(ReadEngine::IO_URING).engine() == ReadEngine::IO_URING)
+    {
+        Result uring;
+        evict(filenames);
+        time = testReader(uring, filenames, decode, ReadEngine::IO_URING, 128);
+        print("io_uring:", time, uring, map);
+    }
+    else
+    {
+        printf("io_uring:    not available\n");
+    }
+
+    Result threadpool;
+    evict(filenames);
+    time = testReader(threadpool, filenames, decode, ReadEngine::THREADPOOL, 128);
+    print("threadpool:", time, threadpool, map);
+}
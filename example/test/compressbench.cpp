@@ -0,0 +1,611 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Compression benchmark: compresses synthetic corpora (text, image, already compressed
+    and sparse binary data) and the files given on the command line with every compressor
+    at every level. The corpus is split into buffers which are compressed independently,
+    first on one thread and then concurrently in the ThreadPool, for each buffer size.
+    The decompressed data is compared against the source.
+
+    The peak memory is the growth of the peak resident set size of the process during
+    the single threaded compression and decompression (Linux only). The compressors keep
+    their contexts per thread, so the memory shows up on the first run which needs it.
+
+    usage: compressbench [options] [file ...]
+
+        --method <name>     compressor (default: all)
+        --levels <list>     levels, for example 1,6,10 (default: 0-10)
+        --sizes <list>      buffer sizes in KB, for example 4,64 (default: 4,64,1024)
+        --corpus <MB>       size of the synthetic corpora (default: 2)
+        --csv <file>        write the results as CSV
+        --json <file>       write the results as JSON
+*/
+
+// ----------------------------------------------------------------------------
+// corpus
+// ----------------------------------------------------------------------------
+
+struct Corpus
+{
+    std::string name;
+    std::vector<u8> data;
+};
+
+struct Random
+{
+    u32 seed;
+
+    Random(u32 seed)
+        : seed(seed)
+    {
+    }
+
+    u32 operator () ()
+    {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    }
+};
+
+std::vector<u8> generateText(size_t size, u32 seed)
+{
+    const char* words[] =
+    {
+        "the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "with", "was",
+        "on", "be", "by", "this", "are", "from", "at", "or", "which", "an", "not", "have",
+        "texture", "buffer", "memory", "compression", "stream", "block", "level", "thread",
+        "file", "container", "image", "format", "decoder", "encoder", "pixel", "surface",
+        "archive", "header", "offset", "segment", "dictionary", "performance", "quality",
+    };
+    const int count = int(sizeof(words) / sizeof(words[0]));
+
+    Random random(seed);
+    std::string text;
+
+    while (text.size() < size)
+    {
+        int length = 4 + random() % 12;
+        for (int i = 0; i < length; ++i)
+        {
+            // the common words are picked more often
+            u32 x = random() % 1024;
+            text += words[(x * x / 1024) * count / 1024];
+            text += (i < length - 1) ? " " : (random() & 3) ? ". " : ".\n";
+        }
+    }
+
+    return std::vector<u8>(text.begin(), text.begin() + size);
+}
+
+std::vector<u8> generateImage(size_t size, u32 seed)
+{
+    // RGBA pixels interpolated from a coarse random grid with some noise
+    const int width = 1024;
+    const int height = int(std::max(size_t(1), size / (width * 4)));
+    const int cell = 32;
+    const int gw = width / cell + 1;
+    const int gh = height / cell + 2;
+
+    Random random(seed);
+
+    std::vector<u8> grid(gw * gh * 4);
+    for (u8& v : grid)
+    {
+        v = u8(random());
+    }
+
+    std::vector<u8> image(size);
+
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const int gx = x / cell;
+            const int gy = y / cell;
+            const int fx = x % cell;
+            const int fy = y % cell;
+
+            for (int c = 0; c < 4; ++c)
+            {
+                int a = grid[(gy * gw + gx) * 4 + c];
+                int b = grid[(gy * gw + gx + 1) * 4 + c];
+                int d = grid[((gy + 1) * gw + gx) * 4 + c];
+                int e = grid[((gy + 1) * gw + gx + 1) * 4 + c];
+                int top = a * (cell - fx) + b * fx;
+                int bottom = d * (cell - fx) + e * fx;
+                int value = (top * (cell - fy) + bottom * fy) / (cell * cell);
+
+                if (c < 3)
+                {
+                    value += int(random() % 9) - 4;
+                }
+                else
+                {
+                    value = 255;
+                }
+
+                size_t offset = (size_t(y) * width + x) * 4 + c;
+                if (offset < size)
+                {
+                    image[offset] = u8(std::min(255, std::max(0, value)));
+                }
+            }
+        }
+    }
+
+    return image;
+}
+
+std::vector<u8> generateCompressed(size_t size, u32 seed)
+{
+    std::vector<u8> data;
+
+    while (data.size() < size)
+    {
+        std::vector<u8> text = generateText(1024 * 1024, seed++);
+        std::vector<u8> buffer(deflate::bound(text.size()));
+
+        size_t bytes = deflate::compress(Memory(buffer.data(), buffer.size()), ConstMemory(text.data(), text.size()), 6);
+        data.insert(data.end(), buffer.begin(), buffer.begin() + bytes);
+    }
+
+    data.resize(size);
+    return data;
+}
+
+std::vector<u8> generateSparse(size_t size, u32 seed)
+{
+    // 64 byte records: index, type, quantized position, mostly zero payload
+    Random random(seed);
+    std::vector<u8> data(size, 0);
+
+    for (size_t offset = 0; offset + 64 <= size; offset += 64)
+    {
+        u8* p = data.data() + offset;
+
+        ustore32le(p + 0, u32(offset / 64));
+        ustore32le(p + 4, random() % 8);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            float position = float(random() % 64) * 0.25f;
+            std::memcpy(p + 8 + i * 4, &position, 4);
+        }
+
+        if (random() % 16 == 0)
+        {
+            ustore32le(p + 24, random());
+            ustore32le(p + 28, random());
+        }
+    }
+
+    return data;
+}
+
+// ----------------------------------------------------------------------------
+// peak memory
+// ----------------------------------------------------------------------------
+
+#if defined(MANGO_PLATFORM_LINUX)
+
+s64 readStatus(const char* key)
+{
+    s64 value = -1;
+
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file)
+    {
+        char line[256];
+        size_t length = std::strlen(key);
+
+        while (fgets(line, sizeof(line), file))
+        {
+            if (!std::strncmp(line, key, length))
+            {
+                value = std::atoll(line + length) * 1024;
+                break;
+            }
+        }
+
+        fclose(file);
+    }
+
+    return value;
+}
+
+s64 resetPeakMemory()
+{
+    // writing 5 to clear_refs resets the peak resident set size to the current one
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (!file)
+        return -1;
+
+    fputs("5", file);
+    fclose(file);
+
+    return readStatus("VmHWM:");
+}
+
+s64 getPeakMemory()
+{
+    return readStatus("VmHWM:");
+}
+
+#else
+
+s64 resetPeakMemory()
+{
+    return -1;
+}
+
+s64 getPeakMemory()
+{
+    return -1;
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+// benchmark
+// ----------------------------------------------------------------------------
+
+struct Result
+{
+    std::string corpus;
+    std::string method;
+    int level;
+    size_t buffer_size;
+    size_t size;
+    size_t compressed;
+    double compress[2];   // MB/s, single and multi threaded
+    double decompress[2];
+    s64 peak_memory;      // bytes; -1 if not available
+    bool success;
+};
+
+double mbs(size_t bytes, u64 us)
+{
+    return double(bytes) / std::max(u64(1), us);
+}
+
+Result test(const Compressor& compressor, int level, const Corpus& corpus, size_t buffer_size)
+{
+    const size_t size = corpus.data.size();
+    const size_t count = std::max(size_t(1), (size + buffer_size - 1) / buffer_size);
+
+    struct Chunk
+    {
+        ConstMemory source;
+        Memory dest;
+        size_t bytes;
+    };
+
+    std::vector<Chunk> chunks(count);
+    std::vector<u8> output(size);
+    Buffer compressed(compressor.bound(buffer_size) * count);
+
+    // touch the buffers so that they are not counted as compressor memory
+    std::memset(compressed.data(), 0, compressed.size());
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t offset = i * buffer_size;
+        size_t bytes = std::min(buffer_size, size - std::min(size, offset));
+        chunks[i].source = ConstMemory(corpus.data.data() + offset, bytes);
+        chunks[i].dest = Memory(compressed.data() + i * compressor.bound(buffer_size), compressor.bound(buffer_size));
+        chunks[i].bytes = 0;
+    }
+
+    Result result;
+    result.corpus = corpus.name;
+    result.method = compressor.name;
+    result.level = level;
+    result.buffer_size = buffer_size;
+    result.size = size;
+    result.compressed = 0;
+    result.success = true;
+
+    auto compress = [&] (size_t i)
+    {
+        chunks[i].bytes = compressor.compress(chunks[i].dest, chunks[i].source, level);
+    };
+
+    auto decompress = [&] (size_t i)
+    {
+        Memory dest(output.data() + (chunks[i].source.address - corpus.data.data()), chunks[i].source.size);
+        compressor.decompress(dest, ConstMemory(chunks[i].dest.address, chunks[i].bytes));
+    };
+
+    try
+    {
+        // single threaded
+        s64 baseline = resetPeakMemory();
+
+        u64 time0 = Time::us();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            compress(i);
+        }
+
+        u64 time1 = Time::us();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            decompress(i);
+        }
+
+        u64 time2 = Time::us();
+
+        s64 peak = getPeakMemory();
+        result.peak_memory = (baseline < 0 || peak < 0) ? -1 : std::max(s64(0), peak - baseline);
+
+        for (const Chunk& chunk : chunks)
+        {
+            result.compressed += chunk.bytes;
+        }
+
+        result.success = !std::memcmp(output.data(), corpus.data.data(), size);
+        result.compress[0] = mbs(size, time1 - time0);
+        result.decompress[0] = mbs(size, time2 - time1);
+
+        // multi threaded
+        std::fill(output.begin(), output.end(), 0);
+
+        u64 time3 = Time::us();
+
+        ConcurrentQueue q("compressbench");
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            q.enqueue([&compress, i] { compress(i); });
+        }
+
+        q.wait();
+
+        u64 time4 = Time::us();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            q.enqueue([&decompress, i] { decompress(i); });
+        }
+
+        q.wait();
+
+        u64 time5 = Time::us();
+
+        result.success = result.success && !std::memcmp(output.data(), corpus.data.data(), size);
+        result.compress[1] = mbs(size, time4 - time3);
+        result.decompress[1] = mbs(size, time5 - time4);
+    }
+    catch (Exception& e)
+    {
+        printf("%s %d: %s\n", compressor.name.c_str(), level, e.what());
+        result.success = false;
+        result.compress[0] = result.compress[1] = 0;
+        result.decompress[0] = result.decompress[1] = 0;
+        result.peak_memory = -1;
+    }
+
+    return result;
+}
+
+void print(const Result& result)
+{
+    char memory[32] = "n/a";
+    if (result.peak_memory >= 0)
+    {
+        std::snprintf(memory, sizeof(memory), "%lld", (long long)(result.peak_memory / 1024));
+    }
+
+    printf("%-12s %-8s %2d %6d | %6.1f %% | %8.1f %8.1f | %8.1f %8.1f | %8s %s\n",
+        result.corpus.c_str(), result.method.c_str(), result.level, int(result.buffer_size / 1024),
+        result.compressed * 100.0 / std::max(size_t(1), result.size),
+        result.compress[0], result.decompress[0],
+        result.compress[1], result.decompress[1],
+        memory, result.success ? "" : "[FAILED]");
+}
+
+void writeCSV(const std::string& filename, const std::vector<Result>& results)
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    if (!file)
+    {
+        MANGO_EXCEPTION("[compressbench] Creating \"%s\" failed.", filename.c_str());
+    }
+
+    fprintf(file, "corpus,method,level,buffer_size,size,compressed,ratio,"
+                  "compress_st,decompress_st,compress_mt,decompress_mt,peak_memory,success\n");
+
+    for (const Result& result : results)
+    {
+        fprintf(file, "%s,%s,%d,%zu,%zu,%zu,%.4f,%.2f,%.2f,%.2f,%.2f,%lld,%d\n",
+            result.corpus.c_str(), result.method.c_str(), result.level,
+            result.buffer_size, result.size, result.compressed,
+            double(result.compressed) / std::max(size_t(1), result.size),
+            result.compress[0], result.decompress[0], result.compress[1], result.decompress[1],
+            (long long)result.peak_memory, result.success ? 1 : 0);
+    }
+
+    fclose(file);
+}
+
+void writeJSON(const std::string& filename, const std::vector<Result>& results)
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    if (!file)
+    {
+        MANGO_EXCEPTION("[compressbench] Creating \"%s\" failed.", filename.c_str());
+    }
+
+    fprintf(file, "{\n  \"threads\": %d,\n  \"results\": [\n", ThreadPool::getHardwareConcurrency());
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& result = results[i];
+
+        // the corpus names are file names; escape the characters which need it
+        std::string corpus;
+        for (char c : result.corpus)
+        {
+            if (c == '"' || c == '\\')
+                corpus += '\\';
+            corpus += c;
+        }
+
+        fprintf(file, "    { \"corpus\": \"%s\", \"method\": \"%s\", \"level\": %d, "
+                      "\"buffer_size\": %zu, \"size\": %zu, \"compressed\": %zu, \"ratio\": %.4f, "
+                      "\"compress_st\": %.2f, \"decompress_st\": %.2f, \"compress_mt\": %.2f, \"decompress_mt\": %.2f, ",
+            corpus.c_str(), result.method.c_str(), result.level,
+            result.buffer_size, result.size, result.compressed,
+            double(result.compressed) / std::max(size_t(1), result.size),
+            result.compress[0], result.decompress[0], result.compress[1], result.decompress[1]);
+
+        if (result.peak_memory >= 0)
+            fprintf(file, "\"peak_memory\": %lld, ", (long long)result.peak_memory);
+        else
+            fprintf(file, "\"peak_memory\": null, ");
+
+        fprintf(file, "\"success\": %s }%s\n", result.success ? "true" : "false",
+            i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
+
+std::vector<int> parseList(const char* text)
+{
+    std::vector<int> values;
+
+    for (const char* p = text; *p; )
+    {
+        values.push_back(std::atoi(p));
+        p = std::strchr(p, ',');
+        if (!p)
+            break;
+        ++p;
+    }
+
+    return values;
+}
+
+int main(int argc, const char* argv[])
+{
+    std::vector<Compressor> compressors = getCompressors();
+    std::vector<int> levels = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    std::vector<int> sizes = { 4, 64, 1024 };
+    size_t corpus_size = 2 * 1024 * 1024;
+    std::string csv;
+    std::string json;
+    std::vector<std::string> filenames;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        const bool option = arg == "--method" || arg == "--levels" || arg == "--sizes" ||
+                            arg == "--corpus" || arg == "--csv" || arg == "--json";
+
+        if (option && !value)
+        {
+            printf("Option %s requires a value.\n", arg.c_str());
+            return 1;
+        }
+
+        if (arg == "--method")
+        {
+            compressors = { getCompressor(std::string(value)) };
+            ++i;
+        }
+        else if (arg == "--levels")
+        {
+            levels = parseList(value);
+            ++i;
+        }
+        else if (arg == "--sizes")
+        {
+            sizes = parseList(value);
+            ++i;
+        }
+        else if (arg == "--corpus")
+        {
+            corpus_size = std::max(1, std::atoi(value)) * 1024 * 1024;
+            ++i;
+        }
+        else if (arg == "--csv")
+        {
+            csv = value;
+            ++i;
+        }
+        else if (arg == "--json")
+        {
+            json = value;
+            ++i;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            printf("Usage: %s [--method <name>] [--levels <list>] [--sizes <list>] [--corpus <MB>] "
+                   "[--csv <file>] [--json <file>] [file ...]\n", argv[0]);
+            return 1;
+        }
+        else
+        {
+            filenames.push_back(arg);
+        }
+    }
+
+    std::vector<Corpus> corpora;
+    corpora.push_back({ "text", generateText(corpus_size, 1) });
+    corpora.push_back({ "image", generateImage(corpus_size, 2) });
+    corpora.push_back({ "compressed", generateCompressed(corpus_size, 3) });
+    corpora.push_back({ "sparse", generateSparse(corpus_size, 4) });
+
+    for (const std::string& filename : filenames)
+    {
+        File file(filename);
+        corpora.push_back({ removePath(filename), std::vector<u8>(file.data(), file.data() + file.size()) });
+    }
+
+    printf("%d threads\n", ThreadPool::getHardwareConcurrency());
+    printf("%-12s %-8s %2s %6s | %8s | %17s | %17s | %8s\n", "", "", "", "buffer", "", "single MB/s", "multi MB/s", "peak");
+    printf("%-12s %-8s %2s %6s | %8s | %8s %8s | %8s %8s | %8s\n",
+        "corpus", "method", "lv", "KB", "ratio", "comp", "decomp", "comp", "decomp", "KB");
+
+    std::vector<Result> results;
+
+    for (const Corpus& corpus : corpora)
+    {
+        for (const Compressor& compressor : compressors)
+        {
+            for (int level : levels)
+            {
+                for (int size : sizes)
+                {
+                    size_t buffer_size = std::min(size_t(std::max(1, size)) * 1024, std::max(size_t(1), corpus.data.size()));
+                    Result result = test(compressor, level, corpus, buffer_size);
+                    print(result);
+                    results.push_back(result);
+                }
+            }
+        }
+    }
+
+    if (!csv.empty())
+    {
+        writeCSV(csv, results);
+    }
+
+    if (!json.empty())
+    {
+        writeJSON(json, results);
+    }
+}
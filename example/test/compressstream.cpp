@@ -0,0 +1,126 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Streaming compression benchmark: compresses a file through CompressStream into
+    a temporary file with small writes and reads it back through DecompressStream
+    with every streaming method. The decompressed data is compared against the source.
+
+    usage: compressstream <file> [folder]
+*/
+
+struct Method
+{
+    const char* name;
+    Compressor::Method method;
+    const char* extension;
+};
+
+double mbs(u64 bytes, u64 us)
+{
+    return double(bytes) / std::max(u64(1), us);
+}
+
+void test(const Method& method, ConstMemory source, const std::string& filename)
+{
+    u64 time0 = Time::us();
+
+    {
+        FileStream file(filename, Stream::WRITE);
+        CompressStream stream(file, method.method);
+
+        // write in uneven pieces to exercise the buffering
+        for (size_t offset = 0; offset < source.size; )
+        {
+            size_t bytes = std::min(source.size - offset, size_t(1000 + offset % 7000));
+            stream.write(source.address + offset, bytes);
+            offset += bytes;
+        }
+
+        stream.finish();
+    }
+
+    u64 time1 = Time::us();
+
+    u64 compressed = 0;
+    bool success = true;
+
+    {
+        FileStream file(filename, Stream::READ);
+        compressed = file.size();
+
+        DecompressStream stream(file, method.method);
+
+        Buffer buffer(256 * 1024);
+        size_t offset = 0;
+
+        for (;;)
+        {
+            size_t bytes = stream.readSome(buffer);
+            if (!bytes)
+                break;
+
+            success = success && offset + bytes <= source.size &&
+                      !std::memcmp(buffer.data(), source.address + offset, bytes);
+            offset += bytes;
+        }
+
+        success = success && offset == source.size;
+    }
+
+    u64 time2 = Time::us();
+
+    printf("%-8s %6.1f %% | %8.1f MB/s | %8.1f MB/s %s\n",
+        method.name, compressed * 100.0 / std::max(size_t(1), source.size),
+        mbs(source.size, time1 - time0), mbs(source.size, time2 - time1),
+        success ? "" : "[FAILED]");
+
+    std::remove(filename.c_str());
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <file> [folder]\n", argv[0]);
+        return 1;
+    }
+
+    File file(argv[1]);
+
+    std::string folder;
+    if (argc > 2)
+    {
+        folder = argv[2];
+        if (folder.back() != '/')
+        {
+            folder += '/';
+        }
+    }
+
+    const Method methods[] =
+    {
+        { "none",    Compressor::NONE,    ".raw" },
+        { "lz4",     Compressor::LZ4,     ".lz4" },
+        { "zstd",    Compressor::ZSTD,    ".zst" },
+        { "bzip2",   Compressor::BZIP2,   ".bz2" },
+        { "lzma",    Compressor::LZMA,    ".lzma" },
+        { "deflate", Compressor::DEFLATE, ".deflate" },
+        { "zlib",    Compressor::ZLIB,    ".zlib" },
+        { "gzip",    Compressor::GZIP,    ".gz" },
+    };
+
+    printf("%.1f MB\n", file.size() / (1024.0 * 1024.0));
+    printf("%-8s %8s | %13s | %13s\n", "method", "ratio", "compress", "decompress");
+
+    for (const Method& method : methods)
+    {
+        test(method, file, folder + "compressstream" + method.extension);
+    }
+}
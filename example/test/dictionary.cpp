@@ -0,0 +1,130 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Dictionary compression benchmark: trains a dictionary from half of the small
+    files in a folder and compresses the other half one file at a time with and
+    without the dictionary. The decompressed data is compared against the source.
+
+    usage: dictionary <folder> [dictionary size in KB]
+*/
+
+double average(u64 us, size_t count)
+{
+    return double(us) / std::max(size_t(1), count);
+}
+
+void test(Compressor::Method method, int level, ConstMemory content, const std::vector<std::vector<u8>>& files)
+{
+    Compressor compressor = getCompressor(method);
+    SharedObject<CompressionDictionary> dictionary = createDictionary(method, content, level);
+
+    size_t total = 0;
+    size_t plain = 0;
+    size_t packed = 0;
+    u64 plain_time = 0;
+    u64 compress_time = 0;
+    u64 decompress_time = 0;
+    bool success = true;
+
+    for (const std::vector<u8>& file : files)
+    {
+        ConstMemory source(file.data(), file.size());
+        Buffer buffer(compressor.bound(source.size));
+        Buffer output(source.size);
+
+        u64 time0 = Time::us();
+        plain += compressor.compress(buffer, source, level);
+
+        u64 time1 = Time::us();
+        size_t bytes = dictionary->compress(buffer, source);
+
+        u64 time2 = Time::us();
+        dictionary->decompress(output, ConstMemory(buffer.data(), bytes));
+
+        u64 time3 = Time::us();
+
+        total += source.size;
+        packed += bytes;
+        plain_time += time1 - time0;
+        compress_time += time2 - time1;
+        decompress_time += time3 - time2;
+
+        success = success && !std::memcmp(output.data(), source.address, source.size);
+    }
+
+    printf("%-8s %2d %6.1f %% %7.1f us | %6.1f %% %7.1f us %7.1f us %s\n",
+        compressor.name.c_str(), level,
+        plain * 100.0 / std::max(size_t(1), total), average(plain_time, files.size()),
+        packed * 100.0 / std::max(size_t(1), total), average(compress_time, files.size()),
+        average(decompress_time, files.size()),
+        success ? "" : "[FAILED]");
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <folder> [dictionary size in KB]\n", argv[0]);
+        return 1;
+    }
+
+    std::string folder = argv[1];
+    if (folder.back() != '/')
+    {
+        folder += '/';
+    }
+
+    size_t size = 64 * 1024;
+    if (argc > 2)
+    {
+        size = std::atoi(argv[2]) * 1024;
+    }
+
+    // every other small file is used for training
+    std::vector<std::vector<u8>> samples;
+    std::vector<std::vector<u8>> files;
+
+    Path path(folder);
+
+    for (auto& node : path.walk())
+    {
+        if (node.isDirectory() || !node.size || node.size > 64 * 1024)
+            continue;
+
+        File file(path, node.name);
+        std::vector<std::vector<u8>>& target = (samples.size() > files.size()) ? files : samples;
+        target.emplace_back(file.data(), file.data() + file.size());
+    }
+
+    std::vector<ConstMemory> memory;
+    for (const std::vector<u8>& sample : samples)
+    {
+        memory.emplace_back(sample.data(), sample.size());
+    }
+
+    u64 time0 = Time::ms();
+
+    std::vector<u8> content = trainDictionary(memory, size);
+
+    u64 time1 = Time::ms();
+
+    printf("dictionary: %d KB from %d files in %d ms, %d test files\n",
+        int(content.size() / 1024), int(samples.size()), int(time1 - time0), int(files.size()));
+    printf("%-8s %2s %8s %10s | %8s %10s %10s\n", "", "", "plain", "plain", "dict", "dict", "dict");
+    printf("%-8s %2s %8s %10s | %8s %10s %10s\n", "method", "lv", "ratio", "compress", "ratio", "compress", "decompress");
+
+    for (Compressor::Method method : { Compressor::LZ4, Compressor::ZSTD })
+    {
+        for (int level : { 1, 6, 10 })
+        {
+            test(method, level, ConstMemory(content.data(), content.size()), files);
+        }
+    }
+}
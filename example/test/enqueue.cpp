@@ -0,0 +1,112 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <new>
+#include <cstdlib>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+/*
+    Task submission microbenchmark: measures enqueue + execute cost per task and
+    counts the heap allocations made while doing it. The "std::function" rows wrap
+    the same lambda in std::function before enqueue, which is what the ThreadPool
+    used to store internally, so they show the cost of the old submission path.
+
+    NOTE: Callables larger than the TaskFunction inline storage use recycled
+          blocks; new blocks are only allocated when there are more tasks in flight
+          than there are blocks available, eg. when the producer runs ahead of the pool.
+*/
+
+static std::atomic<u64> g_allocations { 0 };
+
+void* operator new (size_t size)
+{
+    ++g_allocations;
+    void* ptr = std::malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete (void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete (void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+template <int Size>
+struct Payload
+{
+    u8 data[Size];
+};
+
+template <int Size, bool Wrap>
+void benchmark(const char* name, int count)
+{
+    ConcurrentQueue q;
+    std::atomic<u32> counter { 0 };
+
+    Payload<Size> payload;
+    std::memset(payload.data, 1, Size);
+
+    auto lambda = [&counter, payload]
+    {
+        counter += payload.data[Size - 1];
+    };
+
+    // warm up the pool and the task storage
+    for (int i = 0; i < 1000; ++i)
+    {
+        q.enqueue(lambda);
+    }
+    q.wait();
+    counter = 0;
+
+    u64 allocations0 = g_allocations;
+    u64 time0 = Time::ns();
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (Wrap)
+        {
+            std::function<void()> func = lambda;
+            q.enqueue(std::move(func));
+        }
+        else
+        {
+            q.enqueue(lambda);
+        }
+    }
+
+    q.wait();
+
+    u64 time1 = Time::ns();
+    u64 allocations1 = g_allocations;
+
+    const char* status = counter == u32(count) ? "" : " [FAILED]";
+
+    printf("%-14s %4d bytes: %7.1f ns/task, %5.2f allocations/task%s\n", name, Size,
+        double(time1 - time0) / count, double(allocations1 - allocations0) / count, status);
+}
+
+int main(int argc, char* argv[])
+{
+    int count = 1'000'000;
+    if (argc == 2)
+    {
+        count = std::atoi(argv[1]);
+    }
+
+    benchmark<8, false>("TaskFunction", count);
+    benchmark<8, true>("std::function", count);
+    benchmark<40, false>("TaskFunction", count);
+    benchmark<40, true>("std::function", count);
+    benchmark<200, false>("TaskFunction", count);
+    benchmark<200, true>("std::function", count);
+}
@@ -0,0 +1,95 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <atomic>
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Archive extraction benchmark: maps (and decompresses) every file in an archive
+    one at a time with File and concurrently with Path::map(), and compares the
+    contents.
+
+    usage: extract <archive>
+*/
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <archive>\n", argv[0]);
+        return 1;
+    }
+
+    std::string pathname = argv[1];
+    if (pathname.back() != '/')
+    {
+        pathname += '/';
+    }
+
+    Path path(pathname);
+
+    std::vector<std::string> filenames;
+    for (const FileInfo& node : path.walk())
+    {
+        if (!node.isDirectory())
+        {
+            filenames.push_back(node.name);
+        }
+    }
+
+    // serial
+    u64 time0 = Time::us();
+
+    u64 serial = 0;
+    u64 bytes = 0;
+
+    for (const std::string& filename : filenames)
+    {
+        File file(path, filename);
+        serial += xx3hash64(0, file);
+        bytes += file.size();
+    }
+
+    // concurrent
+    u64 time1 = Time::us();
+
+    std::atomic<u64> concurrent { 0 };
+    std::atomic<int> errors { 0 };
+
+    path.map(filenames, [&] (const std::string& filename, std::unique_ptr<VirtualMemory> memory, const Status& status)
+    {
+        if (status)
+        {
+            concurrent += xx3hash64(0, *memory);
+        }
+        else
+        {
+            printf("%s: %s\n", filename.c_str(), status.info.c_str());
+            ++errors;
+        }
+    });
+
+    u64 time2 = Time::us();
+
+    // concurrent, in order
+    std::vector<std::unique_ptr<VirtualMemory>> memory = path.map(filenames);
+
+    u64 ordered = 0;
+    for (auto& m : memory)
+    {
+        ordered += xx3hash64(0, *m);
+    }
+
+    double mb = bytes / (1024.0 * 1024.0);
+    double serial_ms = (time1 - time0) / 1000.0;
+    double concurrent_ms = (time2 - time1) / 1000.0;
+
+    printf("%d files, %.1f MB\n", int(filenames.size()), mb);
+    printf("serial:     %8.1f ms %8.1f MB/s\n", serial_ms, mb * 1000.0 / serial_ms);
+    printf("concurrent: %8.1f ms %8.1f MB/s %s\n", concurrent_ms, mb * 1000.0 / concurrent_ms,
+        (concurrent == serial && ordered == serial && !errors) ? "" : "[FAILED]");
+}
@@ -0,0 +1,136 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+using namespace mango::image;
+
+/*
+    FileStream write benchmark: writes the same data with small endian stream writes
+    (the access pattern of most encoders) and encodes an image with the default
+    FileStream and with the buffered modes. The written files are compared.
+
+    usage: filewrite <folder> [image]
+*/
+
+struct Mode
+{
+    const char* name;
+    bool buffered;
+    FileBuffering buffering;
+};
+
+std::vector<Mode> getModes()
+{
+    std::vector<Mode> modes;
+
+    FileBuffering buffering;
+    modes.push_back({ "stdio", false, buffering });
+    modes.push_back({ "buffered", true, buffering });
+
+    buffering.write_behind = true;
+    modes.push_back({ "write-behind", true, buffering });
+
+    buffering.direct = true;
+    modes.push_back({ "direct", true, buffering });
+
+    return modes;
+}
+
+std::unique_ptr<FileStream> createStream(const std::string& filename, const Mode& mode)
+{
+    if (mode.buffered)
+    {
+        return std::make_unique<FileStream>(filename, Stream::WRITE, mode.buffering);
+    }
+
+    return std::make_unique<FileStream>(filename, Stream::WRITE);
+}
+
+u64 checksum(const std::string& filename)
+{
+    File file(filename);
+    return xx3hash64(0, file);
+}
+
+void writeSmall(FileStream& stream)
+{
+    // 64 MB as 32 bit values with a header patched afterwards
+    LittleEndianStream s = stream;
+
+    s.write32(0);
+
+    for (u32 i = 0; i < 16 * 1024 * 1024; ++i)
+    {
+        s.write32(i * 0x9e3779b9);
+    }
+
+    u64 size = stream.offset();
+    stream.seek(0, Stream::BEGIN);
+    s.write32(u32(size));
+    stream.seek(0, Stream::END);
+}
+
+void test(const char* name, const std::string& folder, std::function<void(FileStream&)> func)
+{
+    printf("%s:\n", name);
+
+    u64 reference = 0;
+
+    for (const Mode& mode : getModes())
+    {
+        std::string filename = folder + "filewrite.tmp";
+
+        u64 time0 = Time::us();
+        {
+            std::unique_ptr<FileStream> stream = createStream(filename, mode);
+            func(*stream);
+            stream->flush();
+        }
+        u64 time1 = Time::us();
+
+        u64 value = checksum(filename);
+        if (!reference)
+        {
+            reference = value;
+        }
+
+        printf("  %-14s %8.1f ms %s\n", mode.name, (time1 - time0) / 1000.0, value == reference ? "" : "[FAILED]");
+        std::remove(filename.c_str());
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <folder> [image]\n", argv[0]);
+        return 1;
+    }
+
+    std::string folder = argv[1];
+    if (folder.back() != '/')
+    {
+        folder += '/';
+    }
+
+    test("write32", folder, writeSmall);
+
+    if (argc > 2)
+    {
+        Bitmap bitmap(argv[2], Format(32, Format::UNORM, Format::RGBA, 8, 8, 8, 8));
+
+        for (const char* extension : { ".png", ".jpg" })
+        {
+            ImageEncoder encoder(extension);
+            test(extension, folder, [&] (FileStream& stream)
+            {
+                ImageEncodeOptions options;
+                encoder.encode(stream, bitmap, options);
+            });
+        }
+    }
+}
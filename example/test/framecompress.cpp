@@ -0,0 +1,112 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Block-parallel compression benchmark: compresses a file with every compressor
+    at a few levels with a single compress() call and as a FrameCompressor frame,
+    decompresses the frame and reads random ranges from it. The decompressed data
+    is compared against the source.
+
+    usage: framecompress <file> [block size in KB] [method]
+*/
+
+double mbs(u64 bytes, u64 us)
+{
+    return double(bytes) / std::max(u64(1), us);
+}
+
+void test(const Compressor& compressor, int level, ConstMemory source, size_t block_size)
+{
+    // single call
+    u64 time0 = Time::us();
+
+    Buffer single(compressor.bound(source.size));
+    size_t single_size = compressor.compress(single, source, level);
+
+    // frame
+    u64 time1 = Time::us();
+
+    FrameOptions options;
+    options.method = compressor.method;
+    options.level = level;
+    options.block_size = block_size;
+
+    MemoryStream frame;
+    FrameCompressor::compress(frame, source, options);
+
+    u64 time2 = Time::us();
+
+    FrameDecompressor decompressor(frame);
+    Buffer output(size_t(decompressor.size()));
+    decompressor.decompress(output);
+
+    u64 time3 = Time::us();
+
+    bool success = decompressor.size() == source.size &&
+                   !std::memcmp(output.data(), source.address, source.size);
+
+    // random access
+    u32 seed = 1;
+    Buffer range(64 * 1024);
+
+    for (int i = 0; i < 64 && source.size; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        u64 offset = u64(seed) % source.size;
+
+        size_t bytes = decompressor.read(range, offset);
+        success = success && bytes == std::min(range.size(), size_t(source.size - offset)) &&
+                  !std::memcmp(range.data(), source.address + offset, bytes);
+    }
+
+    u64 time4 = Time::us();
+
+    printf("%-8s %2d %6.1f %% | %8.1f MB/s | %8.1f MB/s %6.1f %% %8.1f MB/s | %7.1f us %s\n",
+        compressor.name.c_str(), level,
+        single_size * 100.0 / std::max(size_t(1), source.size), mbs(source.size, time1 - time0),
+        mbs(source.size, time2 - time1), frame.size() * 100.0 / std::max(size_t(1), source.size),
+        mbs(source.size, time3 - time2), (time4 - time3) / 64.0,
+        success ? "" : "[FAILED]");
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <file> [block size in KB] [method]\n", argv[0]);
+        return 1;
+    }
+
+    File file(argv[1]);
+
+    size_t block_size = 1024 * 1024;
+    if (argc > 2)
+    {
+        block_size = std::atoi(argv[2]) * 1024;
+    }
+
+    std::vector<Compressor> compressors = getCompressors();
+    if (argc > 3)
+    {
+        compressors = { getCompressor(argv[3]) };
+    }
+
+    printf("%.1f MB, %d KB blocks, %d threads\n", file.size() / (1024.0 * 1024.0),
+        int(block_size / 1024), ThreadPool::getHardwareConcurrency());
+    printf("%-8s %2s %8s | %13s | %13s %8s %13s | %10s\n", "", "", "single", "single", "frame", "frame", "frame", "random");
+    printf("%-8s %2s %8s | %13s | %13s %8s %13s | %10s\n", "method", "lv", "ratio", "compress", "compress", "ratio", "decompress", "read 64 KB");
+
+    for (const Compressor& compressor : compressors)
+    {
+        for (int level : { 1, 6, 10 })
+        {
+            test(compressor, level, file, block_size);
+        }
+    }
+}
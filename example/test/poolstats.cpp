@@ -0,0 +1,108 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <thread>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+/*
+    ThreadPool instrumentation example: runs a mixed workload through a few
+    named queues, prints the per-queue and per-worker statistics and optionally
+    writes a Chrome trace (open it in chrome://tracing or ui.perfetto.dev).
+
+    usage: poolstats [trace.json]
+*/
+
+static volatile u32 g_sink = 0;
+
+void work(int iterations)
+{
+    u32 x = 1;
+    for (int i = 0; i < iterations; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    g_sink = g_sink + (x == 0);
+}
+
+void workload()
+{
+    ConcurrentQueue decode("example.decode", Priority::HIGH);
+    ConcurrentQueue upload("example.upload", Priority::LOW);
+
+    for (int i = 0; i < 64; ++i)
+    {
+        decode.enqueue([&upload]
+        {
+            work(200000);
+
+            upload.enqueue([]
+            {
+                work(20000);
+            });
+        });
+    }
+
+    parallel_for(0, 4096, 0, [] (int y0, int y1)
+    {
+        work((y1 - y0) * 500);
+    });
+
+    decode.wait();
+    upload.wait();
+}
+
+void print(const ThreadPool::Statistics& statistics)
+{
+    printf("elapsed: %d ms\n\n", int(statistics.elapsed / 1000000));
+
+    printf("queue                  tasks | wait avg  p50     p99     | exec avg  p50     p99       (us)\n");
+    for (auto& queue : statistics.queues)
+    {
+        printf("%-20s %7d | %-8d %-7d %-7d | %-8d %-7d %-7d\n",
+            queue.name.c_str(), int(queue.executed),
+            int(queue.wait.average() / 1000),
+            int(queue.wait.percentile(0.50f) / 1000),
+            int(queue.wait.percentile(0.99f) / 1000),
+            int(queue.execute.average() / 1000),
+            int(queue.execute.percentile(0.50f) / 1000),
+            int(queue.execute.percentile(0.99f) / 1000));
+    }
+
+    printf("\nworker   tasks | busy ms | idle ms\n");
+    for (size_t i = 0; i < statistics.workers.size(); ++i)
+    {
+        auto& worker = statistics.workers[i];
+        printf("%6d %7d | %7d | %7d\n", int(i), int(worker.tasks),
+            int(worker.busy / 1000000), int(worker.idle / 1000000));
+    }
+
+    printf("\nidle: %d spins, %d yields, %d parks, %d wakeups\n",
+        int(statistics.idle.spins), int(statistics.idle.yields),
+        int(statistics.idle.parks), int(statistics.idle.wakeups));
+}
+
+int main(int argc, char* argv[])
+{
+    ThreadPool& pool = ThreadPool::getInstance();
+
+    const bool trace = argc == 2;
+    pool.setInstrumentation(trace ? ThreadPool::Instrumentation::TRACE
+                                  : ThreadPool::Instrumentation::STATISTICS);
+
+    workload();
+
+    pool.setInstrumentation(ThreadPool::Instrumentation::NONE);
+    print(pool.getStatistics());
+
+    if (trace)
+    {
+        std::string json = pool.getTraceJSON();
+        filesystem::FileStream file(argv[1], Stream::WRITE);
+        file.write(json.data(), json.size());
+    }
+}
@@ -0,0 +1,148 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <thread>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+/*
+    Ring buffer test / benchmark: moves a sequence of integers through the
+    MPMC and SPSC ring buffers with single and batch operations and checks that
+    every value arrives exactly once (and in order when there is one producer).
+    The last test measures the SerialQueue enqueue cost.
+*/
+
+template <typename Ring>
+bool transfer(Ring& ring, int producers, int consumers, u32 count, size_t batch)
+{
+    std::atomic<u64> sum { 0 };
+    std::atomic<u32> received { 0 };
+    std::atomic<bool> ordered { true };
+
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&ring, p, producers, count, batch]
+        {
+            std::vector<u32> values(batch);
+            for (u32 i = p; i < count; )
+            {
+                size_t n = 0;
+                for (u32 j = i; j < count && n < batch; j += producers)
+                {
+                    values[n++] = j;
+                }
+
+                size_t offset = 0;
+                while (offset < n)
+                {
+                    size_t pushed = batch > 1 ? ring.push(values.data() + offset, n - offset)
+                                              : size_t(ring.push(values[offset]));
+                    if (!pushed)
+                        std::this_thread::yield();
+                    offset += pushed;
+                }
+
+                i += u32(n) * producers;
+            }
+        });
+    }
+
+    for (int c = 0; c < consumers; ++c)
+    {
+        threads.emplace_back([&, producers, count, batch]
+        {
+            std::vector<u32> values(batch);
+            u32 previous = 0;
+            bool first = true;
+
+            while (received.load() < count)
+            {
+                size_t n = batch > 1 ? ring.pop(values.data(), batch)
+                                     : size_t(ring.pop(values[0]));
+                if (!n)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                for (size_t i = 0; i < n; ++i)
+                {
+                    if (producers == 1 && !first && values[i] != previous + 1)
+                        ordered = false;
+                    previous = values[i];
+                    first = false;
+                    sum += values[i];
+                }
+
+                received += u32(n);
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    u64 expected = u64(count) * (count - 1) / 2;
+    return sum == expected && received == count && (ordered || consumers > 1);
+}
+
+template <typename Ring>
+void test(const char* name, int producers, int consumers, size_t batch)
+{
+    const u32 count = 1 << 20;
+
+    Ring ring(1024);
+
+    u64 time0 = Time::us();
+    bool success = transfer(ring, producers, consumers, count, batch);
+    u64 time1 = Time::us();
+
+    printf("%-6s %d x %d batch: %3d %8.1f ns/value %s\n", name, producers, consumers, int(batch),
+        double(time1 - time0) * 1000.0 / count, success ? "" : "[FAILED]");
+}
+
+void serial(int count)
+{
+    SerialQueue q("ringbuffer.serial");
+
+    u32 next = 0;
+    bool ordered = true;
+
+    u64 time0 = Time::us();
+
+    for (int i = 0; i < count; ++i)
+    {
+        q.enqueue([&next, &ordered, i]
+        {
+            if (next != u32(i))
+                ordered = false;
+            ++next;
+        });
+    }
+
+    q.wait();
+
+    u64 time1 = Time::us();
+
+    bool success = ordered && next == u32(count);
+    printf("SerialQueue enqueue: %8.1f ns/task %s\n",
+        double(time1 - time0) * 1000.0 / count, success ? "" : "[FAILED]");
+}
+
+int main(int argc, char* argv[])
+{
+    test<MPMCRingBuffer<u32>>("MPMC", 1, 1, 1);
+    test<MPMCRingBuffer<u32>>("MPMC", 1, 1, 32);
+    test<MPMCRingBuffer<u32>>("MPMC", 4, 4, 1);
+    test<MPMCRingBuffer<u32>>("MPMC", 4, 4, 32);
+    test<SPSCRingBuffer<u32>>("SPSC", 1, 1, 1);
+    test<SPSCRingBuffer<u32>>("SPSC", 1, 1, 32);
+
+    serial(1 << 20);
+}
@@ -0,0 +1,137 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+/*
+    ThreadPool scaling benchmark: measures task throughput as a function of
+    the number of worker threads for tiny and medium sized tasks. The tasks are
+    submitted both from the main thread (shared injection queue) and from inside
+    the pool (per-worker deques + stealing).
+*/
+
+static volatile u32 g_sink = 0;
+
+static inline
+u32 work(u32 seed, int iterations)
+{
+    u32 x = seed | 1;
+    for (int i = 0; i < iterations; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    return x;
+}
+
+double flat(ThreadPool& pool, int tasks, int iterations)
+{
+    ConcurrentQueue q(pool, "scaling.flat");
+
+    std::atomic<u32> result { 0 };
+
+    u64 time0 = Time::us();
+
+    for (int i = 0; i < tasks; ++i)
+    {
+        q.enqueue([&result, i, iterations]
+        {
+            u32 x = work(u32(i), iterations);
+            if (!x)
+                result += x;
+        });
+    }
+
+    q.wait();
+
+    u64 time1 = Time::us();
+    g_sink = g_sink + result.load();
+
+    return tasks / double(std::max(time1 - time0, u64(1)));
+}
+
+double nested(ThreadPool& pool, int tasks, int iterations)
+{
+    ConcurrentQueue q(pool, "scaling.nested");
+
+    std::atomic<u32> result { 0 };
+
+    const int fanout = 64;
+    const int parents = std::max(tasks / fanout, 1);
+
+    u64 time0 = Time::us();
+
+    for (int i = 0; i < parents; ++i)
+    {
+        q.enqueue([&q, &result, i, iterations]
+        {
+            for (int j = 0; j < fanout; ++j)
+            {
+                q.enqueue([&result, i, j, iterations]
+                {
+                    u32 x = work(u32(i * fanout + j), iterations);
+                    if (!x)
+                        result += x;
+                });
+            }
+        });
+    }
+
+    q.wait();
+
+    u64 time1 = Time::us();
+    g_sink = g_sink + result.load();
+
+    return (parents * fanout) / double(std::max(time1 - time0, u64(1)));
+}
+
+int main(int argc, char* argv[])
+{
+    int maxThreads = ThreadPool::getHardwareConcurrency();
+    if (argc == 2)
+    {
+        maxThreads = std::max(1, std::atoi(argv[1]));
+    }
+
+    struct Workload
+    {
+        const char* name;
+        int tasks;
+        int iterations;
+    };
+
+    Workload workloads [] =
+    {
+        { "tiny",   1'000'000, 1 },
+        { "medium", 100'000, 2000 },
+    };
+
+    printf("threads |");
+    for (auto& workload : workloads)
+    {
+        printf(" %6s flat | %6s nested |", workload.name, workload.name);
+    }
+    printf("   (million tasks / second)\n");
+
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        ThreadPool pool(threads);
+
+        printf("%7d |", threads);
+        for (auto& workload : workloads)
+        {
+            double a = flat(pool, workload.tasks, workload.iterations);
+            double b = nested(pool, workload.tasks, workload.iterations);
+            printf(" %11.2f | %13.2f |", a, b);
+        }
+        printf("\n");
+
+        if (threads == maxThreads)
+            break;
+    }
+}
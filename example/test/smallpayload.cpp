@@ -0,0 +1,113 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Small payload compression benchmark: compresses and decompresses slices of a
+    file with a new context for every call (the setup cost of each call) and with
+    a reused context. The decompressed payloads are compared against the source.
+
+    usage: smallpayload <file> [method]
+*/
+
+struct Result
+{
+    u64 compress = 0;
+    u64 decompress = 0;
+    bool success = true;
+};
+
+Result test(Compressor::Method method, ConstMemory source, size_t payload, int count, bool reuse)
+{
+    Result result;
+
+    SharedObject<CompressContext> encoder = createCompressContext(method);
+    SharedObject<DecompressContext> decoder = createDecompressContext(method);
+
+    const Compressor compressor = getCompressor(method);
+    Buffer compressed(compressor.bound(payload));
+    Buffer decompressed(payload);
+
+    for (int i = 0; i < count; ++i)
+    {
+        size_t offset = (i * payload) % (source.size - payload + 1);
+        ConstMemory input(source.address + offset, payload);
+
+        u64 time0 = Time::us();
+
+        if (!reuse)
+        {
+            encoder = createCompressContext(method);
+        }
+
+        size_t bytes = encoder->compress(compressed, input, 6);
+
+        u64 time1 = Time::us();
+
+        if (!reuse)
+        {
+            decoder = createDecompressContext(method);
+        }
+
+        decoder->decompress(decompressed, ConstMemory(compressed.data(), bytes));
+
+        u64 time2 = Time::us();
+
+        result.compress += time1 - time0;
+        result.decompress += time2 - time1;
+        result.success = result.success && !std::memcmp(decompressed.data(), input.address, payload);
+    }
+
+    return result;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <file> [method]\n", argv[0]);
+        return 1;
+    }
+
+    File file(argv[1]);
+
+    std::vector<Compressor> compressors = getCompressors();
+    if (argc > 2)
+    {
+        compressors = { getCompressor(argv[2]) };
+    }
+
+    printf("%-8s %6s | %21s | %21s\n", "", "", "compress (us/call)", "decompress (us/call)");
+    printf("%-8s %6s | %6s %6s %7s | %6s %6s %7s\n", "method", "size", "new", "reuse", "speedup", "new", "reuse", "speedup");
+
+    for (const Compressor& compressor : compressors)
+    {
+        if (compressor.method == Compressor::NONE)
+            continue;
+
+        for (size_t payload : { 1024, 4096, 16384, 65536 })
+        {
+            if (payload > file.size())
+                break;
+
+            // roughly the same amount of data for each payload size
+            const int count = int(std::max(size_t(16), (4 * 1024 * 1024) / payload));
+
+            Result first = test(compressor.method, file, payload, count, false);
+            Result second = test(compressor.method, file, payload, count, true);
+
+            printf("%-8s %5dK | %6.1f %6.1f %6.1fx | %6.1f %6.1f %6.1fx %s\n",
+                compressor.name.c_str(), int(payload / 1024),
+                double(first.compress) / count, double(second.compress) / count,
+                double(first.compress) / std::max(u64(1), second.compress),
+                double(first.decompress) / count, double(second.decompress) / count,
+                double(first.decompress) / std::max(u64(1), second.decompress),
+                first.success && second.success ? "" : "[FAILED]");
+        }
+    }
+}
@@ -0,0 +1,85 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <thread>
+#include <mango/mango.hpp>
+
+using namespace mango;
+
+/*
+    ThreadPool idle policy benchmark: submits bursts of small tasks separated by
+    a pause so that the workers go idle in between. Reports the average latency
+    from enqueue to the start of execution and the idle counters of the pool for
+    a few spin / yield settings.
+*/
+
+struct Policy
+{
+    const char* name;
+    int spin;
+    int yield;
+};
+
+void benchmark(const Policy& policy, int threads, int bursts, int tasks, int pause_us)
+{
+    ThreadPoolConfig config;
+    config.threads = threads;
+    config.spin = policy.spin;
+    config.yield = policy.yield;
+
+    ThreadPool pool(config);
+    ConcurrentQueue q(pool, "wakeup");
+
+    std::atomic<u64> latency { 0 };
+    std::atomic<int> count { 0 };
+
+    for (int i = 0; i < bursts; ++i)
+    {
+        for (int j = 0; j < tasks; ++j)
+        {
+            u64 time0 = Time::ns();
+            q.enqueue([&latency, &count, time0]
+            {
+                latency += Time::ns() - time0;
+                ++count;
+            });
+        }
+
+        q.wait();
+        std::this_thread::sleep_for(std::chrono::microseconds(pause_us));
+    }
+
+    const ThreadPool::IdleStatistics statistics = pool.getIdleStatistics();
+
+    const char* status = count == bursts * tasks ? "" : " [FAILED]";
+
+    printf("%-10s %8.1f us | %10d | %10d | %8d | %8d%s\n", policy.name,
+        double(latency) / std::max(count.load(), 1) / 1000.0,
+        int(statistics.spins), int(statistics.yields),
+        int(statistics.parks), int(statistics.wakeups), status);
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = ThreadPool::getHardwareConcurrency();
+    if (argc == 2)
+    {
+        threads = std::max(1, std::atoi(argv[1]));
+    }
+
+    Policy policies [] =
+    {
+        { "park",     0,    0 },
+        { "default",  64,   16 },
+        { "yield",    0,    10000 },
+        { "spin",     20000, 0 },
+    };
+
+    printf("policy      latency    |      spins |     yields |    parks |  wakeups\n");
+
+    for (auto& policy : policies)
+    {
+        benchmark(policy, threads, 200, 64, 2000);
+    }
+}
@@ -0,0 +1,79 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::filesystem;
+
+/*
+    Directory walk benchmark: lists a directory tree recursively one folder at a
+    time with Path and with the parallel Path::walk() and checks that both find
+    the same files.
+
+    usage: walk <folder>
+*/
+
+void scan(const Path& parent, const std::string& prefix, std::vector<std::string>& names)
+{
+    for (auto& node : parent)
+    {
+        names.push_back(prefix + node.name);
+
+        if (node.isDirectory() && !node.isContainer())
+        {
+            Path path(parent, node.name);
+            scan(path, prefix + node.name, names);
+        }
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <folder>\n", argv[0]);
+        return 1;
+    }
+
+    std::string folder = argv[1];
+    if (folder.back() != '/')
+    {
+        folder += '/';
+    }
+
+    u64 time0 = Time::ms();
+
+    std::vector<std::string> names;
+    scan(Path(folder), "", names);
+    std::sort(names.begin(), names.end());
+
+    u64 time1 = Time::ms();
+
+    FileIndex index = Path(folder).walk();
+
+    u64 time2 = Time::ms();
+
+    bool success = index.size() == names.size();
+    for (size_t i = 0; success && i < names.size(); ++i)
+    {
+        success = index[int(i)].name == names[i];
+    }
+
+    printf("serial:   %6d ms (%d entries)\n", int(time1 - time0), int(names.size()));
+    printf("parallel: %6d ms (%d entries) %s\n", int(time2 - time1), int(index.size()), success ? "" : "[FAILED]");
+
+    // skip everything except the files with the extension
+    WalkFilter filter;
+    filter.file = [] (const std::string& file)
+    {
+        return getExtension(file) == ".jpg";
+    };
+
+    index = Path(folder).walk(filter);
+
+    u64 time3 = Time::ms();
+
+    printf("filtered: %6d ms (%d entries)\n", int(time3 - time2), int(index.size()));
+}
@@ -5,9 +5,13 @@
 #pragma once
 
 #include <vector>
+#include <deque>
+#include <memory>
 #include <mango/core/configure.hpp>
 #include <mango/core/memory.hpp>
+#include <mango/core/buffer.hpp>
 #include <mango/core/object.hpp>
+#include <mango/core/stream.hpp>
 
 namespace mango
 {
@@ -207,4 +211,387 @@ namespace mango
     Compressor getCompressor(Compressor::Method method);
     Compressor getCompressor(const std::string& name);
 
+    // -----------------------------------------------------------------------
+    // compression context
+    // -----------------------------------------------------------------------
+
+    /*
+        Reusable compressor and decompressor state for compressing a lot of small
+        payloads with the memory block API; the context allocation and setup is done
+        once instead of on every call. The results are identical to the memory block
+        functions with the same method and level.
+
+        The memory block functions (zstd::compress(), deflate::decompress(), etc.)
+        keep a context per thread internally, so they already avoid the setup cost.
+        The contexts are for callers which want to control the lifetime of the state;
+        they retain the memory required by the highest compression level used.
+        A context must not be used by multiple threads at the same time.
+
+        Methods which do not have reusable state (bzip2, lzma2, ppmd8) return a context
+        which calls the memory block functions; lzo and lzfse reuse a per-thread work
+        buffer in the memory block functions.
+
+        Usage example:
+
+        auto context = createCompressContext(Compressor::ZSTD);
+
+        for (auto& message : messages)
+        {
+            size_t bytes = context->compress(buffer, message, 4);
+            send(buffer, bytes);
+        }
+
+    */
+
+    class CompressContext
+    {
+    public:
+        CompressContext() {}
+        virtual ~CompressContext() {}
+        virtual size_t compress(Memory dest, ConstMemory source, int level = 6) = 0;
+    };
+
+    class DecompressContext
+    {
+    public:
+        DecompressContext() {}
+        virtual ~DecompressContext() {}
+        virtual size_t decompress(Memory dest, ConstMemory source) = 0;
+    };
+
+    SharedObject<CompressContext> createCompressContext(Compressor::Method method);
+    SharedObject<DecompressContext> createDecompressContext(Compressor::Method method);
+
+    // -----------------------------------------------------------------------
+    // incremental compression
+    // -----------------------------------------------------------------------
+
+    /*
+        Push/pull interface for compressing and decompressing a stream of unknown
+        length with bounded memory. Unlike the StreamEncoder the output is a single
+        self-delimiting stream in the method's standard format; the caller does not
+        need to transmit block sizes.
+
+        encode() and decode() consume input and produce output until the input has
+        been consumed or the output is full; the input and output are advanced past
+        the processed bytes. The caller drains the output and calls again.
+
+        encode() returns true when the stream has been completely written; this only
+        happens after finish is set and all of the output has been drained.
+
+        decode() returns true when the end of the compressed stream has been reached.
+        Formats which allow concatenated streams (gzip, zstd, lz4, bzip2) start a new
+        stream if decode() is called again with more input; for the others the extra
+        input is an error.
+
+        Supported methods: NONE, LZ4 (lz4 frame format), ZSTD, BZIP2, LZMA (5 byte
+        properties followed by the stream with an end marker), DEFLATE, ZLIB and GZIP.
+
+        Usage example:
+
+        auto encoder = createIncrementalEncoder(Compressor::GZIP, 6);
+
+        u8 buffer[4096];
+        bool done = false;
+        while (!done)
+        {
+            Memory output(buffer, sizeof(buffer));
+            done = encoder->encode(input, output, true);
+            file.write(buffer, sizeof(buffer) - output.size);
+        }
+
+    */
+
+    class IncrementalEncoder
+    {
+    public:
+        IncrementalEncoder() {}
+        virtual ~IncrementalEncoder() {}
+        virtual bool encode(ConstMemory& input, Memory& output, bool finish) = 0;
+    };
+
+    class IncrementalDecoder
+    {
+    public:
+        IncrementalDecoder() {}
+        virtual ~IncrementalDecoder() {}
+        virtual bool decode(ConstMemory& input, Memory& output) = 0;
+    };
+
+    SharedObject<IncrementalEncoder> createIncrementalEncoder(Compressor::Method method, int level = 6);
+    SharedObject<IncrementalDecoder> createIncrementalDecoder(Compressor::Method method);
+
+    // -----------------------------------------------------------------------
+    // CompressStream, DecompressStream
+    // -----------------------------------------------------------------------
+
+    /*
+        Stream adapters which compress everything written into them to the wrapped
+        stream, or decompress from the wrapped stream when read. The compressed data
+        never has to be in memory at once; encoders can write multi-gigabyte outputs
+        through a CompressStream into a FileStream.
+
+        The streams are sequential: CompressStream is write-only and DecompressStream
+        is read-only and can only be seeked forward (the skipped data is decoded).
+        size() is the number of uncompressed bytes written or read so far.
+
+        Usage example:
+
+        FileStream file("image.png.gz", Stream::WRITE);
+        CompressStream stream(file, Compressor::GZIP);
+        encoder.encode(stream, bitmap, options);
+        stream.finish(); // or let the destructor do it
+
+        FileStream file("data.zst", Stream::READ);
+        DecompressStream stream(file, Compressor::ZSTD);
+        LittleEndianStream s = stream;
+        u32 magic = s.read32();
+
+    */
+
+    class CompressStream : public Stream
+    {
+    protected:
+        Stream& m_stream;
+        SharedObject<IncrementalEncoder> m_encoder;
+        std::vector<u8> m_input;  // put area for the small writes
+        std::vector<u8> m_output;
+        u64 m_offset = 0;         // bytes encoded
+        bool m_finished = false;
+
+        void encode(ConstMemory input, bool finish);
+
+    public:
+        CompressStream(Stream& stream, Compressor::Method method, int level = 6);
+        ~CompressStream();
+
+        // complete the compressed stream; the wrapped stream is not closed
+        void finish();
+
+        u64 size() const override;
+        u64 offset() const override;
+        void seek(s64 distance, SeekMode mode) override;
+        void read(void* dest, u64 size) override;
+        void write(const void* data, u64 size) override;
+
+        void write(ConstMemory memory)
+        {
+            Stream::write(memory);
+        }
+    };
+
+    class DecompressStream : public Stream
+    {
+    protected:
+        Stream& m_stream;
+        SharedObject<IncrementalDecoder> m_decoder;
+        std::vector<u8> m_buffer;
+        ConstMemory m_input;
+        u64 m_offset = 0;
+        bool m_end = false;
+
+    public:
+        DecompressStream(Stream& stream, Compressor::Method method);
+        ~DecompressStream();
+
+        // read up to dest.size bytes; returns zero at the end of the compressed data
+        size_t readSome(Memory dest);
+
+        u64 size() const override;
+        u64 offset() const override;
+        void seek(s64 distance, SeekMode mode) override;
+        void read(void* dest, u64 size) override;
+        void write(const void* data, u64 size) override;
+    };
+
+    // -----------------------------------------------------------------------
+    // dictionary compression
+    // -----------------------------------------------------------------------
+
+    /*
+        Small payloads of similar content (records, metadata, small assets) compress
+        poorly on their own since there is no history for the matches. A dictionary
+        is content which is shared by the compressor and the decompressor; the payloads
+        are compressed as if the dictionary preceded them.
+
+        trainDictionary() selects the segments which occur in most of the samples
+        into a raw content dictionary of at most size bytes. The samples should be
+        representative payloads; a few hundred samples totalling 10-100x the
+        dictionary size give good results. lz4 uses the last 64 KB of a dictionary.
+
+        CompressionDictionary is the dictionary prepared (digested) for one method and
+        compression level so that the preparation is not repeated for every payload.
+        It can be shared by multiple threads. The destination size for compress() is
+        the method's bound(); decompress() needs the exact decompressed size like the
+        memory block functions. The id() identifies the dictionary content; it is
+        stored in the containers which reference the dictionary.
+
+        Usage example:
+
+        std::vector<ConstMemory> samples = getRecords();
+        std::vector<u8> content = trainDictionary(samples, 32 * 1024);
+
+        auto dictionary = zstd::createDictionary(ConstMemory(content.data(), content.size()), 6);
+        size_t bytes = dictionary->compress(buffer, record);
+        ...
+        dictionary->decompress(output, ConstMemory(buffer, bytes));
+
+    */
+
+    std::vector<u8> trainDictionary(const std::vector<ConstMemory>& samples, size_t size = 64 * 1024);
+
+    class CompressionDictionary : protected NonCopyable
+    {
+    protected:
+        Buffer m_content;
+        u32 m_id;
+
+    public:
+        CompressionDictionary(ConstMemory content);
+        virtual ~CompressionDictionary();
+
+        ConstMemory content() const;
+        u32 id() const;
+
+        virtual size_t compress(Memory dest, ConstMemory source) const = 0;
+        virtual size_t decompress(Memory dest, ConstMemory source) const = 0;
+    };
+
+    u32 getDictionaryID(ConstMemory content);
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    namespace lz4
+    {
+        SharedObject<CompressionDictionary> createDictionary(ConstMemory content, int level = 6);
+    }
+
+    namespace zstd
+    {
+        SharedObject<CompressionDictionary> createDictionary(ConstMemory content, int level = 6);
+    }
+
+#endif
+
+    // supported methods: LZ4, ZSTD
+    SharedObject<CompressionDictionary> createDictionary(Compressor::Method method, ConstMemory content, int level = 6);
+
+    // -----------------------------------------------------------------------
+    // block-parallel compression frame
+    // -----------------------------------------------------------------------
+
+    /*
+        The frame splits the data into independent blocks of block_size bytes which
+        are compressed and decompressed in the ThreadPool with any Compressor::Method.
+        The frame ends with a block index which stores the location and a crc32c
+        checksum of the uncompressed data of every block, so that any range of the
+        uncompressed data can be decoded without touching the other blocks. A block
+        which does not compress is stored as-is.
+
+        The FrameCompressor writes the blocks in order so the output is identical
+        regardless of the number of threads; the input can be written in pieces of
+        any size so that the whole data does not have to be in memory at once.
+
+        Usage example:
+
+        FrameOptions options;
+        options.method = Compressor::ZSTD;
+        options.level = 8;
+
+        FileStream file("blob.mgf", Stream::WRITE);
+        FrameCompressor compressor(file, options);
+        compressor.write(memory);
+        compressor.finalize(); // or let the destructor do it
+
+        File file("blob.mgf");
+        FrameDecompressor decompressor(file);
+        decompressor.read(Memory(buffer, 4096), 1000000); // 4 KB at offset 1000000
+        decompressor.decompress(Memory(all, decompressor.size())); // everything
+
+    */
+
+    struct FrameOptions
+    {
+        Compressor::Method method = Compressor::ZSTD;
+        int level = 6;
+        size_t block_size = 1024 * 1024; // uncompressed block size
+    };
+
+    class FrameCompressor : protected NonCopyable
+    {
+    protected:
+        struct PendingBlock;
+
+        struct BlockEntry
+        {
+            u64 offset;
+            u32 compressed;
+            u32 uncompressed;
+            u32 checksum;
+            u32 flags;
+        };
+
+        Stream& m_stream;
+        u64 m_base;
+        FrameOptions m_options;
+        Compressor m_compressor;
+
+        std::unique_ptr<PendingBlock> m_current;
+        std::deque<std::unique_ptr<PendingBlock>> m_pending;
+        size_t m_pending_limit;
+        std::vector<BlockEntry> m_blocks;
+        u64 m_size = 0;
+        bool m_finalized = false;
+
+        void submit();
+        void writeOldest();
+
+    public:
+        FrameCompressor(Stream& stream, const FrameOptions& options = FrameOptions());
+        ~FrameCompressor();
+
+        void write(ConstMemory memory);
+        void finalize();
+
+        // compress the memory into a frame
+        static void compress(Stream& stream, ConstMemory memory, const FrameOptions& options = FrameOptions());
+    };
+
+    class FrameDecompressor : protected NonCopyable
+    {
+    protected:
+        struct BlockEntry
+        {
+            u64 offset;
+            u32 compressed;
+            u32 uncompressed;
+            u32 checksum;
+            u32 flags;
+        };
+
+        ConstMemory m_memory;
+        Compressor m_compressor;
+        size_t m_block_size;
+        u64 m_size;
+        std::vector<BlockEntry> m_blocks;
+
+        void decode(u8* dest, size_t index) const;
+
+    public:
+        // the frame memory must be valid for the lifetime of the object
+        FrameDecompressor(ConstMemory memory);
+        ~FrameDecompressor();
+
+        u64 size() const; // uncompressed size
+        size_t blocks() const;
+        Compressor::Method method() const;
+
+        // decompress everything; dest must have room for size() bytes
+        void decompress(Memory dest) const;
+
+        // decompress dest.size bytes (clipped to the end of the data) starting at the
+        // uncompressed offset; returns the number of bytes decompressed
+        size_t read(Memory dest, u64 offset) const;
+    };
+
 } // namespace mango
@@ -23,5 +23,7 @@
 #include <mango/core/buffer.hpp>
 #include <mango/core/memory.hpp>
 #include <mango/core/string.hpp>
-#include <mango/core/thread.hpp>
+#include <mango/core/ringbuffer.hpp>
+#include <mango/core/thread.hpp>
+#include <mango/core/coroutine.hpp>
 #include <mango/core/dynamic_library.hpp>
@@ -0,0 +1,566 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <mango/core/configure.hpp>
+#include <mango/core/thread.hpp>
+
+// ----------------------------------------------------------------------------------
+// coroutine support
+// ----------------------------------------------------------------------------------
+
+// The library is built as C++14; the coroutine front-end is header-only and is
+// available when the client code is compiled with a C++20 compiler.
+
+#if defined(__has_include)
+    #if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+        #define MANGO_ENABLE_COROUTINES
+    #endif
+#endif
+
+#if defined(MANGO_ENABLE_COROUTINES)
+
+#include <coroutine>
+#include <optional>
+#include <exception>
+#include <atomic>
+#include <vector>
+#include <utility>
+
+namespace mango
+{
+
+    // ----------------------------------------------------------------------------------
+    // AsyncTask
+    // ----------------------------------------------------------------------------------
+
+    /*
+        AsyncTask<T> is a lazily started coroutine which produces a value of type T.
+        The coroutine starts executing when it is awaited and the awaiting coroutine
+        is resumed, on the thread which completed the task, when the result is ready.
+
+        A coroutine does not block the thread it is running on when it awaits; the
+        work is done in the ThreadPool and the coroutine continues in the worker which
+        completed it. This allows one service thread to keep hundreds of operations in
+        flight while the pool does the actual work.
+
+        resumeOn(pool)    - continue the coroutine in the ThreadPool
+        runAsync(func)    - execute func in the ThreadPool, resume with it's result
+        co_await future   - resume when a FutureTask has completed
+        whenAll(tasks)    - start all tasks concurrently, resume when all are complete
+        syncWait(task)    - block the calling (non-coroutine) thread until task completes
+
+        Usage example:
+
+        AsyncTask<int> compute(int x)
+        {
+            int y = co_await runAsync([x] { return x * x; });
+            co_return y + 1;
+        }
+
+        AsyncTask<int> sum()
+        {
+            std::vector<AsyncTask<int>> tasks;
+            for (int i = 0; i < 100; ++i)
+                tasks.push_back(compute(i));
+
+            std::vector<int> results = co_await whenAll(std::move(tasks));
+
+            int s = 0;
+            for (int x : results)
+                s += x;
+            co_return s;
+        }
+
+        int s = syncWait(sum());
+
+    */
+
+    template <typename T = void>
+    class AsyncTask;
+
+    namespace detail
+    {
+
+        struct AsyncFinalAwaiter
+        {
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                std::coroutine_handle<> continuation = handle.promise().continuation;
+                if (continuation)
+                    return continuation;
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept
+            {
+            }
+        };
+
+        struct AsyncPromiseBase
+        {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            AsyncFinalAwaiter final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void unhandled_exception() noexcept
+            {
+                exception = std::current_exception();
+            }
+        };
+
+        template <typename T>
+        struct AsyncPromise : AsyncPromiseBase
+        {
+            std::optional<T> value;
+
+            AsyncTask<T> get_return_object() noexcept;
+
+            template <typename U>
+            void return_value(U&& v)
+            {
+                value.emplace(std::forward<U>(v));
+            }
+
+            T result()
+            {
+                if (exception)
+                    std::rethrow_exception(exception);
+                return std::move(*value);
+            }
+        };
+
+        template <>
+        struct AsyncPromise<void> : AsyncPromiseBase
+        {
+            AsyncTask<void> get_return_object() noexcept;
+
+            void return_void() noexcept
+            {
+            }
+
+            void result()
+            {
+                if (exception)
+                    std::rethrow_exception(exception);
+            }
+        };
+
+    } // namespace detail
+
+    template <typename T>
+    class AsyncTask
+    {
+    public:
+        using promise_type = detail::AsyncPromise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+    protected:
+        Handle m_handle;
+
+    public:
+        AsyncTask() = default;
+
+        explicit AsyncTask(Handle handle)
+            : m_handle(handle)
+        {
+        }
+
+        AsyncTask(AsyncTask&& other) noexcept
+            : m_handle(std::exchange(other.m_handle, nullptr))
+        {
+        }
+
+        AsyncTask& operator = (AsyncTask&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (m_handle)
+                    m_handle.destroy();
+                m_handle = std::exchange(other.m_handle, nullptr);
+            }
+            return *this;
+        }
+
+        AsyncTask(const AsyncTask&) = delete;
+        AsyncTask& operator = (const AsyncTask&) = delete;
+
+        ~AsyncTask()
+        {
+            if (m_handle)
+                m_handle.destroy();
+        }
+
+        bool done() const
+        {
+            return !m_handle || m_handle.done();
+        }
+
+        auto operator co_await () noexcept
+        {
+            struct Awaiter
+            {
+                Handle handle;
+
+                bool await_ready() const noexcept
+                {
+                    return !handle || handle.done();
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    // start the task; it resumes the awaiting coroutine when complete
+                    handle.promise().continuation = awaiting;
+                    return handle;
+                }
+
+                T await_resume()
+                {
+                    return handle.promise().result();
+                }
+            };
+
+            return Awaiter { m_handle };
+        }
+    };
+
+    namespace detail
+    {
+
+        template <typename T>
+        AsyncTask<T> AsyncPromise<T>::get_return_object() noexcept
+        {
+            return AsyncTask<T>(std::coroutine_handle<AsyncPromise<T>>::from_promise(*this));
+        }
+
+        inline AsyncTask<void> AsyncPromise<void>::get_return_object() noexcept
+        {
+            return AsyncTask<void>(std::coroutine_handle<AsyncPromise<void>>::from_promise(*this));
+        }
+
+    } // namespace detail
+
+    // ----------------------------------------------------------------------------------
+    // awaitables
+    // ----------------------------------------------------------------------------------
+
+    inline auto resumeOn(ThreadPool& pool = ThreadPool::getInstance())
+    {
+        struct Awaiter
+        {
+            ThreadPool& pool;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                pool.enqueue([handle]
+                {
+                    handle.resume();
+                });
+            }
+
+            void await_resume() noexcept
+            {
+            }
+        };
+
+        return Awaiter { pool };
+    }
+
+    template <typename F>
+    class AsyncCall
+    {
+    protected:
+        using R = std::invoke_result_t<F&>;
+        using Value = std::conditional_t<std::is_void_v<R>, bool, R>;
+
+        F m_func;
+        ThreadPool& m_pool;
+        std::optional<Value> m_value;
+        std::exception_ptr m_exception;
+
+    public:
+        AsyncCall(F&& func, ThreadPool& pool)
+            : m_func(std::move(func))
+            , m_pool(pool)
+        {
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            // the awaiter lives in the suspended coroutine frame until it is resumed
+            m_pool.enqueue([this, handle]
+            {
+                try
+                {
+                    if constexpr (std::is_void_v<R>)
+                    {
+                        m_func();
+                        m_value.emplace(true);
+                    }
+                    else
+                    {
+                        m_value.emplace(m_func());
+                    }
+                }
+                catch (...)
+                {
+                    m_exception = std::current_exception();
+                }
+
+                handle.resume();
+            });
+        }
+
+        R await_resume()
+        {
+            if (m_exception)
+                std::rethrow_exception(m_exception);
+
+            if constexpr (!std::is_void_v<R>)
+                return std::move(*m_value);
+        }
+    };
+
+    template <typename F>
+    AsyncCall<std::decay_t<F>> runAsync(F&& func, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        return AsyncCall<std::decay_t<F>>(std::decay_t<F>(std::forward<F>(func)), pool);
+    }
+
+    template <typename T>
+    auto operator co_await (FutureTask<T>& task)
+    {
+        struct Awaiter
+        {
+            FutureTask<T>& task;
+
+            bool await_ready() const
+            {
+                return task.ready();
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                task.onComplete([handle]
+                {
+                    handle.resume();
+                });
+            }
+
+            T await_resume()
+            {
+                return task.get();
+            }
+        };
+
+        return Awaiter { task };
+    }
+
+    template <typename T>
+    auto operator co_await (FutureTask<T>&& task)
+    {
+        return operator co_await (task);
+    }
+
+    // ----------------------------------------------------------------------------------
+    // whenAll / syncWait
+    // ----------------------------------------------------------------------------------
+
+    namespace detail
+    {
+
+        // Detached coroutine used to start the tasks in whenAll() and syncWait();
+        // the frame is destroyed automatically when the coroutine completes.
+        struct DetachedTask
+        {
+            struct promise_type
+            {
+                DetachedTask get_return_object() noexcept
+                {
+                    return {};
+                }
+
+                std::suspend_never initial_suspend() noexcept
+                {
+                    return {};
+                }
+
+                std::suspend_never final_suspend() noexcept
+                {
+                    return {};
+                }
+
+                void return_void() noexcept
+                {
+                }
+
+                void unhandled_exception() noexcept
+                {
+                    std::terminate();
+                }
+            };
+        };
+
+        struct SyncEvent
+        {
+            std::mutex mutex;
+            std::condition_variable condition;
+            bool complete = false;
+
+            void signal()
+            {
+                // the waiting thread cannot return before the lock is released
+                std::lock_guard<std::mutex> lock(mutex);
+                complete = true;
+                condition.notify_one();
+            }
+
+            void wait()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return complete; });
+            }
+        };
+
+        template <typename T>
+        struct AsyncResult
+        {
+            std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> value;
+            std::exception_ptr exception;
+
+            template <typename Complete>
+            DetachedTask run(AsyncTask<T> task, Complete complete)
+            {
+                try
+                {
+                    if constexpr (std::is_void_v<T>)
+                    {
+                        co_await task;
+                        value.emplace(true);
+                    }
+                    else
+                    {
+                        value.emplace(co_await task);
+                    }
+                }
+                catch (...)
+                {
+                    exception = std::current_exception();
+                }
+
+                complete();
+            }
+
+            T get()
+            {
+                if (exception)
+                    std::rethrow_exception(exception);
+
+                if constexpr (!std::is_void_v<T>)
+                    return std::move(*value);
+            }
+        };
+
+    } // namespace detail
+
+    template <typename T>
+    auto whenAll(std::vector<AsyncTask<T>> tasks)
+    {
+        struct Awaiter
+        {
+            std::vector<AsyncTask<T>> tasks;
+            std::vector<detail::AsyncResult<T>> results;
+            std::atomic<size_t> counter { 0 };
+
+            bool await_ready() const noexcept
+            {
+                return tasks.empty();
+            }
+
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                const size_t count = tasks.size();
+                results.resize(count);
+
+                // one extra reference is held until all tasks have been started
+                counter = count + 1;
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    results[i].run(std::move(tasks[i]), [this, handle]
+                    {
+                        if (counter.fetch_sub(1) == 1)
+                            handle.resume();
+                    });
+                }
+
+                // continue without suspending if all tasks completed synchronously
+                return counter.fetch_sub(1) != 1;
+            }
+
+            auto await_resume()
+            {
+                if constexpr (std::is_void_v<T>)
+                {
+                    for (auto& result : results)
+                        result.get();
+                }
+                else
+                {
+                    std::vector<T> values;
+                    values.reserve(results.size());
+                    for (auto& result : results)
+                        values.push_back(result.get());
+                    return values;
+                }
+            }
+        };
+
+        return Awaiter { std::move(tasks) };
+    }
+
+    template <typename T>
+    T syncWait(AsyncTask<T> task)
+    {
+        detail::SyncEvent event;
+        detail::AsyncResult<T> result;
+
+        result.run(std::move(task), [&event]
+        {
+            event.signal();
+        });
+
+        event.wait();
+        return result.get();
+    }
+
+} // namespace mango
+
+#endif // defined(MANGO_ENABLE_COROUTINES)
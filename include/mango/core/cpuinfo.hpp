@@ -4,6 +4,7 @@
 */
 #pragma once
 
+#include <vector>
 #include <mango/core/configure.hpp>
 
 namespace mango
@@ -63,4 +64,48 @@ namespace mango
 
 	u64 getCPUFlags();
 
+	// ----------------------------------------------------------------------------
+	// getCPUTopology()
+	// ----------------------------------------------------------------------------
+
+    /*
+        The topology is read from sysfs on Linux, GetLogicalProcessorInformationEx() on
+        Windows and sysctl(hw.*) on macOS and iOS, which do not report NUMA nodes or
+        the processor to core mapping; the hardware threads of a core are assumed to be
+        numbered consecutively. On other platforms every logical processor is reported
+        as a separate core in a single package and NUMA node. The Windows processor
+        number is group * 64 + processor in the group.
+        The package, node and core indices are dense (0..count-1) even when the OS
+        numbering has gaps.
+    */
+
+    struct CPUTopology
+    {
+        struct Processor
+        {
+            int id;      // logical processor number used by the OS (thread affinity)
+            int core;    // physical core (unique in the system)
+            int package; // physical package (socket)
+            int node;    // NUMA node
+            int thread;  // hardware thread in the core (0: first thread, 1..: SMT sibling)
+        };
+
+        std::vector<Processor> processors;
+
+        int packages = 1;
+        int nodes = 1;
+        int cores = 1;
+
+        // cache sizes in bytes as seen from the first processor (0: unknown)
+        size_t l1 = 0; // level 1 data cache
+        size_t l2 = 0;
+        size_t l3 = 0;
+        size_t cacheline = 64;
+    };
+
+    const CPUTopology& getCPUTopology();
+
+    // logical processor number the calling thread is running on (-1: unknown)
+    int getCurrentProcessor();
+
 } // namespace mango
@@ -84,24 +84,95 @@ namespace detail {
         }
     };
 
+    // access pattern hints for the memory mapped files
+    enum class AccessHint
+    {
+        NORMAL,     // default read-ahead
+        SEQUENTIAL, // aggressive read-ahead; the pages can be dropped soon after they are accessed
+        RANDOM,     // no read-ahead
+        WILLNEED,   // start reading the range in the background
+        DONTNEED,   // the range is not needed for a while; the pages can be dropped
+        POPULATE,   // read the range into memory before returning
+    };
+
+    /*
+        VirtualMemory is memory mapped from a file or container. The memory can be
+        materialized lazily, eg. decompressed on demand: m_memory.size is valid from the
+        start but the contents are valid only after the range has been materialized.
+        Accessing the memory as a whole materializes everything; view() and read()
+        materialize only the requested range so the cost of probing a header is
+        proportional to the bytes touched.
+
+        The memory of a file in a container can reference the container: the stored
+        files point into it and the compressed files are decompressed from it. The
+        memory must not outlive the object it was mapped from (see AbstractMapper::mmap()).
+    */
+
     class VirtualMemory : private NonCopyable
     {
     protected:
         ConstMemory m_memory;
 
+        // lazily materialized memory must have the range valid when this returns
+        virtual void materialize(u64 offset, u64 size) const
+        {
+            MANGO_UNREFERENCED(offset);
+            MANGO_UNREFERENCED(size);
+        }
+
     public:
         VirtualMemory() = default;
         virtual ~VirtualMemory() {}
 
         const ConstMemory* operator -> () const
         {
+            materialize(0, m_memory.size);
             return &m_memory;
         }
 
         operator ConstMemory () const
         {
+            materialize(0, m_memory.size);
             return m_memory;
         }
+
+        u64 size() const
+        {
+            return m_memory.size;
+        }
+
+        // the range is clamped to the end of the memory
+        ConstMemory view(u64 offset, u64 size) const
+        {
+            offset = std::min(offset, u64(m_memory.size));
+            size = std::min(size, m_memory.size - offset);
+            materialize(offset, size);
+            return ConstMemory(m_memory.address + offset, size_t(size));
+        }
+
+        size_t read(void* dest, u64 offset, size_t size) const
+        {
+            ConstMemory memory = view(offset, size);
+            std::copy(memory.address, memory.address + memory.size, reinterpret_cast<u8*>(dest));
+            return memory.size;
+        }
+
+        // access pattern hint for the range; the memory mapped files forward the hints to
+        // the operating system, other memory only implements POPULATE (which materializes
+        // the range and touches every page of it)
+        virtual void advise(AccessHint hint, u64 offset = 0, u64 size = ~u64(0)) const
+        {
+            if (hint == AccessHint::POPULATE)
+            {
+                ConstMemory memory = view(offset, size);
+
+                volatile u8 sum = 0;
+                for (size_t i = 0; i < memory.size; i += 4096)
+                {
+                    sum = sum + memory.address[i];
+                }
+            }
+        }
     };
 
     // -----------------------------------------------------------------------
@@ -0,0 +1,448 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <mango/core/configure.hpp>
+#include <mango/core/object.hpp>
+
+namespace mango
+{
+
+    /*
+        Bounded lock-free ring buffers.
+
+        MPMCRingBuffer - any number of producers and consumers
+        SPSCRingBuffer - exactly one producer thread and one consumer thread
+
+        The capacity is rounded up to the next power of two and fixed at construction;
+        push() returns false when the buffer is full and pop() returns false when it is
+        empty so the caller decides whether to retry, back off or fall back to another
+        container. The batch versions transfer as many elements as possible (up to count)
+        with a single update of the shared position and return the number transferred.
+
+        The producer and consumer positions are on separate cache lines so the
+        producers and consumers do not invalidate each other's cache lines unless
+        they touch the same element.
+
+        Usage example:
+
+        MPMCRingBuffer<int> ring(1024);
+
+        // producer(s)
+        if (!ring.push(7))
+        {
+            // full
+        }
+
+        // consumer(s)
+        int value;
+        while (ring.pop(value))
+        {
+            // ..
+        }
+
+    */
+
+    namespace detail
+    {
+
+        using RingCacheLine = u8[64];
+
+        inline size_t getRingCapacity(size_t capacity)
+        {
+            size_t size = 2;
+            while (size < capacity)
+            {
+                size *= 2;
+            }
+            return size;
+        }
+
+        template <typename T>
+        struct RingStorage
+        {
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+            T* get()
+            {
+                return reinterpret_cast<T*>(&storage);
+            }
+        };
+
+    } // namespace detail
+
+    // ----------------------------------------------------------------------------------
+    // MPMCRingBuffer
+    // ----------------------------------------------------------------------------------
+
+    template <typename T>
+    class MPMCRingBuffer : private NonCopyable
+    {
+    protected:
+        // Every slot has a sequence number which tells which position the slot is
+        // ready for: sequence == position when it can be written and position + 1
+        // when it can be read. The positions grow monotonically; a position is claimed
+        // with compare-exchange and the slot is published by storing it's sequence.
+
+        struct Slot : detail::RingStorage<T>
+        {
+            std::atomic<size_t> sequence;
+        };
+
+        Slot* m_slots;
+        size_t m_mask;
+
+        // NOTE: padding instead of alignas() so that the heap allocated objects do not
+        //       depend on C++17 aligned new (see SerialQueue).
+        detail::RingCacheLine m_padding0;
+        std::atomic<size_t> m_tail { 0 }; // push position
+        detail::RingCacheLine m_padding1;
+        std::atomic<size_t> m_head { 0 }; // pop position
+        detail::RingCacheLine m_padding2;
+
+    public:
+        explicit MPMCRingBuffer(size_t capacity)
+        {
+            const size_t size = detail::getRingCapacity(capacity);
+
+            m_slots = new Slot[size];
+            m_mask = size - 1;
+
+            for (size_t i = 0; i < size; ++i)
+            {
+                m_slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~MPMCRingBuffer()
+        {
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+            for (size_t i = m_head.load(std::memory_order_relaxed); i != tail; ++i)
+            {
+                m_slots[i & m_mask].get()->~T();
+            }
+
+            delete[] m_slots;
+        }
+
+        size_t capacity() const
+        {
+            return m_mask + 1;
+        }
+
+        // approximate when there are concurrent producers or consumers
+        size_t size() const
+        {
+            const size_t head = m_head.load(std::memory_order_acquire);
+            const size_t tail = m_tail.load(std::memory_order_acquire);
+            return tail > head ? tail - head : 0;
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        template <typename U>
+        bool push(U&& value)
+        {
+            size_t pos = m_tail.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                Slot& slot = m_slots[pos & m_mask];
+                const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                const std::ptrdiff_t diff = std::ptrdiff_t(sequence - pos);
+
+                if (diff == 0)
+                {
+                    if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        new (slot.get()) T(std::forward<U>(value));
+                        slot.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    // the slot has not been consumed yet
+                    return false;
+                }
+                else
+                {
+                    pos = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool pop(T& value)
+        {
+            size_t pos = m_head.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                Slot& slot = m_slots[pos & m_mask];
+                const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                const std::ptrdiff_t diff = std::ptrdiff_t(sequence - (pos + 1));
+
+                if (diff == 0)
+                {
+                    if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        T* ptr = slot.get();
+                        value = std::move(*ptr);
+                        ptr->~T();
+                        slot.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    // the slot has not been published yet
+                    return false;
+                }
+                else
+                {
+                    pos = m_head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // moves up to count values into the buffer, returns the number of values moved
+        size_t push(T* values, size_t count)
+        {
+            if (!count)
+                return 0;
+
+            size_t pos = m_tail.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                // a slot with sequence == position can only be written by the producer
+                // which claims the position so the whole run is claimed with one exchange
+                size_t n = 0;
+                while (n < count && m_slots[(pos + n) & m_mask].sequence.load(std::memory_order_acquire) == pos + n)
+                {
+                    ++n;
+                }
+
+                if (!n)
+                {
+                    const size_t sequence = m_slots[pos & m_mask].sequence.load(std::memory_order_acquire);
+                    if (std::ptrdiff_t(sequence - pos) < 0)
+                        return 0;
+
+                    pos = m_tail.load(std::memory_order_relaxed);
+                    continue;
+                }
+
+                if (m_tail.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+                {
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        Slot& slot = m_slots[(pos + i) & m_mask];
+                        new (slot.get()) T(std::move(values[i]));
+                        slot.sequence.store(pos + i + 1, std::memory_order_release);
+                    }
+                    return n;
+                }
+            }
+        }
+
+        // moves up to count values out of the buffer, returns the number of values moved
+        size_t pop(T* values, size_t count)
+        {
+            if (!count)
+                return 0;
+
+            size_t pos = m_head.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                size_t n = 0;
+                while (n < count && m_slots[(pos + n) & m_mask].sequence.load(std::memory_order_acquire) == pos + n + 1)
+                {
+                    ++n;
+                }
+
+                if (!n)
+                {
+                    const size_t sequence = m_slots[pos & m_mask].sequence.load(std::memory_order_acquire);
+                    if (std::ptrdiff_t(sequence - (pos + 1)) < 0)
+                        return 0;
+
+                    pos = m_head.load(std::memory_order_relaxed);
+                    continue;
+                }
+
+                if (m_head.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+                {
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        Slot& slot = m_slots[(pos + i) & m_mask];
+                        T* ptr = slot.get();
+                        values[i] = std::move(*ptr);
+                        ptr->~T();
+                        slot.sequence.store(pos + i + m_mask + 1, std::memory_order_release);
+                    }
+                    return n;
+                }
+            }
+        }
+    };
+
+    // ----------------------------------------------------------------------------------
+    // SPSCRingBuffer
+    // ----------------------------------------------------------------------------------
+
+    template <typename T>
+    class SPSCRingBuffer : private NonCopyable
+    {
+    protected:
+        using Storage = detail::RingStorage<T>;
+
+        Storage* m_buffer;
+        size_t m_mask;
+
+        // each side keeps a private copy of the other side's position and reloads
+        // the shared one only when the copy says the buffer is full / empty
+        detail::RingCacheLine m_padding0;
+        std::atomic<size_t> m_tail { 0 }; // written by the producer
+        size_t m_head_cache { 0 };
+        detail::RingCacheLine m_padding1;
+        std::atomic<size_t> m_head { 0 }; // written by the consumer
+        size_t m_tail_cache { 0 };
+        detail::RingCacheLine m_padding2;
+
+        size_t writable(size_t tail, size_t count)
+        {
+            size_t available = capacity() - (tail - m_head_cache);
+            if (available < count)
+            {
+                m_head_cache = m_head.load(std::memory_order_acquire);
+                available = capacity() - (tail - m_head_cache);
+            }
+            return available;
+        }
+
+        size_t readable(size_t head, size_t count)
+        {
+            size_t available = m_tail_cache - head;
+            if (available < count)
+            {
+                m_tail_cache = m_tail.load(std::memory_order_acquire);
+                available = m_tail_cache - head;
+            }
+            return available;
+        }
+
+    public:
+        explicit SPSCRingBuffer(size_t capacity)
+        {
+            const size_t size = detail::getRingCapacity(capacity);
+
+            m_buffer = new Storage[size];
+            m_mask = size - 1;
+        }
+
+        ~SPSCRingBuffer()
+        {
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+            for (size_t i = m_head.load(std::memory_order_relaxed); i != tail; ++i)
+            {
+                m_buffer[i & m_mask].get()->~T();
+            }
+
+            delete[] m_buffer;
+        }
+
+        size_t capacity() const
+        {
+            return m_mask + 1;
+        }
+
+        // exact when called from the producer or the consumer thread
+        size_t size() const
+        {
+            const size_t head = m_head.load(std::memory_order_acquire);
+            const size_t tail = m_tail.load(std::memory_order_acquire);
+            return tail - head;
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        // producer
+
+        template <typename U>
+        bool push(U&& value)
+        {
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (!writable(tail, 1))
+                return false;
+
+            new (m_buffer[tail & m_mask].get()) T(std::forward<U>(value));
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t push(T* values, size_t count)
+        {
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+            const size_t n = std::min(writable(tail, count), count);
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                new (m_buffer[(tail + i) & m_mask].get()) T(std::move(values[i]));
+            }
+
+            m_tail.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        // consumer
+
+        bool pop(T& value)
+        {
+            const size_t head = m_head.load(std::memory_order_relaxed);
+            if (!readable(head, 1))
+                return false;
+
+            T* ptr = m_buffer[head & m_mask].get();
+            value = std::move(*ptr);
+            ptr->~T();
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t pop(T* values, size_t count)
+        {
+            const size_t head = m_head.load(std::memory_order_relaxed);
+            const size_t n = std::min(readable(head, count), count);
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                T* ptr = m_buffer[(head + i) & m_mask].get();
+                values[i] = std::move(*ptr);
+                ptr->~T();
+            }
+
+            m_head.store(head + n, std::memory_order_release);
+            return n;
+        }
+    };
+
+} // namespace mango
@@ -15,6 +15,13 @@ namespace mango
 
     class Stream : protected NonCopyable
     {
+    protected:
+        // Optional write buffer of a buffered stream: the free space is [m_put_ptr, m_put_end).
+        // put() copies small writes into it without a virtual call; the stream reclaims the
+        // data from the buffer in it's virtual functions.
+        u8* m_put_ptr = nullptr;
+        u8* m_put_end = nullptr;
+
     public:
         enum OpenMode
         {
@@ -40,7 +47,22 @@ namespace mango
 
         void write(ConstMemory memory)
         {
-            write(memory.address, memory.size);
+            put(memory.address, memory.size);
+        }
+
+        // write() with a fast path for buffered streams; the empty writes go to write()
+        // as the streams without a buffer have null pointers
+        void put(const void* data, u64 size)
+        {
+            if (size && size <= u64(m_put_end - m_put_ptr))
+            {
+                std::memcpy(m_put_ptr, data, size_t(size));
+                m_put_ptr += size;
+            }
+            else
+            {
+                write(data, size);
+            }
         }
     };
 
@@ -134,33 +156,33 @@ namespace mango
 
         void write(const void* data, u64 size)
         {
-            s.write(data, size);
+            s.put(data, size);
         }
 
         void write(ConstMemory memory)
         {
-            s.write(memory);
+            s.put(memory.address, memory.size);
         }
 
         void write8(u8 value)
         {
-            s.write(&value, sizeof(u8));
+            s.put(&value, sizeof(u8));
 
         }
 
         void write16(u16 value)
         {
-            s.write(&value, sizeof(u16));
+            s.put(&value, sizeof(u16));
         }
 
         void write32(u32 value)
         {
-            s.write(&value, sizeof(u32));
+            s.put(&value, sizeof(u32));
         }
 
         void write64(u64 value)
         {
-            s.write(&value, sizeof(u64));
+            s.put(&value, sizeof(u64));
         }
 
         void write16f(Half value)
@@ -272,35 +294,35 @@ namespace mango
 
         void write(const void* data, u64 size)
         {
-            s.write(data, size);
+            s.put(data, size);
         }
 
         void write(ConstMemory memory)
         {
-            s.write(memory);
+            s.put(memory.address, memory.size);
         }
 
         void write8(u8 value)
         {
-            s.write(&value, 1);
+            s.put(&value, 1);
         }
 
         void write16(u16 value)
         {
             value = byteswap(value);
-            s.write(&value, 2);
+            s.put(&value, 2);
         }
 
         void write32(u32 value)
         {
             value = byteswap(value);
-            s.write(&value, 4);
+            s.put(&value, 4);
         }
 
         void write64(u64 value)
         {
             value = byteswap(value);
-            s.write(&value, 8);
+            s.put(&value, 8);
         }
 
         void write16f(Half value)
@@ -4,7 +4,9 @@
 */
 #pragma once
 
+#include <cstddef>
 #include <queue>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <thread>
@@ -12,23 +14,247 @@
 #include <functional>
 #include <condition_variable>
 #include <future>
+#include <type_traits>
 #include <mango/core/exception.hpp>
 #include <mango/core/object.hpp>
 #include <mango/core/atomic.hpp>
+#include <mango/core/ringbuffer.hpp>
 
 namespace mango
 {
 
+    // ----------------------------------------------------------------------------------
+    // TaskFunction
+    // ----------------------------------------------------------------------------------
+
+    /*
+        TaskFunction is a move-only replacement for std::function<void()> used to store
+        the tasks in the ThreadPool. The object is exactly one cache line; callables which
+        fit into the inline storage are stored in-place (lambdas capturing a handful of
+        values or pointers). Larger callables are stored in blocks recycled through a
+        thread-cached free list so that the enqueue path does not call the heap allocator
+        once the pool has warmed up.
+    */
+
+    namespace detail
+    {
+        void* allocateTaskStorage(size_t size);
+        void freeTaskStorage(void* ptr, size_t size);
+    }
+
+    class TaskFunction
+    {
+    protected:
+        enum Operation
+        {
+            MOVE,
+            DESTROY
+        };
+
+        using InvokeFunc = void (*)(void* storage);
+        using ManageFunc = void (*)(Operation operation, void* dest, void* source);
+
+        static constexpr size_t StorageSize = 64 - sizeof(InvokeFunc) - sizeof(ManageFunc);
+        static constexpr size_t StorageAlign = alignof(std::max_align_t);
+
+        alignas(StorageAlign) u8 m_storage[StorageSize];
+        InvokeFunc m_invoke { nullptr };
+        ManageFunc m_manage { nullptr };
+
+        template <typename F>
+        struct InlineStorage
+        {
+            static void invoke(void* storage)
+            {
+                (*reinterpret_cast<F*>(storage))();
+            }
+
+            static void manage(Operation operation, void* dest, void* source)
+            {
+                F* func = reinterpret_cast<F*>(source);
+                if (operation == MOVE)
+                {
+                    new (dest) F(std::move(*func));
+                }
+                func->~F();
+            }
+        };
+
+        template <typename F>
+        struct PooledStorage
+        {
+            static void invoke(void* storage)
+            {
+                (**reinterpret_cast<F**>(storage))();
+            }
+
+            static void manage(Operation operation, void* dest, void* source)
+            {
+                F* func = *reinterpret_cast<F**>(source);
+                if (operation == MOVE)
+                {
+                    *reinterpret_cast<F**>(dest) = func;
+                }
+                else
+                {
+                    func->~F();
+                    detail::freeTaskStorage(func, sizeof(F));
+                }
+            }
+        };
+
+        template <typename F>
+        using IsInline = std::integral_constant<bool,
+            sizeof(F) <= StorageSize &&
+            alignof(F) <= StorageAlign &&
+            std::is_nothrow_move_constructible<F>::value>;
+
+        template <typename F>
+        void construct(F&& func, std::true_type)
+        {
+            using T = typename std::decay<F>::type;
+            new (m_storage) T(std::forward<F>(func));
+            m_invoke = InlineStorage<T>::invoke;
+            m_manage = InlineStorage<T>::manage;
+        }
+
+        template <typename F>
+        void construct(F&& func, std::false_type)
+        {
+            using T = typename std::decay<F>::type;
+            void* ptr = detail::allocateTaskStorage(sizeof(T));
+            *reinterpret_cast<T**>(m_storage) = new (ptr) T(std::forward<F>(func));
+            m_invoke = PooledStorage<T>::invoke;
+            m_manage = PooledStorage<T>::manage;
+        }
+
+        void reset()
+        {
+            if (m_manage)
+            {
+                m_manage(DESTROY, nullptr, m_storage);
+                m_invoke = nullptr;
+                m_manage = nullptr;
+            }
+        }
+
+    public:
+        TaskFunction() = default;
+
+        template <typename F, typename = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, TaskFunction>::value>::type>
+        TaskFunction(F&& func)
+        {
+            using T = typename std::decay<F>::type;
+            construct(std::forward<F>(func), IsInline<T>());
+        }
+
+        TaskFunction(TaskFunction&& other) noexcept
+        {
+            if (other.m_manage)
+            {
+                other.m_manage(MOVE, m_storage, other.m_storage);
+                m_invoke = other.m_invoke;
+                m_manage = other.m_manage;
+                other.m_invoke = nullptr;
+                other.m_manage = nullptr;
+            }
+        }
+
+        TaskFunction& operator = (TaskFunction&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                if (other.m_manage)
+                {
+                    other.m_manage(MOVE, m_storage, other.m_storage);
+                    m_invoke = other.m_invoke;
+                    m_manage = other.m_manage;
+                    other.m_invoke = nullptr;
+                    other.m_manage = nullptr;
+                }
+            }
+            return *this;
+        }
+
+        TaskFunction(const TaskFunction&) = delete;
+        TaskFunction& operator = (const TaskFunction&) = delete;
+
+        ~TaskFunction()
+        {
+            reset();
+        }
+
+        explicit operator bool () const
+        {
+            return m_invoke != nullptr;
+        }
+
+        void operator () ()
+        {
+            m_invoke(m_storage);
+        }
+    };
+
     // ----------------------------------------------------------------------------------
     // ThreadPool
     // ----------------------------------------------------------------------------------
 
+    /*
+        ThreadPoolConfig selects the size of a ThreadPool and how the workers are placed
+        on the processors (see getCPUTopology()). The workers are assigned to processors
+        in order where the first hardware thread of every core comes before the SMT
+        siblings and the NUMA nodes are interleaved, so a pool smaller than the machine
+        is spread evenly over the nodes and does not share cores unless it has to.
+
+        When the workers are pinned and the machine has more than one NUMA node the pool
+        has separate injection queues for each node; tasks enqueued from a thread running
+        on node N are picked up by workers on node N first, and idle workers steal from
+        workers on the same node before crossing to another node.
+
+        Usage example:
+
+        ThreadPoolConfig config;
+        config.affinity = ThreadPoolConfig::NODE;
+
+        ThreadPool pool(config);
+        ConcurrentQueue q(pool, "decode");
+
+    */
+
+    struct ThreadPoolConfig
+    {
+        enum Affinity
+        {
+            NONE,      // let the OS schedule the workers
+            NODE,      // pin each worker to the processors of one NUMA node
+            PROCESSOR  // pin each worker to one logical processor
+        };
+
+        int threads = 0;           // number of workers (0: one for each processor)
+        bool smt = true;           // use SMT siblings when threads is 0 (false: one for each core)
+        Affinity affinity = NONE;  // worker placement
+        bool numa = true;          // node-local queues when the workers are pinned
+
+        // idle policy: a worker without work polls the queues with cpu pause in between,
+        // then polls with yield in between and finally parks until a task is enqueued.
+        // more polling gives lower wakeup latency, less polling saves power. a thread
+        // waiting for a queue helps with the tasks and follows the same policy except
+        // that it keeps yielding instead of parking, since nothing wakes it up.
+        int spin = 64;             // polls with cpu pause before yielding
+        int yield = 16;            // polls with yield before parking
+    };
+
     class ThreadPool : private NonCopyable
     {
     private:
         friend class ConcurrentQueue;
         using CacheLine = u8[64];
 
+        struct Metrics;
+        Metrics* getMetrics(const std::string& name, int priority);
+
         struct Queue
         {
             ThreadPool* pool;
@@ -53,6 +279,13 @@ namespace mango
 
 #endif
 
+            // tasks which have not started before the deadline (Time::ms) are skipped
+            std::atomic<u64> deadline { 0 };
+
+            // instrumentation; shared by all queues with the same name and resolved
+            // when the first task is enqueued with the instrumentation enabled
+            std::atomic<Metrics*> metrics { nullptr };
+
             Queue(ThreadPool* pool, int priority, const std::string& name)
                 : pool(pool)
                 , priority(priority)
@@ -63,12 +296,14 @@ namespace mango
 
         struct Task
         {
-            Queue* queue;
-            std::function<void()> func;
+            Queue* queue = nullptr;
+            u64 time = 0; // enqueue time in nanoseconds when instrumented
+            TaskFunction func;
         };
 
     public:
         ThreadPool(size_t size);
+        ThreadPool(const ThreadPoolConfig& config);
         ~ThreadPool();
 
         static int getHardwareConcurrency();
@@ -76,29 +311,139 @@ namespace mango
 
         int size() const;
 
-        void enqueue(std::function<void()>&& func)
+        struct IdleStatistics
+        {
+            u64 spins = 0;    // polls without work followed by cpu pause
+            u64 yields = 0;   // polls without work followed by yield
+            u64 parks = 0;    // workers parked
+            u64 wakeups = 0;  // parked workers woken up by enqueue
+        };
+
+        IdleStatistics getIdleStatistics() const;
+
+        /*
+            Instrumentation collects statistics for every queue name and worker while
+            enabled: number of tasks, time from enqueue until the task starts (wait),
+            task execution time and worker busy / idle time. Queues with the same name
+            share the statistics (eg. every parallel_for call). The TRACE mode also
+            records every task execution for getTraceJSON() which returns the events in
+            Chrome trace-event format (chrome://tracing, ui.perfetto.dev).
+
+            The instrumentation is disabled by default; the disabled cost is one relaxed
+            atomic load for each enqueue and task. The statistics for a queue name are
+            created when the first task is enqueued into such queue while the
+            instrumentation is enabled and they are kept for the lifetime of the pool.
+
+            Usage example:
+
+            ThreadPool& pool = ThreadPool::getInstance();
+            pool.setInstrumentation(ThreadPool::Instrumentation::STATISTICS);
+
+            // ... run the workload ...
+
+            ThreadPool::Statistics statistics = pool.getStatistics();
+            for (auto& queue : statistics.queues)
+            {
+                printf("%s: %d tasks, wait p99: %d us\n", queue.name.c_str(),
+                    int(queue.executed), int(queue.wait.percentile(0.99f) / 1000));
+            }
+
+        */
+
+        enum class Instrumentation
+        {
+            NONE,
+            STATISTICS,
+            TRACE
+        };
+
+        struct Histogram
+        {
+            // bucket n counts the samples in [2^n, 2^(n+1)) nanoseconds
+            u64 buckets[40] = {};
+            u64 count = 0;
+            u64 total = 0; // nanoseconds
+
+            u64 average() const;
+            u64 percentile(float p) const; // upper bound of the bucket in nanoseconds
+        };
+
+        struct QueueStatistics
+        {
+            std::string name;
+            int priority = 0;
+            u64 enqueued = 0;
+            u64 executed = 0;
+            u64 cancelled = 0;
+            Histogram wait;     // time from enqueue to start of execution
+            Histogram execute;  // execution time
+        };
+
+        struct WorkerStatistics
+        {
+            u64 tasks = 0;
+            u64 busy = 0; // nanoseconds executing tasks
+            u64 idle = 0; // nanoseconds without a task
+        };
+
+        struct Statistics
+        {
+            u64 elapsed = 0; // nanoseconds the instrumentation has been enabled
+            std::vector<QueueStatistics> queues;
+            std::vector<WorkerStatistics> workers;
+            IdleStatistics idle;
+        };
+
+        void setInstrumentation(Instrumentation instrumentation);
+        Statistics getStatistics() const;
+        std::string getTraceJSON() const;
+
+        void enqueue(TaskFunction&& func)
         {
             enqueue(&m_static_queue, std::move(func));
         }
 
     protected:
+        struct Worker;
+
         void thread(size_t threadID);
+        void park(Worker* worker);
+        void wake(int node);
+        int getCurrentNode() const;
 
-        void enqueue(Queue* queue, std::function<void()>&& func);
+        void enqueue(Queue* queue, TaskFunction&& func);
         bool dequeue_and_process();
+        bool dequeue(Worker* worker, Task& task);
+        static bool isSkipped(const Queue* queue);
+        void process(Worker* worker, Task& task);
+        void process_instrumented(Worker* worker, Task& task);
         void cancel(Queue* queue);
         void wait(Queue* queue);
 
     private:
         static ThreadPool m_static_instance;
 
+        // shared injection queues for tasks enqueued from outside of the pool,
+        // one set of priority queues for each NUMA node the pool is using
         struct TaskQueue;
         alignas(64) TaskQueue* m_queues;
+        int m_node_count;
+        std::vector<int> m_processor_node;
+
+        // per-worker work-stealing deques for tasks enqueued from the workers
+        alignas(64) Worker* m_workers;
+
+        struct Monitor;
+        Monitor* m_monitor;
+        std::atomic<int> m_instrumentation { 0 };
 
         alignas(64) std::atomic<bool> m_stop { false };
         alignas(64) std::atomic<int> m_sleep_count { 0 };
-        std::mutex m_queue_mutex;
-        std::condition_variable m_condition;
+        std::atomic<u32> m_wake_index { 0 };
+        std::atomic<u64> m_wakeup_count { 0 };
+
+        int m_spin_count;
+        int m_yield_count;
 
         Queue m_static_queue;
         std::vector<std::thread> m_threads;
@@ -111,6 +456,79 @@ namespace mango
         LOW = 2
     };
 
+    // ----------------------------------------------------------------------------------
+    // CancellationToken
+    // ----------------------------------------------------------------------------------
+
+    /*
+        CancellationSource requests cancellation of work which has been given one of the
+        source's tokens. The tokens are cheap to copy and to poll; long running tasks and
+        the image decoders poll the token at natural boundaries (scanline, MCU row, restart
+        interval) and stop early when the source is cancelled or it's deadline has passed.
+        A default constructed token is never cancelled.
+
+        The deadlines are in the Time::ms() time base.
+
+        Usage example:
+
+        CancellationSource source;
+        source.setTimeout(200); // cancel automatically after 200 ms
+
+        ImageDecodeOptions options;
+        options.cancellation = source.token();
+
+        ImageDecodeStatus status = decoder.decode(bitmap, options);
+
+        // from any thread:
+        source.cancel();
+
+    */
+
+    namespace detail
+    {
+
+        struct CancellationState
+        {
+            std::atomic<bool> cancelled { false };
+            std::atomic<u64> deadline { 0 };
+
+            bool isCancelled() const;
+        };
+
+    } // namespace detail
+
+    class CancellationToken
+    {
+    protected:
+        friend class CancellationSource;
+        std::shared_ptr<const detail::CancellationState> m_state;
+
+    public:
+        CancellationToken() = default;
+
+        bool isCancelled() const
+        {
+            return m_state && m_state->isCancelled();
+        }
+    };
+
+    class CancellationSource
+    {
+    protected:
+        std::shared_ptr<detail::CancellationState> m_state;
+
+    public:
+        CancellationSource();
+        ~CancellationSource();
+
+        CancellationToken token() const;
+
+        void cancel();
+        void setDeadline(u64 time);
+        void setTimeout(u64 ms);
+        bool isCancelled() const;
+    };
+
     // ----------------------------------------------------------------------------------
     // ConcurrentQueue
     // ----------------------------------------------------------------------------------
@@ -122,6 +540,10 @@ namespace mango
         queues. The queues can be configuted to different priorities to control which tasks
         are more time critical.
 
+        Tasks enqueued from inside a task are pushed into the calling worker's own deque
+        and executed by the same worker (newest first) unless an idle worker steals them
+        (oldest first). This keeps recursively spawned work cache-local.
+
         Usage example:
 
         // create queue
@@ -136,6 +558,12 @@ namespace mango
         // wait until the queue is drained
         q.wait(); // cooperative, blocking (helps pool until all tasks are complete)
 
+        The queue can have a deadline; tasks which have not started when the deadline
+        passes are skipped the same way as cancelled tasks. The tasks which are already
+        running are not interrupted; use a CancellationToken for that.
+
+        q.setTimeout(100); // drop the tasks which are still waiting after 100 ms
+
     */
 
     class ConcurrentQueue : private NonCopyable
@@ -147,19 +575,116 @@ namespace mango
     public:
         ConcurrentQueue();
         ConcurrentQueue(const std::string& name, Priority priority = Priority::NORMAL);
+        ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority = Priority::NORMAL);
         ~ConcurrentQueue();
 
+        template <class F>
+        void enqueue(F&& f)
+        {
+            m_pool.enqueue(&m_queue, TaskFunction(std::forward<F>(f)));
+        }
+
         template <class F, class... Args>
         void enqueue(F&& f, Args&&... args)
         {
-            m_pool.enqueue(&m_queue, std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+            m_pool.enqueue(&m_queue, TaskFunction(std::bind(std::forward<F>(f), std::forward<Args>(args)...)));
         }
 
         void steal();
         void cancel();
         void wait();
+
+        void setDeadline(u64 time); // Time::ms(), 0: no deadline
+        void setTimeout(u64 ms);
     };
 
+    // ----------------------------------------------------------------------------------
+    // parallel_for
+    // ----------------------------------------------------------------------------------
+
+    /*
+        parallel_for executes func(begin, end) over sub-ranges of [begin, end) in the
+        ThreadPool. The range is split recursively in halves; the upper half is enqueued
+        and the lower half is split again until it is no larger than the grain size.
+        Idle workers steal the largest outstanding halves so the work spreads out quickly
+        on big ranges while small ranges are not chopped into more tasks than is useful.
+
+        The grain is the smallest range worth a task of it's own. When the grain is zero
+        or negative it is selected automatically from the range and the pool size. The
+        grain is never made smaller than requested but it is increased so that huge ranges
+        are not split into more tasks than the pool can use. Ranges not larger than the
+        grain are executed directly on the calling thread.
+
+        The call returns when all of the sub-ranges have been processed; the calling
+        thread helps executing tasks while waiting so parallel_for can be used from
+        inside of a task.
+
+        Usage example:
+
+        parallel_for(0, height, 0, [&] (int y0, int y1)
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                // TODO: process a scanline here..
+            }
+        });
+
+        parallel_for_rows selects the grain so that each task processes at least
+        (roughly) 64 KB of data; bytes_per_row is the amount of data per row.
+
+        The tasks are enqueued with the given priority; latency critical callers can
+        use Priority::HIGH but bulk loops should not starve the other high priority work.
+
+    */
+
+    namespace detail
+    {
+        int getParallelGrain(int range, int grain);
+        int getParallelRowGrain(size_t bytes_per_row);
+
+        template <typename Func>
+        void parallel_split(ConcurrentQueue& queue, int begin, int end, int grain, Func& func)
+        {
+            while (end - begin > grain)
+            {
+                const int middle = begin + (end - begin) / 2;
+                queue.enqueue([&queue, &func, middle, end, grain]
+                {
+                    parallel_split(queue, middle, end, grain, func);
+                });
+                end = middle;
+            }
+
+            func(begin, end);
+        }
+
+    } // namespace detail
+
+    template <typename Func>
+    void parallel_for(int begin, int end, int grain, Func&& func, Priority priority = Priority::NORMAL)
+    {
+        if (begin >= end)
+            return;
+
+        grain = detail::getParallelGrain(end - begin, grain);
+        if (end - begin <= grain)
+        {
+            func(begin, end);
+            return;
+        }
+
+        ConcurrentQueue queue("parallel_for", priority);
+        detail::parallel_split(queue, begin, end, grain, func);
+        queue.wait();
+    }
+
+    template <typename Func>
+    void parallel_for_rows(int height, size_t bytes_per_row, Func&& func, Priority priority = Priority::NORMAL)
+    {
+        const int grain = detail::getParallelRowGrain(bytes_per_row);
+        parallel_for(0, height, grain, std::forward<Func>(func), priority);
+    }
+
     // ----------------------------------------------------------------------------------
     // SerialQueue
     // ----------------------------------------------------------------------------------
@@ -191,7 +716,6 @@ namespace mango
     class SerialQueue : private NonCopyable
     {
     protected:
-        using Task = std::function<void()>;
         using CacheLine = u8[64];
 
         std::string m_name;
@@ -215,13 +739,28 @@ namespace mango
 
 #endif
 
-        std::deque<Task> m_task_queue;
-        std::mutex m_queue_mutex;
+        // The tasks are passed to the execution thread through a lock-free ring buffer;
+        // the producers take a lock only when the ring is full (the tasks go into the
+        // overflow list until the execution thread has drained it) or when the execution
+        // thread is sleeping and must be woken up.
+
+        MPMCRingBuffer<TaskFunction> m_ring;
+
+        std::atomic<bool> m_overflow_active { false };
+        std::deque<TaskFunction> m_overflow;
+        std::mutex m_overflow_mutex;
+
+        std::atomic<bool> m_sleeping { false };
+        std::mutex m_sleep_mutex;
+        std::condition_variable m_sleep_condition;
+
         std::mutex m_wait_mutex;
-        std::condition_variable m_task_condition;
         std::condition_variable m_wait_condition;
 
         void thread();
+        void push(TaskFunction&& task);
+        bool pop(TaskFunction& task);
+        void complete(int count);
 
     public:
         SerialQueue();
@@ -231,10 +770,7 @@ namespace mango
         template <class F, class... Args>
         void enqueue(F&& f, Args&&... args)
         {
-            std::unique_lock<std::mutex> lock(m_queue_mutex);
-            m_task_queue.emplace_back(f, (args)...);
-            ++m_task_counter;
-            m_task_condition.notify_one();
+            push(TaskFunction(std::bind(std::forward<F>(f), std::forward<Args>(args)...)));
         }
 
         void cancel();
@@ -349,11 +885,18 @@ namespace mango
     class Task
     {
     public:
+        template <class F>
+        Task(F&& f)
+        {
+            ThreadPool& pool = ThreadPool::getInstance();
+            pool.enqueue(TaskFunction(std::forward<F>(f)));
+        }
+
         template <class F, class... Args>
         Task(F&& f, Args&&... args)
         {
             ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+            pool.enqueue(TaskFunction(std::bind(std::forward<F>(f), std::forward<Args>(args)...)));
         }
     };
 
@@ -365,7 +908,20 @@ namespace mango
         FutureTask is an asynchronous API to submit tasks into the ThreadPool.
         The get() member function will block the current thread until the result is available
         and does not consume any significant amount of CPU; the thread will yield/sleep
-        while waiting for the result.
+        while waiting for the result. If the task throws the exception is re-thrown by get().
+
+        Continuations are attached with then(); the continuation is enqueued into the
+        ThreadPool when the task completes and receives the task's result as argument
+        (no argument when the result is void). The continuation never blocks a worker
+        waiting for it's antecedent so long chains of dependent stages can be built
+        without tying up the pool. An exception thrown in any stage propagates through
+        the rest of the chain into get().
+
+        The task has a single consumer like std::future: get() can be called only once
+        and then() must not be called after it; both throw std::future_error with
+        future_errc::no_state when the result has already been taken. The result is
+        moved out by get() when no continuation has been attached to the task; when
+        the task has continuations they share the result and get() returns a copy.
 
         Usage example:
 
@@ -374,85 +930,309 @@ namespace mango
             return 7;
         });
 
+        // attach a continuation
+        FutureTask<float> next = task.then([] (int x) -> float {
+            return x * 0.5f;
+        });
+
         // this will block until the task has been completed
         int x = task.get();
+        float y = next.get();
 
     */
 
+    namespace detail
+    {
+
+        template <typename T, typename F>
+        void setFutureValue(std::promise<T>& promise, F& func)
+        {
+            promise.set_value(func());
+        }
+
+        template <typename F>
+        void setFutureValue(std::promise<void>& promise, F& func)
+        {
+            func();
+            promise.set_value();
+        }
+
+        template <typename F, typename T>
+        auto invokeContinuation(F& func, const std::shared_future<T>& future) -> decltype(func(future.get()))
+        {
+            return func(future.get());
+        }
+
+        template <typename F>
+        auto invokeContinuation(F& func, const std::shared_future<void>& future) -> decltype(func())
+        {
+            future.get();
+            return func();
+        }
+
+        template <typename T>
+        T takeFutureValue(const std::shared_future<T>& future, bool shared)
+        {
+            if (shared)
+            {
+                return future.get();
+            }
+
+            // the value in the shared state is not const; the caller is the only consumer
+            return std::move(const_cast<T&>(future.get()));
+        }
+
+        template <typename T>
+        T& takeFutureValue(const std::shared_future<T&>& future, bool shared)
+        {
+            MANGO_UNREFERENCED(shared);
+            return future.get();
+        }
+
+        static inline
+        void takeFutureValue(const std::shared_future<void>& future, bool shared)
+        {
+            MANGO_UNREFERENCED(shared);
+            future.get();
+        }
+
+        template <typename T>
+        class FutureState : private NonCopyable
+        {
+        protected:
+            std::promise<T> m_promise;
+            SpinLock m_lock;
+            bool m_ready = false;
+            std::vector<TaskFunction> m_continuations;
+
+        public:
+            std::shared_future<T> future;
+
+            FutureState()
+                : future(m_promise.get_future().share())
+            {
+            }
+
+            template <typename F>
+            void run(F& func)
+            {
+                try
+                {
+                    setFutureValue(m_promise, func);
+                }
+                catch (...)
+                {
+                    m_promise.set_exception(std::current_exception());
+                }
+
+                std::vector<TaskFunction> continuations;
+                {
+                    SpinLockGuard guard(m_lock);
+                    m_ready = true;
+                    continuations.swap(m_continuations);
+                }
+
+                ThreadPool& pool = ThreadPool::getInstance();
+                for (auto& continuation : continuations)
+                {
+                    pool.enqueue(std::move(continuation));
+                }
+            }
+
+            void attach(TaskFunction&& continuation)
+            {
+                {
+                    SpinLockGuard guard(m_lock);
+                    if (!m_ready)
+                    {
+                        m_continuations.push_back(std::move(continuation));
+                        return;
+                    }
+                }
+
+                ThreadPool& pool = ThreadPool::getInstance();
+                pool.enqueue(std::move(continuation));
+            }
+        };
+
+    } // namespace detail
+
     template <typename T>
     class FutureTask
     {
     private:
-        using Future = std::future<T>;
-        using Promise = std::promise<T>;
-        using Function = std::function<T()>;
+        template <typename U>
+        friend class FutureTask;
+
+        using State = detail::FutureState<T>;
 
-        Promise m_promise;
-        Future m_future;
+        struct Continuation { };
+
+        std::shared_ptr<State> m_state;
+        bool m_shared = false; // continuations use the result
+        bool m_taken = false;  // get() has been called
+
+        FutureTask(Continuation, std::shared_ptr<State> state)
+            : m_state(std::move(state))
+        {
+        }
 
     public:
-        template <class F, class... Args>
+        template <class F, class... Args,
+                  typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, FutureTask>::value>::type>
         FutureTask(F&& f, Args&&... args)
-            : m_promise()
-            , m_future(m_promise.get_future())
+            : m_state(std::make_shared<State>())
         {
-            Function func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            auto container = std::bind([this] (Function func) {
-                T value = func();
-                m_promise.set_value(value);
-            }, func);
+            auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
 
             ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(container);
+            pool.enqueue([state = m_state, func = std::move(func)] () mutable
+            {
+                state->run(func);
+            });
+        }
+
+        FutureTask(FutureTask&&) = default;
+        FutureTask& operator = (FutureTask&&) = default;
+
+        template <class F, class Func = typename std::decay<F>::type>
+        auto then(F&& f) -> FutureTask<decltype(detail::invokeContinuation(std::declval<Func&>(), std::declval<const std::shared_future<T>&>()))>
+        {
+            using U = decltype(detail::invokeContinuation(std::declval<Func&>(), std::declval<const std::shared_future<T>&>()));
+
+            if (m_taken)
+            {
+                throw std::future_error(std::future_errc::no_state);
+            }
+
+            auto next = std::make_shared<detail::FutureState<U>>();
+            m_shared = true;
+
+            m_state->attach([next, future = m_state->future, func = Func(std::forward<F>(f))] () mutable
+            {
+                auto invoke = [&] () -> U
+                {
+                    return detail::invokeContinuation(func, future);
+                };
+                next->run(invoke);
+            });
+
+            return FutureTask<U>(typename FutureTask<U>::Continuation(), std::move(next));
+        }
+
+        // The callable is invoked once the task has completed, with or without an exception;
+        // it is always executed in the ThreadPool.
+        template <class F>
+        void onComplete(F&& f)
+        {
+            m_state->attach(TaskFunction(std::forward<F>(f)));
+        }
+
+        bool ready() const
+        {
+            return m_state->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
         }
 
         T get()
         {
-            return m_future.get();
+            if (m_taken)
+            {
+                throw std::future_error(std::future_errc::no_state);
+            }
+
+            m_taken = true;
+            return detail::takeFutureValue(m_state->future, m_shared);
         }
 
         void wait()
         {
-            m_future.wait();
+            m_state->future.wait();
         }
     };
 
-    template <>
-    class FutureTask<void>
+    // ----------------------------------------------------------------------------------
+    // TaskGraph
+    // ----------------------------------------------------------------------------------
+
+    /*
+        TaskGraph executes tasks with dependencies between them. Every task added to the
+        graph returns a Node which can be used as predecessor for tasks added later. A task
+        is enqueued into the ThreadPool when all of it's predecessors have completed; no
+        worker is ever blocked waiting for a dependency. Tasks can be added to the graph
+        from any thread, including from inside of the graph's own tasks, and predecessors
+        which have already completed are simply ignored.
+
+        A node without function is a join point; it can be used to collect a number of
+        tasks into one predecessor. The nodes are owned by the graph and remain valid until
+        the graph is destroyed. The destructor waits until all tasks have been completed.
+
+        Usage example:
+
+        TaskGraph graph;
+
+        auto* load = graph.add([&] { ... });
+        auto* decode = graph.add([&] { ... }, { load });
+        auto* mipmap = graph.add([&] { ... }, { decode });
+        auto* compress = graph.add([&] { ... }, { decode });
+        graph.add([&] { ... }, { mipmap, compress });
+
+        graph.wait(); // cooperative, blocking (helps pool until all tasks are complete)
+
+    */
+
+    class TaskGraph : private NonCopyable
     {
-    private:
-        using Future = std::future<void>;
-        using Promise = std::promise<void>;
-        using Function = std::function<void()>;
+    public:
+        class Node : private NonCopyable
+        {
+        protected:
+            friend class TaskGraph;
+
+            TaskFunction m_func;
+            std::atomic<int> m_pending { 1 };
+            SpinLock m_lock;
+            bool m_finished = false;
+            std::vector<Node*> m_successors;
+        };
+
+    protected:
+        ConcurrentQueue m_queue;
+        std::atomic<int> m_active { 0 };
+        SpinLock m_nodes_lock;
+        std::vector<std::unique_ptr<Node>> m_nodes;
 
-        Promise m_promise;
-        Future m_future;
+        Node* insert(TaskFunction&& func, Node* const* predecessors, size_t count);
+        void schedule(Node* node);
+        void complete(Node* node);
 
     public:
-        template <class F, class... Args>
-        FutureTask(F&& f, Args&&... args)
-            : m_promise()
-            , m_future(m_promise.get_future())
+        TaskGraph();
+        TaskGraph(const std::string& name, Priority priority = Priority::NORMAL);
+        ~TaskGraph();
+
+        template <class F>
+        Node* add(F&& func, std::initializer_list<Node*> predecessors = {})
         {
-            Function func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            auto container = std::bind([this] (Function func) {
-                func();
-                m_promise.set_value();
-            }, func);
+            return insert(TaskFunction(std::forward<F>(func)), predecessors.begin(), predecessors.size());
+        }
 
-            ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(container);
+        template <class F>
+        Node* add(F&& func, const std::vector<Node*>& predecessors)
+        {
+            return insert(TaskFunction(std::forward<F>(func)), predecessors.data(), predecessors.size());
         }
 
-        void get()
+        Node* join(std::initializer_list<Node*> predecessors)
         {
-            m_future.get();
+            return insert(TaskFunction(), predecessors.begin(), predecessors.size());
         }
 
-        void wait()
+        Node* join(const std::vector<Node*>& predecessors)
         {
-            m_future.wait();
+            return insert(TaskFunction(), predecessors.data(), predecessors.size());
         }
+
+        void wait();
     };
 
 } // namespace mango
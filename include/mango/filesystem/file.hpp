@@ -7,8 +7,11 @@
 #include <cstdio>
 #include <string>
 #include <vector>
+#include <functional>
 #include <mango/core/configure.hpp>
+#include <mango/core/exception.hpp>
 #include <mango/core/stream.hpp>
+#include <mango/core/thread.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
 
@@ -39,6 +42,181 @@ namespace filesystem {
         operator const u8* () const;
         const u8* data() const;
         u64 size() const;
+
+        // partial access; files in compressed containers are decompressed only as far
+        // as required for the range instead of the whole file
+        ConstMemory view(u64 offset, u64 size) const;
+        size_t read(void* dest, u64 offset, size_t size) const;
+
+        // access pattern hint for the range (see AccessHint)
+        void advise(AccessHint hint, u64 offset = 0, u64 size = ~u64(0)) const;
+    };
+
+    // -----------------------------------------------------------------
+    // FilePrefetch
+    // -----------------------------------------------------------------
+
+    /*
+        Reads files (or ranges of them) into memory in the ThreadPool ahead of the
+        time they are needed, so that mapping and decoding them later does not wait
+        for page faults one page at a time. The data lands in the operating system's
+        page cache; nothing is kept by the prefetcher. Files which cannot be opened
+        are ignored as the prefetch is only a hint.
+
+        A compressed file in a container is decompressed when it is prefetched and the
+        result is discarded; prefetch the container itself instead.
+
+        Usage example:
+
+        FilePrefetch prefetch;
+        for (auto& filename : filenames)
+        {
+            prefetch.enqueue(filename);
+        }
+
+        for (auto& filename : filenames)
+        {
+            Bitmap bitmap(filename); // decode while the rest are being prefetched
+        }
+
+    */
+
+    class FilePrefetch : protected NonCopyable
+    {
+    protected:
+        ConcurrentQueue m_queue;
+
+    public:
+        FilePrefetch(Priority priority = Priority::LOW);
+        ~FilePrefetch();
+
+        void enqueue(const std::string& filename, u64 offset = 0, u64 size = ~u64(0));
+        void enqueue(const std::vector<std::string>& filenames);
+
+        // the path must outlive the prefetch
+        void enqueue(const Path& path, const std::string& filename, u64 offset = 0, u64 size = ~u64(0));
+
+        void cancel(); // skip the files which are not being read yet
+        void wait();
+    };
+
+    // -----------------------------------------------------------------
+    // AsyncFileReader
+    // -----------------------------------------------------------------
+
+    /*
+        Reads a large number of files concurrently into memory. On Linux the reads
+        are submitted to the kernel in batches with io_uring so that hundreds of them
+        can be in flight at the same time (which hides the latency of network storage)
+        without blocking a thread per read; opening the files is done in the ThreadPool.
+        When io_uring is not available (old kernel, blocked by a sandbox) or on other
+        platforms the files are read with blocking reads in the ThreadPool.
+
+        The callback is called in the ThreadPool when the read is complete; the calls
+        are concurrent and in no particular order. The memory is valid only during
+        the callback; the buffer is recycled for the next reads afterwards. When the
+        read fails the memory is empty and the status has the error.
+
+        The depth is the maximum number of reads in flight with either engine; the
+        rest of the reads wait in the reader. It also limits the amount of memory used
+        by the buffers of the reads: io_uring opens up to twice as many files so that
+        the next reads are ready to be submitted and the buffer of a read is recycled
+        when it's callback returns.
+
+        Usage example:
+
+        AsyncFileReader reader;
+        for (auto& filename : filenames)
+        {
+            reader.read(filename, [] (const std::string& filename, ConstMemory memory, const Status& status)
+            {
+                if (status)
+                {
+                    ImageDecoder decoder(memory, getExtension(filename));
+                    ...
+                }
+            });
+        }
+
+        reader.wait();
+
+    */
+
+    enum class ReadEngine
+    {
+        AUTO,       // io_uring when it is available
+        IO_URING,   // same as AUTO; the ThreadPool is used when io_uring is not available
+        THREADPOOL,
+    };
+
+    class AsyncFileReader : protected NonCopyable
+    {
+    public:
+        using Callback = std::function<void(const std::string& filename, ConstMemory memory, const Status& status)>;
+
+    protected:
+        struct ReaderContext* m_context;
+
+    public:
+        AsyncFileReader(ReadEngine engine = ReadEngine::AUTO, u32 depth = 64);
+        ~AsyncFileReader();
+
+        // the engine in use: IO_URING or THREADPOOL
+        ReadEngine engine() const;
+
+        // read the whole file into a buffer from the reader's pool
+        void read(const std::string& filename, Callback callback);
+
+        // read the file starting from offset into the caller's memory; the read ends
+        // at the end of the file or the end of the memory whichever comes first
+        void read(const std::string& filename, Memory dest, u64 offset, Callback callback);
+
+        // wait until all of the callbacks have returned; must not be called from a callback
+        void wait();
+    };
+
+    // -----------------------------------------------------------------
+    // FileStream
+    // -----------------------------------------------------------------
+
+    /*
+        Buffering options of a FileStream. The stream writes into a large aligned
+        buffer which is written into the file when it is full; the small writes of
+        the endian streams (write8(), write32(), ...) are copied into the buffer
+        without a virtual function call.
+
+        With write-behind the full buffers are written in a background thread while
+        the next buffer is being filled, so that the encoding overlaps the writing.
+        The write errors are reported as exceptions from the following write() or
+        flush(); call flush() before the stream is destroyed to see all of them.
+
+        The direct I/O bypasses the operating system's page cache (O_DIRECT on Linux,
+        F_NOCACHE on macOS, FILE_FLAG_NO_BUFFERING on Windows) which is useful for
+        large files which are not read back soon. The file system might not support
+        it in which case the normal buffered I/O is used. The writes which are not
+        aligned to 4 KB, such as the last partial buffer or the buffer written with
+        flush() or seek(), go through the page cache; the aligned writes which follow
+        them use the direct I/O again.
+
+        When the stream is opened for reading only the buffer size is used.
+
+        Usage example:
+
+        FileBuffering buffering;
+        buffering.write_behind = true;
+
+        FileStream file("image.png", Stream::WRITE, buffering);
+        ImageEncoder encoder(".png");
+        encoder.encode(file, surface, ImageEncodeOptions());
+        file.flush();
+
+    */
+
+    struct FileBuffering
+    {
+        size_t size = 4 * 1024 * 1024;
+        bool direct = false;
+        bool write_behind = false;
     };
 
     class FileStream : public Stream
@@ -48,10 +226,14 @@ namespace filesystem {
 
     public:
         FileStream(const std::string& filename, OpenMode mode);
+        FileStream(const std::string& filename, OpenMode mode, const FileBuffering& buffering);
         ~FileStream();
 
         const std::string& filename() const;
 
+        // write the buffered data into the file
+        void flush();
+
         u64 size() const override;
         u64 offset() const override;
         void seek(s64 distance, SeekMode mode) override;
@@ -64,5 +246,41 @@ namespace filesystem {
         }
     };
 
+#if defined(MANGO_ENABLE_COROUTINES)
+
+    /*
+        Asynchronous File construction for coroutines: opening and mapping the file
+        (and decompressing it when it is stored in a compressed container) is done in
+        the ThreadPool and the awaiting coroutine continues in the worker.
+
+        Usage example:
+
+        AsyncTask<size_t> size(std::string filename)
+        {
+            std::unique_ptr<File> file = co_await mapFileAsync(filename);
+            co_return file->size();
+        }
+
+    */
+
+    inline auto mapFileAsync(const std::string& filename, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        return runAsync([filename]
+        {
+            return std::make_unique<File>(filename);
+        }, pool);
+    }
+
+    // The path must outlive the operation.
+    inline auto mapFileAsync(const Path& path, const std::string& filename, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        return runAsync([&path, filename]
+        {
+            return std::make_unique<File>(path, filename);
+        }, pool);
+    }
+
+#endif
+
 } // namespace filesystem
 } // namespace mango
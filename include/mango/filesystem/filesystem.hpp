@@ -7,4 +7,5 @@
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
 #include <mango/filesystem/file.hpp>
-#include <mango/filesystem/fileobserver.hpp>
+#include <mango/filesystem/fileobserver.hpp>
+#include <mango/filesystem/mgx.hpp>
@@ -6,8 +6,12 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
 #include <mango/core/configure.hpp>
+#include <mango/core/exception.hpp>
 #include <mango/core/memory.hpp>
+#include <mango/core/coroutine.hpp>
 
 namespace mango {
 namespace filesystem {
@@ -88,6 +92,19 @@ namespace filesystem {
         }
     };
 
+    /*
+        Filters for the recursive directory walk. The names are relative to the
+        walked path ("textures/wall.jpg", folder names end with '/'). A folder
+        which is rejected is not descended into. A missing filter accepts
+        everything. The filters are called from multiple threads.
+    */
+
+    struct WalkFilter
+    {
+        std::function<bool(const std::string& folder)> folder;
+        std::function<bool(const std::string& file)> file;
+    };
+
     class AbstractMapper : protected NonCopyable
     {
     public:
@@ -96,7 +113,32 @@ namespace filesystem {
 
         virtual bool isFile(const std::string& filename) const = 0;
         virtual void getIndex(FileIndex& index, const std::string& pathname) = 0;
+
+        // The memory can reference the parent memory of the mapper; the stored files
+        // point into it and the compressed files are decompressed from it at the first
+        // access. The memory must not outlive the mapper (the Path which owns it);
+        // File keeps it's own Path for this reason.
         virtual VirtualMemory* mmap(const std::string& filename) = 0;
+
+        // modification time of the file in seconds; zero when it is not available
+        virtual u64 getTime(const std::string& filename) const
+        {
+            MANGO_UNREFERENCED(filename);
+            return 0;
+        }
+
+        // recursive index of the pathname with the names relative to it; the
+        // containers are listed but not descended into
+        virtual void walk(FileIndex& index, const std::string& pathname, const WalkFilter& filter);
+
+        // the callback takes the ownership of the memory; the memory is null when the status is an error
+        using MapCallback = std::function<void(const std::string& filename, std::unique_ptr<VirtualMemory> memory, const Status& status)>;
+
+        // same as MapCallback but the file is identified by it's index in the filenames
+        using MapIndexCallback = std::function<void(size_t index, std::unique_ptr<VirtualMemory> memory, const Status& status)>;
+
+        // map the files concurrently in the ThreadPool; see Path::map()
+        virtual void map(const std::vector<std::string>& filenames, const MapIndexCallback& callback);
     };
 
     class Mapper : protected NonCopyable
@@ -128,5 +170,40 @@ namespace filesystem {
         static bool isCustomMapper(const std::string& filename);
     };
 
+    /*
+        Persistent index cache for the ZIP and RAR archives. The index of an archive
+        which is opened from the native filesystem is stored in the cache folder and
+        memory mapped when the archive is opened again, which skips parsing the
+        archive directory. The index is identified by the archive size, modification
+        time and a hash of the archive tail so a modified archive gets a new index;
+        the indices of the old versions are not removed from the folder. The cache
+        is disabled when the folder is empty (default).
+
+        Usage example:
+
+        setArchiveIndexCache("/var/cache/myapp/");
+        Path path("assets.zip/"); // parsed and stored on the first run, mapped later
+
+    */
+
+    void setArchiveIndexCache(const std::string& folder);
+    std::string getArchiveIndexCache();
+
+#if defined(MANGO_ENABLE_COROUTINES)
+
+    // Maps a file from the mapper in the ThreadPool; the awaiting coroutine is resumed
+    // in the worker which completed the mapping. The mapper must outlive the operation
+    // and the returned memory (see AbstractMapper::mmap()).
+    inline auto mmapAsync(const Mapper& mapper, const std::string& filename, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        return runAsync([&mapper, filename] () -> std::unique_ptr<VirtualMemory>
+        {
+            AbstractMapper* m = mapper;
+            return std::unique_ptr<VirtualMemory>(m->mmap(filename));
+        }, pool);
+    }
+
+#endif
+
 } // namespace filesystem
 } // namespace mango
@@ -0,0 +1,186 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <memory>
+#include <mango/core/configure.hpp>
+#include <mango/core/object.hpp>
+#include <mango/core/memory.hpp>
+#include <mango/core/buffer.hpp>
+#include <mango/core/stream.hpp>
+#include <mango/core/compress.hpp>
+#include <mango/core/thread.hpp>
+
+namespace mango {
+namespace filesystem {
+
+    // -----------------------------------------------------------------
+    // MGXWriter
+    // -----------------------------------------------------------------
+
+    /*
+        MGXWriter creates .mgx containers which are read with the MGX mapper.
+
+        The file data is stored in blocks which are compressed in parallel in the
+        ThreadPool. Files smaller than small_file are packed together into shared
+        blocks; larger files are split into blocks of block_size (see MGXWriterOptions).
+        A block which does not compress is stored as-is so that a file which occupies
+        one stored block can be mapped directly from the container without a copy.
+
+        The folder entries are generated from the file names; the names use '/' as
+        separator and must not start with one.
+
+        With a dictionary (LZ4 and ZSTD, see trainDictionary()) the blocks can be made
+        small for fast access to small files without losing the compression ratio.
+        The dictionary is stored in the container unless embed_dictionary is false;
+        the container then only references the dictionary by its id and the reader
+        must register it with registerMGXDictionary() before mapping the container.
+
+        Usage example:
+
+        MGXWriterOptions options;
+        options.method = Compressor::ZSTD;
+
+        MGXWriter writer("assets.mgx", options);
+        writer.addFile("textures/wall.jpg", "data/wall.jpg");   // file from disk
+        writer.addFile("config.json", memory);                  // file from memory
+        writer.finalize(); // or let the destructor do it
+
+    */
+
+    struct MGXWriterOptions
+    {
+        Compressor::Method method = Compressor::LZ4;
+        int level = 6;
+        size_t block_size = 1024 * 1024; // maximum uncompressed block size
+        size_t small_file = 64 * 1024;   // files smaller than this are packed into shared blocks
+        ConstMemory dictionary;          // optional, see trainDictionary()
+        bool embed_dictionary = true;
+    };
+
+    class MGXWriter : protected NonCopyable
+    {
+    public:
+        struct Statistics
+        {
+            u64 files = 0;
+            u64 blocks = 0;
+            u64 uncompressed = 0; // bytes
+            u64 compressed = 0;   // bytes, including the stored blocks
+        };
+
+    protected:
+        struct Segment
+        {
+            u32 block;
+            u32 offset;
+            u32 size;
+        };
+
+        struct FileEntry
+        {
+            std::string filename;
+            u64 size;
+            u32 checksum;
+            std::vector<Segment> segments;
+        };
+
+        struct BlockEntry
+        {
+            u64 offset;
+            u64 compressed;
+            u64 uncompressed;
+            u32 method;
+        };
+
+        struct PendingBlock;
+
+        std::shared_ptr<CompressionDictionary> m_dictionary;
+
+        std::unique_ptr<Stream> m_file_stream;
+        Stream& m_stream;
+        u64 m_base; // offset of the container in the stream
+        MGXWriterOptions m_options;
+        Compressor m_compressor;
+        bool m_finalized { false };
+
+        std::vector<FileEntry> m_files;
+        std::set<std::string> m_folders;
+        std::vector<BlockEntry> m_blocks;
+        Statistics m_statistics;
+
+        // blocks which are being compressed; written out in the order they were submitted
+        std::deque<std::unique_ptr<PendingBlock>> m_pending;
+        size_t m_pending_limit;
+        u32 m_block_count { 0 };
+
+        // the shared block small files are packed into; the block index is assigned
+        // when the block is submitted and patched into the files packed into it
+        std::unique_ptr<PendingBlock> m_pack;
+        std::vector<size_t> m_pack_files;
+
+        void initialize();
+        void addFolders(const std::string& filename);
+        u32 submit(std::unique_ptr<PendingBlock> block);
+        void flushPack();
+        void writeOldest();
+        void waitPending();
+
+    public:
+        MGXWriter(const std::string& filename, const MGXWriterOptions& options = MGXWriterOptions());
+        MGXWriter(Stream& stream, const MGXWriterOptions& options = MGXWriterOptions());
+        ~MGXWriter();
+
+        void addFile(const std::string& filename, ConstMemory memory);
+        void addFile(const std::string& filename, const std::string& source);
+        void addFolder(const std::string& foldername);
+
+        void finalize();
+
+        const Statistics& getStatistics() const;
+    };
+
+#ifdef MANGO_ENABLE_ARCHIVE_MGX
+
+    // -----------------------------------------------------------------
+    // MGX block cache
+    // -----------------------------------------------------------------
+
+    /*
+        The MGX mapper caches the decompressed blocks which are shared by small files
+        so that the files in the same block are mapped from one decompressed copy. The
+        cache is shared by all .mgx containers and evicts the least recently used
+        blocks when it is over budget; the mapped files keep their block alive.
+    */
+
+    struct MGXCacheStatistics
+    {
+        u64 hits;
+        u64 misses;
+        u64 evictions;
+        u64 bytes;  // decompressed blocks in the cache
+        u64 budget;
+    };
+
+    void setMGXCacheBudget(size_t bytes); // default: 64 MB
+    MGXCacheStatistics getMGXCacheStatistics();
+
+    // -----------------------------------------------------------------
+    // MGX dictionaries
+    // -----------------------------------------------------------------
+
+    // Dictionaries for the containers which reference a dictionary that is not
+    // stored in the container; the dictionary is identified by its content.
+
+    void registerMGXDictionary(ConstMemory content);
+
+#endif
+
+} // namespace filesystem
+} // namespace mango
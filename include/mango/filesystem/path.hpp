@@ -64,6 +64,59 @@ namespace filesystem {
             updateIndex();
             return m_index[index];
         }
+
+        /*
+            Recursive index of the path, sorted by name. The names are relative to the
+            path ("textures/wall.jpg") and the folders are included ("textures/"). Native
+            directories are scanned in parallel in the ThreadPool; the containers are
+            listed but not descended into.
+
+            Usage example:
+
+            WalkFilter filter;
+            filter.folder = [] (const std::string& folder) { return folder != ".git/"; };
+            filter.file = [] (const std::string& file) { return getExtension(file) == ".jpg"; };
+
+            FileIndex index = Path("assets/").walk(filter);
+        */
+        FileIndex walk(const WalkFilter& filter = WalkFilter()) const;
+
+        /*
+            Maps the files concurrently in the ThreadPool. The compressed files are
+            decompressed in the workers so that extracting a whole archive uses all of
+            the cores. The names are relative to the path (as returned by walk()); the
+            files must not be inside of containers in the path (use File for those).
+
+            The callback is called in the worker as soon as the file is ready and it
+            takes the ownership of the memory. The memory must not outlive the path.
+            The call returns when all of the files have been processed; an exception
+            thrown by the callback does not stop the other files and the first one
+            is rethrown from the call.
+
+            Usage example:
+
+            Path path("comic.cbz/");
+
+            std::vector<std::string> filenames;
+            for (auto& node : path.walk())
+            {
+                if (!node.isDirectory())
+                    filenames.push_back(node.name);
+            }
+
+            path.map(filenames, [] (const std::string& filename, std::unique_ptr<VirtualMemory> memory, const Status& status)
+            {
+                if (status)
+                {
+                    Bitmap bitmap(*memory, getExtension(filename));
+                    ...
+                }
+            });
+        */
+        void map(const std::vector<std::string>& filenames, const AbstractMapper::MapCallback& callback) const;
+
+        // the memory of the files in the same order as the names; the first error is thrown
+        std::vector<std::unique_ptr<VirtualMemory>> map(const std::vector<std::string>& filenames) const;
     };
 
     // filename manipulation functions (example: "foo/bar/readme.txt")
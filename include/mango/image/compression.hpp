@@ -7,6 +7,7 @@
 #include <mango/core/memory.hpp>
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
+#include <mango/core/thread.hpp>
 #include <mango/image/format.hpp>
 #include <mango/image/fourcc.hpp>
 
@@ -241,7 +242,8 @@ namespace mango
         TextureCompressionInfo(opengl::TextureFormat format);
         TextureCompressionInfo(vulkan::TextureFormat format);
 
-        TextureCompressionStatus decompress(const Surface& surface, ConstMemory memory) const;
+        TextureCompressionStatus decompress(const Surface& surface, ConstMemory memory,
+            const CancellationToken& cancellation = CancellationToken()) const;
         TextureCompressionStatus compress(Memory memory, const Surface& surface) const;
 
         CompressionFormat getCompressionFormat() const
@@ -7,6 +7,8 @@
 #include <string>
 #include <mango/core/object.hpp>
 #include <mango/core/exception.hpp>
+#include <mango/core/thread.hpp>
+#include <mango/core/coroutine.hpp>
 #include <mango/image/format.hpp>
 #include <mango/image/compression.hpp>
 #include <mango/image/exif.hpp>
@@ -49,6 +51,10 @@ namespace mango
         // - palette is resolved into the provided palette object
         // - decode() destination surface must be indexed
         Palette* palette = nullptr; // enable indexed decoding by pointing to a palette
+
+        // decoders which support cancellation poll the token and return an error
+        // status when the decoding was cancelled (the image is partially decoded)
+        CancellationToken cancellation;
     };
 
     class ImageDecoderInterface : protected NonCopyable
@@ -57,6 +63,9 @@ namespace mango
         ImageDecoderInterface() = default;
         virtual ~ImageDecoderInterface() = default;
 
+        // ImageDecodeOptions::cancellation of the decode() in progress
+        CancellationToken cancellation;
+
         virtual ImageHeader header() = 0;
         virtual ImageDecodeStatus decode(const Surface& dest, Palette* palette, int level, int depth, int face) = 0;
 
@@ -89,4 +98,37 @@ namespace mango
     void registerImageDecoder(ImageDecoder::CreateDecoderFunc func, const std::string& extension);
     bool isImageDecoder(const std::string& extension);
 
+#if defined(MANGO_ENABLE_COROUTINES)
+
+    /*
+        Decodes the image in the ThreadPool; the awaiting coroutine continues in the worker
+        which completed the decoding. The decoder and the destination surface must outlive
+        the operation. The decoding can be cancelled with ImageDecodeOptions::cancellation.
+
+        Usage example:
+
+        AsyncTask<ImageDecodeStatus> load(std::string filename, Bitmap& bitmap)
+        {
+            std::unique_ptr<File> file = co_await mapFileAsync(filename);
+            ImageDecoder decoder(*file, getExtension(filename));
+            ImageHeader header = decoder.header();
+            bitmap = Bitmap(header.width, header.height, header.format);
+            co_return co_await decodeAsync(decoder, bitmap);
+        }
+
+    */
+
+    inline auto decodeAsync(ImageDecoder& decoder, const Surface& dest,
+                            const ImageDecodeOptions& options = ImageDecodeOptions(),
+                            int level = 0, int depth = 0, int face = 0,
+                            ThreadPool& pool = ThreadPool::getInstance())
+    {
+        return runAsync([&decoder, &dest, options, level, depth, face]
+        {
+            return decoder.decode(dest, options, level, depth, face);
+        }, pool);
+    }
+
+#endif
+
 } // namespace mango
@@ -369,6 +369,10 @@ struct libdeflate_compressor {
 	/* Anything smaller than this we won't bother trying to compress.  */
 	unsigned min_size_to_compress;
 
+	/* mango: the last block ends the stream; cleared for the non-final chunks
+	 * of libdeflate_deflate_compress_chunk()  */
+	bool final_chunk;
+
 	/* Temporary space for Huffman code output  */
 	u32 precode_freqs[DEFLATE_NUM_PRECODE_SYMS];
 	u8 precode_lens[DEFLATE_NUM_PRECODE_SYMS];
@@ -1677,6 +1681,20 @@ deflate_write_uncompressed_block(struct deflate_output_bitstream *os,
 	os->next += len;
 }
 
+/*
+ * mango: end the output of a chunk. A non-final chunk ends with an empty
+ * uncompressed block (like zlib's Z_SYNC_FLUSH) so that the output is byte
+ * aligned and the next chunk can be appended to it.
+ */
+static size_t
+deflate_finish_output(struct libdeflate_compressor *c,
+		      struct deflate_output_bitstream *os)
+{
+	if (!c->final_chunk)
+		deflate_write_uncompressed_block(os, os->begin, 0, false);
+	return deflate_flush_output(os);
+}
+
 static void
 deflate_write_uncompressed_blocks(struct deflate_output_bitstream *os,
 				  const u8 *data, size_t data_length,
@@ -1971,9 +1989,9 @@ deflate_compress_none(struct libdeflate_compressor * restrict c,
 
 	deflate_init_output(&os, out, out_nbytes_avail);
 
-	deflate_write_uncompressed_blocks(&os, in, in_nbytes, true);
+	deflate_write_uncompressed_blocks(&os, in, in_nbytes, c->final_chunk);
 
-	return deflate_flush_output(&os);
+	return deflate_finish_output(c, &os);
 }
 
 /*
@@ -2053,10 +2071,10 @@ deflate_compress_greedy(struct libdeflate_compressor * restrict c,
 		deflate_finish_sequence(next_seq, litrunlen);
 		deflate_flush_block(c, &os, in_block_begin,
 				    (u32)(in_next - in_block_begin),
-				    in_next == in_end, false);
+				    in_next == in_end && c->final_chunk, false);
 	} while (in_next != in_end);
 
-	return deflate_flush_output(&os);
+	return deflate_finish_output(c, &os);
 }
 
 /*
@@ -2200,10 +2218,10 @@ deflate_compress_lazy(struct libdeflate_compressor * restrict c,
 		deflate_finish_sequence(next_seq, litrunlen);
 		deflate_flush_block(c, &os, in_block_begin,
 				    (u32)(in_next - in_block_begin),
-				    in_next == in_end, false);
+				    in_next == in_end && c->final_chunk, false);
 	} while (in_next != in_end);
 
-	return deflate_flush_output(&os);
+	return deflate_finish_output(c, &os);
 }
 
 #if SUPPORT_NEAR_OPTIMAL_PARSING
@@ -2643,10 +2661,10 @@ deflate_compress_near_optimal(struct libdeflate_compressor * restrict c,
 		deflate_optimize_block(c, (u32)(in_next - in_block_begin), cache_ptr,
 				       in_block_begin == in);
 		deflate_flush_block(c, &os, in_block_begin, (u32)(in_next - in_block_begin),
-				    in_next == in_end, true);
+				    in_next == in_end && c->final_chunk, true);
 	} while (in_next != in_end);
 
-	return deflate_flush_output(&os);
+	return deflate_finish_output(c, &os);
 }
 
 #endif /* SUPPORT_NEAR_OPTIMAL_PARSING */
@@ -2715,6 +2733,7 @@ libdeflate_alloc_compressor(int compression_level)
 	 * compress very small inputs.
 	 */
 	c->min_size_to_compress = 56 - (compression_level * 4);
+	c->final_chunk = true;
 
 	switch (compression_level) {
 	case 0:
@@ -2820,13 +2839,29 @@ libdeflate_deflate_compress(struct libdeflate_compressor *c,
 		deflate_init_output(&os, out, out_nbytes_avail);
 		if (in_nbytes == 0)
 			in = &os; /* Avoid passing NULL to memcpy() */
-		deflate_write_uncompressed_block(&os, in, in_nbytes, true);
-		return deflate_flush_output(&os);
+		deflate_write_uncompressed_block(&os, in, in_nbytes, c->final_chunk);
+		return deflate_finish_output(c, &os);
 	}
 
 	return (*c->impl)(c, in, in_nbytes, out, out_nbytes_avail);
 }
 
+LIBDEFLATEEXPORT size_t LIBDEFLATEAPI
+libdeflate_deflate_compress_chunk(struct libdeflate_compressor *c,
+				  const void *in, size_t in_nbytes,
+				  void *out, size_t out_nbytes_avail,
+				  int is_final_chunk)
+{
+	size_t result;
+
+	c->final_chunk = is_final_chunk != 0;
+	result = libdeflate_deflate_compress(c, in, in_nbytes,
+					     out, out_nbytes_avail);
+	c->final_chunk = true;
+
+	return result;
+}
+
 LIBDEFLATEEXPORT void LIBDEFLATEAPI
 libdeflate_free_compressor(struct libdeflate_compressor *c)
 {
@@ -90,6 +90,20 @@ libdeflate_deflate_compress(struct libdeflate_compressor *compressor,
 			    const void *in, size_t in_nbytes,
 			    void *out, size_t out_nbytes_avail);
 
+/*
+ * mango: libdeflate_deflate_compress_chunk() compresses one chunk of a raw
+ * DEFLATE stream which is produced in pieces. The chunks are independent (the
+ * matches do not cross chunk boundaries); a chunk which is not the final one
+ * ends with an empty uncompressed block instead of the final block so that the
+ * outputs of consecutive chunks can be concatenated into one stream. Use
+ * libdeflate_deflate_compress_bound() + 5 for the output size.
+ */
+LIBDEFLATEEXPORT size_t LIBDEFLATEAPI
+libdeflate_deflate_compress_chunk(struct libdeflate_compressor *compressor,
+				  const void *in, size_t in_nbytes,
+				  void *out, size_t out_nbytes_avail,
+				  int is_final_chunk);
+
 /*
  * libdeflate_deflate_compress_bound() returns a worst-case upper bound on the
  * number of bytes of compressed data that may be produced by compressing any
@@ -76,33 +76,60 @@ namespace lz4 {
 		return LZ4_compressBound(s);
     }
 
-    size_t compress(Memory dest, ConstMemory source, int level)
+    // context
+
+    class CompressContextLZ4 : public CompressContext
     {
-        const int source_size = int(source.size);
-        const int dest_size = int(dest.size);
+    protected:
+        // the states are allocated on first use
+        std::vector<u8> m_state;
+        std::vector<u8> m_state_hc;
 
-        size_t written = 0;
+    public:
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            const int source_size = int(source.size);
+            const int dest_size = int(dest.size);
 
-        level = clamp(level, 0, 10);
+            size_t written = 0;
 
-        if (level > 6)
-        {
-            const int compression_level = 1 + (level - 7) * 5;
-            written = LZ4_compress_HC(source.cast<const char>(), dest.cast<char>(), source_size, dest_size, compression_level);
-        }
-        else
-        {
-            const int acceleration = 19 - level * 3;
-            written = LZ4_compress_fast(source.cast<const char>(), dest.cast<char>(), source_size, dest_size, acceleration);
-        }
+            level = clamp(level, 0, 10);
 
-	    if (written <= 0 || written > dest.size)
-        {
-			MANGO_EXCEPTION("[lz4] compression failed.");
-		}
+            if (level > 6)
+            {
+                if (m_state_hc.empty())
+                {
+                    m_state_hc.resize(LZ4_sizeofStateHC());
+                }
 
-        return written;
-	}
+                const int compression_level = 1 + (level - 7) * 5;
+                written = LZ4_compress_HC_extStateHC(m_state_hc.data(), source.cast<const char>(), dest.cast<char>(), source_size, dest_size, compression_level);
+            }
+            else
+            {
+                if (m_state.empty())
+                {
+                    m_state.resize(LZ4_sizeofState());
+                }
+
+                const int acceleration = 19 - level * 3;
+                written = LZ4_compress_fast_extState(m_state.data(), source.cast<const char>(), dest.cast<char>(), source_size, dest_size, acceleration);
+            }
+
+            if (written <= 0 || written > dest.size)
+            {
+                MANGO_EXCEPTION("[lz4] compression failed.");
+            }
+
+            return written;
+        }
+    };
+
+    size_t compress(Memory dest, ConstMemory source, int level)
+    {
+        thread_local CompressContextLZ4 context;
+        return context.compress(dest, source, level);
+    }
 
     size_t decompress(Memory dest, ConstMemory source)
     {
@@ -258,13 +285,13 @@ namespace lzo {
     {
         MANGO_UNREFERENCED(level);
 
-        void* workmem = aligned_malloc(LZO1X_MEM_COMPRESS);
+        // the work memory is allocated once per thread
+        thread_local Buffer workmem(LZO1X_MEM_COMPRESS);
 
         lzo_uint dst_len = (lzo_uint)dest.size;
         int x = lzo1x_1_compress(source.address, lzo_uint(source.size),
-            dest.address, &dst_len, workmem);
+            dest.address, &dst_len, workmem.data());
 
-        aligned_free(workmem);
         if (x != LZO_E_OK)
         {
             MANGO_EXCEPTION("[lzo] compression failed.");
@@ -301,34 +328,82 @@ namespace zstd {
 		return ZSTD_compressBound(size) + turbo;
     }
 
-    size_t compress(Memory dest, ConstMemory source, int level)
+    // context
+
+    class CompressContextZSTD : public CompressContext
     {
-        // zstd compress does not support encoding of empty source
-        if (!source.size)
-            return 0;
+    protected:
+        ZSTD_CCtx* m_context;
 
-        level = clamp(level * 2, 1, 20);
+    public:
+        CompressContextZSTD()
+        {
+            m_context = ZSTD_createCCtx();
+        }
 
-        const size_t x = ZSTD_compress(dest.address, dest.size,
-                                       source.address, source.size, level);
-        if (ZSTD_isError(x))
+        ~CompressContextZSTD()
         {
-            MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+            ZSTD_freeCCtx(m_context);
         }
 
-        return x;
-	}
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            // zstd compress does not support encoding of empty source
+            if (!source.size)
+                return 0;
 
-    size_t decompress(Memory dest, ConstMemory source)
+            level = clamp(level * 2, 1, 20);
+
+            const size_t x = ZSTD_compressCCtx(m_context, dest.address, dest.size,
+                                               source.address, source.size, level);
+            if (ZSTD_isError(x))
+            {
+                MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+            }
+
+            return x;
+        }
+    };
+
+    class DecompressContextZSTD : public DecompressContext
     {
-        size_t x = ZSTD_decompress((void*)dest.address, dest.size,
-                                   source.address, source.size);
-        if (ZSTD_isError(x))
+    protected:
+        ZSTD_DCtx* m_context;
+
+    public:
+        DecompressContextZSTD()
         {
-            MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+            m_context = ZSTD_createDCtx();
         }
 
-        return dest.size;
+        ~DecompressContextZSTD()
+        {
+            ZSTD_freeDCtx(m_context);
+        }
+
+        size_t decompress(Memory dest, ConstMemory source) override
+        {
+            size_t x = ZSTD_decompressDCtx(m_context, dest.address, dest.size,
+                                           source.address, source.size);
+            if (ZSTD_isError(x))
+            {
+                MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+            }
+
+            return dest.size;
+        }
+    };
+
+    size_t compress(Memory dest, ConstMemory source, int level)
+    {
+        thread_local CompressContextZSTD context;
+        return context.compress(dest, source, level);
+	}
+
+    size_t decompress(Memory dest, ConstMemory source)
+    {
+        thread_local DecompressContextZSTD context;
+        return context.decompress(dest, source);
     }
 
     // stream
@@ -549,16 +624,14 @@ namespace lzfse {
     {
         MANGO_UNREFERENCED(level);
 
-        const size_t scratch_size = lzfse_encode_scratch_size();
-        Buffer scratch(scratch_size);
+        thread_local Buffer scratch(lzfse_encode_scratch_size());
         size_t written = lzfse_encode_buffer(dest.address, dest.size, source, source.size, scratch);
         return written;
     }
 
     size_t decompress(Memory dest, ConstMemory source)
     {
-        const size_t scratch_size = lzfse_decode_scratch_size();
-        Buffer scratch(scratch_size);
+        thread_local Buffer scratch(lzfse_decode_scratch_size());
         size_t written = lzfse_decode_buffer(dest.address, dest.size, source, source.size, scratch);
         return written;
     }
@@ -598,68 +671,136 @@ namespace lzma
         return (size * 3) / 2 + 1024 * 16;
     }
 
-    size_t compress(Memory dest, ConstMemory source, int level)
+    // context
+
+    class CompressContextLZMA : public CompressContext
     {
-        CLzmaEncProps props;
-        LzmaEncProps_Init(&props);
+    protected:
+        // the encoder keeps its buffers between calls when the properties do not change
+        CLzmaEncHandle m_encoder;
 
-        level = clamp(level - 1, 0, 9);
+    public:
+        CompressContextLZMA()
+        {
+            m_encoder = LzmaEnc_Create(&g_Alloc);
+        }
 
-        props.level = level; // [0, 9] (default: 5)
-        props.dictSize = 2048 << level; // use (1 << N) or (3 << N). 4 KB < dictSize <= 128 MB
-        props.lc = 3; // [0, 8] (default: 3)
-        props.lp = 0; // [0, 4] (default: 0)
-        props.pb = 2; // [0, 4] (default: 2)
-        props.fb = 32; // [5, 273] (default: 32)
-        props.numThreads = 1;
+        ~CompressContextLZMA()
+        {
+            LzmaEnc_Destroy(m_encoder, &g_Alloc, &g_Alloc);
+        }
 
-        u8* start = dest.address;
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            CLzmaEncProps props;
+            LzmaEncProps_Init(&props);
 
-        // write the 5 byte props header before compressed data
-        u8* props_output = dest.address;
-        SizeT props_output_size = LZMA_PROPS_SIZE;
-        dest.address += LZMA_PROPS_SIZE;
-        dest.size -= LZMA_PROPS_SIZE;
+            level = clamp(level - 1, 0, 9);
 
-        SizeT dest_length = dest.size;
-        SizeT source_length = source.size;
+            props.level = level; // [0, 9] (default: 5)
+            props.dictSize = 2048 << level; // use (1 << N) or (3 << N). 4 KB < dictSize <= 128 MB
+            props.lc = 3; // [0, 8] (default: 3)
+            props.lp = 0; // [0, 4] (default: 0)
+            props.pb = 2; // [0, 4] (default: 2)
+            props.fb = 32; // [5, 273] (default: 32)
+            props.numThreads = 1;
 
-        SRes result = LzmaEncode(
-            dest.address, &dest_length, source.address, source_length,
-            &props, props_output, &props_output_size, 0,
-            nullptr, &g_Alloc, &g_Alloc);
+            u8* start = dest.address;
 
-        const char* error = get_error_string(result);
-        if (error)
-        {
-            MANGO_EXCEPTION("[lzma] %s", error);
-        }
+            SRes result = LzmaEnc_SetProps(m_encoder, &props);
 
-        size_t bytes_written = dest.address + dest_length - start;
-        return bytes_written;
-    }
+            // write the 5 byte props header before compressed data
+            SizeT props_output_size = LZMA_PROPS_SIZE;
+            if (result == SZ_OK)
+            {
+                result = LzmaEnc_WriteProperties(m_encoder, dest.address, &props_output_size);
+            }
 
-    size_t decompress(Memory dest, ConstMemory source)
+            dest.address += LZMA_PROPS_SIZE;
+            dest.size -= LZMA_PROPS_SIZE;
+
+            SizeT dest_length = dest.size;
+            SizeT source_length = source.size;
+
+            if (result == SZ_OK)
+            {
+                result = LzmaEnc_MemEncode(m_encoder, dest.address, &dest_length,
+                    source.address, source_length, 0, nullptr, &g_Alloc, &g_Alloc);
+            }
+
+            const char* error = get_error_string(result);
+            if (error)
+            {
+                MANGO_EXCEPTION("[lzma] %s", error);
+            }
+
+            size_t bytes_written = dest.address + dest_length - start;
+            return bytes_written;
+        }
+    };
+
+    class DecompressContextLZMA : public DecompressContext
     {
-        // read props header
-        const u8* prop = source.address;
-        source.address += LZMA_PROPS_SIZE;
-        source.size -= LZMA_PROPS_SIZE;
+    protected:
+        // the probability tables are reused when the properties do not change
+        CLzmaDec m_decoder;
 
-        SizeT destLen = dest.size;
-        SizeT srcLen = source.size;
+    public:
+        DecompressContextLZMA()
+        {
+            LzmaDec_Construct(&m_decoder);
+        }
 
-        ELzmaStatus status;
-        SRes result = LzmaDecode(dest.address, &destLen, source.address, &srcLen,
-            prop, LZMA_PROPS_SIZE, LZMA_FINISH_ANY, &status, &g_Alloc);
+        ~DecompressContextLZMA()
+        {
+            LzmaDec_FreeProbs(&m_decoder, &g_Alloc);
+        }
 
-        const char* error = get_error_string(result);
-        if (error)
+        size_t decompress(Memory dest, ConstMemory source) override
         {
-            MANGO_EXCEPTION("[lzma] %s", error);
+            // read props header
+            const u8* prop = source.address;
+            source.address += LZMA_PROPS_SIZE;
+            source.size -= LZMA_PROPS_SIZE;
+
+            SRes result = LzmaDec_AllocateProbs(&m_decoder, prop, LZMA_PROPS_SIZE, &g_Alloc);
+            if (result == SZ_OK)
+            {
+                // decode directly into the destination (same as LzmaDecode)
+                m_decoder.dic = dest.address;
+                m_decoder.dicBufSize = dest.size;
+                LzmaDec_Init(&m_decoder);
+
+                SizeT srcLen = source.size;
+                ELzmaStatus status;
+                result = LzmaDec_DecodeToDic(&m_decoder, dest.size, source.address, &srcLen,
+                    LZMA_FINISH_ANY, &status);
+                if (result == SZ_OK && status == LZMA_STATUS_NEEDS_MORE_INPUT)
+                {
+                    result = SZ_ERROR_INPUT_EOF;
+                }
+            }
+
+            const char* error = get_error_string(result);
+            if (error)
+            {
+                MANGO_EXCEPTION("[lzma] %s", error);
+            }
+
+            return dest.size;
         }
+    };
 
-        return dest.size;
+    size_t compress(Memory dest, ConstMemory source, int level)
+    {
+        thread_local CompressContextLZMA context;
+        return context.compress(dest, source, level);
+    }
+
+    size_t decompress(Memory dest, ConstMemory source)
+    {
+        thread_local DecompressContextLZMA context;
+        return context.decompress(dest, source);
     }
 
 } // namespace lzma
@@ -918,33 +1059,122 @@ namespace deflate {
         return libdeflate_deflate_compress_bound(nullptr, size);
     }
 
-    size_t compress(Memory dest, ConstMemory source, int level)
+    using CompressFunc = size_t (*)(libdeflate_compressor*, const void*, size_t, void*, size_t);
+    using DecompressFunc = libdeflate_result (*)(libdeflate_decompressor*, const void*, size_t, void*, size_t, size_t*);
+
+    // libdeflate state shared by the deflate, zlib and gzip formats
+    struct DeflateState
     {
-        level = clamp(level, 1, 10);
-        if (level >= 8) level = (level * 12) / 10;
+        // compressors are allocated on first use for each level
+        libdeflate_compressor* compressors[13] = { nullptr };
+        libdeflate_decompressor* decompressor = nullptr;
+
+        ~DeflateState()
+        {
+            for (libdeflate_compressor* compressor : compressors)
+            {
+                libdeflate_free_compressor(compressor);
+            }
+
+            libdeflate_free_decompressor(decompressor);
+        }
+
+        size_t compress(CompressFunc func, Memory dest, ConstMemory source, int level)
+        {
+            level = clamp(level, 1, 10);
+            if (level >= 8) level = (level * 12) / 10;
+
+            libdeflate_compressor*& compressor = compressors[level];
+            if (!compressor)
+            {
+                compressor = libdeflate_alloc_compressor(level);
+                if (!compressor)
+                {
+                    MANGO_EXCEPTION("[deflate] compressor allocation failed.");
+                }
+            }
+
+            return func(compressor, source, source.size, dest, dest.size);
+        }
+
+        size_t decompress(DecompressFunc func, const char* name, Memory dest, ConstMemory source)
+        {
+            if (!decompressor)
+            {
+                decompressor = libdeflate_alloc_decompressor();
+                if (!decompressor)
+                {
+                    MANGO_EXCEPTION("[%s] decompressor allocation failed.", name);
+                }
+            }
+
+            size_t bytes_out = 0;
+            libdeflate_result result = func(decompressor, source, source.size, dest, dest.size, &bytes_out);
 
-        libdeflate_compressor* compressor = libdeflate_alloc_compressor(level);
-        size_t bytes_out = libdeflate_deflate_compress(compressor, source, source.size, dest, dest.size);
-        libdeflate_free_compressor(compressor);
+            const char* error = deflate::get_error_string(result);
+            if (error)
+            {
+                MANGO_EXCEPTION("[%s] %s.", name, error);
+            }
+
+            return bytes_out;
+        }
+    };
 
-        return bytes_out;
+    DeflateState& getThreadState()
+    {
+        thread_local DeflateState state;
+        return state;
     }
 
-    size_t decompress(Memory dest, ConstMemory source)
+    // context
+
+    class CompressContextDeflate : public CompressContext
     {
-        libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
+    protected:
+        DeflateState m_state;
+        CompressFunc m_func;
 
-        size_t bytes_out = 0;
-        libdeflate_result result = libdeflate_deflate_decompress(decompressor, source, source.size, dest, dest.size, &bytes_out);
-        libdeflate_free_decompressor(decompressor);
+    public:
+        CompressContextDeflate(CompressFunc func)
+            : m_func(func)
+        {
+        }
 
-        const char* error = deflate::get_error_string(result);
-        if (error)
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            return m_state.compress(m_func, dest, source, level);
+        }
+    };
+
+    class DecompressContextDeflate : public DecompressContext
+    {
+    protected:
+        DeflateState m_state;
+        DecompressFunc m_func;
+        const char* m_name;
+
+    public:
+        DecompressContextDeflate(DecompressFunc func, const char* name)
+            : m_func(func)
+            , m_name(name)
+        {
+        }
+
+        size_t decompress(Memory dest, ConstMemory source) override
         {
-            MANGO_EXCEPTION("[deflate] %s.", error);
+            return m_state.decompress(m_func, m_name, dest, source);
         }
+    };
+
+    size_t compress(Memory dest, ConstMemory source, int level)
+    {
+        return getThreadState().compress(libdeflate_deflate_compress, dest, source, level);
+    }
 
-        return bytes_out;
+    size_t decompress(Memory dest, ConstMemory source)
+    {
+        return getThreadState().decompress(libdeflate_deflate_decompress, "deflate", dest, source);
     }
 
 } // namespace deflate
@@ -962,31 +1192,12 @@ namespace zlib {
 
     size_t compress(Memory dest, ConstMemory source, int level)
     {
-        level = clamp(level, 1, 10);
-        if (level >= 8) level = (level * 12) / 10;
-
-        libdeflate_compressor* compressor = libdeflate_alloc_compressor(level);
-        size_t bytes_out = libdeflate_zlib_compress(compressor, source, source.size, dest, dest.size);
-        libdeflate_free_compressor(compressor);
-
-        return bytes_out;
+        return deflate::getThreadState().compress(libdeflate_zlib_compress, dest, source, level);
     }
 
     size_t decompress(Memory dest, ConstMemory source)
     {
-        libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
-
-        size_t bytes_out = 0;
-        libdeflate_result result = libdeflate_zlib_decompress(decompressor, source, source.size, dest, dest.size, &bytes_out);
-        libdeflate_free_decompressor(decompressor);
-
-        const char* error = deflate::get_error_string(result);
-        if (error)
-        {
-            MANGO_EXCEPTION("[zlib] %s.", error);
-        }
-
-        return bytes_out;
+        return deflate::getThreadState().decompress(libdeflate_zlib_decompress, "zlib", dest, source);
     }
 
 } // namespace zlib
@@ -1004,31 +1215,12 @@ namespace gzip {
 
     size_t compress(Memory dest, ConstMemory source, int level)
     {
-        level = clamp(level, 1, 10);
-        if (level >= 8) level = (level * 12) / 10;
-
-        libdeflate_compressor* compressor = libdeflate_alloc_compressor(level);
-        size_t bytes_out = libdeflate_gzip_compress(compressor, source, source.size, dest, dest.size);
-        libdeflate_free_compressor(compressor);
-
-        return bytes_out;
+        return deflate::getThreadState().compress(libdeflate_gzip_compress, dest, source, level);
     }
 
     size_t decompress(Memory dest, ConstMemory source)
     {
-        libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
-
-        size_t bytes_out = 0;
-        libdeflate_result result = libdeflate_gzip_decompress(decompressor, source, source.size, dest, dest.size, &bytes_out);
-        libdeflate_free_decompressor(decompressor);
-
-        const char* error = deflate::get_error_string(result);
-        if (error)
-        {
-            MANGO_EXCEPTION("[gzip] %s.", error);
-        }
-
-        return bytes_out;
+        return deflate::getThreadState().decompress(libdeflate_gzip_decompress, "gzip", dest, source);
     }
 
 } // namespace gzip
@@ -1079,4 +1271,109 @@ namespace gzip {
         return compressor;
     }
 
+    // ----------------------------------------------------------------------------
+    // compression context
+    // ----------------------------------------------------------------------------
+
+    // methods without reusable state call the memory block functions
+
+    class CompressContextGeneric : public CompressContext
+    {
+    protected:
+        Compressor m_compressor;
+
+    public:
+        CompressContextGeneric(Compressor::Method method)
+            : m_compressor(getCompressor(method))
+        {
+        }
+
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            return m_compressor.compress(dest, source, level);
+        }
+    };
+
+    class DecompressContextGeneric : public DecompressContext
+    {
+    protected:
+        Compressor m_compressor;
+
+    public:
+        DecompressContextGeneric(Compressor::Method method)
+            : m_compressor(getCompressor(method))
+        {
+        }
+
+        size_t decompress(Memory dest, ConstMemory source) override
+        {
+            return m_compressor.decompress(dest, source);
+        }
+    };
+
+    SharedObject<CompressContext> createCompressContext(Compressor::Method method)
+    {
+        CompressContext* context = nullptr;
+
+        switch (method)
+        {
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            case Compressor::LZ4:
+                context = new lz4::CompressContextLZ4();
+                break;
+            case Compressor::ZSTD:
+                context = new zstd::CompressContextZSTD();
+                break;
+#endif
+            case Compressor::LZMA:
+                context = new lzma::CompressContextLZMA();
+                break;
+            case Compressor::DEFLATE:
+                context = new deflate::CompressContextDeflate(libdeflate_deflate_compress);
+                break;
+            case Compressor::ZLIB:
+                context = new deflate::CompressContextDeflate(libdeflate_zlib_compress);
+                break;
+            case Compressor::GZIP:
+                context = new deflate::CompressContextDeflate(libdeflate_gzip_compress);
+                break;
+            default:
+                context = new CompressContextGeneric(method);
+                break;
+        }
+
+        return context;
+    }
+
+    SharedObject<DecompressContext> createDecompressContext(Compressor::Method method)
+    {
+        DecompressContext* context = nullptr;
+
+        switch (method)
+        {
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            case Compressor::ZSTD:
+                context = new zstd::DecompressContextZSTD();
+                break;
+#endif
+            case Compressor::LZMA:
+                context = new lzma::DecompressContextLZMA();
+                break;
+            case Compressor::DEFLATE:
+                context = new deflate::DecompressContextDeflate(libdeflate_deflate_decompress, "deflate");
+                break;
+            case Compressor::ZLIB:
+                context = new deflate::DecompressContextDeflate(libdeflate_zlib_decompress, "zlib");
+                break;
+            case Compressor::GZIP:
+                context = new deflate::DecompressContextDeflate(libdeflate_gzip_decompress, "gzip");
+                break;
+            default:
+                context = new DecompressContextGeneric(method);
+                break;
+        }
+
+        return context;
+    }
+
 } // namespace mango
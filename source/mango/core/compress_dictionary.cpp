@@ -0,0 +1,518 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <mutex>
+#include <mango/core/compress.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/buffer.hpp>
+#include <mango/core/endian.hpp>
+#include <mango/core/hash.hpp>
+#include <mango/math/math.hpp>
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+#define LZ4_STATIC_LINKING_ONLY
+#define LZ4_HC_STATIC_LINKING_ONLY
+#include "../../external/lz4/lz4.h"
+#include "../../external/lz4/lz4hc.h"
+#include "../../external/zstd/zstd.h"
+#endif
+
+namespace
+{
+    using namespace mango;
+
+    // ----------------------------------------------------------------------------
+    // dictionary training
+    // ----------------------------------------------------------------------------
+
+    /*
+        Simplified version of the COVER algorithm (Liao, Petri, Moffat, Wirth:
+        "Effective Construction of Relative Lempel-Ziv Dictionaries"). Every 8 byte
+        sequence (d-mer) is scored by the number of samples it occurs in. The samples
+        are divided into epochs; the segment with the highest total score of distinct
+        d-mers is selected from each epoch and the scores of the selected d-mers are
+        cleared so that the content is not selected again. The segments are placed
+        from the end of the dictionary, which is closest to the compressed data.
+    */
+
+    constexpr size_t dmer_size = 8;
+    constexpr u32 dmer_bits = 20;
+
+    inline u32 dmer_hash(const u8* p)
+    {
+        return u32((uload64le(p) * 0xcf1bbcdcb7a56463ull) >> (64 - dmer_bits));
+    }
+
+    struct Trainer
+    {
+        std::vector<u8> corpus;
+        std::vector<u32> frequency;
+        std::vector<u16> active;
+
+        Trainer(const std::vector<ConstMemory>& samples)
+            : frequency(1u << dmer_bits, 0)
+            , active(1u << dmer_bits, 0)
+        {
+            // number of samples each d-mer occurs in
+            std::vector<u32> last(1u << dmer_bits, 0);
+
+            for (size_t i = 0; i < samples.size(); ++i)
+            {
+                const ConstMemory& sample = samples[i];
+                const u32 index = u32(i + 1);
+
+                for (size_t j = 0; j + dmer_size <= sample.size; ++j)
+                {
+                    const u32 h = dmer_hash(sample.address + j);
+                    if (last[h] != index)
+                    {
+                        last[h] = index;
+                        ++frequency[h];
+                    }
+                }
+
+                corpus.insert(corpus.end(), sample.address, sample.address + sample.size);
+            }
+        }
+
+        u32 score(u32 h) const
+        {
+            // the d-mers which occur in only one sample do not help other samples
+            return frequency[h] > 1 ? frequency[h] : 0;
+        }
+
+        // select the best segment in [begin, end); returns false if nothing is worth selecting
+        bool select(size_t begin, size_t end, size_t segment_size, size_t& first, size_t& last)
+        {
+            const size_t window = segment_size - dmer_size + 1; // d-mers in a segment
+            const u8* data = corpus.data();
+
+            u64 current = 0;
+            u64 best = 0;
+            size_t best_start = begin;
+
+            for (size_t i = begin; i + dmer_size <= end; ++i)
+            {
+                const u32 h = dmer_hash(data + i);
+                if (!active[h]++)
+                {
+                    current += score(h);
+                }
+
+                if (i - begin >= window)
+                {
+                    const u32 x = dmer_hash(data + i - window);
+                    if (!--active[x])
+                    {
+                        current -= score(x);
+                    }
+                }
+
+                if (current > best)
+                {
+                    best = current;
+                    best_start = i + 1 > window ? std::max(begin, i + 1 - window) : begin;
+                }
+            }
+
+            // clear the window counters
+            for (size_t i = begin; i + dmer_size <= end; ++i)
+            {
+                active[dmer_hash(data + i)] = 0;
+            }
+
+            if (!best)
+            {
+                return false;
+            }
+
+            // trim the d-mers which do not score from the ends of the segment
+            const size_t best_end = std::min(best_start + window, end - dmer_size + 1);
+
+            first = best_start;
+            while (first < best_end && !score(dmer_hash(data + first)))
+            {
+                ++first;
+            }
+
+            size_t tail = best_end;
+            while (tail > first && !score(dmer_hash(data + tail - 1)))
+            {
+                --tail;
+            }
+
+            // the selected content is not selected again
+            for (size_t i = first; i < tail; ++i)
+            {
+                frequency[dmer_hash(data + i)] = 0;
+            }
+
+            last = tail - 1 + dmer_size;
+            return true;
+        }
+    };
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    // ----------------------------------------------------------------------------
+    // lz4
+    // ----------------------------------------------------------------------------
+
+    // working streams; one per thread shared by all dictionaries
+    struct ContextLZ4
+    {
+        LZ4_stream_t* stream = nullptr;
+        LZ4_streamHC_t* stream_hc = nullptr;
+
+        ~ContextLZ4()
+        {
+            LZ4_freeStream(stream);
+            LZ4_freeStreamHC(stream_hc);
+        }
+    };
+
+    ContextLZ4& getContextLZ4()
+    {
+        thread_local ContextLZ4 context;
+        return context;
+    }
+
+    class DictionaryLZ4 : public CompressionDictionary
+    {
+    protected:
+        // the dictionary streams are read-only after they are loaded
+        LZ4_stream_t* m_stream = nullptr;
+        LZ4_streamHC_t* m_stream_hc = nullptr;
+        int m_acceleration = 1;
+        int m_compression_level = 0;
+
+    public:
+        DictionaryLZ4(ConstMemory content, int level)
+            : CompressionDictionary(content)
+        {
+            const char* dictionary = m_content.data() ? reinterpret_cast<const char*>(m_content.data()) : "";
+            const int size = int(m_content.size());
+
+            // same parameters as lz4::compress()
+            level = clamp(level, 0, 10);
+
+            if (level > 6)
+            {
+                m_compression_level = 1 + (level - 7) * 5;
+                m_stream_hc = LZ4_createStreamHC();
+                LZ4_resetStreamHC_fast(m_stream_hc, m_compression_level);
+                LZ4_loadDictHC(m_stream_hc, dictionary, size);
+            }
+            else
+            {
+                m_acceleration = 19 - level * 3;
+                m_stream = LZ4_createStream();
+                LZ4_loadDict(m_stream, dictionary, size);
+            }
+        }
+
+        ~DictionaryLZ4()
+        {
+            LZ4_freeStream(m_stream);
+            LZ4_freeStreamHC(m_stream_hc);
+        }
+
+        size_t compress(Memory dest, ConstMemory source) const override
+        {
+            ContextLZ4& context = getContextLZ4();
+
+            const char* src = source.cast<const char>();
+            char* dst = dest.cast<char>();
+            int written = 0;
+
+            if (m_stream_hc)
+            {
+                if (!context.stream_hc)
+                {
+                    context.stream_hc = LZ4_createStreamHC();
+                }
+
+                LZ4_resetStreamHC_fast(context.stream_hc, m_compression_level);
+                LZ4_attach_HC_dictionary(context.stream_hc, m_stream_hc);
+                written = LZ4_compress_HC_continue(context.stream_hc, src, dst, int(source.size), int(dest.size));
+            }
+            else
+            {
+                if (!context.stream)
+                {
+                    context.stream = LZ4_createStream();
+                }
+
+                LZ4_resetStream_fast(context.stream);
+                LZ4_attach_dictionary(context.stream, m_stream);
+                written = LZ4_compress_fast_continue(context.stream, src, dst, int(source.size), int(dest.size), m_acceleration);
+            }
+
+            if (written <= 0)
+            {
+                MANGO_EXCEPTION("[lz4] compression failed.");
+            }
+
+            return size_t(written);
+        }
+
+        size_t decompress(Memory dest, ConstMemory source) const override
+        {
+            int status = LZ4_decompress_safe_usingDict(source.cast<const char>(), dest.cast<char>(),
+                int(source.size), int(dest.size),
+                reinterpret_cast<const char*>(m_content.data()), int(m_content.size()));
+            if (status < 0)
+            {
+                MANGO_EXCEPTION("[lz4] decompression failed.");
+            }
+
+            return dest.size;
+        }
+    };
+
+    // ----------------------------------------------------------------------------
+    // zstd
+    // ----------------------------------------------------------------------------
+
+    struct ContextZSTD
+    {
+        ZSTD_CCtx* compressor = nullptr;
+        ZSTD_DCtx* decompressor = nullptr;
+
+        ~ContextZSTD()
+        {
+            ZSTD_freeCCtx(compressor);
+            ZSTD_freeDCtx(decompressor);
+        }
+    };
+
+    ContextZSTD& getContextZSTD()
+    {
+        thread_local ContextZSTD context;
+        return context;
+    }
+
+    class DictionaryZSTD : public CompressionDictionary
+    {
+    protected:
+        // digested on first use; a decompressing reader never needs the compression state
+        int m_level;
+        mutable std::once_flag m_cdict_once;
+        mutable std::once_flag m_ddict_once;
+        mutable ZSTD_CDict* m_cdict = nullptr;
+        mutable ZSTD_DDict* m_ddict = nullptr;
+
+    public:
+        DictionaryZSTD(ConstMemory content, int level)
+            : CompressionDictionary(content)
+        {
+            // same parameters as zstd::compress()
+            m_level = clamp(level * 2, 1, 20);
+        }
+
+        ~DictionaryZSTD()
+        {
+            ZSTD_freeCDict(m_cdict);
+            ZSTD_freeDDict(m_ddict);
+        }
+
+        size_t compress(Memory dest, ConstMemory source) const override
+        {
+            // zstd compress does not support encoding of empty source
+            if (!source.size)
+                return 0;
+
+            std::call_once(m_cdict_once, [this]
+            {
+                // an exception leaves the flag unset so the next call tries again
+                m_cdict = ZSTD_createCDict(m_content.data(), m_content.size(), m_level);
+                if (!m_cdict)
+                {
+                    MANGO_EXCEPTION("[zstd] Creating the compression dictionary failed.");
+                }
+            });
+
+            ContextZSTD& context = getContextZSTD();
+            if (!context.compressor)
+            {
+                context.compressor = ZSTD_createCCtx();
+            }
+
+            const size_t x = ZSTD_compress_usingCDict(context.compressor, dest.address, dest.size,
+                                                      source.address, source.size, m_cdict);
+            if (ZSTD_isError(x))
+            {
+                MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+            }
+
+            return x;
+        }
+
+        size_t decompress(Memory dest, ConstMemory source) const override
+        {
+            std::call_once(m_ddict_once, [this]
+            {
+                m_ddict = ZSTD_createDDict(m_content.data(), m_content.size());
+                if (!m_ddict)
+                {
+                    MANGO_EXCEPTION("[zstd] Creating the decompression dictionary failed.");
+                }
+            });
+
+            ContextZSTD& context = getContextZSTD();
+            if (!context.decompressor)
+            {
+                context.decompressor = ZSTD_createDCtx();
+            }
+
+            const size_t x = ZSTD_decompress_usingDDict(context.decompressor, dest.address, dest.size,
+                                                        source.address, source.size, m_ddict);
+            if (ZSTD_isError(x))
+            {
+                MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+            }
+
+            return dest.size;
+        }
+    };
+
+#endif // MANGO_ENABLE_LICENSE_BSD
+
+} // namespace
+
+namespace mango
+{
+
+    // ----------------------------------------------------------------------------
+    // trainDictionary()
+    // ----------------------------------------------------------------------------
+
+    std::vector<u8> trainDictionary(const std::vector<ConstMemory>& samples, size_t size)
+    {
+        size_t total = 0;
+        for (const ConstMemory& sample : samples)
+        {
+            total += sample.size;
+        }
+
+        std::vector<u8> dictionary;
+
+        if (total <= size)
+        {
+            // everything fits; the dictionary is the samples
+            for (const ConstMemory& sample : samples)
+            {
+                dictionary.insert(dictionary.end(), sample.address, sample.address + sample.size);
+            }
+
+            return dictionary;
+        }
+
+        Trainer trainer(samples);
+        const u8* corpus = trainer.corpus.data();
+
+        const size_t segment_size = clamp(size / 16, size_t(64), size_t(1024));
+        const size_t segments = std::max(size_t(1), size / segment_size);
+        const size_t epoch_size = std::max(segment_size, total / segments);
+
+        // the dictionary is filled from the end
+        dictionary.resize(size);
+        size_t tail = size;
+
+        for (size_t begin = 0; begin < total && tail > 0; begin += epoch_size)
+        {
+            const size_t end = std::min(begin + epoch_size, total);
+
+            size_t first;
+            size_t last;
+
+            if (trainer.select(begin, end, segment_size, first, last))
+            {
+                const size_t bytes = std::min(last - first, tail);
+                tail -= bytes;
+                std::memcpy(dictionary.data() + tail, corpus + last - bytes, bytes);
+            }
+        }
+
+        if (tail == size)
+        {
+            // the samples have nothing in common; use the most recent content
+            dictionary.assign(corpus + total - size, corpus + total);
+        }
+        else
+        {
+            dictionary.erase(dictionary.begin(), dictionary.begin() + tail);
+        }
+
+        return dictionary;
+    }
+
+    // ----------------------------------------------------------------------------
+    // CompressionDictionary
+    // ----------------------------------------------------------------------------
+
+    CompressionDictionary::CompressionDictionary(ConstMemory content)
+        : m_content(content)
+        , m_id(getDictionaryID(content))
+    {
+    }
+
+    CompressionDictionary::~CompressionDictionary()
+    {
+    }
+
+    ConstMemory CompressionDictionary::content() const
+    {
+        return m_content;
+    }
+
+    u32 CompressionDictionary::id() const
+    {
+        return m_id;
+    }
+
+    u32 getDictionaryID(ConstMemory content)
+    {
+        return xxhash32(0, content);
+    }
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    namespace lz4
+    {
+        SharedObject<CompressionDictionary> createDictionary(ConstMemory content, int level)
+        {
+            CompressionDictionary* dictionary = new DictionaryLZ4(content, level);
+            return dictionary;
+        }
+    }
+
+    namespace zstd
+    {
+        SharedObject<CompressionDictionary> createDictionary(ConstMemory content, int level)
+        {
+            CompressionDictionary* dictionary = new DictionaryZSTD(content, level);
+            return dictionary;
+        }
+    }
+
+#endif
+
+    SharedObject<CompressionDictionary> createDictionary(Compressor::Method method, ConstMemory content, int level)
+    {
+        switch (method)
+        {
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            case Compressor::LZ4:
+                return lz4::createDictionary(content, level);
+            case Compressor::ZSTD:
+                return zstd::createDictionary(content, level);
+#endif
+            default:
+                MANGO_EXCEPTION("[CompressionDictionary] Unsupported compression method (%d).", int(method));
+        }
+    }
+
+} // namespace mango
@@ -0,0 +1,476 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <mango/core/compress.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/buffer.hpp>
+#include <mango/core/crc32.hpp>
+#include <mango/core/pointer.hpp>
+#include <mango/core/thread.hpp>
+
+/*
+    Frame layout (little endian):
+
+    header:  "mgf0", version, method, block size
+    blocks:  compressed or stored blocks
+    index:   per block: u64 offset, u32 compressed size, u32 uncompressed size,
+             u32 crc32c of the uncompressed data, u32 flags
+    trailer: u64 uncompressed size, u64 block count, u64 index offset,
+             u32 crc32c of the index, "mgf1"
+
+    The offsets are relative to the start of the frame. Every block except the last
+    one holds exactly block size bytes of uncompressed data.
+*/
+
+namespace
+{
+    using namespace mango;
+
+    constexpr u32 frame_version = 1;
+    constexpr size_t frame_header_size = 16;
+    constexpr size_t frame_entry_size = 24;
+    constexpr size_t frame_trailer_size = 32;
+
+    constexpr u32 frame_flag_stored = 1;
+
+} // namespace
+
+namespace mango
+{
+
+    // -----------------------------------------------------------------
+    // FrameCompressor
+    // -----------------------------------------------------------------
+
+    struct FrameCompressor::PendingBlock
+    {
+        Buffer input;
+        Buffer output;
+        size_t compressed = 0;
+        u32 checksum = 0;
+        u32 flags = frame_flag_stored;
+        std::unique_ptr<FutureTask<void>> task;
+
+        ConstMemory data() const
+        {
+            return (flags & frame_flag_stored) ? ConstMemory(input) : ConstMemory(output.data(), compressed);
+        }
+    };
+
+    FrameCompressor::FrameCompressor(Stream& stream, const FrameOptions& options)
+        : m_stream(stream)
+        , m_base(stream.offset())
+        , m_options(options)
+    {
+        if (u32(m_options.method) > u32(Compressor::GZIP))
+        {
+            MANGO_EXCEPTION("[FrameCompressor] Incorrect compression method (%d).", int(m_options.method));
+        }
+
+        m_options.block_size = std::max(m_options.block_size, size_t(4096));
+        m_options.block_size = std::min(m_options.block_size, size_t(0x40000000));
+
+        m_compressor = getCompressor(m_options.method);
+        m_pending_limit = std::max(ThreadPool::getHardwareConcurrency() * 2, 4);
+
+        LittleEndianStream s = m_stream;
+        s.write32(u32_mask('m', 'g', 'f', '0'));
+        s.write32(frame_version);
+        s.write32(u32(m_options.method));
+        s.write32(u32(m_options.block_size));
+    }
+
+    FrameCompressor::~FrameCompressor()
+    {
+        if (!m_finalized)
+        {
+            try
+            {
+                finalize();
+            }
+            catch (...)
+            {
+                // NOTE: call finalize() explicitly to see the errors
+            }
+        }
+
+        // the tasks reference the blocks; they must complete before the blocks are released
+        for (auto& block : m_pending)
+        {
+            if (block->task)
+            {
+                block->task->wait();
+            }
+        }
+    }
+
+    void FrameCompressor::submit()
+    {
+        PendingBlock* ptr = m_current.get();
+        const Compressor& compressor = m_compressor;
+        const int level = m_options.level;
+
+        ptr->task.reset(new FutureTask<void>([ptr, &compressor, level]
+        {
+            const size_t size = ptr->input.size();
+            ptr->checksum = crc32c(0, ptr->input);
+
+            if (compressor.method != Compressor::NONE)
+            {
+                ptr->output.resize(compressor.bound(size));
+
+                size_t bytes = compressor.compress(ptr->output, ptr->input, level);
+                if (bytes > 0 && bytes < size)
+                {
+                    ptr->compressed = bytes;
+                    ptr->flags = 0;
+                }
+                else
+                {
+                    // incompressible; the block is stored
+                    ptr->output.reset();
+                }
+            }
+        }));
+
+        m_pending.push_back(std::move(m_current));
+
+        while (m_pending.size() > m_pending_limit)
+        {
+            writeOldest();
+        }
+    }
+
+    void FrameCompressor::writeOldest()
+    {
+        std::unique_ptr<PendingBlock> block = std::move(m_pending.front());
+        m_pending.pop_front();
+
+        // re-throws if the compressor failed
+        block->task->get();
+
+        ConstMemory data = block->data();
+
+        BlockEntry entry;
+        entry.offset = m_stream.offset() - m_base;
+        entry.compressed = u32(data.size);
+        entry.uncompressed = u32(block->input.size());
+        entry.checksum = block->checksum;
+        entry.flags = block->flags;
+        m_blocks.push_back(entry);
+
+        m_stream.write(data);
+    }
+
+    void FrameCompressor::write(ConstMemory memory)
+    {
+        if (m_finalized)
+        {
+            MANGO_EXCEPTION("[FrameCompressor] The frame has been finalized.");
+        }
+
+        m_size += memory.size;
+
+        while (memory.size > 0)
+        {
+            if (!m_current)
+            {
+                m_current.reset(new PendingBlock());
+                m_current->input.reserve(m_options.block_size);
+            }
+
+            const size_t bytes = std::min(memory.size, m_options.block_size - m_current->input.size());
+            m_current->input.append(memory.address, bytes);
+
+            memory.address += bytes;
+            memory.size -= bytes;
+
+            if (m_current->input.size() == m_options.block_size)
+            {
+                submit();
+            }
+        }
+    }
+
+    void FrameCompressor::finalize()
+    {
+        if (m_finalized)
+        {
+            MANGO_EXCEPTION("[FrameCompressor] The frame has already been finalized.");
+        }
+
+        m_finalized = true;
+
+        if (m_current)
+        {
+            submit();
+        }
+
+        while (!m_pending.empty())
+        {
+            writeOldest();
+        }
+
+        const u64 index_offset = m_stream.offset() - m_base;
+
+        Buffer index(m_blocks.size() * frame_entry_size);
+        LittleEndianPointer p = index.data();
+
+        for (const BlockEntry& block : m_blocks)
+        {
+            p.write64(block.offset);
+            p.write32(block.compressed);
+            p.write32(block.uncompressed);
+            p.write32(block.checksum);
+            p.write32(block.flags);
+        }
+
+        m_stream.write(index);
+
+        LittleEndianStream s = m_stream;
+        s.write64(m_size);
+        s.write64(m_blocks.size());
+        s.write64(index_offset);
+        s.write32(crc32c(0, index));
+        s.write32(u32_mask('m', 'g', 'f', '1'));
+    }
+
+    void FrameCompressor::compress(Stream& stream, ConstMemory memory, const FrameOptions& options)
+    {
+        FrameCompressor compressor(stream, options);
+        compressor.write(memory);
+        compressor.finalize();
+    }
+
+    // -----------------------------------------------------------------
+    // FrameDecompressor
+    // -----------------------------------------------------------------
+
+    FrameDecompressor::FrameDecompressor(ConstMemory memory)
+        : m_memory(memory)
+    {
+        if (memory.size < frame_header_size + frame_trailer_size)
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Incorrect frame size.");
+        }
+
+        LittleEndianConstPointer p = memory.address;
+
+        u32 magic0 = p.read32();
+        u32 version = p.read32();
+        u32 method = p.read32();
+        u32 block_size = p.read32();
+
+        if (magic0 != u32_mask('m', 'g', 'f', '0'))
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Incorrect header identifier.");
+        }
+
+        if (version != frame_version)
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Incorrect version (%d).", version);
+        }
+
+        if (method > u32(Compressor::GZIP))
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Incorrect compression method (%d).", method);
+        }
+
+        if (!block_size)
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Incorrect block size.");
+        }
+
+        p = memory.address + memory.size - frame_trailer_size;
+
+        m_size = p.read64();
+        u64 block_count = p.read64();
+        u64 index_offset = p.read64();
+        u32 index_checksum = p.read32();
+        u32 magic1 = p.read32();
+
+        if (magic1 != u32_mask('m', 'g', 'f', '1'))
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Incorrect trailer identifier.");
+        }
+
+        const u64 index_limit = memory.size - frame_trailer_size;
+        if (index_offset < frame_header_size || index_offset > index_limit ||
+            block_count != (index_limit - index_offset) / frame_entry_size ||
+            block_count * frame_entry_size != index_limit - index_offset)
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Incorrect block index.");
+        }
+
+        ConstMemory index(memory.address + index_offset, size_t(index_limit - index_offset));
+        if (crc32c(0, index) != index_checksum)
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Block index checksum mismatch.");
+        }
+
+        p = index.address;
+        u64 total = 0;
+
+        for (u64 i = 0; i < block_count; ++i)
+        {
+            BlockEntry block;
+            block.offset = p.read64();
+            block.compressed = p.read32();
+            block.uncompressed = p.read32();
+            block.checksum = p.read32();
+            block.flags = p.read32();
+
+            // all blocks except the last one must be full so that an offset maps directly to a block
+            bool last = i + 1 == block_count;
+            bool valid = last ? (block.uncompressed > 0 && block.uncompressed <= block_size)
+                              : block.uncompressed == block_size;
+
+            if (block.offset < frame_header_size || block.offset > index_offset ||
+                block.compressed > index_offset - block.offset)
+            {
+                valid = false;
+            }
+
+            if ((block.flags & frame_flag_stored) && block.compressed != block.uncompressed)
+            {
+                valid = false;
+            }
+
+            if (!valid)
+            {
+                MANGO_EXCEPTION("[FrameDecompressor] Incorrect block (%d).", int(i));
+            }
+
+            total += block.uncompressed;
+            m_blocks.push_back(block);
+        }
+
+        if (total != m_size)
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Incorrect uncompressed size.");
+        }
+
+        m_compressor = getCompressor(Compressor::Method(method));
+        m_block_size = block_size;
+    }
+
+    FrameDecompressor::~FrameDecompressor()
+    {
+    }
+
+    u64 FrameDecompressor::size() const
+    {
+        return m_size;
+    }
+
+    size_t FrameDecompressor::blocks() const
+    {
+        return m_blocks.size();
+    }
+
+    Compressor::Method FrameDecompressor::method() const
+    {
+        return m_compressor.method;
+    }
+
+    void FrameDecompressor::decode(u8* dest, size_t index) const
+    {
+        const BlockEntry& block = m_blocks[index];
+        ConstMemory source(m_memory.address + block.offset, block.compressed);
+
+        if (block.flags & frame_flag_stored)
+        {
+            std::memcpy(dest, source.address, source.size);
+        }
+        else
+        {
+            size_t bytes = m_compressor.decompress(Memory(dest, block.uncompressed), source);
+            if (bytes != block.uncompressed)
+            {
+                MANGO_EXCEPTION("[FrameDecompressor] Incorrect decompressed size in block %d.", int(index));
+            }
+        }
+
+        if (crc32c(0, ConstMemory(dest, block.uncompressed)) != block.checksum)
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Checksum mismatch in block %d.", int(index));
+        }
+    }
+
+    void FrameDecompressor::decompress(Memory dest) const
+    {
+        if (dest.size < m_size)
+        {
+            MANGO_EXCEPTION("[FrameDecompressor] Not enough destination memory.");
+        }
+
+        read(dest, 0);
+    }
+
+    size_t FrameDecompressor::read(Memory dest, u64 offset) const
+    {
+        if (offset >= m_size)
+        {
+            return 0;
+        }
+
+        const size_t size = size_t(std::min(u64(dest.size), m_size - offset));
+        if (!size)
+        {
+            return 0;
+        }
+
+        const size_t first = size_t(offset / m_block_size);
+        const size_t last = size_t((offset + size - 1) / m_block_size);
+
+        auto process = [this, dest, offset, size] (size_t index)
+        {
+            const u64 start = u64(index) * m_block_size;
+            const u64 end = start + m_blocks[index].uncompressed;
+            const u64 lo = std::max(offset, start);
+            const u64 hi = std::min(offset + size, end);
+
+            if (lo == start && hi == end)
+            {
+                // the block is fully inside the range; decode it in place
+                decode(dest.address + size_t(start - offset), index);
+            }
+            else
+            {
+                Buffer temp(m_blocks[index].uncompressed);
+                decode(temp, index);
+                std::memcpy(dest.address + size_t(lo - offset), temp.data() + size_t(lo - start), size_t(hi - lo));
+            }
+        };
+
+        if (first == last)
+        {
+            process(first);
+            return size;
+        }
+
+        std::vector<FutureTask<void>> tasks;
+        tasks.reserve(last - first + 1);
+
+        for (size_t i = first; i <= last; ++i)
+        {
+            tasks.emplace_back(process, i);
+        }
+
+        // wait for all blocks before re-throwing the first error; the tasks reference dest
+        for (auto& task : tasks)
+        {
+            task.wait();
+        }
+
+        for (auto& task : tasks)
+        {
+            task.get();
+        }
+
+        return size;
+    }
+
+} // namespace mango
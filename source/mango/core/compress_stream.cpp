@@ -0,0 +1,2321 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <mango/core/compress.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/hash.hpp>
+#include <mango/core/endian.hpp>
+#include <mango/math/math.hpp>
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+#include "../../external/lz4/lz4.h"
+#include "../../external/zstd/zstd.h"
+#endif
+
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+#include "../../external/bzip2/bzlib.h"
+#endif
+
+#include "../../external/lzma/Alloc.h"
+#include "../../external/lzma/LzmaDec.h"
+#include "../../external/lzma/LzmaEnc.h"
+
+#include "../../external/libdeflate/libdeflate.h"
+
+#define XXH_STATIC_LINKING_ONLY
+#define XXH_INLINE_ALL
+#include "../../external/zstd/common/xxhash.h"
+
+namespace
+{
+    using namespace mango;
+
+    // ----------------------------------------------------------------------------
+    // helpers
+    // ----------------------------------------------------------------------------
+
+    size_t copyMemory(Memory& output, ConstMemory& input)
+    {
+        const size_t bytes = std::min(output.size, input.size);
+        std::memcpy(output.address, input.address, bytes);
+        output.address += bytes;
+        output.size -= bytes;
+        input.address += bytes;
+        input.size -= bytes;
+        return bytes;
+    }
+
+    // output which has been produced but not yet drained by the caller
+    struct PendingOutput
+    {
+        std::vector<u8> buffer;
+        size_t offset = 0;
+
+        bool empty() const
+        {
+            return offset == buffer.size();
+        }
+
+        void drain(Memory& output)
+        {
+            ConstMemory memory(buffer.data() + offset, buffer.size() - offset);
+            offset += copyMemory(output, memory);
+
+            if (empty())
+            {
+                buffer.clear();
+                offset = 0;
+            }
+        }
+
+        // room for size more bytes at the end of the buffer
+        u8* append(size_t size)
+        {
+            const size_t position = buffer.size();
+            buffer.resize(position + size);
+            return buffer.data() + position;
+        }
+
+        void write32le(u32 value)
+        {
+            ustore32le(append(4), value);
+        }
+    };
+
+    // accumulates input bytes for the fixed size fields of a stream
+    struct InputGather
+    {
+        std::vector<u8> buffer;
+
+        // returns true when the buffer has at least size bytes
+        bool gather(ConstMemory& input, size_t size)
+        {
+            if (buffer.size() < size)
+            {
+                const size_t bytes = std::min(size - buffer.size(), input.size);
+                buffer.insert(buffer.end(), input.address, input.address + bytes);
+                input.address += bytes;
+                input.size -= bytes;
+            }
+
+            return buffer.size() >= size;
+        }
+
+        void clear()
+        {
+            buffer.clear();
+        }
+
+        const u8* data() const
+        {
+            return buffer.data();
+        }
+    };
+
+    // ----------------------------------------------------------------------------
+    // ChunkEncoder
+    // ----------------------------------------------------------------------------
+
+    // Encoder which compresses the input in independent chunks with a memory block
+    // compressor; the compressed chunks are drained to the caller's output.
+
+    class ChunkEncoder : public IncrementalEncoder
+    {
+    protected:
+        std::vector<u8> m_chunk;
+        size_t m_chunk_size;
+        PendingOutput m_output;
+        bool m_finished = false;
+
+        // compress the chunk into m_output; final is set for the last chunk of the stream
+        virtual void compress(ConstMemory chunk, bool final) = 0;
+
+    public:
+        ChunkEncoder(size_t chunk_size)
+            : m_chunk_size(chunk_size)
+        {
+            m_chunk.reserve(chunk_size);
+        }
+
+        bool encode(ConstMemory& input, Memory& output, bool finish) override
+        {
+            for (;;)
+            {
+                m_output.drain(output);
+                if (!m_output.empty())
+                {
+                    return false;
+                }
+
+                if (m_finished)
+                {
+                    if (input.size)
+                    {
+                        MANGO_EXCEPTION("[IncrementalEncoder] The stream has been finished.");
+                    }
+
+                    return true;
+                }
+
+                const size_t bytes = std::min(input.size, m_chunk_size - m_chunk.size());
+                m_chunk.insert(m_chunk.end(), input.address, input.address + bytes);
+                input.address += bytes;
+                input.size -= bytes;
+
+                const bool final = finish && !input.size;
+                if (m_chunk.size() < m_chunk_size && !final)
+                {
+                    // the input has been consumed
+                    return false;
+                }
+
+                compress(ConstMemory(m_chunk.data(), m_chunk.size()), final);
+                m_chunk.clear();
+                m_finished = final;
+            }
+        }
+    };
+
+    // ----------------------------------------------------------------------------
+    // none
+    // ----------------------------------------------------------------------------
+
+    class EncoderNone : public IncrementalEncoder
+    {
+    public:
+        bool encode(ConstMemory& input, Memory& output, bool finish) override
+        {
+            copyMemory(output, input);
+            return finish && !input.size;
+        }
+    };
+
+    class DecoderNone : public IncrementalDecoder
+    {
+    public:
+        bool decode(ConstMemory& input, Memory& output) override
+        {
+            copyMemory(output, input);
+            return !input.size;
+        }
+    };
+
+    // ----------------------------------------------------------------------------
+    // deflate, zlib, gzip
+    // ----------------------------------------------------------------------------
+
+    enum class DeflateFormat
+    {
+        DEFLATE,
+        ZLIB,
+        GZIP
+    };
+
+    class EncoderDeflate : public ChunkEncoder
+    {
+    protected:
+        libdeflate_compressor* m_compressor;
+        DeflateFormat m_format;
+        int m_level;
+        bool m_header = false;
+        u32 m_checksum;
+        u32 m_size = 0;
+
+    public:
+        EncoderDeflate(DeflateFormat format, int level)
+            : ChunkEncoder(256 * 1024)
+            , m_format(format)
+        {
+            level = clamp(level, 1, 10);
+            if (level >= 8) level = (level * 12) / 10;
+
+            m_compressor = libdeflate_alloc_compressor(level);
+            if (!m_compressor)
+            {
+                MANGO_EXCEPTION("[deflate] compressor allocation failed.");
+            }
+
+            m_level = level;
+            m_checksum = format == DeflateFormat::ZLIB ? 1 : 0;
+        }
+
+        ~EncoderDeflate()
+        {
+            libdeflate_free_compressor(m_compressor);
+        }
+
+        void compress(ConstMemory chunk, bool final) override
+        {
+            if (!m_header)
+            {
+                m_header = true;
+
+                if (m_format == DeflateFormat::ZLIB)
+                {
+                    // compression level hint: fastest, fast, default, slowest
+                    u16 hint = m_level < 2 ? 0 : m_level < 6 ? 1 : m_level == 6 ? 2 : 3;
+                    u16 header = (0x78 << 8) | (hint << 6);
+                    header |= 31 - (header % 31);
+                    ustore16be(m_output.append(2), header);
+                }
+                else if (m_format == DeflateFormat::GZIP)
+                {
+                    u8* p = m_output.append(10);
+                    p[0] = 0x1f;
+                    p[1] = 0x8b;
+                    p[2] = 8; // deflate
+                    p[3] = 0; // flags
+                    ustore32le(p + 4, 0); // modification time
+                    p[8] = m_level < 2 ? 4 : m_level >= 8 ? 2 : 0; // extra flags
+                    p[9] = 0xff; // unknown operating system
+                }
+            }
+
+            if (m_format == DeflateFormat::ZLIB)
+            {
+                m_checksum = libdeflate_adler32(m_checksum, chunk.address, chunk.size);
+            }
+            else if (m_format == DeflateFormat::GZIP)
+            {
+                m_checksum = libdeflate_crc32(m_checksum, chunk.address, chunk.size);
+                m_size += u32(chunk.size);
+            }
+
+            // the non-final chunk ends with an empty stored block
+            const size_t bound = libdeflate_deflate_compress_bound(m_compressor, chunk.size) + 16;
+            u8* dest = m_output.append(bound);
+
+            size_t bytes = libdeflate_deflate_compress_chunk(m_compressor, chunk.address, chunk.size,
+                dest, bound, final);
+            if (!bytes)
+            {
+                MANGO_EXCEPTION("[deflate] compression failed.");
+            }
+
+            m_output.buffer.resize(m_output.buffer.size() - bound + bytes);
+
+            if (final)
+            {
+                if (m_format == DeflateFormat::ZLIB)
+                {
+                    ustore32be(m_output.append(4), m_checksum);
+                }
+                else if (m_format == DeflateFormat::GZIP)
+                {
+                    m_output.write32le(m_checksum);
+                    m_output.write32le(m_size);
+                }
+            }
+        }
+    };
+
+    // Streaming DEFLATE decoder. The compressed stream is decoded into a 64 KB window
+    // from which the output is drained; the window keeps the 32 KB of history which the
+    // matches refer to. The decoder never needs more input than is available: the bits
+    // for a literal or a match are decoded from a bit buffer as a unit and the state is
+    // rolled back when there are not enough bits.
+
+    class Inflater
+    {
+    protected:
+        enum State
+        {
+            BLOCK_HEADER,
+            STORED_HEADER,
+            STORED,
+            TABLE_COUNTS,
+            TABLE_CODELENGTHS,
+            TABLE_LENGTHS,
+            CODES,
+            DONE
+        };
+
+        enum Result
+        {
+            NEED_INPUT,
+            NEED_OUTPUT,
+            END
+        };
+
+        static constexpr u32 window_size = 65536;
+        static constexpr u32 window_mask = window_size - 1;
+        static constexpr u32 table_bits = 15;
+        static constexpr u32 max_match = 258;
+
+        State m_state = BLOCK_HEADER;
+        bool m_final = false;
+
+        u64 m_bitbuf = 0;
+        u32 m_bitcount = 0;
+
+        std::vector<u8> m_window;
+        u64 m_position = 0;  // bytes decoded
+        u64 m_delivered = 0; // bytes drained to the output
+
+        // decoding tables: (symbol << 4) | code length, zero for invalid codes
+        std::vector<u16> m_litlen;
+        std::vector<u16> m_distance;
+        u16 m_codelength[128];
+
+        u32 m_stored = 0;
+        u32 m_hlit = 0;
+        u32 m_hdist = 0;
+        u32 m_hclen = 0;
+        u32 m_index = 0;
+        u8 m_lengths[320];
+
+        void refill(ConstMemory& input)
+        {
+            while (m_bitcount <= 56 && input.size)
+            {
+                m_bitbuf |= u64(*input.address++) << m_bitcount;
+                m_bitcount += 8;
+                --input.size;
+            }
+        }
+
+        u32 bits(u32 count)
+        {
+            u32 value = u32(m_bitbuf & ((1ull << count) - 1));
+            m_bitbuf >>= count;
+            m_bitcount -= count;
+            return value;
+        }
+
+        static void buildTable(u16* table, u32 table_size_bits, const u8* lengths, u32 count, bool allow_incomplete)
+        {
+            u32 histogram[16] = { 0 };
+            for (u32 i = 0; i < count; ++i)
+            {
+                ++histogram[lengths[i]];
+            }
+
+            histogram[0] = 0;
+
+            u32 next[16];
+            u32 code = 0;
+            s32 left = 1;
+
+            for (u32 i = 1; i < 16; ++i)
+            {
+                left = (left << 1) - s32(histogram[i]);
+                if (left < 0)
+                {
+                    MANGO_EXCEPTION("[deflate] Over-subscribed Huffman code.");
+                }
+
+                code = (code + histogram[i - 1]) << 1;
+                next[i] = code;
+            }
+
+            if (left > 0 && !allow_incomplete)
+            {
+                MANGO_EXCEPTION("[deflate] Incomplete Huffman code.");
+            }
+
+            const u32 size = 1u << table_size_bits;
+            std::fill(table, table + size, 0);
+
+            for (u32 symbol = 0; symbol < count; ++symbol)
+            {
+                const u32 length = lengths[symbol];
+                if (!length)
+                    continue;
+
+                // the codes are stored msb first; the table is indexed lsb first
+                u32 c = next[length]++;
+                u32 reversed = 0;
+                for (u32 i = 0; i < length; ++i)
+                {
+                    reversed = (reversed << 1) | (c & 1);
+                    c >>= 1;
+                }
+
+                const u16 entry = u16((symbol << 4) | length);
+                for (u32 i = reversed; i < size; i += (1u << length))
+                {
+                    table[i] = entry;
+                }
+            }
+        }
+
+        void buildFixedTables()
+        {
+            u8 lengths[320];
+            std::fill(lengths +   0, lengths + 144, 8);
+            std::fill(lengths + 144, lengths + 256, 9);
+            std::fill(lengths + 256, lengths + 280, 7);
+            std::fill(lengths + 280, lengths + 288, 8);
+            std::fill(lengths + 288, lengths + 320, 5);
+
+            buildTable(m_litlen.data(), table_bits, lengths, 288, false);
+            buildTable(m_distance.data(), table_bits, lengths + 288, 32, false);
+        }
+
+        void put(u8 value)
+        {
+            m_window[m_position++ & window_mask] = value;
+        }
+
+        u32 pending() const
+        {
+            return u32(m_position - m_delivered);
+        }
+
+        Result decodeStored(ConstMemory& input)
+        {
+            while (m_stored)
+            {
+                u32 space = window_size - pending();
+                if (!space)
+                {
+                    return NEED_OUTPUT;
+                }
+
+                if (m_bitcount >= 8)
+                {
+                    // bytes which are already in the bit buffer
+                    put(u8(bits(8)));
+                    --m_stored;
+                    continue;
+                }
+
+                if (!input.size)
+                {
+                    return NEED_INPUT;
+                }
+
+                const u32 offset = u32(m_position & window_mask);
+                size_t bytes = std::min({ size_t(m_stored), input.size, size_t(space), size_t(window_size - offset) });
+                std::memcpy(m_window.data() + offset, input.address, bytes);
+
+                input.address += bytes;
+                input.size -= bytes;
+                m_position += bytes;
+                m_stored -= u32(bytes);
+            }
+
+            m_state = BLOCK_HEADER;
+            return END;
+        }
+
+        Result decodeLengths(ConstMemory& input)
+        {
+            while (m_index < m_hlit + m_hdist)
+            {
+                refill(input);
+
+                const u16 entry = m_codelength[m_bitbuf & 127];
+                const u32 length = entry & 15;
+                const u32 symbol = entry >> 4;
+
+                if (!length)
+                {
+                    MANGO_EXCEPTION("[deflate] Incorrect code length code.");
+                }
+
+                static const u8 extra_bits[] = { 2, 3, 7 };
+                static const u8 base[] = { 3, 3, 11 };
+
+                const u32 extra = symbol < 16 ? 0 : extra_bits[symbol - 16];
+                if (length + extra > m_bitcount)
+                {
+                    return NEED_INPUT;
+                }
+
+                bits(length);
+
+                if (symbol < 16)
+                {
+                    m_lengths[m_index++] = u8(symbol);
+                    continue;
+                }
+
+                const u32 count = base[symbol - 16] + bits(extra);
+                if (m_index + count > m_hlit + m_hdist)
+                {
+                    MANGO_EXCEPTION("[deflate] Too many code lengths.");
+                }
+
+                u8 value = 0;
+                if (symbol == 16)
+                {
+                    if (!m_index)
+                    {
+                        MANGO_EXCEPTION("[deflate] Repeated code length without a previous length.");
+                    }
+
+                    value = m_lengths[m_index - 1];
+                }
+
+                std::fill(m_lengths + m_index, m_lengths + m_index + count, value);
+                m_index += count;
+            }
+
+            if (!m_lengths[256])
+            {
+                MANGO_EXCEPTION("[deflate] Missing end-of-block code.");
+            }
+
+            u8 distances[32] = { 0 };
+            std::copy(m_lengths + m_hlit, m_lengths + m_hlit + m_hdist, distances);
+
+            buildTable(m_litlen.data(), table_bits, m_lengths, m_hlit, false);
+            buildTable(m_distance.data(), table_bits, distances, 32, true);
+
+            m_state = CODES;
+            return END;
+        }
+
+        Result decodeCodes(ConstMemory& input)
+        {
+            static const u16 length_base[] =
+            {
+                3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+            };
+
+            static const u8 length_extra[] =
+            {
+                0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+            };
+
+            static const u16 distance_base[] =
+            {
+                1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                8193, 12289, 16385, 24577
+            };
+
+            static const u8 distance_extra[] =
+            {
+                0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+            };
+
+            const u32 mask = (1u << table_bits) - 1;
+
+            for (;;)
+            {
+                if (pending() + max_match > window_size)
+                {
+                    return NEED_OUTPUT;
+                }
+
+                refill(input);
+
+                // decode a literal or a length-distance pair from a copy of the bit buffer
+                u64 bitbuf = m_bitbuf;
+                u32 bitcount = m_bitcount;
+
+                u16 entry = m_litlen[bitbuf & mask];
+                u32 length = entry & 15;
+                u32 symbol = entry >> 4;
+
+                if (!length)
+                {
+                    MANGO_EXCEPTION("[deflate] Incorrect literal/length code.");
+                }
+
+                if (length > bitcount)
+                {
+                    return NEED_INPUT;
+                }
+
+                bitbuf >>= length;
+                bitcount -= length;
+
+                if (symbol < 256)
+                {
+                    m_bitbuf = bitbuf;
+                    m_bitcount = bitcount;
+                    put(u8(symbol));
+                    continue;
+                }
+
+                if (symbol == 256)
+                {
+                    m_bitbuf = bitbuf;
+                    m_bitcount = bitcount;
+                    m_state = BLOCK_HEADER;
+                    return END;
+                }
+
+                symbol -= 257;
+                if (symbol >= 29)
+                {
+                    MANGO_EXCEPTION("[deflate] Incorrect length symbol.");
+                }
+
+                u32 extra = length_extra[symbol];
+                if (extra > bitcount)
+                {
+                    return NEED_INPUT;
+                }
+
+                const u32 match = length_base[symbol] + u32(bitbuf & ((1u << extra) - 1));
+                bitbuf >>= extra;
+                bitcount -= extra;
+
+                entry = m_distance[bitbuf & mask];
+                length = entry & 15;
+                symbol = entry >> 4;
+
+                if (!length || symbol >= 30)
+                {
+                    MANGO_EXCEPTION("[deflate] Incorrect distance code.");
+                }
+
+                if (length > bitcount)
+                {
+                    return NEED_INPUT;
+                }
+
+                bitbuf >>= length;
+                bitcount -= length;
+
+                extra = distance_extra[symbol];
+                if (extra > bitcount)
+                {
+                    return NEED_INPUT;
+                }
+
+                const u32 distance = distance_base[symbol] + u32(bitbuf & ((1u << extra) - 1));
+                bitbuf >>= extra;
+                bitcount -= extra;
+
+                if (distance > m_position)
+                {
+                    MANGO_EXCEPTION("[deflate] Match distance is too far back.");
+                }
+
+                m_bitbuf = bitbuf;
+                m_bitcount = bitcount;
+
+                for (u32 i = 0; i < match; ++i)
+                {
+                    m_window[m_position & window_mask] = m_window[(m_position - distance) & window_mask];
+                    ++m_position;
+                }
+            }
+        }
+
+        Result step(ConstMemory& input)
+        {
+            for (;;)
+            {
+                Result result = END;
+
+                switch (m_state)
+                {
+                    case BLOCK_HEADER:
+                        if (m_final)
+                        {
+                            // the trailer starts from the next byte
+                            bits(m_bitcount & 7);
+                            m_state = DONE;
+                            return END;
+                        }
+
+                        refill(input);
+                        if (m_bitcount < 3)
+                        {
+                            return NEED_INPUT;
+                        }
+
+                        m_final = bits(1) != 0;
+
+                        switch (bits(2))
+                        {
+                            case 0:
+                                bits(m_bitcount & 7);
+                                m_state = STORED_HEADER;
+                                break;
+                            case 1:
+                                buildFixedTables();
+                                m_state = CODES;
+                                break;
+                            case 2:
+                                m_state = TABLE_COUNTS;
+                                break;
+                            default:
+                                MANGO_EXCEPTION("[deflate] Incorrect block type.");
+                        }
+                        break;
+
+                    case STORED_HEADER:
+                    {
+                        refill(input);
+                        if (m_bitcount < 32)
+                        {
+                            return NEED_INPUT;
+                        }
+
+                        u32 length = bits(16);
+                        u32 complement = bits(16);
+                        if (length != (~complement & 0xffff))
+                        {
+                            MANGO_EXCEPTION("[deflate] Incorrect stored block length.");
+                        }
+
+                        m_stored = length;
+                        m_state = STORED;
+                        break;
+                    }
+
+                    case STORED:
+                        result = decodeStored(input);
+                        break;
+
+                    case TABLE_COUNTS:
+                        refill(input);
+                        if (m_bitcount < 14)
+                        {
+                            return NEED_INPUT;
+                        }
+
+                        m_hlit = bits(5) + 257;
+                        m_hdist = bits(5) + 1;
+                        m_hclen = bits(4) + 4;
+
+                        if (m_hlit > 286 || m_hdist > 30)
+                        {
+                            MANGO_EXCEPTION("[deflate] Incorrect number of codes.");
+                        }
+
+                        std::fill(m_lengths, m_lengths + 19, 0);
+                        m_index = 0;
+                        m_state = TABLE_CODELENGTHS;
+                        break;
+
+                    case TABLE_CODELENGTHS:
+                    {
+                        static const u8 order[] =
+                        {
+                            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+                        };
+
+                        while (m_index < m_hclen)
+                        {
+                            refill(input);
+                            if (m_bitcount < 3)
+                            {
+                                return NEED_INPUT;
+                            }
+
+                            m_lengths[order[m_index++]] = u8(bits(3));
+                        }
+
+                        buildTable(m_codelength, 7, m_lengths, 19, false);
+                        m_index = 0;
+                        m_state = TABLE_LENGTHS;
+                        break;
+                    }
+
+                    case TABLE_LENGTHS:
+                        result = decodeLengths(input);
+                        break;
+
+                    case CODES:
+                        result = decodeCodes(input);
+                        break;
+
+                    case DONE:
+                        return END;
+                }
+
+                if (result != END)
+                {
+                    return result;
+                }
+            }
+        }
+
+        void deliver(Memory& output)
+        {
+            while (output.size && m_delivered < m_position)
+            {
+                const u32 offset = u32(m_delivered & window_mask);
+                size_t bytes = std::min({ output.size, size_t(m_position - m_delivered), size_t(window_size - offset) });
+                std::memcpy(output.address, m_window.data() + offset, bytes);
+
+                output.address += bytes;
+                output.size -= bytes;
+                m_delivered += bytes;
+            }
+        }
+
+    public:
+        Inflater()
+            : m_window(window_size)
+            , m_litlen(1 << table_bits)
+            , m_distance(1 << table_bits)
+        {
+        }
+
+        // prepare for the next stream; the bits which were read past the end remain
+        void reset()
+        {
+            m_state = BLOCK_HEADER;
+            m_final = false;
+            m_position = 0;
+            m_delivered = 0;
+        }
+
+        // returns true when the final block has been decoded and drained to the output
+        bool decode(ConstMemory& input, Memory& output)
+        {
+            for (;;)
+            {
+                deliver(output);
+
+                if (m_state == DONE)
+                {
+                    return m_delivered == m_position;
+                }
+
+                if (!output.size)
+                {
+                    return false;
+                }
+
+                if (step(input) == NEED_INPUT)
+                {
+                    deliver(output);
+                    return false;
+                }
+            }
+        }
+
+        // the stream is byte aligned at the header and after the final block
+        bool readByte(ConstMemory& input, u8& value)
+        {
+            if (m_bitcount >= 8)
+            {
+                value = u8(bits(8));
+                return true;
+            }
+
+            if (!input.size)
+            {
+                return false;
+            }
+
+            value = *input.address++;
+            --input.size;
+            return true;
+        }
+
+        bool buffered() const
+        {
+            return m_bitcount >= 8;
+        }
+    };
+
+    class DecoderDeflate : public IncrementalDecoder
+    {
+    protected:
+        enum State
+        {
+            HEADER,
+            GZIP_EXTRA,
+            GZIP_NAME,
+            GZIP_COMMENT,
+            GZIP_HEADER_CRC,
+            BODY,
+            TRAILER,
+            END
+        };
+
+        Inflater m_inflater;
+        DeflateFormat m_format;
+        State m_state = HEADER;
+        std::vector<u8> m_temp;
+        u8 m_flags = 0;
+        u32 m_checksum = 0;
+        u32 m_size = 0;
+
+        bool gather(ConstMemory& input, size_t size)
+        {
+            while (m_temp.size() < size)
+            {
+                u8 value;
+                if (!m_inflater.readByte(input, value))
+                {
+                    return false;
+                }
+
+                m_temp.push_back(value);
+            }
+
+            return true;
+        }
+
+        // read bytes until a terminating zero
+        bool skipString(ConstMemory& input)
+        {
+            u8 value;
+            while (m_inflater.readByte(input, value))
+            {
+                if (!value)
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void start()
+        {
+            m_state = m_format == DeflateFormat::DEFLATE ? BODY : HEADER;
+            m_checksum = m_format == DeflateFormat::ZLIB ? 1 : 0;
+            m_size = 0;
+            m_temp.clear();
+            m_inflater.reset();
+        }
+
+    public:
+        DecoderDeflate(DeflateFormat format)
+            : m_format(format)
+        {
+            start();
+        }
+
+        bool decode(ConstMemory& input, Memory& output) override
+        {
+            for (;;)
+            {
+                switch (m_state)
+                {
+                    case HEADER:
+                        if (m_format == DeflateFormat::ZLIB)
+                        {
+                            if (!gather(input, 2))
+                                return false;
+
+                            const u8* p = m_temp.data();
+                            if ((p[0] & 0x0f) != 8 || ((p[0] << 8) | p[1]) % 31)
+                            {
+                                MANGO_EXCEPTION("[zlib] Incorrect header.");
+                            }
+
+                            if (p[1] & 0x20)
+                            {
+                                MANGO_EXCEPTION("[zlib] Preset dictionaries are not supported.");
+                            }
+
+                            m_temp.clear();
+                            m_state = BODY;
+                        }
+                        else
+                        {
+                            if (!gather(input, 10))
+                                return false;
+
+                            const u8* p = m_temp.data();
+                            if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8)
+                            {
+                                MANGO_EXCEPTION("[gzip] Incorrect header.");
+                            }
+
+                            m_flags = p[3];
+                            m_temp.clear();
+                            m_state = GZIP_EXTRA;
+                        }
+                        break;
+
+                    case GZIP_EXTRA:
+                        if (m_flags & 0x04)
+                        {
+                            if (!gather(input, 2))
+                                return false;
+
+                            const size_t size = 2 + uload16le(m_temp.data());
+                            if (!gather(input, size))
+                                return false;
+                        }
+
+                        m_temp.clear();
+                        m_state = GZIP_NAME;
+                        break;
+
+                    case GZIP_NAME:
+                        if ((m_flags & 0x08) && !skipString(input))
+                            return false;
+
+                        m_state = GZIP_COMMENT;
+                        break;
+
+                    case GZIP_COMMENT:
+                        if ((m_flags & 0x10) && !skipString(input))
+                            return false;
+
+                        m_state = GZIP_HEADER_CRC;
+                        break;
+
+                    case GZIP_HEADER_CRC:
+                        if (m_flags & 0x02)
+                        {
+                            if (!gather(input, 2))
+                                return false;
+                        }
+
+                        m_temp.clear();
+                        m_state = BODY;
+                        break;
+
+                    case BODY:
+                    {
+                        u8* start = output.address;
+                        bool done = m_inflater.decode(input, output);
+
+                        const size_t bytes = output.address - start;
+                        if (m_format == DeflateFormat::ZLIB)
+                        {
+                            m_checksum = libdeflate_adler32(m_checksum, start, bytes);
+                        }
+                        else if (m_format == DeflateFormat::GZIP)
+                        {
+                            m_checksum = libdeflate_crc32(m_checksum, start, bytes);
+                            m_size += u32(bytes);
+                        }
+
+                        if (!done)
+                            return false;
+
+                        m_state = TRAILER;
+                        break;
+                    }
+
+                    case TRAILER:
+                        if (m_format == DeflateFormat::ZLIB)
+                        {
+                            if (!gather(input, 4))
+                                return false;
+
+                            if (uload32be(m_temp.data()) != m_checksum)
+                            {
+                                MANGO_EXCEPTION("[zlib] Checksum mismatch.");
+                            }
+                        }
+                        else if (m_format == DeflateFormat::GZIP)
+                        {
+                            if (!gather(input, 8))
+                                return false;
+
+                            if (uload32le(m_temp.data()) != m_checksum || uload32le(m_temp.data() + 4) != m_size)
+                            {
+                                MANGO_EXCEPTION("[gzip] Checksum mismatch.");
+                            }
+                        }
+
+                        m_temp.clear();
+                        m_state = END;
+                        return true;
+
+                    case END:
+                        if (!input.size && !m_inflater.buffered())
+                        {
+                            return true;
+                        }
+
+                        if (m_format != DeflateFormat::GZIP)
+                        {
+                            MANGO_EXCEPTION("[deflate] Data after the end of the stream.");
+                        }
+
+                        // concatenated gzip member
+                        start();
+                        break;
+                }
+            }
+        }
+    };
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    // ----------------------------------------------------------------------------
+    // lz4 frame
+    // ----------------------------------------------------------------------------
+
+    constexpr u32 lz4_frame_magic = 0x184d2204;
+    constexpr u32 lz4_block_size = 1024 * 1024;
+
+    class EncoderLZ4 : public ChunkEncoder
+    {
+    protected:
+        int m_level;
+        bool m_header = false;
+        XXH32_state_t m_checksum;
+
+    public:
+        EncoderLZ4(int level)
+            : ChunkEncoder(lz4_block_size)
+            , m_level(level)
+        {
+            XXH32_reset(&m_checksum, 0);
+        }
+
+        void compress(ConstMemory chunk, bool final) override
+        {
+            if (!m_header)
+            {
+                m_header = true;
+
+                // version 1, independent blocks, content checksum, 1 MB maximum block size
+                u8 descriptor[] = { 0x64, 0x60 };
+
+                m_output.write32le(lz4_frame_magic);
+                u8* p = m_output.append(3);
+                p[0] = descriptor[0];
+                p[1] = descriptor[1];
+                p[2] = u8(xxhash32(0, ConstMemory(descriptor, 2)) >> 8);
+            }
+
+            if (chunk.size)
+            {
+                XXH32_update(&m_checksum, chunk.address, chunk.size);
+
+                const size_t bound = lz4::bound(chunk.size);
+                u8* dest = m_output.append(4 + bound);
+
+                size_t bytes = lz4::compress(Memory(dest + 4, bound), chunk, m_level);
+                if (bytes < chunk.size)
+                {
+                    ustore32le(dest, u32(bytes));
+                }
+                else
+                {
+                    // incompressible; stored with the high bit set in the size
+                    bytes = chunk.size;
+                    ustore32le(dest, u32(bytes) | 0x80000000);
+                    std::memcpy(dest + 4, chunk.address, bytes);
+                }
+
+                m_output.buffer.resize(m_output.buffer.size() - bound + bytes);
+            }
+
+            if (final)
+            {
+                // end mark
+                m_output.write32le(0);
+                m_output.write32le(XXH32_digest(&m_checksum));
+            }
+        }
+    };
+
+    class DecoderLZ4 : public IncrementalDecoder
+    {
+    protected:
+        enum State
+        {
+            MAGIC,
+            HEADER,
+            SKIP,
+            BLOCK_SIZE,
+            BLOCK,
+            CONTENT_CHECKSUM,
+            END
+        };
+
+        State m_state = MAGIC;
+        InputGather m_input;
+        PendingOutput m_output;
+        std::vector<u8> m_history; // the last 64 KB for the linked blocks
+        u8 m_flags = 0;
+        u32 m_max_block_size = 0;
+        u32 m_block_size = 0;
+        u64 m_skip = 0;
+        XXH32_state_t m_checksum; // of the decoded content
+
+        void decodeBlock(const u8* data)
+        {
+            const bool stored = (m_block_size & 0x80000000) != 0;
+            const u32 size = m_block_size & 0x7fffffff;
+
+            if (m_flags & 0x10)
+            {
+                if (xxhash32(0, ConstMemory(data, size)) != uload32le(data + size))
+                {
+                    MANGO_EXCEPTION("[lz4] Block checksum mismatch.");
+                }
+            }
+
+            u8* dest = m_output.append(m_max_block_size);
+            int bytes = int(size);
+
+            if (stored)
+            {
+                if (size > m_max_block_size)
+                {
+                    MANGO_EXCEPTION("[lz4] Incorrect block size.");
+                }
+
+                std::memcpy(dest, data, size);
+            }
+            else if (m_flags & 0x20)
+            {
+                bytes = LZ4_decompress_safe(reinterpret_cast<const char*>(data),
+                    reinterpret_cast<char*>(dest), int(size), int(m_max_block_size));
+            }
+            else
+            {
+                bytes = LZ4_decompress_safe_usingDict(reinterpret_cast<const char*>(data),
+                    reinterpret_cast<char*>(dest), int(size), int(m_max_block_size),
+                    reinterpret_cast<const char*>(m_history.data()), int(m_history.size()));
+            }
+
+            if (bytes < 0)
+            {
+                MANGO_EXCEPTION("[lz4] decompression failed.");
+            }
+
+            m_output.buffer.resize(m_output.buffer.size() - m_max_block_size + bytes);
+
+            if (m_flags & 0x04)
+            {
+                XXH32_update(&m_checksum, dest, size_t(bytes));
+            }
+
+            if (!(m_flags & 0x20))
+            {
+                m_history.insert(m_history.end(), dest, dest + bytes);
+                if (m_history.size() > 65536)
+                {
+                    m_history.erase(m_history.begin(), m_history.end() - 65536);
+                }
+            }
+        }
+
+    public:
+        bool decode(ConstMemory& input, Memory& output) override
+        {
+            for (;;)
+            {
+                m_output.drain(output);
+                if (!m_output.empty())
+                {
+                    return false;
+                }
+
+                switch (m_state)
+                {
+                    case MAGIC:
+                    {
+                        if (!m_input.gather(input, 4))
+                            return false;
+
+                        const u32 magic = uload32le(m_input.data());
+                        if (magic == lz4_frame_magic)
+                        {
+                            m_state = HEADER;
+                        }
+                        else if ((magic & 0xfffffff0) == 0x184d2a50)
+                        {
+                            // skippable frame
+                            if (!m_input.gather(input, 8))
+                                return false;
+
+                            m_skip = uload32le(m_input.data() + 4);
+                            m_state = SKIP;
+                        }
+                        else
+                        {
+                            MANGO_EXCEPTION("[lz4] Incorrect frame identifier.");
+                        }
+
+                        break;
+                    }
+
+                    case HEADER:
+                    {
+                        if (!m_input.gather(input, 6))
+                            return false;
+
+                        const u8 flags = m_input.data()[4];
+                        const size_t size = 7 + ((flags & 0x08) ? 8 : 0) + ((flags & 0x01) ? 4 : 0);
+
+                        if (!m_input.gather(input, size))
+                            return false;
+
+                        const u8* p = m_input.data() + 4;
+
+                        if ((flags & 0xc0) != 0x40)
+                        {
+                            MANGO_EXCEPTION("[lz4] Incorrect frame version.");
+                        }
+
+                        if (flags & 0x01)
+                        {
+                            MANGO_EXCEPTION("[lz4] Dictionaries are not supported.");
+                        }
+
+                        const u32 descriptor_size = u32(size - 5);
+                        if (u8(xxhash32(0, ConstMemory(p, descriptor_size)) >> 8) != p[descriptor_size])
+                        {
+                            MANGO_EXCEPTION("[lz4] Header checksum mismatch.");
+                        }
+
+                        const u32 code = (p[1] >> 4) & 7;
+                        if (code < 4)
+                        {
+                            MANGO_EXCEPTION("[lz4] Incorrect maximum block size.");
+                        }
+
+                        m_flags = flags;
+                        m_max_block_size = 1u << (code * 2 + 8);
+                        m_history.clear();
+                        XXH32_reset(&m_checksum, 0);
+                        m_input.clear();
+                        m_state = BLOCK_SIZE;
+                        break;
+                    }
+
+                    case SKIP:
+                    {
+                        const size_t bytes = size_t(std::min(u64(input.size), m_skip));
+                        input.address += bytes;
+                        input.size -= bytes;
+                        m_skip -= bytes;
+
+                        if (m_skip)
+                            return false;
+
+                        m_input.clear();
+                        m_state = END;
+                        break;
+                    }
+
+                    case BLOCK_SIZE:
+                        if (!m_input.gather(input, 4))
+                            return false;
+
+                        m_block_size = uload32le(m_input.data());
+                        m_input.clear();
+
+                        if (!m_block_size)
+                        {
+                            m_state = CONTENT_CHECKSUM;
+                        }
+                        else if ((m_block_size & 0x7fffffff) > m_max_block_size)
+                        {
+                            MANGO_EXCEPTION("[lz4] Incorrect block size.");
+                        }
+                        else
+                        {
+                            m_state = BLOCK;
+                        }
+
+                        break;
+
+                    case BLOCK:
+                    {
+                        const size_t size = (m_block_size & 0x7fffffff) + ((m_flags & 0x10) ? 4 : 0);
+                        if (!m_input.gather(input, size))
+                            return false;
+
+                        decodeBlock(m_input.data());
+                        m_input.clear();
+                        m_state = BLOCK_SIZE;
+                        break;
+                    }
+
+                    case CONTENT_CHECKSUM:
+                        if (m_flags & 0x04)
+                        {
+                            if (!m_input.gather(input, 4))
+                                return false;
+
+                            if (XXH32_digest(&m_checksum) != uload32le(m_input.data()))
+                            {
+                                MANGO_EXCEPTION("[lz4] Content checksum mismatch.");
+                            }
+                        }
+
+                        m_input.clear();
+                        m_state = END;
+                        return true;
+
+                    case END:
+                        if (!input.size)
+                            return true;
+
+                        // concatenated frame
+                        m_state = MAGIC;
+                        break;
+                }
+            }
+        }
+    };
+
+    // ----------------------------------------------------------------------------
+    // zstd
+    // ----------------------------------------------------------------------------
+
+    class EncoderZSTD : public IncrementalEncoder
+    {
+    protected:
+        ZSTD_CCtx* m_context;
+
+    public:
+        EncoderZSTD(int level)
+        {
+            m_context = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(m_context, ZSTD_c_compressionLevel, clamp(level * 2, 1, 20));
+        }
+
+        ~EncoderZSTD()
+        {
+            ZSTD_freeCCtx(m_context);
+        }
+
+        bool encode(ConstMemory& input, Memory& output, bool finish) override
+        {
+            ZSTD_inBuffer in = { input.address, input.size, 0 };
+            ZSTD_outBuffer out = { output.address, output.size, 0 };
+
+            size_t remaining;
+
+            do
+            {
+                remaining = ZSTD_compressStream2(m_context, &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+                if (ZSTD_isError(remaining))
+                {
+                    MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(remaining));
+                }
+            } while (out.pos < out.size && (finish ? remaining != 0 : in.pos < in.size));
+
+            input.address += in.pos;
+            input.size -= in.pos;
+            output.address += out.pos;
+            output.size -= out.pos;
+
+            return finish && !remaining;
+        }
+    };
+
+    class DecoderZSTD : public IncrementalDecoder
+    {
+    protected:
+        ZSTD_DCtx* m_context;
+
+    public:
+        DecoderZSTD()
+        {
+            m_context = ZSTD_createDCtx();
+        }
+
+        ~DecoderZSTD()
+        {
+            ZSTD_freeDCtx(m_context);
+        }
+
+        bool decode(ConstMemory& input, Memory& output) override
+        {
+            ZSTD_inBuffer in = { input.address, input.size, 0 };
+            ZSTD_outBuffer out = { output.address, output.size, 0 };
+
+            size_t result;
+
+            do
+            {
+                // returns zero when a frame has been decoded and flushed
+                result = ZSTD_decompressStream(m_context, &out, &in);
+                if (ZSTD_isError(result))
+                {
+                    MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(result));
+                }
+            } while (result && in.pos < in.size && out.pos < out.size);
+
+            input.address += in.pos;
+            input.size -= in.pos;
+            output.address += out.pos;
+            output.size -= out.pos;
+
+            return !result;
+        }
+    };
+
+#endif // MANGO_ENABLE_LICENSE_BSD
+
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+
+    // ----------------------------------------------------------------------------
+    // bzip2
+    // ----------------------------------------------------------------------------
+
+    // bz_stream counts bytes in unsigned int
+    constexpr size_t bzip2_max_size = 0x40000000;
+
+    class EncoderBZIP2 : public IncrementalEncoder
+    {
+    protected:
+        bz_stream m_stream;
+        bool m_finished = false;
+
+    public:
+        EncoderBZIP2(int level)
+        {
+            m_stream.bzalloc = nullptr;
+            m_stream.bzfree = nullptr;
+            m_stream.opaque = nullptr;
+
+            int x = BZ2_bzCompressInit(&m_stream, clamp(level, 1, 9), 0, 30);
+            if (x != BZ_OK)
+            {
+                MANGO_EXCEPTION("[bzip2] compression failed.");
+            }
+        }
+
+        ~EncoderBZIP2()
+        {
+            BZ2_bzCompressEnd(&m_stream);
+        }
+
+        bool encode(ConstMemory& input, Memory& output, bool finish) override
+        {
+            if (m_finished)
+            {
+                return true;
+            }
+
+            // bzip2 reports a call which makes no progress as an error
+            if (!output.size || (!input.size && !finish))
+            {
+                return false;
+            }
+
+            for (;;)
+            {
+                const size_t in_size = std::min(input.size, bzip2_max_size);
+                const size_t out_size = std::min(output.size, bzip2_max_size);
+
+                m_stream.next_in = const_cast<char*>(reinterpret_cast<const char*>(input.address));
+                m_stream.avail_in = unsigned(in_size);
+                m_stream.next_out = reinterpret_cast<char*>(output.address);
+                m_stream.avail_out = unsigned(out_size);
+
+                // the last part of the input is given with BZ_FINISH
+                const bool last = finish && in_size == input.size;
+                int x = BZ2_bzCompress(&m_stream, last ? BZ_FINISH : BZ_RUN);
+
+                const size_t consumed = in_size - m_stream.avail_in;
+                const size_t produced = out_size - m_stream.avail_out;
+                input.address += consumed;
+                input.size -= consumed;
+                output.address += produced;
+                output.size -= produced;
+
+                if (x == BZ_STREAM_END)
+                {
+                    m_finished = true;
+                    return true;
+                }
+
+                if (x != BZ_RUN_OK && x != BZ_FINISH_OK)
+                {
+                    MANGO_EXCEPTION("[bzip2] compression failed.");
+                }
+
+                if (!output.size || (!input.size && !last))
+                {
+                    return false;
+                }
+            }
+        }
+    };
+
+    class DecoderBZIP2 : public IncrementalDecoder
+    {
+    protected:
+        bz_stream m_stream;
+        bool m_end = false;
+
+        void init()
+        {
+            m_stream.bzalloc = nullptr;
+            m_stream.bzfree = nullptr;
+            m_stream.opaque = nullptr;
+
+            int x = BZ2_bzDecompressInit(&m_stream, 0, 0);
+            if (x != BZ_OK)
+            {
+                MANGO_EXCEPTION("[bzip2] decompression failed.");
+            }
+        }
+
+    public:
+        DecoderBZIP2()
+        {
+            init();
+        }
+
+        ~DecoderBZIP2()
+        {
+            BZ2_bzDecompressEnd(&m_stream);
+        }
+
+        bool decode(ConstMemory& input, Memory& output) override
+        {
+            if (m_end)
+            {
+                if (!input.size)
+                {
+                    return true;
+                }
+
+                // concatenated stream
+                BZ2_bzDecompressEnd(&m_stream);
+                init();
+                m_end = false;
+            }
+
+            for (;;)
+            {
+                const size_t in_size = std::min(input.size, bzip2_max_size);
+                const size_t out_size = std::min(output.size, bzip2_max_size);
+
+                m_stream.next_in = const_cast<char*>(reinterpret_cast<const char*>(input.address));
+                m_stream.avail_in = unsigned(in_size);
+                m_stream.next_out = reinterpret_cast<char*>(output.address);
+                m_stream.avail_out = unsigned(out_size);
+
+                int x = BZ2_bzDecompress(&m_stream);
+
+                const size_t consumed = in_size - m_stream.avail_in;
+                const size_t produced = out_size - m_stream.avail_out;
+                input.address += consumed;
+                input.size -= consumed;
+                output.address += produced;
+                output.size -= produced;
+
+                if (x == BZ_STREAM_END)
+                {
+                    m_end = true;
+                    return true;
+                }
+
+                if (x != BZ_OK)
+                {
+                    MANGO_EXCEPTION("[bzip2] decompression failed.");
+                }
+
+                if (!output.size || !input.size || (!consumed && !produced))
+                {
+                    return false;
+                }
+            }
+        }
+    };
+
+#endif // MANGO_ENABLE_LICENSE_ZLIB
+
+    // ----------------------------------------------------------------------------
+    // lzma
+    // ----------------------------------------------------------------------------
+
+    // The lzma-sdk encoder pulls the input and pushes the output through callbacks.
+    // It runs in a dedicated thread which the encode() calls feed and drain; the
+    // output which the thread may produce ahead of the caller is bounded.
+
+    class EncoderLZMA : public IncrementalEncoder
+    {
+    protected:
+        struct InStream : ISeqInStream
+        {
+            EncoderLZMA* encoder;
+        };
+
+        struct OutStream : ISeqOutStream
+        {
+            EncoderLZMA* encoder;
+        };
+
+        static constexpr size_t output_limit = 1024 * 1024;
+
+        CLzmaEncHandle m_handle;
+        InStream m_in;
+        OutStream m_out;
+        PendingOutput m_header;
+
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+
+        // input which the caller has made available to the encoder
+        const u8* m_input = nullptr;
+        size_t m_input_size = 0;
+        bool m_finish = false;
+
+        PendingOutput m_output;
+        bool m_done = false;
+        bool m_abort = false;
+        SRes m_result = SZ_OK;
+
+        static SRes read(const ISeqInStream* p, void* buf, size_t* size)
+        {
+            EncoderLZMA& e = *static_cast<const InStream*>(p)->encoder;
+            std::unique_lock<std::mutex> lock(e.m_mutex);
+
+            e.m_condition.wait(lock, [&] { return e.m_input_size || e.m_finish || e.m_abort; });
+            if (e.m_abort)
+            {
+                return SZ_ERROR_READ;
+            }
+
+            // zero bytes is the end of the stream
+            const size_t bytes = std::min(*size, e.m_input_size);
+            std::memcpy(buf, e.m_input, bytes);
+            e.m_input += bytes;
+            e.m_input_size -= bytes;
+            *size = bytes;
+
+            e.m_condition.notify_all();
+            return SZ_OK;
+        }
+
+        static size_t write(const ISeqOutStream* p, const void* buf, size_t size)
+        {
+            EncoderLZMA& e = *static_cast<const OutStream*>(p)->encoder;
+            std::unique_lock<std::mutex> lock(e.m_mutex);
+
+            e.m_condition.wait(lock, [&] { return e.m_output.buffer.size() < output_limit || e.m_abort; });
+            if (e.m_abort)
+            {
+                return 0;
+            }
+
+            std::memcpy(e.m_output.append(size), buf, size);
+
+            e.m_condition.notify_all();
+            return size;
+        }
+
+        void run()
+        {
+            SRes result = LzmaEnc_Encode(m_handle, &m_out, &m_in, nullptr, &g_Alloc, &g_Alloc);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_result = result;
+            m_done = true;
+            m_condition.notify_all();
+        }
+
+    public:
+        EncoderLZMA(int level)
+        {
+            CLzmaEncProps props;
+            LzmaEncProps_Init(&props);
+
+            level = clamp(level - 1, 0, 9);
+
+            // same parameters as lzma::compress()
+            props.level = level;
+            props.dictSize = 2048 << level;
+            props.lc = 3;
+            props.lp = 0;
+            props.pb = 2;
+            props.fb = 32;
+            props.numThreads = 1;
+            props.writeEndMark = 1;
+
+            m_handle = LzmaEnc_Create(&g_Alloc);
+            if (!m_handle || LzmaEnc_SetProps(m_handle, &props) != SZ_OK)
+            {
+                MANGO_EXCEPTION("[lzma] compression failed.");
+            }
+
+            SizeT size = LZMA_PROPS_SIZE;
+            LzmaEnc_WriteProperties(m_handle, m_header.append(LZMA_PROPS_SIZE), &size);
+
+            m_in.Read = read;
+            m_in.encoder = this;
+            m_out.Write = write;
+            m_out.encoder = this;
+        }
+
+        ~EncoderLZMA()
+        {
+            if (m_thread.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_abort = true;
+                    m_condition.notify_all();
+                }
+
+                m_thread.join();
+            }
+
+            LzmaEnc_Destroy(m_handle, &g_Alloc, &g_Alloc);
+        }
+
+        bool encode(ConstMemory& input, Memory& output, bool finish) override
+        {
+            m_header.drain(output);
+            if (!m_header.empty())
+            {
+                return false;
+            }
+
+            if (!m_thread.joinable())
+            {
+                m_thread = std::thread([this] { run(); });
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_input = input.address;
+            m_input_size = input.size;
+            m_finish = finish;
+            m_condition.notify_all();
+
+            bool complete = false;
+
+            for (;;)
+            {
+                if (!m_output.empty())
+                {
+                    m_output.drain(output);
+                    m_condition.notify_all();
+                }
+
+                if (m_done && m_output.empty())
+                {
+                    if (m_result != SZ_OK)
+                    {
+                        MANGO_EXCEPTION("[lzma] compression failed.");
+                    }
+
+                    complete = true;
+                    break;
+                }
+
+                if (!output.size || (!m_input_size && !finish))
+                {
+                    break;
+                }
+
+                m_condition.wait(lock, [&] { return !m_output.empty() || m_done || (!m_input_size && !finish); });
+            }
+
+            // take back the input which the encoder has not consumed
+            const size_t consumed = input.size - m_input_size;
+            input.address += consumed;
+            input.size -= consumed;
+
+            if (m_input_size)
+            {
+                // the encoder has not seen the end of the input
+                m_finish = false;
+            }
+
+            m_input = nullptr;
+            m_input_size = 0;
+
+            return complete;
+        }
+    };
+
+    class DecoderLZMA : public IncrementalDecoder
+    {
+    protected:
+        CLzmaDec m_decoder;
+        InputGather m_props;
+        bool m_initialized = false;
+        bool m_end = false;
+
+    public:
+        DecoderLZMA()
+        {
+            LzmaDec_Construct(&m_decoder);
+        }
+
+        ~DecoderLZMA()
+        {
+            LzmaDec_Free(&m_decoder, &g_Alloc);
+        }
+
+        bool decode(ConstMemory& input, Memory& output) override
+        {
+            if (!m_initialized)
+            {
+                if (!m_props.gather(input, LZMA_PROPS_SIZE))
+                {
+                    return false;
+                }
+
+                if (LzmaDec_Allocate(&m_decoder, m_props.data(), LZMA_PROPS_SIZE, &g_Alloc) != SZ_OK)
+                {
+                    MANGO_EXCEPTION("[lzma] Incorrect properties.");
+                }
+
+                LzmaDec_Init(&m_decoder);
+                m_initialized = true;
+            }
+
+            if (m_end)
+            {
+                if (input.size)
+                {
+                    MANGO_EXCEPTION("[lzma] Data after the end of the stream.");
+                }
+
+                return true;
+            }
+
+            for (;;)
+            {
+                SizeT out_size = output.size;
+                SizeT in_size = input.size;
+                ELzmaStatus status;
+
+                SRes result = LzmaDec_DecodeToBuf(&m_decoder, output.address, &out_size,
+                    input.address, &in_size, LZMA_FINISH_ANY, &status);
+                if (result != SZ_OK)
+                {
+                    MANGO_EXCEPTION("[lzma] decompression failed.");
+                }
+
+                input.address += in_size;
+                input.size -= in_size;
+                output.address += out_size;
+                output.size -= out_size;
+
+                if (status == LZMA_STATUS_FINISHED_WITH_MARK)
+                {
+                    m_end = true;
+                    return true;
+                }
+
+                if (!output.size || (!in_size && !out_size))
+                {
+                    return false;
+                }
+            }
+        }
+    };
+
+} // namespace
+
+namespace mango
+{
+
+    // ----------------------------------------------------------------------------
+    // incremental compression
+    // ----------------------------------------------------------------------------
+
+    SharedObject<IncrementalEncoder> createIncrementalEncoder(Compressor::Method method, int level)
+    {
+        IncrementalEncoder* encoder = nullptr;
+
+        switch (method)
+        {
+            case Compressor::NONE:
+                encoder = new EncoderNone();
+                break;
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            case Compressor::LZ4:
+                encoder = new EncoderLZ4(level);
+                break;
+            case Compressor::ZSTD:
+                encoder = new EncoderZSTD(level);
+                break;
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+            case Compressor::BZIP2:
+                encoder = new EncoderBZIP2(level);
+                break;
+#endif
+            case Compressor::LZMA:
+                encoder = new EncoderLZMA(level);
+                break;
+            case Compressor::DEFLATE:
+                encoder = new EncoderDeflate(DeflateFormat::DEFLATE, level);
+                break;
+            case Compressor::ZLIB:
+                encoder = new EncoderDeflate(DeflateFormat::ZLIB, level);
+                break;
+            case Compressor::GZIP:
+                encoder = new EncoderDeflate(DeflateFormat::GZIP, level);
+                break;
+            default:
+                MANGO_EXCEPTION("[IncrementalEncoder] Unsupported compression method (%d).", int(method));
+        }
+
+        return encoder;
+    }
+
+    SharedObject<IncrementalDecoder> createIncrementalDecoder(Compressor::Method method)
+    {
+        IncrementalDecoder* decoder = nullptr;
+
+        switch (method)
+        {
+            case Compressor::NONE:
+                decoder = new DecoderNone();
+                break;
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            case Compressor::LZ4:
+                decoder = new DecoderLZ4();
+                break;
+            case Compressor::ZSTD:
+                decoder = new DecoderZSTD();
+                break;
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+            case Compressor::BZIP2:
+                decoder = new DecoderBZIP2();
+                break;
+#endif
+            case Compressor::LZMA:
+                decoder = new DecoderLZMA();
+                break;
+            case Compressor::DEFLATE:
+                decoder = new DecoderDeflate(DeflateFormat::DEFLATE);
+                break;
+            case Compressor::ZLIB:
+                decoder = new DecoderDeflate(DeflateFormat::ZLIB);
+                break;
+            case Compressor::GZIP:
+                decoder = new DecoderDeflate(DeflateFormat::GZIP);
+                break;
+            default:
+                MANGO_EXCEPTION("[IncrementalDecoder] Unsupported compression method (%d).", int(method));
+        }
+
+        return decoder;
+    }
+
+    // ----------------------------------------------------------------------------
+    // CompressStream
+    // ----------------------------------------------------------------------------
+
+    CompressStream::CompressStream(Stream& stream, Compressor::Method method, int level)
+        : m_stream(stream)
+        , m_encoder(createIncrementalEncoder(method, level))
+        , m_input(64 * 1024)
+        , m_output(64 * 1024)
+    {
+        m_put_ptr = m_input.data();
+        m_put_end = m_input.data() + m_input.size();
+    }
+
+    CompressStream::~CompressStream()
+    {
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+            // NOTE: call finish() explicitly to see the errors
+        }
+    }
+
+    void CompressStream::encode(ConstMemory input, bool finish)
+    {
+        m_offset += input.size;
+
+        for (;;)
+        {
+            Memory output(m_output.data(), m_output.size());
+            bool done = m_encoder->encode(input, output, finish);
+
+            const size_t bytes = m_output.size() - output.size;
+            if (bytes)
+            {
+                m_stream.write(m_output.data(), bytes);
+            }
+
+            if (finish ? done : !input.size)
+            {
+                break;
+            }
+        }
+    }
+
+    void CompressStream::finish()
+    {
+        if (m_finished)
+        {
+            return;
+        }
+
+        m_finished = true;
+
+        ConstMemory input(m_input.data(), m_put_ptr - m_input.data());
+        m_put_ptr = nullptr;
+        m_put_end = nullptr;
+
+        encode(input, true);
+    }
+
+    u64 CompressStream::size() const
+    {
+        return offset();
+    }
+
+    u64 CompressStream::offset() const
+    {
+        return m_put_ptr ? m_offset + (m_put_ptr - m_input.data()) : m_offset;
+    }
+
+    void CompressStream::seek(s64 distance, SeekMode mode)
+    {
+        MANGO_UNREFERENCED(distance);
+        MANGO_UNREFERENCED(mode);
+        MANGO_EXCEPTION("[CompressStream] seek() is not supported.");
+    }
+
+    void CompressStream::read(void* dest, u64 size)
+    {
+        MANGO_UNREFERENCED(dest);
+        MANGO_UNREFERENCED(size);
+        MANGO_EXCEPTION("[CompressStream] read() is not supported.");
+    }
+
+    void CompressStream::write(const void* data, u64 size)
+    {
+        if (m_finished)
+        {
+            MANGO_EXCEPTION("[CompressStream] The stream has been finished.");
+        }
+
+        // the put area is full
+        encode(ConstMemory(m_input.data(), m_put_ptr - m_input.data()), false);
+        m_put_ptr = m_input.data();
+
+        if (size >= m_input.size())
+        {
+            encode(ConstMemory(reinterpret_cast<const u8*>(data), size_t(size)), false);
+        }
+        else
+        {
+            std::memcpy(m_put_ptr, data, size_t(size));
+            m_put_ptr += size;
+        }
+    }
+
+    // ----------------------------------------------------------------------------
+    // DecompressStream
+    // ----------------------------------------------------------------------------
+
+    DecompressStream::DecompressStream(Stream& stream, Compressor::Method method)
+        : m_stream(stream)
+        , m_decoder(createIncrementalDecoder(method))
+        , m_buffer(64 * 1024)
+    {
+    }
+
+    DecompressStream::~DecompressStream()
+    {
+    }
+
+    size_t DecompressStream::readSome(Memory dest)
+    {
+        Memory output = dest;
+
+        while (output.size)
+        {
+            if (!m_input.size)
+            {
+                const u64 available = m_stream.size() - m_stream.offset();
+                if (available)
+                {
+                    const size_t bytes = size_t(std::min(available, u64(m_buffer.size())));
+                    m_stream.read(m_buffer.data(), bytes);
+                    m_input = ConstMemory(m_buffer.data(), bytes);
+                }
+                else if (m_end)
+                {
+                    // the compressed stream ends here
+                    break;
+                }
+            }
+
+            const size_t input_size = m_input.size;
+            const size_t output_size = output.size;
+
+            m_end = m_decoder->decode(m_input, output);
+
+            if (input_size == m_input.size && output_size == output.size)
+            {
+                if (m_end && !m_input.size)
+                {
+                    continue;
+                }
+
+                MANGO_EXCEPTION("[DecompressStream] Unexpected end of compressed data.");
+            }
+        }
+
+        const size_t bytes = dest.size - output.size;
+        m_offset += bytes;
+        return bytes;
+    }
+
+    u64 DecompressStream::size() const
+    {
+        return m_offset;
+    }
+
+    u64 DecompressStream::offset() const
+    {
+        return m_offset;
+    }
+
+    void DecompressStream::seek(s64 distance, SeekMode mode)
+    {
+        u64 target = 0;
+
+        switch (mode)
+        {
+            case BEGIN:
+                target = u64(distance);
+                break;
+            case CURRENT:
+                target = m_offset + distance;
+                break;
+            case END:
+                MANGO_EXCEPTION("[DecompressStream] The size is not known.");
+        }
+
+        if (target < m_offset)
+        {
+            MANGO_EXCEPTION("[DecompressStream] Cannot seek backwards.");
+        }
+
+        u8 temp[4096];
+
+        while (m_offset < target)
+        {
+            const size_t bytes = size_t(std::min(target - m_offset, u64(sizeof(temp))));
+            read(temp, bytes);
+        }
+    }
+
+    void DecompressStream::read(void* dest, u64 size)
+    {
+        Memory memory(reinterpret_cast<u8*>(dest), size_t(size));
+        if (readSome(memory) != memory.size)
+        {
+            MANGO_EXCEPTION("[DecompressStream] Reading past the end of the data.");
+        }
+    }
+
+    void DecompressStream::write(const void* data, u64 size)
+    {
+        MANGO_UNREFERENCED(data);
+        MANGO_UNREFERENCED(size);
+        MANGO_EXCEPTION("[DecompressStream] write() is not supported.");
+    }
+
+} // namespace mango
@@ -3,8 +3,21 @@
     Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <algorithm>
+#include <thread>
+#include <string>
+#include <map>
+#include <cstdio>
+#include <cstring>
 #include <mango/core/cpuinfo.hpp>
 
+#if defined(MANGO_PLATFORM_LINUX)
+    #include <dirent.h>
+    #include <sched.h>
+#elif defined(MANGO_PLATFORM_OSX) || defined(MANGO_PLATFORM_IOS)
+    #include <sys/types.h>
+    #include <sys/sysctl.h>
+#endif
+
 namespace
 {
     using namespace mango;
@@ -276,6 +289,444 @@ namespace
         return 0; // unsupported platform
     }
 
+#endif
+
+    // ----------------------------------------------------------------------------
+    // getCPUTopologyInternal()
+    // ----------------------------------------------------------------------------
+
+    void setDefaultTopology(CPUTopology& topology)
+    {
+        const int count = std::max(int(std::thread::hardware_concurrency()), 1);
+
+        topology.processors.clear();
+        for (int i = 0; i < count; ++i)
+        {
+            topology.processors.push_back({ i, i, 0, 0, 0 });
+        }
+
+        topology.packages = 1;
+        topology.nodes = 1;
+        topology.cores = count;
+    }
+
+#if defined(MANGO_PLATFORM_LINUX)
+
+    bool readLine(const std::string& filename, std::string& line)
+    {
+        FILE* file = std::fopen(filename.c_str(), "r");
+        if (!file)
+            return false;
+
+        char buffer[256];
+        bool status = std::fgets(buffer, sizeof(buffer), file) != nullptr;
+        std::fclose(file);
+
+        if (status)
+        {
+            line = buffer;
+            while (!line.empty() && (line.back() == '\n' || line.back() == ' '))
+            {
+                line.pop_back();
+            }
+        }
+
+        return status;
+    }
+
+    int readInt(const std::string& filename, int defaultValue)
+    {
+        std::string line;
+        if (!readLine(filename, line) || line.empty())
+            return defaultValue;
+        return std::atoi(line.c_str());
+    }
+
+    std::vector<int> parseList(const std::string& list)
+    {
+        // "0-3,8,10-11"
+        std::vector<int> result;
+
+        const char* s = list.c_str();
+        while (*s)
+        {
+            char* end;
+            int first = int(std::strtol(s, &end, 10));
+            if (end == s)
+                break;
+
+            int last = first;
+            s = end;
+
+            if (*s == '-')
+            {
+                last = int(std::strtol(s + 1, &end, 10));
+                s = end;
+            }
+
+            for (int i = first; i <= last; ++i)
+            {
+                result.push_back(i);
+            }
+
+            if (*s == ',')
+                ++s;
+        }
+
+        return result;
+    }
+
+    size_t parseSize(const std::string& text)
+    {
+        // "32K", "8192K", "16M"
+        size_t size = size_t(std::strtoull(text.c_str(), nullptr, 10));
+        switch (text.empty() ? 0 : text.back())
+        {
+            case 'K': size <<= 10; break;
+            case 'M': size <<= 20; break;
+            case 'G': size <<= 30; break;
+        }
+        return size;
+    }
+
+    void getCacheInfo(CPUTopology& topology, int processor)
+    {
+        const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(processor) + "/cache/index";
+
+        for (int index = 0; index < 16; ++index)
+        {
+            const std::string folder = path + std::to_string(index) + "/";
+
+            std::string type;
+            if (!readLine(folder + "type", type))
+                break;
+
+            if (type == "Instruction")
+                continue;
+
+            std::string size;
+            readLine(folder + "size", size);
+
+            int level = readInt(folder + "level", 0);
+            switch (level)
+            {
+                case 1: topology.l1 = parseSize(size); break;
+                case 2: topology.l2 = parseSize(size); break;
+                case 3: topology.l3 = parseSize(size); break;
+            }
+
+            int linesize = readInt(folder + "coherency_line_size", 0);
+            if (linesize > 0)
+            {
+                topology.cacheline = size_t(linesize);
+            }
+        }
+    }
+
+    CPUTopology getCPUTopologyInternal()
+    {
+        CPUTopology topology;
+
+        std::string online;
+        if (!readLine("/sys/devices/system/cpu/online", online))
+        {
+            setDefaultTopology(topology);
+            return topology;
+        }
+
+        // NUMA node for each processor; the node folder is missing without NUMA support
+        std::map<int, int> processorNode;
+
+        if (DIR* dir = opendir("/sys/devices/system/node"))
+        {
+            while (dirent* entry = readdir(dir))
+            {
+                int node;
+                if (std::sscanf(entry->d_name, "node%d", &node) != 1)
+                    continue;
+
+                std::string cpulist;
+                readLine(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist", cpulist);
+
+                for (int id : parseList(cpulist))
+                {
+                    processorNode[id] = node;
+                }
+            }
+
+            closedir(dir);
+        }
+
+        // remap OS numbering into dense indices
+        std::map<int, int> packages;
+        std::map<int, int> nodes;
+        std::map<std::pair<int, int>, int> cores;
+        std::map<int, int> threads; // hardware threads found so far in each core
+
+        for (int id : parseList(online))
+        {
+            const std::string folder = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+
+            int package = readInt(folder + "physical_package_id", 0);
+            int core = readInt(folder + "core_id", id);
+
+            auto i = processorNode.find(id);
+            int node = i != processorNode.end() ? i->second : 0;
+
+            CPUTopology::Processor processor;
+
+            processor.id = id;
+            processor.package = packages.emplace(package, int(packages.size())).first->second;
+            processor.node = nodes.emplace(node, int(nodes.size())).first->second;
+            processor.core = cores.emplace(std::make_pair(package, core), int(cores.size())).first->second;
+            processor.thread = threads[processor.core]++;
+
+            topology.processors.push_back(processor);
+        }
+
+        if (topology.processors.empty())
+        {
+            setDefaultTopology(topology);
+            return topology;
+        }
+
+        topology.packages = int(packages.size());
+        topology.nodes = int(nodes.size());
+        topology.cores = int(cores.size());
+
+        getCacheInfo(topology, topology.processors[0].id);
+
+        return topology;
+    }
+
+#elif defined(MANGO_PLATFORM_WINDOWS)
+
+    void appendProcessors(std::vector<int>& processors, const GROUP_AFFINITY& affinity)
+    {
+        // the processor number is unique across the processor groups
+        const int bits = int(sizeof(KAFFINITY) * 8);
+        for (int bit = 0; bit < bits; ++bit)
+        {
+            if (affinity.Mask & (KAFFINITY(1) << bit))
+            {
+                processors.push_back(int(affinity.Group) * 64 + bit);
+            }
+        }
+    }
+
+    CPUTopology getCPUTopologyInternal()
+    {
+        CPUTopology topology;
+
+        DWORD length = 0;
+        GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+
+        std::vector<u8> buffer(length);
+        if (!length || !GetLogicalProcessorInformationEx(RelationAll,
+            reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data()), &length))
+        {
+            setDefaultTopology(topology);
+            return topology;
+        }
+
+        std::vector<std::vector<int>> cores; // logical processors in each core
+        std::map<int, int> processorPackage;
+        std::map<int, int> processorNode;
+        int packageCount = 0;
+
+        for (DWORD offset = 0; offset < length; )
+        {
+            const auto& info = *reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+            offset += info.Size;
+
+            std::vector<int> processors;
+
+            switch (info.Relationship)
+            {
+                case RelationProcessorCore:
+                    for (WORD i = 0; i < info.Processor.GroupCount; ++i)
+                    {
+                        appendProcessors(processors, info.Processor.GroupMask[i]);
+                    }
+                    cores.push_back(processors);
+                    break;
+
+                case RelationProcessorPackage:
+                    for (WORD i = 0; i < info.Processor.GroupCount; ++i)
+                    {
+                        appendProcessors(processors, info.Processor.GroupMask[i]);
+                    }
+                    for (int id : processors)
+                    {
+                        processorPackage[id] = packageCount;
+                    }
+                    ++packageCount;
+                    break;
+
+                case RelationNumaNode:
+                    appendProcessors(processors, info.NumaNode.GroupMask);
+                    for (int id : processors)
+                    {
+                        processorNode[id] = int(info.NumaNode.NodeNumber);
+                    }
+                    break;
+
+                case RelationCache:
+                {
+                    // caches of the first processor
+                    const CACHE_RELATIONSHIP& cache = info.Cache;
+                    if (cache.Type == CacheInstruction || cache.GroupMask.Group || !(cache.GroupMask.Mask & 1))
+                        break;
+
+                    switch (cache.Level)
+                    {
+                        case 1: topology.l1 = size_t(cache.CacheSize); break;
+                        case 2: topology.l2 = size_t(cache.CacheSize); break;
+                        case 3: topology.l3 = size_t(cache.CacheSize); break;
+                    }
+
+                    if (cache.LineSize)
+                    {
+                        topology.cacheline = size_t(cache.LineSize);
+                    }
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+
+        // remap OS numbering into dense indices
+        std::map<int, int> packages;
+        std::map<int, int> nodes;
+
+        for (size_t core = 0; core < cores.size(); ++core)
+        {
+            int thread = 0;
+
+            for (int id : cores[core])
+            {
+                auto i = processorNode.find(id);
+                int node = i != processorNode.end() ? i->second : 0;
+
+                CPUTopology::Processor processor;
+
+                processor.id = id;
+                processor.core = int(core);
+                processor.package = packages.emplace(processorPackage[id], int(packages.size())).first->second;
+                processor.node = nodes.emplace(node, int(nodes.size())).first->second;
+                processor.thread = thread++;
+
+                topology.processors.push_back(processor);
+            }
+        }
+
+        if (topology.processors.empty())
+        {
+            setDefaultTopology(topology);
+            return topology;
+        }
+
+        std::sort(topology.processors.begin(), topology.processors.end(), [] (const CPUTopology::Processor& a, const CPUTopology::Processor& b)
+        {
+            return a.id < b.id;
+        });
+
+        topology.packages = int(packages.size());
+        topology.nodes = int(nodes.size());
+        topology.cores = int(cores.size());
+
+        return topology;
+    }
+
+#elif defined(MANGO_PLATFORM_OSX) || defined(MANGO_PLATFORM_IOS)
+
+    s64 readSysctl(const char* name, s64 defaultValue)
+    {
+        // the hw.* values are either 32 or 64 bit integers
+        u8 buffer[8] = { 0 };
+        size_t size = sizeof(buffer);
+
+        if (sysctlbyname(name, buffer, &size, nullptr, 0) != 0)
+            return defaultValue;
+
+        if (size == sizeof(s32))
+        {
+            s32 value;
+            std::memcpy(&value, buffer, sizeof(s32));
+            return value;
+        }
+
+        if (size == sizeof(s64))
+        {
+            s64 value;
+            std::memcpy(&value, buffer, sizeof(s64));
+            return value;
+        }
+
+        return defaultValue;
+    }
+
+    CPUTopology getCPUTopologyInternal()
+    {
+        CPUTopology topology;
+
+        // the kernel does not expose the processor to core mapping; the hardware
+        // threads of a core are numbered consecutively
+        const int logical = int(readSysctl("hw.logicalcpu", 0));
+        const int physical = int(readSysctl("hw.physicalcpu", 0));
+        const int packages = std::max(int(readSysctl("hw.packages", 1)), 1);
+
+        if (logical < 1 || physical < 1 || physical > logical)
+        {
+            setDefaultTopology(topology);
+            return topology;
+        }
+
+        const int threads = logical / physical;
+
+        for (int i = 0; i < logical; ++i)
+        {
+            const int core = std::min(i / threads, physical - 1);
+
+            CPUTopology::Processor processor;
+
+            processor.id = i;
+            processor.core = core;
+            processor.package = std::min(core * packages / physical, packages - 1);
+            processor.node = 0;
+            processor.thread = i - core * threads;
+
+            topology.processors.push_back(processor);
+        }
+
+        topology.packages = packages;
+        topology.nodes = 1;
+        topology.cores = physical;
+
+        topology.l1 = size_t(std::max(readSysctl("hw.l1dcachesize", 0), s64(0)));
+        topology.l2 = size_t(std::max(readSysctl("hw.l2cachesize", 0), s64(0)));
+        topology.l3 = size_t(std::max(readSysctl("hw.l3cachesize", 0), s64(0)));
+
+        const s64 cacheline = readSysctl("hw.cachelinesize", 0);
+        if (cacheline > 0)
+        {
+            topology.cacheline = size_t(cacheline);
+        }
+
+        return topology;
+    }
+
+#else
+
+    CPUTopology getCPUTopologyInternal()
+    {
+        CPUTopology topology;
+        setDefaultTopology(topology);
+        return topology;
+    }
+
 #endif
 
     // cache the flags
@@ -291,4 +742,21 @@ namespace mango
         return g_cpu_flags;
     }
 
+    const CPUTopology& getCPUTopology()
+    {
+        static CPUTopology topology = getCPUTopologyInternal();
+        return topology;
+    }
+
+    int getCurrentProcessor()
+    {
+#if defined(MANGO_PLATFORM_LINUX)
+        return sched_getcpu();
+#elif defined(MANGO_PLATFORM_WINDOWS)
+        return int(GetCurrentProcessorNumber());
+#else
+        return -1;
+#endif
+    }
+
 } // namespace mango
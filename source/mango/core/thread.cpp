@@ -2,15 +2,26 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
-#include <chrono>
+#include <algorithm>
+#include <map>
+#include <cmath>
+#include <cstdio>
 #include <mango/core/thread.hpp>
+#include <mango/core/cpuinfo.hpp>
+#include <mango/core/timer.hpp>
+#include <mango/core/bits.hpp>
 #include "../../external/concurrentqueue/concurrentqueue.h"
 #include "../../external/concurrentqueue/readerwriterqueue.h"
 
-using std::chrono::high_resolution_clock;
-using std::chrono::duration_cast;
-using std::chrono::microseconds;
-using std::chrono::milliseconds;
+#if defined(MANGO_PLATFORM_LINUX)
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#if defined(MANGO_CPU_INTEL)
+    #include <immintrin.h>
+#endif
 
 // ------------------------------------------------------------
 // thread affinity
@@ -21,31 +32,35 @@ using std::chrono::milliseconds;
 #include <pthread.h>
 
     template <typename H>
-    static void set_thread_affinity(H handle, int processor)
+    static void set_thread_affinity(H handle, const std::vector<int>& processors)
     {
         cpu_set_t cpuset;
 
         CPU_ZERO(&cpuset);
-        CPU_SET(processor, &cpuset);
+        for (int processor : processors)
+        {
+            CPU_SET(processor, &cpuset);
+        }
         pthread_setaffinity_np(handle, sizeof(cpu_set_t), &cpuset);
     }
 
-    static void set_current_thread_affinity(int processor)
-    {
-        set_thread_affinity(pthread_self(), processor);
-    }
-
 #elif defined(MANGO_PLATFORM_WINDOWS)
 
     template <typename H>
-    static void set_thread_affinity(H handle, int processor)
+    static void set_thread_affinity(H handle, const std::vector<int>& processors)
     {
-        SetThreadAffinityMask(handle, DWORD_PTR(1) << processor);
-    }
+        // NOTE: processors outside of the first processor group are ignored
+        DWORD_PTR mask = 0;
+        for (int processor : processors)
+        {
+            if (processor < 64)
+                mask |= DWORD_PTR(1) << processor;
+        }
 
-    static void set_current_thread_affinity(int processor)
-    {
-        set_thread_affinity(GetCurrentThread(), processor);
+        if (mask)
+        {
+            SetThreadAffinityMask(handle, mask);
+        }
     }
 
 #else
@@ -53,15 +68,10 @@ using std::chrono::milliseconds;
     // TODO: iOS, macOS, Android
 
     template <typename H>
-    static void set_thread_affinity(H handle, int processor)
+    static void set_thread_affinity(H handle, const std::vector<int>& processors)
     {
         MANGO_UNREFERENCED(handle);
-        MANGO_UNREFERENCED(processor);
-    }
-
-    static void set_current_thread_affinity(int processor)
-    {
-        MANGO_UNREFERENCED(processor);
+        MANGO_UNREFERENCED(processors);
     }
 
 #endif
@@ -90,6 +100,385 @@ using std::chrono::milliseconds;
 namespace mango
 {
 
+    // ------------------------------------------------------------
+    // TaskFunction storage
+    // ------------------------------------------------------------
+
+    /*
+        Storage for callables which don't fit into TaskFunction inline storage.
+        Blocks are rounded up to power-of-two size classes and recycled through
+        a thread-local free list. The tasks are typically allocated by the producer
+        and released by the worker which executed them, so the thread-local lists
+        exchange batches of blocks with a shared list to keep the memory flowing
+        back to the producers. Blocks larger than the largest class use the heap.
+    */
+
+    namespace
+    {
+
+        struct TaskBlock
+        {
+            TaskBlock* next;
+        };
+
+        constexpr int    task_block_classes = 5;    // 128 .. 2048 bytes
+        constexpr size_t task_block_min_size = 128;
+        constexpr size_t task_block_batch = 32;
+        constexpr size_t task_block_local_limit = task_block_batch * 2;
+
+        inline int getTaskBlockClass(size_t size)
+        {
+            int index = 0;
+            size_t capacity = task_block_min_size;
+            while (capacity < size)
+            {
+                capacity *= 2;
+                ++index;
+            }
+            return index;
+        }
+
+        inline size_t getTaskBlockSize(int index)
+        {
+            return task_block_min_size << index;
+        }
+
+        // move up to count blocks from the front of list into a chain
+        inline TaskBlock* splitTaskBlocks(TaskBlock*& list, size_t& available, size_t count)
+        {
+            TaskBlock* head = list;
+            TaskBlock* tail = nullptr;
+
+            for (size_t i = 0; i < count && list; ++i)
+            {
+                tail = list;
+                list = list->next;
+                --available;
+            }
+
+            if (tail)
+            {
+                tail->next = nullptr;
+            }
+
+            return tail ? head : nullptr;
+        }
+
+        inline void joinTaskBlocks(TaskBlock*& list, TaskBlock* chain)
+        {
+            if (chain)
+            {
+                TaskBlock* tail = chain;
+                while (tail->next)
+                {
+                    tail = tail->next;
+                }
+
+                tail->next = list;
+                list = chain;
+            }
+        }
+
+        struct TaskBlockArena
+        {
+            SpinLock lock;
+            TaskBlock* blocks[task_block_classes] { };
+            size_t count[task_block_classes] { };
+
+            ~TaskBlockArena()
+            {
+                for (int i = 0; i < task_block_classes; ++i)
+                {
+                    while (blocks[i])
+                    {
+                        TaskBlock* block = blocks[i];
+                        blocks[i] = block->next;
+                        ::operator delete(block);
+                    }
+                }
+            }
+
+            TaskBlock* acquire(int index)
+            {
+                SpinLockGuard guard(lock);
+                return splitTaskBlocks(blocks[index], count[index], task_block_batch);
+            }
+
+            void release(int index, TaskBlock* chain, size_t n)
+            {
+                SpinLockGuard guard(lock);
+                joinTaskBlocks(blocks[index], chain);
+                count[index] += n;
+            }
+        };
+
+        // NOTE: must be defined before the static ThreadPool instance so that it
+        //       outlives the worker threads when the program is terminating.
+        TaskBlockArena g_task_arena;
+
+        struct TaskBlockCache
+        {
+            TaskBlock* blocks[task_block_classes] { };
+            size_t count[task_block_classes] { };
+
+            ~TaskBlockCache()
+            {
+                for (int i = 0; i < task_block_classes; ++i)
+                {
+                    if (blocks[i])
+                    {
+                        g_task_arena.release(i, blocks[i], count[i]);
+                    }
+                }
+            }
+
+            void* allocate(int index)
+            {
+                if (!blocks[index])
+                {
+                    TaskBlock* chain = g_task_arena.acquire(index);
+                    for (TaskBlock* block = chain; block; block = block->next)
+                    {
+                        ++count[index];
+                    }
+                    blocks[index] = chain;
+                }
+
+                TaskBlock* block = blocks[index];
+                if (block)
+                {
+                    blocks[index] = block->next;
+                    --count[index];
+                    return block;
+                }
+
+                return ::operator new(getTaskBlockSize(index));
+            }
+
+            void free(int index, void* ptr)
+            {
+                TaskBlock* block = reinterpret_cast<TaskBlock*>(ptr);
+                block->next = blocks[index];
+                blocks[index] = block;
+
+                if (++count[index] > task_block_local_limit)
+                {
+                    // give a batch of blocks back to the producers
+                    size_t n = count[index];
+                    TaskBlock* chain = splitTaskBlocks(blocks[index], count[index], task_block_batch);
+                    g_task_arena.release(index, chain, n - count[index]);
+                }
+            }
+        };
+
+        thread_local TaskBlockCache g_task_cache;
+
+    } // namespace
+
+    namespace detail
+    {
+
+        void* allocateTaskStorage(size_t size)
+        {
+            const int index = getTaskBlockClass(size);
+            if (index >= task_block_classes)
+            {
+                return ::operator new(size);
+            }
+
+            return g_task_cache.allocate(index);
+        }
+
+        void freeTaskStorage(void* ptr, size_t size)
+        {
+            const int index = getTaskBlockClass(size);
+            if (index >= task_block_classes)
+            {
+                ::operator delete(ptr);
+                return;
+            }
+
+            g_task_cache.free(index, ptr);
+        }
+
+    } // namespace detail
+
+    // ------------------------------------------------------------
+    // Parker
+    // ------------------------------------------------------------
+
+    static inline
+    void cpu_pause()
+    {
+#if defined(MANGO_CPU_INTEL)
+        _mm_pause();
+#elif defined(MANGO_CPU_ARM) && !defined(MANGO_COMPILER_MICROSOFT)
+        __asm__ __volatile__("yield");
+#else
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+    }
+
+    /*
+        Parker puts one thread to sleep until another thread unparks it. The thread
+        announces with prepare() that it is about to park, checks one more time if
+        there is work to do and then either cancels or parks. The waker claims the
+        parked state with an atomic exchange so every park is matched with exactly
+        one wakeup and no wakeups are lost in between prepare() and park().
+    */
+
+    class Parker
+    {
+    protected:
+        enum : u32
+        {
+            RUNNING = 0,
+            PARKED = 1
+        };
+
+        std::atomic<u32> m_state { RUNNING };
+
+#if !defined(MANGO_PLATFORM_LINUX)
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+#endif
+
+    public:
+        void prepare()
+        {
+            m_state.store(PARKED, std::memory_order_seq_cst);
+        }
+
+        void cancel()
+        {
+            m_state.store(RUNNING, std::memory_order_relaxed);
+        }
+
+        bool unpark()
+        {
+            u32 expected = PARKED;
+            if (!m_state.compare_exchange_strong(expected, RUNNING))
+                return false;
+
+#if defined(MANGO_PLATFORM_LINUX)
+            syscall(SYS_futex, reinterpret_cast<u32*>(&m_state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_condition.notify_one();
+#endif
+            return true;
+        }
+
+        void park()
+        {
+#if defined(MANGO_PLATFORM_LINUX)
+            while (m_state.load(std::memory_order_acquire) == PARKED)
+            {
+                syscall(SYS_futex, reinterpret_cast<u32*>(&m_state), FUTEX_WAIT_PRIVATE, PARKED, nullptr, nullptr, 0);
+            }
+#else
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_state.load(std::memory_order_acquire) != PARKED; });
+#endif
+        }
+    };
+
+    // ------------------------------------------------------------
+    // WorkStealingDeque
+    // ------------------------------------------------------------
+
+    /*
+        Per-worker task deque. The owner pushes and pops at the back (LIFO) so that
+        the most recently spawned task runs next while it's data is still in cache.
+        Idle workers steal from the front (FIFO) which gives them the oldest work.
+
+        The deque is guarded with a spinlock; the owner is practically the only one
+        touching it until it has more work than it can handle so the lock is not
+        contended. The thieves check the atomic size first so that empty deques
+        can be skipped without touching the lock.
+    */
+
+    template <typename T>
+    class WorkStealingDeque : private NonCopyable
+    {
+    protected:
+        SpinLock m_lock;
+        std::vector<T> m_ring;
+        size_t m_mask;
+        size_t m_head { 0 }; // steal end
+        size_t m_tail { 0 }; // owner end
+        std::atomic<size_t> m_size { 0 };
+
+        void grow()
+        {
+            std::vector<T> ring(m_ring.size() * 2);
+            const size_t mask = ring.size() - 1;
+
+            for (size_t i = m_head; i != m_tail; ++i)
+            {
+                ring[i & mask] = std::move(m_ring[i & m_mask]);
+            }
+
+            m_ring.swap(ring);
+            m_mask = mask;
+        }
+
+    public:
+        WorkStealingDeque(size_t capacity = 256)
+            : m_ring(capacity)
+            , m_mask(capacity - 1)
+        {
+        }
+
+        bool empty() const
+        {
+            return m_size.load(std::memory_order_relaxed) == 0;
+        }
+
+        void push(T&& value)
+        {
+            SpinLockGuard guard(m_lock);
+
+            if (m_tail - m_head == m_ring.size())
+            {
+                grow();
+            }
+
+            m_ring[m_tail++ & m_mask] = std::move(value);
+            m_size.store(m_tail - m_head, std::memory_order_relaxed);
+        }
+
+        bool pop(T& value)
+        {
+            if (empty())
+                return false;
+
+            SpinLockGuard guard(m_lock);
+
+            if (m_tail == m_head)
+                return false;
+
+            value = std::move(m_ring[--m_tail & m_mask]);
+            m_size.store(m_tail - m_head, std::memory_order_relaxed);
+            return true;
+        }
+
+        bool steal(T& value)
+        {
+            if (empty())
+                return false;
+
+            SpinLockGuard guard(m_lock);
+
+            if (m_tail == m_head)
+                return false;
+
+            value = std::move(m_ring[m_head++ & m_mask]);
+            m_size.store(m_tail - m_head, std::memory_order_relaxed);
+            return true;
+        }
+    };
+
     // ------------------------------------------------------------
     // ThreadPool
     // ------------------------------------------------------------
@@ -105,165 +494,881 @@ namespace mango
         moodycamel::ConcurrentQueue<Task> tasks;
     };
 
+    // ------------------------------------------------------------
+    // ThreadPool instrumentation
+    // ------------------------------------------------------------
+
+    struct ThreadPool::Metrics
+    {
+        u32 name;
+        int priority;
+
+        std::atomic<u64> enqueued { 0 };
+        std::atomic<u64> executed { 0 };
+        std::atomic<u64> cancelled { 0 };
+
+        std::atomic<u64> wait[40];
+        std::atomic<u64> wait_total { 0 };
+        std::atomic<u64> execute[40];
+        std::atomic<u64> execute_total { 0 };
+
+        Metrics(u32 name, int priority)
+            : name(name)
+            , priority(priority)
+        {
+            for (int i = 0; i < 40; ++i)
+            {
+                wait[i] = 0;
+                execute[i] = 0;
+            }
+        }
+
+        static void record(std::atomic<u64>* buckets, std::atomic<u64>& total, u64 time)
+        {
+            int bucket = time ? std::min(u64_log2(time), 39) : 0;
+            buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            total.fetch_add(time, std::memory_order_relaxed);
+        }
+
+        static void resolve(Histogram& histogram, const std::atomic<u64>* buckets, const std::atomic<u64>& total)
+        {
+            for (int i = 0; i < 40; ++i)
+            {
+                u64 count = buckets[i].load(std::memory_order_relaxed);
+                histogram.buckets[i] = count;
+                histogram.count += count;
+            }
+            histogram.total = total.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct TraceEvent
+    {
+        u32 name;
+        int priority;
+        u64 start;
+        u64 duration;
+    };
+
+    struct TraceBuffer
+    {
+        // keep the memory usage bounded when tracing is left on
+        static constexpr size_t limit = 1 << 20;
+
+        SpinLock lock;
+        std::vector<TraceEvent> events;
+
+        void push(const TraceEvent& event)
+        {
+            SpinLockGuard guard(lock);
+            if (events.size() < limit)
+            {
+                events.push_back(event);
+            }
+        }
+    };
+
+    struct ThreadPool::Monitor
+    {
+        std::mutex mutex;
+        std::vector<std::string> names;
+        std::map<std::string, std::vector<std::unique_ptr<Metrics>>> metrics;
+
+        // time the instrumentation has been enabled
+        u64 start = 0;
+        u64 elapsed = 0;
+
+        // tasks executed by threads which are not workers of the pool (eg. in wait())
+        TraceBuffer external;
+    };
+
+    struct ThreadPool::Worker
+    {
+        using Task = ThreadPool::Task;
+
+        ThreadPool* pool { nullptr };
+        u32 seed { 0 };
+        int node { 0 };
+        Parker parker;
+
+        // idle counters; written only by the worker itself
+        std::atomic<u64> spins { 0 };
+        std::atomic<u64> yields { 0 };
+        std::atomic<u64> parks { 0 };
+
+        // instrumentation
+        std::atomic<u64> tasks { 0 };
+        std::atomic<u64> busy { 0 };
+        TraceBuffer trace;
+
+        static void increment(std::atomic<u64>& counter)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        WorkStealingDeque<Task> deques[3];
+        CacheLine padding;
+
+        u32 random()
+        {
+            // xorshift32
+            u32 x = seed;
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            seed = x;
+            return x;
+        }
+    };
+
+    static thread_local void* g_current_worker = nullptr;
+
+    static
+    ThreadPoolConfig getSizeConfig(size_t size)
+    {
+        ThreadPoolConfig config;
+        config.threads = int(size);
+        return config;
+    }
+
+    static
+    std::vector<CPUTopology::Processor> getProcessorOrder(const CPUTopology& topology)
+    {
+        // first hardware thread of every core before the SMT siblings, NUMA nodes interleaved
+        std::vector<CPUTopology::Processor> order = topology.processors;
+        std::vector<int> rank(order.size());
+        std::map<std::pair<int, int>, int> counters;
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            rank[i] = counters[std::make_pair(order[i].thread, order[i].node)]++;
+        }
+
+        std::vector<size_t> index(order.size());
+        for (size_t i = 0; i < index.size(); ++i)
+        {
+            index[i] = i;
+        }
+
+        std::stable_sort(index.begin(), index.end(), [&] (size_t a, size_t b)
+        {
+            if (order[a].thread != order[b].thread)
+                return order[a].thread < order[b].thread;
+            if (rank[a] != rank[b])
+                return rank[a] < rank[b];
+            return order[a].node < order[b].node;
+        });
+
+        std::vector<CPUTopology::Processor> result;
+        for (size_t i : index)
+        {
+            result.push_back(order[i]);
+        }
+
+        return result;
+    }
+
     ThreadPool::ThreadPool(size_t size)
+        : ThreadPool(getSizeConfig(size))
+    {
+    }
+
+    ThreadPool::ThreadPool(const ThreadPoolConfig& config)
         : m_queues(nullptr)
+        , m_node_count(1)
+        , m_workers(nullptr)
+        , m_monitor(new Monitor())
+        , m_spin_count(std::max(config.spin, 0))
+        , m_yield_count(std::max(config.yield, 0))
         , m_static_queue(this, int(Priority::NORMAL), "static")
-        , m_threads(size)
     {
-        m_queues = new TaskQueue[3];
+        const CPUTopology& topology = getCPUTopology();
+        const std::vector<CPUTopology::Processor> order = getProcessorOrder(topology);
+
+        size_t size = std::max(config.threads, 0);
+        if (!size)
+        {
+            size = config.smt ? topology.processors.size() : size_t(topology.cores);
+        }
+
+        size = std::max(size, size_t(1));
+
+        const bool affinity = config.affinity != ThreadPoolConfig::NONE;
+        const bool numa = affinity && config.numa && topology.nodes > 1;
+
+        if (numa)
+        {
+            m_node_count = topology.nodes;
+            for (auto& processor : topology.processors)
+            {
+                if (processor.id >= int(m_processor_node.size()))
+                    m_processor_node.resize(processor.id + 1, 0);
+                m_processor_node[processor.id] = processor.node;
+            }
+        }
+
+        m_queues = new TaskQueue[m_node_count * 3];
+        m_workers = new Worker[size];
+        m_threads.resize(size);
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_workers[i].pool = this;
+            m_workers[i].seed = u32(i * 0x9e3779b9 + 1);
+            m_workers[i].node = numa ? order[i % order.size()].node : 0;
+        }
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_threads[i] = std::thread([this, i]
+            {
+                thread(i);
+            });
+
+#if defined(MANGO_PLATFORM_WINDOWS)
+            if (concurrency > 64 && !affinity)
+            {
+                // HACK: work around Windows 64 logical processor per ProcessorGroup limitation
+                GROUP_AFFINITY group{};
+                group.Mask = KAFFINITY(~0);
+                group.Group = WORD(i & 1);
+
+                auto handle = get_native_handle(m_threads[i]);
+                BOOL r = SetThreadGroupAffinity(handle, &group, nullptr);
+            }
+#endif
+
+            if (affinity)
+            {
+                const CPUTopology::Processor& processor = order[i % order.size()];
+
+                std::vector<int> processors;
+                if (config.affinity == ThreadPoolConfig::NODE)
+                {
+                    for (auto& p : topology.processors)
+                    {
+                        if (p.node == processor.node)
+                            processors.push_back(p.id);
+                    }
+                }
+                else
+                {
+                    processors.push_back(processor.id);
+                }
+
+                set_thread_affinity(get_native_handle(m_threads[i]), processors);
+            }
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        m_stop = true;
+
+        for (size_t i = 0; i < m_threads.size(); ++i)
+        {
+            m_workers[i].parker.unpark();
+        }
+
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+
+        delete[] m_workers;
+        delete[] m_queues;
+        delete m_monitor;
+    }
+
+    int ThreadPool::getHardwareConcurrency()
+    {
+        return int(std::thread::hardware_concurrency());
+    }
+
+    ThreadPool& ThreadPool::getInstance()
+    {
+        return m_static_instance;
+    }
+
+    int ThreadPool::size() const
+    {
+        return int(m_threads.size());
+    }
+
+    int ThreadPool::getCurrentNode() const
+    {
+        if (m_node_count > 1)
+        {
+            int processor = getCurrentProcessor();
+            if (processor >= 0 && processor < int(m_processor_node.size()))
+            {
+                return m_processor_node[processor];
+            }
+        }
+
+        return 0;
+    }
+
+    ThreadPool::IdleStatistics ThreadPool::getIdleStatistics() const
+    {
+        IdleStatistics statistics;
+
+        for (size_t i = 0; i < m_threads.size(); ++i)
+        {
+            statistics.spins += m_workers[i].spins.load(std::memory_order_relaxed);
+            statistics.yields += m_workers[i].yields.load(std::memory_order_relaxed);
+            statistics.parks += m_workers[i].parks.load(std::memory_order_relaxed);
+        }
+
+        statistics.wakeups = m_wakeup_count.load(std::memory_order_relaxed);
+
+        return statistics;
+    }
+
+    ThreadPool::Metrics* ThreadPool::getMetrics(const std::string& name, int priority)
+    {
+        std::lock_guard<std::mutex> lock(m_monitor->mutex);
+
+        auto& list = m_monitor->metrics[name];
+        for (auto& metrics : list)
+        {
+            if (metrics->priority == priority)
+                return metrics.get();
+        }
+
+        u32 id = u32(m_monitor->names.size());
+        m_monitor->names.push_back(name);
+
+        list.emplace_back(new Metrics(id, priority));
+        return list.back().get();
+    }
+
+    void ThreadPool::setInstrumentation(Instrumentation instrumentation)
+    {
+        std::lock_guard<std::mutex> lock(m_monitor->mutex);
+
+        const int previous = m_instrumentation.load();
+        const int current = int(instrumentation);
+
+        if (!previous && current)
+        {
+            m_monitor->start = Time::ns();
+        }
+        else if (previous && !current)
+        {
+            m_monitor->elapsed += Time::ns() - m_monitor->start;
+        }
+
+        if (current == int(Instrumentation::TRACE) && previous != current)
+        {
+            // start a new trace
+            for (size_t i = 0; i <= m_threads.size(); ++i)
+            {
+                TraceBuffer& buffer = i < m_threads.size() ? m_workers[i].trace : m_monitor->external;
+                SpinLockGuard guard(buffer.lock);
+                buffer.events.clear();
+            }
+        }
+
+        m_instrumentation = current;
+    }
+
+    ThreadPool::Statistics ThreadPool::getStatistics() const
+    {
+        Statistics statistics;
+
+        std::lock_guard<std::mutex> lock(m_monitor->mutex);
+
+        statistics.elapsed = m_monitor->elapsed;
+        if (m_instrumentation.load())
+        {
+            statistics.elapsed += Time::ns() - m_monitor->start;
+        }
+
+        for (auto& node : m_monitor->metrics)
+        {
+            for (auto& metrics : node.second)
+            {
+                QueueStatistics queue;
+
+                queue.name = node.first;
+                queue.priority = metrics->priority;
+                queue.enqueued = metrics->enqueued.load(std::memory_order_relaxed);
+                queue.executed = metrics->executed.load(std::memory_order_relaxed);
+                queue.cancelled = metrics->cancelled.load(std::memory_order_relaxed);
+                Metrics::resolve(queue.wait, metrics->wait, metrics->wait_total);
+                Metrics::resolve(queue.execute, metrics->execute, metrics->execute_total);
+
+                if (queue.enqueued || queue.executed || queue.cancelled)
+                {
+                    statistics.queues.push_back(queue);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < m_threads.size(); ++i)
+        {
+            WorkerStatistics worker;
+
+            worker.tasks = m_workers[i].tasks.load(std::memory_order_relaxed);
+            worker.busy = m_workers[i].busy.load(std::memory_order_relaxed);
+            worker.idle = statistics.elapsed - std::min(worker.busy, statistics.elapsed);
+
+            statistics.workers.push_back(worker);
+        }
+
+        statistics.idle = getIdleStatistics();
+
+        return statistics;
+    }
+
+    static
+    void appendEscaped(std::string& json, const std::string& text)
+    {
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                json += '\\';
+                json += c;
+            }
+            else if (u8(c) < 0x20)
+            {
+                json += ' ';
+            }
+            else
+            {
+                json += c;
+            }
+        }
+    }
+
+    std::string ThreadPool::getTraceJSON() const
+    {
+        static const char* priorities [] = { "high", "normal", "low" };
+
+        std::vector<std::string> names;
+        {
+            std::lock_guard<std::mutex> lock(m_monitor->mutex);
+            names = m_monitor->names;
+        }
+
+        std::string json = "{\"traceEvents\":[\n";
+        char buffer[256];
+
+        const size_t count = m_threads.size();
+
+        for (size_t i = 0; i <= count; ++i)
+        {
+            std::snprintf(buffer, sizeof(buffer),
+                "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}},\n",
+                int(i), i < count ? "worker" : "other", int(i));
+            json += buffer;
+        }
+
+        for (size_t i = 0; i <= count; ++i)
+        {
+            TraceBuffer& trace = i < count ? m_workers[i].trace : m_monitor->external;
+
+            std::vector<TraceEvent> events;
+            {
+                SpinLockGuard guard(trace.lock);
+                events = trace.events;
+            }
+
+            for (const TraceEvent& event : events)
+            {
+                json += "{\"name\":\"";
+                appendEscaped(json, names[event.name]);
+
+                std::snprintf(buffer, sizeof(buffer),
+                    "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+                    priorities[event.priority % 3], int(i), event.start / 1000.0, event.duration / 1000.0);
+                json += buffer;
+            }
+        }
+
+        // remove the trailing comma
+        json.erase(json.size() - 2, 1);
+        json += "],\"displayTimeUnit\":\"ns\"}\n";
+
+        return json;
+    }
+
+    u64 ThreadPool::Histogram::average() const
+    {
+        return count ? total / count : 0;
+    }
+
+    u64 ThreadPool::Histogram::percentile(float p) const
+    {
+        const u64 target = u64(std::ceil(double(count) * p));
+
+        u64 sum = 0;
+        for (int i = 0; i < 40; ++i)
+        {
+            sum += buckets[i];
+            if (sum >= target && sum > 0)
+                return (u64(2) << i) - 1;
+        }
+
+        return 0;
+    }
+
+    void ThreadPool::thread(size_t threadID)
+    {
+        Worker* worker = &m_workers[threadID];
+        g_current_worker = worker;
+
+        int idle = 0;
+
+        while (!m_stop.load(std::memory_order_relaxed))
+        {
+            if (dequeue_and_process())
+            {
+                idle = 0;
+                continue;
+            }
+
+            ++idle;
+
+            if (idle <= m_spin_count)
+            {
+                Worker::increment(worker->spins);
+                for (int i = 0; i < 16; ++i)
+                {
+                    cpu_pause();
+                }
+            }
+            else if (idle <= m_spin_count + m_yield_count)
+            {
+                Worker::increment(worker->yields);
+                std::this_thread::yield();
+            }
+            else
+            {
+                park(worker);
+                idle = 0;
+            }
+        }
+
+        g_current_worker = nullptr;
+    }
+
+    void ThreadPool::park(Worker* worker)
+    {
+        worker->parker.prepare();
+        ++m_sleep_count;
+
+        // the enqueue might have missed the parked state; look for work once more
+        Task task;
+        if (m_stop.load() || dequeue(worker, task))
+        {
+            worker->parker.cancel();
+            --m_sleep_count;
+
+            if (task.queue)
+            {
+                process(worker, task);
+            }
+
+            return;
+        }
 
-        // NOTE: let OS scheduler shuffle tasks as it sees fit
-        //       this gives better performance overall UNTIL we have some practical
-        //       use for the affinity (eg. dependent tasks using same cache)
-        const bool affinity = false;//std::thread::hardware_concurrency() > 1;
-		if (affinity)
+        Worker::increment(worker->parks);
+        worker->parker.park();
+        --m_sleep_count;
+    }
+
+    void ThreadPool::wake(int node)
+    {
+        // pairs with the parked state + m_sleep_count update in park()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_sleep_count.load(std::memory_order_relaxed) == 0)
+            return;
+
+        const size_t count = m_threads.size();
+        const size_t start = m_wake_index.fetch_add(1, std::memory_order_relaxed);
+        const int passes = m_node_count > 1 ? 2 : 1;
+
+        // wake up exactly one parked worker, preferring the given node
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                Worker& worker = m_workers[(start + i) % count];
+
+                if (passes > 1 && (worker.node == node) != (pass == 0))
+                    continue;
+
+                if (worker.parker.unpark())
+                {
+                    m_wakeup_count.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        }
+    }
+
+    void ThreadPool::enqueue(Queue* queue, TaskFunction&& func)
+    {
+        Task task;
+        task.queue = queue;
+        task.func = std::move(func);
+
+        if (m_instrumentation.load(std::memory_order_relaxed))
+        {
+            Metrics* metrics = queue->metrics.load(std::memory_order_acquire);
+            if (!metrics)
+            {
+                // every thread resolving the queue concurrently gets the same metrics
+                metrics = getMetrics(queue->name, queue->priority);
+                queue->metrics.store(metrics, std::memory_order_release);
+            }
+
+            task.time = std::max(Time::ns(), u64(1));
+            metrics->enqueued.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ++queue->task_counter;
+
+        Worker* worker = static_cast<Worker*>(g_current_worker);
+        if (worker && worker->pool == this)
+        {
+            // enqueued from a task running in this pool; keep the work local
+            worker->deques[queue->priority].push(std::move(task));
+            wake(worker->node);
+        }
+        else
         {
-            set_current_thread_affinity(0);
+            const int node = getCurrentNode();
+            m_queues[node * 3 + queue->priority].tasks.enqueue(std::move(task));
+            wake(node);
         }
+    }
 
-        for (size_t i = 0; i < size; ++i)
+    bool ThreadPool::dequeue(Worker* worker, Task& task)
+    {
+        const size_t count = m_threads.size();
+        const int home = worker ? worker->node : getCurrentNode();
+        const int passes = m_node_count > 1 ? 2 : 1;
+
+        // scan task queues in priority order
+        for (size_t priority = 0; priority < 3; ++priority)
         {
-            m_threads[i] = std::thread([this, i]
+            // newest local task first (LIFO)
+            if (worker && worker->deques[priority].pop(task))
             {
-                thread(i);
-            });
+                return true;
+            }
 
-#if defined(MANGO_PLATFORM_WINDOWS)
-            if (concurrency > 64)
+            // tasks submitted from outside of the pool; own node first
+            for (int i = 0; i < m_node_count; ++i)
             {
-                // HACK: work around Windows 64 logical processor per ProcessorGroup limitation
-                GROUP_AFFINITY group{};
-                group.Mask = KAFFINITY(~0);
-                group.Group = WORD(i & 1);
-
-                auto handle = get_native_handle(m_threads[i]);
-                BOOL r = SetThreadGroupAffinity(handle, &group, nullptr);
+                const int node = (home + i) % m_node_count;
+                if (m_queues[node * 3 + priority].tasks.try_dequeue(task))
+                {
+                    return true;
+                }
             }
-#endif
 
-            if (affinity)
+            // steal oldest task from other workers (FIFO); start from a random
+            // victim so that the thieves don't all converge on the same worker.
+            // workers on the same node are tried before the remote ones.
+            size_t start = worker ? worker->random() : 0;
+            for (int pass = 0; pass < passes; ++pass)
             {
-                set_thread_affinity(get_native_handle(m_threads[i]), int(i + 1));
+                for (size_t i = 0; i < count; ++i)
+                {
+                    Worker& victim = m_workers[(start + i) % count];
+                    if (&victim == worker)
+                        continue;
+
+                    if (passes > 1 && (victim.node == home) != (pass == 0))
+                        continue;
+
+                    if (victim.deques[priority].steal(task))
+                    {
+                        return true;
+                    }
+                }
             }
         }
+
+        return false;
     }
 
-    ThreadPool::~ThreadPool()
+    bool ThreadPool::isSkipped(const Queue* queue)
     {
-        m_stop = true;
-        m_condition.notify_all();
+        if (queue->cancelled.load(std::memory_order_relaxed))
+            return true;
 
-        for (auto& thread : m_threads)
+        const u64 deadline = queue->deadline.load(std::memory_order_relaxed);
+        return deadline && Time::ms() >= deadline;
+    }
+
+    void ThreadPool::process(Worker* worker, Task& task)
+    {
+        if (task.time)
         {
-            thread.join();
+            process_instrumented(worker, task);
+            return;
         }
 
-        delete[] m_queues;
-    }
+        Queue* queue = task.queue;
 
-    int ThreadPool::getHardwareConcurrency()
-    {
-        return int(std::thread::hardware_concurrency());
+        // check if the task is cancelled
+        if (!isSkipped(queue))
+        {
+            // process task
+            task.func();
+        }
+
+        --queue->task_counter;
     }
 
-    ThreadPool& ThreadPool::getInstance()
+    void ThreadPool::process_instrumented(Worker* worker, Task& task)
     {
-        return m_static_instance;
+        Queue* queue = task.queue;
+        Metrics* metrics = queue->metrics.load(std::memory_order_acquire);
+
+        if (isSkipped(queue))
+        {
+            metrics->cancelled.fetch_add(1, std::memory_order_relaxed);
+            --queue->task_counter;
+            return;
+        }
+
+        u64 time0 = Time::ns();
+        task.func();
+        u64 time1 = Time::ns();
+
+        const u64 duration = time1 - time0;
+
+        Metrics::record(metrics->wait, metrics->wait_total, time0 - std::min(task.time, time0));
+        Metrics::record(metrics->execute, metrics->execute_total, duration);
+        metrics->executed.fetch_add(1, std::memory_order_relaxed);
+
+        if (worker)
+        {
+            Worker::increment(worker->tasks);
+            worker->busy.store(worker->busy.load(std::memory_order_relaxed) + duration, std::memory_order_relaxed);
+        }
+
+        if (m_instrumentation.load(std::memory_order_relaxed) == int(Instrumentation::TRACE))
+        {
+            TraceBuffer& buffer = worker ? worker->trace : m_monitor->external;
+            buffer.push({ metrics->name, metrics->priority, time0, duration });
+        }
+
+        --queue->task_counter;
     }
 
-    int ThreadPool::size() const
+    bool ThreadPool::dequeue_and_process()
     {
-        return int(m_threads.size());
+        Worker* worker = static_cast<Worker*>(g_current_worker);
+        if (worker && worker->pool != this)
+        {
+            // a worker of another pool is helping this one
+            worker = nullptr;
+        }
+
+        Task task;
+        if (dequeue(worker, task))
+        {
+            process(worker, task);
+            return true;
+        }
+
+        return false;
     }
 
-    void ThreadPool::thread(size_t threadID)
+    void ThreadPool::wait(Queue* queue)
     {
-        MANGO_UNREFERENCED(threadID);
+        int idle = 0;
 
-        auto time0 = high_resolution_clock::now();
-
-        while (!m_stop.load(std::memory_order_relaxed))
+        while (queue->task_counter > 0)
         {
             if (dequeue_and_process())
             {
-                // remember the last time we processed a task
-                time0 = high_resolution_clock::now();
+                idle = 0;
+                continue;
+            }
+
+            // the remaining tasks are being processed by the workers; spinning
+            // is cheap for short tasks but after that the waiter would only take
+            // cpu time from the workers (up to 2x slower on oversubscribed cores)
+            if (++idle <= m_spin_count)
+            {
+                cpu_pause();
             }
             else
             {
-                // don't be too eager to sleep
-                auto time1 = high_resolution_clock::now();
-                auto elapsed = duration_cast<milliseconds>(time1 - time0).count();
-                if (elapsed >= microseconds(1200).count())
-                {
-                    // sleep but check what's happening after a while unless signaled
-                    ++m_sleep_count;
-                    std::unique_lock<std::mutex> lock(m_queue_mutex);
-                    m_condition.wait_for(lock, milliseconds(120));
-                    --m_sleep_count;
-                }
-                else
-                {
-                    // no work; yield and try again soon
-                    std::this_thread::yield();
-                }
+                std::this_thread::yield();
             }
         }
     }
 
-    void ThreadPool::enqueue(Queue* queue, std::function<void()>&& func)
+    void ThreadPool::cancel(Queue* queue)
     {
-        Task task;
-        task.queue = queue;
-        task.func = std::move(func);
+        queue->cancelled = true;
+        wait(queue);
+        queue->cancelled = false;
+    }
 
-        ++queue->task_counter;
-        m_queues[queue->priority].tasks.enqueue(std::move(task));
+    // ------------------------------------------------------------
+    // CancellationToken
+    // ------------------------------------------------------------
+
+    namespace detail
+    {
 
-        if (m_sleep_count > 0)
+        bool CancellationState::isCancelled() const
         {
-            m_condition.notify_one();
+            if (cancelled.load(std::memory_order_relaxed))
+                return true;
+
+            const u64 time = deadline.load(std::memory_order_relaxed);
+            return time && Time::ms() >= time;
         }
+
+    } // namespace detail
+
+    CancellationSource::CancellationSource()
+        : m_state(std::make_shared<detail::CancellationState>())
+    {
     }
 
-    bool ThreadPool::dequeue_and_process()
+    CancellationSource::~CancellationSource()
     {
-        // scan task queues in priority order
-        for (size_t priority = 0; priority < 3; ++priority)
-        {
-            Task task;
-            if (m_queues[priority].tasks.try_dequeue(task))
-            {
-                Queue* queue = task.queue;
+    }
 
-                // check if the task is cancelled
-                if (!queue->cancelled)
-                {
-                    // process task
-                    task.func();
-                }
+    CancellationToken CancellationSource::token() const
+    {
+        CancellationToken token;
+        token.m_state = m_state;
+        return token;
+    }
 
-                --queue->task_counter;
-                return true;
-            }
-        }
+    void CancellationSource::cancel()
+    {
+        m_state->cancelled = true;
+    }
 
-        return false;
+    void CancellationSource::setDeadline(u64 time)
+    {
+        m_state->deadline = time;
     }
 
-    void ThreadPool::wait(Queue* queue)
+    void CancellationSource::setTimeout(u64 ms)
     {
-        while (queue->task_counter > 0)
-        {
-            dequeue_and_process();
-        }
+        m_state->deadline = Time::ms() + ms;
     }
 
-    void ThreadPool::cancel(Queue* queue)
+    bool CancellationSource::isCancelled() const
     {
-        queue->cancelled = true;
-        wait(queue);
-        queue->cancelled = false;
+        return m_state->isCancelled();
     }
 
     // ------------------------------------------------------------
@@ -282,6 +1387,12 @@ namespace mango
     {
     }
 
+    ConcurrentQueue::ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority)
+        : m_pool(pool)
+        , m_queue(&m_pool, int(priority), name)
+    {
+    }
+
     ConcurrentQueue::~ConcurrentQueue()
     {
         wait();
@@ -302,12 +1413,53 @@ namespace mango
         m_pool.wait(&m_queue);
     }
 
+    void ConcurrentQueue::setDeadline(u64 time)
+    {
+        m_queue.deadline = time;
+    }
+
+    void ConcurrentQueue::setTimeout(u64 ms)
+    {
+        m_queue.deadline = Time::ms() + ms;
+    }
+
+    // ------------------------------------------------------------
+    // parallel_for
+    // ------------------------------------------------------------
+
+    namespace detail
+    {
+
+        int getParallelGrain(int range, int grain)
+        {
+            // split into at most this many tasks per worker; a few tasks per worker
+            // are enough for load balancing as the thieves take the largest pieces
+            constexpr int tasks_per_worker = 8;
+
+            const int workers = ThreadPool::getInstance().size();
+            const int count = std::max(workers * tasks_per_worker, 1);
+            const int minimum = (range + count - 1) / count;
+
+            return std::max(std::max(grain, minimum), 1);
+        }
+
+        int getParallelRowGrain(size_t bytes_per_row)
+        {
+            constexpr size_t bytes_per_task = 64 * 1024;
+
+            size_t rows = bytes_per_task / std::max(bytes_per_row, size_t(1));
+            return int(std::min(std::max(rows, size_t(1)), size_t(1) << 30));
+        }
+
+    } // namespace detail
+
     // ------------------------------------------------------------
     // SerialQueue
     // ------------------------------------------------------------
 
     SerialQueue::SerialQueue()
         : m_name("serial.default")
+        , m_ring(1024)
     {
         m_thread = std::thread([this] {
             thread();
@@ -316,6 +1468,7 @@ namespace mango
 
     SerialQueue::SerialQueue(const std::string& name)
         : m_name(name)
+        , m_ring(1024)
     {
         m_thread = std::thread([this] {
             thread();
@@ -326,43 +1479,129 @@ namespace mango
     {
         wait();
 
-        std::unique_lock<std::mutex> queue_lock(m_queue_mutex);
         m_stop = true;
-        queue_lock.unlock();
 
-        m_task_condition.notify_one();
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_sleeping = false;
+            m_sleep_condition.notify_one();
+        }
+
         m_thread.join();
     }
 
+    void SerialQueue::push(TaskFunction&& task)
+    {
+        ++m_task_counter;
+
+        // once a task is in the overflow list the following tasks must go there too
+        // so that they are executed in the order they were enqueued
+        if (m_overflow_active.load(std::memory_order_acquire) || !m_ring.push(std::move(task)))
+        {
+            std::lock_guard<std::mutex> lock(m_overflow_mutex);
+            m_overflow.push_back(std::move(task));
+            m_overflow_active = true;
+        }
+
+        // pairs with the fence in thread(): either we see the sleeping flag or the
+        // execution thread sees the task before it goes to sleep
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_sleeping.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_sleeping = false;
+            m_sleep_condition.notify_one();
+        }
+    }
+
+    bool SerialQueue::pop(TaskFunction& task)
+    {
+        if (m_ring.pop(task))
+            return true;
+
+        // the ring is drained before the overflow list; the tasks in the list
+        // were enqueued after the ones in the ring
+        if (!m_overflow_active.load(std::memory_order_acquire))
+            return false;
+
+        std::lock_guard<std::mutex> lock(m_overflow_mutex);
+        if (m_overflow.empty())
+            return false;
+
+        task = std::move(m_overflow.front());
+        m_overflow.pop_front();
+
+        if (m_overflow.empty())
+        {
+            m_overflow_active = false;
+        }
+
+        return true;
+    }
+
+    void SerialQueue::complete(int count)
+    {
+        if (m_task_counter.fetch_sub(count) == count)
+        {
+            std::lock_guard<std::mutex> lock(m_wait_mutex);
+            m_wait_condition.notify_all();
+        }
+    }
+
     void SerialQueue::thread()
     {
-        while (!m_stop.load(std::memory_order_relaxed))
+        TaskFunction task;
+
+        for (;;)
         {
-            std::unique_lock<std::mutex> queue_lock(m_queue_mutex);
-            if (m_task_counter > 0)
+            if (pop(task))
             {
-                auto task = std::move(m_task_queue.front());
-                m_task_queue.pop_front();
-                queue_lock.unlock();
-
                 task();
-
-                std::unique_lock<std::mutex> wait_lock(m_wait_mutex);
-                --m_task_counter;
+                task = TaskFunction();
+                complete(1);
+                continue;
             }
-            else
+
+            if (m_stop.load(std::memory_order_relaxed))
+                break;
+
+            m_sleeping = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (!m_ring.empty() || m_overflow_active.load(std::memory_order_relaxed) || m_stop.load(std::memory_order_relaxed))
             {
-                m_wait_condition.notify_all();
-                m_task_condition.wait(queue_lock, [this] { return m_stop || m_task_counter; });
+                m_sleeping = false;
+                continue;
             }
+
+            std::unique_lock<std::mutex> lock(m_sleep_mutex);
+            m_sleep_condition.wait(lock, [this] { return !m_sleeping.load(std::memory_order_relaxed); });
         }
     }
 
     void SerialQueue::cancel()
     {
-        std::unique_lock<std::mutex> queue_lock(m_queue_mutex);
-        m_task_counter -= u32(m_task_queue.size());
-        m_task_queue.clear();
+        int count = 0;
+
+        TaskFunction task;
+        while (m_ring.pop(task))
+        {
+            task = TaskFunction();
+            ++count;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_overflow_mutex);
+            count += int(m_overflow.size());
+            m_overflow.clear();
+            m_overflow_active = false;
+        }
+
+        if (count)
+        {
+            complete(count);
+        }
     }
 
     void SerialQueue::wait()
@@ -487,4 +1726,112 @@ namespace mango
         m_wait_condition.wait(wait_lock, [this] { return !m_ticket_counter.load(std::memory_order_relaxed); });
     }
 
+    // ------------------------------------------------------------
+    // TaskGraph
+    // ------------------------------------------------------------
+
+    TaskGraph::TaskGraph()
+        : m_queue("graph.default")
+    {
+    }
+
+    TaskGraph::TaskGraph(const std::string& name, Priority priority)
+        : m_queue(name, priority)
+    {
+    }
+
+    TaskGraph::~TaskGraph()
+    {
+        wait();
+    }
+
+    TaskGraph::Node* TaskGraph::insert(TaskFunction&& func, Node* const* predecessors, size_t count)
+    {
+        Node* node = new Node();
+        node->m_func = std::move(func);
+
+        {
+            SpinLockGuard guard(m_nodes_lock);
+            m_nodes.emplace_back(node);
+        }
+
+        ++m_active;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Node* predecessor = predecessors[i];
+            if (!predecessor)
+                continue;
+
+            SpinLockGuard guard(predecessor->m_lock);
+            if (!predecessor->m_finished)
+            {
+                predecessor->m_successors.push_back(node);
+                ++node->m_pending;
+            }
+        }
+
+        // release the guard reference; schedule if all predecessors have completed
+        if (--node->m_pending == 0)
+        {
+            schedule(node);
+        }
+
+        return node;
+    }
+
+    void TaskGraph::schedule(Node* node)
+    {
+        if (!node->m_func)
+        {
+            // join point; no need to go through the pool
+            complete(node);
+            return;
+        }
+
+        m_queue.enqueue([this, node]
+        {
+            node->m_func();
+            complete(node);
+        });
+    }
+
+    void TaskGraph::complete(Node* node)
+    {
+        // release the captured state as early as possible
+        node->m_func = TaskFunction();
+
+        std::vector<Node*> successors;
+        {
+            SpinLockGuard guard(node->m_lock);
+            node->m_finished = true;
+            successors.swap(node->m_successors);
+        }
+
+        for (Node* successor : successors)
+        {
+            if (--successor->m_pending == 0)
+            {
+                schedule(successor);
+            }
+        }
+
+        --m_active;
+    }
+
+    void TaskGraph::wait()
+    {
+        while (m_active > 0)
+        {
+            // helps with the enqueued tasks and yields while the workers finish them;
+            // the nodes which are still waiting for a predecessor are enqueued by it
+            m_queue.wait();
+
+            if (m_active > 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
 } // namespace mango
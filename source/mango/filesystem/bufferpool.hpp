@@ -0,0 +1,93 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <mango/core/configure.hpp>
+#include <mango/core/memory.hpp>
+
+namespace mango {
+namespace filesystem {
+
+    // -----------------------------------------------------------------
+    // ReadBufferPool
+    // -----------------------------------------------------------------
+
+    /*
+        Recycled read buffers; the buffers are page aligned and their capacity is
+        rounded up to 64 KB so that files of similar size share the buffers. At most
+        limit bytes are kept in the pool; the rest are released.
+    */
+
+    class ReadBufferPool : protected NonCopyable
+    {
+    protected:
+        std::mutex m_mutex;
+        std::multimap<size_t, u8*> m_buffers;
+        size_t m_bytes = 0;
+        size_t m_limit;
+
+    public:
+        ReadBufferPool(size_t limit)
+            : m_limit(limit)
+        {
+        }
+
+        ~ReadBufferPool()
+        {
+            for (auto& buffer : m_buffers)
+            {
+                aligned_free(buffer.second);
+            }
+        }
+
+        u8* acquire(size_t size, size_t& capacity)
+        {
+            capacity = std::max(size_t(1), (size + 0xffff) & ~size_t(0xffff));
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                // don't waste a buffer which is more than twice as large as requested
+                auto it = m_buffers.lower_bound(capacity);
+                if (it != m_buffers.end() && it->first <= capacity * 2)
+                {
+                    u8* buffer = it->second;
+                    capacity = it->first;
+                    m_bytes -= capacity;
+                    m_buffers.erase(it);
+                    return buffer;
+                }
+            }
+
+            return reinterpret_cast<u8*>(aligned_malloc(capacity, Alignment(4096)));
+        }
+
+        void release(u8* buffer, size_t capacity)
+        {
+            if (!buffer)
+            {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                if (m_bytes + capacity <= m_limit)
+                {
+                    m_bytes += capacity;
+                    m_buffers.emplace(capacity, buffer);
+                    return;
+                }
+            }
+
+            aligned_free(buffer);
+        }
+    };
+
+} // namespace filesystem
+} // namespace mango
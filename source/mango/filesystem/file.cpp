@@ -115,7 +115,26 @@ namespace filesystem {
 
     u64 File::size() const
     {
-        return getMemory().size;
+        // does not materialize lazily decompressed memory
+        return m_memory ? m_memory->size() : 0;
+    }
+
+    ConstMemory File::view(u64 offset, u64 size) const
+    {
+        return m_memory ? m_memory->view(offset, size) : ConstMemory();
+    }
+
+    size_t File::read(void* dest, u64 offset, size_t size) const
+    {
+        return m_memory ? m_memory->read(dest, offset, size) : 0;
+    }
+
+    void File::advise(AccessHint hint, u64 offset, u64 size) const
+    {
+        if (m_memory)
+        {
+            m_memory->advise(hint, offset, size);
+        }
     }
 
     ConstMemory File::getMemory() const
@@ -123,5 +142,69 @@ namespace filesystem {
         return m_memory ? *m_memory : ConstMemory();
     }
 
+    // -----------------------------------------------------------------
+    // FilePrefetch
+    // -----------------------------------------------------------------
+
+    FilePrefetch::FilePrefetch(Priority priority)
+        : m_queue("file.prefetch", priority)
+    {
+    }
+
+    FilePrefetch::~FilePrefetch()
+    {
+        m_queue.cancel();
+    }
+
+    void FilePrefetch::enqueue(const std::string& filename, u64 offset, u64 size)
+    {
+        m_queue.enqueue([filename, offset, size]
+        {
+            try
+            {
+                File file(filename);
+                file.advise(AccessHint::POPULATE, offset, size);
+            }
+            catch (...)
+            {
+                // the prefetch is only a hint
+            }
+        });
+    }
+
+    void FilePrefetch::enqueue(const std::vector<std::string>& filenames)
+    {
+        for (const std::string& filename : filenames)
+        {
+            enqueue(filename);
+        }
+    }
+
+    void FilePrefetch::enqueue(const Path& path, const std::string& filename, u64 offset, u64 size)
+    {
+        m_queue.enqueue([&path, filename, offset, size]
+        {
+            try
+            {
+                File file(path, filename);
+                file.advise(AccessHint::POPULATE, offset, size);
+            }
+            catch (...)
+            {
+                // the prefetch is only a hint
+            }
+        });
+    }
+
+    void FilePrefetch::cancel()
+    {
+        m_queue.cancel();
+    }
+
+    void FilePrefetch::wait()
+    {
+        m_queue.wait();
+    }
+
 } // namespace filesystem
 } // namespace mango
@@ -0,0 +1,197 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <mango/core/core.hpp>
+#include <mango/filesystem/filesystem.hpp>
+#include <mango/image/fourcc.hpp>
+#include "indexcache.hpp"
+
+/*
+    Index cache file layout (the index is in native byte order; the cache is local
+    to the machine):
+
+    "mgi0"
+    u32 version
+    u64 key
+    index
+
+    The file name is the key in hexadecimal with ".index" extension.
+*/
+
+namespace
+{
+    using namespace mango;
+    using namespace mango::filesystem;
+
+    constexpr u32 index_cache_version = 1;
+    constexpr size_t index_cache_header = 16;
+
+    // the ZIP directory end record (and ZIP64 locator) is in the archive tail
+    constexpr size_t index_cache_tail = 64 * 1024;
+
+    struct IndexCacheSettings
+    {
+        std::mutex mutex;
+        std::string folder;
+    };
+
+    IndexCacheSettings& getSettings()
+    {
+        static IndexCacheSettings settings;
+        return settings;
+    }
+
+    std::string getFilename(u64 key)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%016llx.index", static_cast<unsigned long long>(key));
+        return buffer;
+    }
+
+} // namespace
+
+namespace mango {
+namespace filesystem {
+
+    void setArchiveIndexCache(const std::string& folder)
+    {
+        IndexCacheSettings& settings = getSettings();
+        std::lock_guard<std::mutex> lock(settings.mutex);
+
+        settings.folder = folder;
+        if (!folder.empty() && folder.back() != '/')
+        {
+            settings.folder += '/';
+        }
+    }
+
+    std::string getArchiveIndexCache()
+    {
+        IndexCacheSettings& settings = getSettings();
+        std::lock_guard<std::mutex> lock(settings.mutex);
+        return settings.folder;
+    }
+
+    u64 getIndexCacheKey(ConstMemory archive, u64 time, u32 format)
+    {
+        if (!time || !archive.address || getArchiveIndexCache().empty())
+        {
+            // the archive is not a native file or the cache is disabled
+            return 0;
+        }
+
+        const size_t tail = std::min(archive.size, index_cache_tail);
+
+        const u64 values[] =
+        {
+            u64(archive.size),
+            time,
+            u64(format),
+            u64(index_cache_version),
+            xx3hash64(0, archive.slice(archive.size - tail)),
+        };
+
+        u64 key = xx3hash64(0, ConstMemory(reinterpret_cast<const u8*>(values), sizeof(values)));
+        return key ? key : 1;
+    }
+
+    std::unique_ptr<VirtualMemory> loadIndexCache(u64 key, ConstMemory& index)
+    {
+        std::unique_ptr<VirtualMemory> memory;
+
+        const std::string folder = getArchiveIndexCache();
+        const std::string filename = getFilename(key);
+
+        if (folder.empty() || !key)
+        {
+            return memory;
+        }
+
+        Path path(folder);
+        AbstractMapper* mapper = path.getMapper();
+
+        if (!mapper || !mapper->isFile(filename))
+        {
+            return memory;
+        }
+
+        try
+        {
+            // the folder is in the native filesystem; the memory is a file mapping which
+            // does not reference the path so it can be returned
+            memory.reset(mapper->mmap(filename));
+        }
+        catch (...)
+        {
+            // the index might have been removed after isFile()
+            return memory;
+        }
+
+        ConstMemory data = *memory;
+
+        if (data.size < index_cache_header)
+        {
+            memory.reset();
+            return memory;
+        }
+
+        LittleEndianConstPointer p = data.address;
+        u32 magic = p.read32();
+        u32 version = p.read32();
+        u64 stored_key = p.read64();
+
+        if (magic != u32_mask('m', 'g', 'i', '0') || version != index_cache_version || stored_key != key)
+        {
+            memory.reset();
+            return memory;
+        }
+
+        index = data.slice(index_cache_header);
+        return memory;
+    }
+
+    void storeIndexCache(u64 key, ConstMemory index)
+    {
+        const std::string folder = getArchiveIndexCache();
+
+        if (folder.empty() || !key)
+        {
+            return;
+        }
+
+        const std::string filename = folder + getFilename(key);
+
+        // write into a temporary file and rename it so that a partially written
+        // index is never mapped (concurrent writers produce an identical index)
+        const std::string temp = filename + "." + std::to_string(Time::us()) + ".tmp";
+
+        try
+        {
+            {
+                FileStream file(temp, Stream::WRITE);
+                LittleEndianStream s = file;
+
+                s.write32(u32_mask('m', 'g', 'i', '0'));
+                s.write32(index_cache_version);
+                s.write64(key);
+                file.write(index);
+            }
+
+            if (std::rename(temp.c_str(), filename.c_str()))
+            {
+                std::remove(temp.c_str());
+            }
+        }
+        catch (...)
+        {
+            // the cache is optional; the folder might be read-only
+            std::remove(temp.c_str());
+        }
+    }
+
+} // namespace filesystem
+} // namespace mango
@@ -0,0 +1,54 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <memory>
+#include <mango/core/configure.hpp>
+#include <mango/core/memory.hpp>
+
+namespace mango {
+namespace filesystem {
+
+    // -----------------------------------------------------------------
+    // persistent archive index cache
+    // -----------------------------------------------------------------
+
+    /*
+        Mappers store their serialized index in the cache after parsing the archive
+        and map it on the next open (see setArchiveIndexCache()). The format is the
+        mapper's identifier for the layout of the index; it must be changed when the
+        serialized headers change.
+
+        Usage example:
+
+        u64 key = getIndexCacheKey(parent, time, u32_mask('z', 'i', 'p', '0'));
+        if (key)
+        {
+            ConstMemory index;
+            std::unique_ptr<VirtualMemory> memory = loadIndexCache(key, index);
+            if (memory && load(index)) ... // the index refers to the mapped memory
+        }
+
+        ... parse the archive ...
+
+        if (key)
+        {
+            MemoryStream stream;
+            save(stream);
+            storeIndexCache(key, stream);
+        }
+    */
+
+    // zero when the index of the archive is not cached
+    u64 getIndexCacheKey(ConstMemory archive, u64 time, u32 format);
+
+    // memory mapped index or nullptr if the index is not in the cache; the index is 8 byte aligned
+    std::unique_ptr<VirtualMemory> loadIndexCache(u64 key, ConstMemory& index);
+
+    // failure to store the index is not an error; the archive is parsed again on the next open
+    void storeIndexCache(u64 key, ConstMemory index);
+
+} // namespace filesystem
+} // namespace mango
@@ -1,60 +1,570 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #pragma once
 
 #include <string>
-#include <map>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <mango/core/configure.hpp>
+#include <mango/core/memory.hpp>
+#include <mango/core/stream.hpp>
+#include <mango/core/hash.hpp>
 
 namespace mango {
 namespace filesystem {
+namespace detail {
+
+    // -----------------------------------------------------------------
+    // Array
+    // -----------------------------------------------------------------
+
+    /*
+        Read-only view of an array which is either owned by a std::vector or
+        stored in a memory mapped index. The serialized form is the number of
+        elements followed by the elements in native layout, padded to 8 bytes so
+        that the next array is aligned when the index is mapped.
+    */
+
+    template <typename T>
+    struct Array
+    {
+        const T* data = nullptr;
+        size_t size = 0;
+
+        void set(const std::vector<T>& vector)
+        {
+            data = vector.data();
+            size = vector.size();
+        }
+
+        const T& operator [] (size_t index) const
+        {
+            return data[index];
+        }
+
+        void save(Stream& stream) const
+        {
+            const u64 count = size;
+            stream.write(&count, sizeof(count));
+            stream.write(data, size * sizeof(T));
+
+            const u8 zeros[8] = { 0 };
+            stream.write(zeros, (0 - size * sizeof(T)) & 7);
+        }
+
+        bool load(ConstMemory& memory)
+        {
+            if (memory.size < sizeof(u64))
+                return false;
+
+            u64 count;
+            std::memcpy(&count, memory.address, sizeof(count));
+
+            const u64 available = (memory.size - sizeof(u64)) / sizeof(T);
+            if (count > available)
+                return false;
+
+            const size_t bytes = (size_t(count) * sizeof(T) + 7) & ~size_t(7);
+            if (sizeof(u64) + bytes > memory.size)
+                return false;
+
+            data = reinterpret_cast<const T*>(memory.address + sizeof(u64));
+            size = size_t(count);
+            memory = memory.slice(sizeof(u64) + bytes);
+            return true;
+        }
+    };
+
+} // namespace detail
+
+    // -----------------------------------------------------------------
+    // NameTable
+    // -----------------------------------------------------------------
+
+    /*
+        Open addressing (linear probing) hash table of names which are stored in
+        one contiguous character arena. The table stores indices to the names so
+        that it can be grown without touching the arena.
+    */
+
+    class NameTable
+    {
+    protected:
+        struct Name
+        {
+            u64 offset;
+            u32 length;
+            u32 hash;
+        };
+
+        enum : u32 { EMPTY = 0xffffffff };
+
+        // storage while the table is being built
+        std::vector<char> m_arena;
+        std::vector<Name> m_names;
+        std::vector<u32> m_slots; // name index, empty slots are ~0
+
+        // the table contents; the vectors above or a memory mapped index
+        detail::Array<char> m_arena_view;
+        detail::Array<Name> m_names_view;
+        detail::Array<u32> m_slots_view;
+
+        static u32 computeHash(const char* text, size_t length)
+        {
+            return u32(xx3hash64(0, ConstMemory(reinterpret_cast<const u8*>(text), length)));
+        }
+
+        bool isEqual(const Name& name, const char* text, size_t length, u32 hash) const
+        {
+            return name.hash == hash && name.length == length &&
+                   !std::memcmp(m_arena_view.data + name.offset, text, length);
+        }
+
+        void update()
+        {
+            m_arena_view.set(m_arena);
+            m_names_view.set(m_names);
+            m_slots_view.set(m_slots);
+        }
+
+        void rehash(size_t capacity)
+        {
+            m_slots.assign(capacity, u32(EMPTY));
+            const size_t mask = capacity - 1;
+
+            for (size_t i = 0; i < m_names.size(); ++i)
+            {
+                size_t slot = m_names[i].hash & mask;
+                while (m_slots[slot] != EMPTY)
+                {
+                    slot = (slot + 1) & mask;
+                }
+                m_slots[slot] = u32(i);
+            }
+
+            update();
+        }
+
+    public:
+        size_t size() const
+        {
+            return m_names_view.size;
+        }
+
+        void reserve(size_t count, size_t characters)
+        {
+            m_names.reserve(count);
+            m_arena.reserve(characters);
+
+            size_t capacity = 16;
+            while (capacity < count * 2)
+            {
+                capacity *= 2;
+            }
+
+            if (capacity > m_slots.size())
+            {
+                rehash(capacity);
+            }
+        }
+
+        // returns the index of the name or ~0 if the name is not in the table
+        u32 find(const char* text, size_t length) const
+        {
+            if (!m_names_view.size)
+                return EMPTY;
+
+            const u32 hash = computeHash(text, length);
+            const size_t mask = m_slots_view.size - 1;
+
+            for (size_t slot = hash & mask; m_slots_view[slot] != EMPTY; slot = (slot + 1) & mask)
+            {
+                const u32 index = m_slots_view[slot];
+                if (isEqual(m_names_view[index], text, length, hash))
+                {
+                    return index;
+                }
+            }
+
+            return EMPTY;
+        }
+
+        // returns the index of the name; the name is added if it is not in the table
+        u32 insert(const char* text, size_t length, bool& inserted)
+        {
+            // keep the load factor at 50% or below
+            if ((m_names.size() + 1) * 2 > m_slots.size())
+            {
+                rehash(std::max(m_slots.size() * 2, size_t(16)));
+            }
+
+            const u32 hash = computeHash(text, length);
+            const size_t mask = m_slots.size() - 1;
+
+            size_t slot = hash & mask;
+            for ( ; m_slots[slot] != EMPTY; slot = (slot + 1) & mask)
+            {
+                const u32 index = m_slots[slot];
+                if (isEqual(m_names[index], text, length, hash))
+                {
+                    inserted = false;
+                    return index;
+                }
+            }
+
+            const u32 index = u32(m_names.size());
+            m_names.push_back({ m_arena.size(), u32(length), hash });
+            m_arena.insert(m_arena.end(), text, text + length);
+            m_slots[slot] = index;
+            update();
+
+            inserted = true;
+            return index;
+        }
+
+        const char* getName(u32 index) const
+        {
+            return m_arena_view.data + m_names_view[index].offset;
+        }
+
+        size_t getLength(u32 index) const
+        {
+            return m_names_view[index].length;
+        }
+
+        // strict weak ordering of the names; same as comparing the names as std::string
+        bool less(u32 a, u32 b) const
+        {
+            const Name& na = m_names_view[a];
+            const Name& nb = m_names_view[b];
+            int x = std::memcmp(m_arena_view.data + na.offset, m_arena_view.data + nb.offset,
+                                std::min(na.length, nb.length));
+            return x < 0 || (x == 0 && na.length < nb.length);
+        }
+
+        void save(Stream& stream) const
+        {
+            m_arena_view.save(stream);
+            m_names_view.save(stream);
+            m_slots_view.save(stream);
+        }
+
+        bool load(ConstMemory& memory)
+        {
+            if (!m_arena_view.load(memory) || !m_names_view.load(memory) || !m_slots_view.load(memory))
+                return false;
+
+            // validate so that a damaged index cannot cause out of bounds access
+            const size_t capacity = m_slots_view.size;
+            if (capacity & (capacity - 1) || capacity < m_names_view.size * 2)
+                return false;
+
+            for (size_t i = 0; i < m_names_view.size; ++i)
+            {
+                const Name& name = m_names_view[i];
+                if (name.offset > m_arena_view.size || name.length > m_arena_view.size - name.offset)
+                    return false;
+            }
+
+            for (size_t i = 0; i < capacity; ++i)
+            {
+                u32 index = m_slots_view[i];
+                if (index != EMPTY && index >= m_names_view.size)
+                    return false;
+            }
+
+            return true;
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // Indexer
+    // -----------------------------------------------------------------
+
+    /*
+        Flat index of the archive contents. The headers are stored by their full
+        path in one contiguous array and looked up through a hash table; every folder
+        has a contiguous range of children sorted by name.
+
+        Inserting a path which already is in the index overwrites the header. The
+        folder ranges are built by finalize(); it must be called after the last
+        insert and before the folders are queried (the headers can be queried at
+        any time). The index is read-only after finalize() so it can be queried
+        from multiple threads.
+
+        Indices of trivially copyable headers can be saved and loaded; the loaded
+        index refers to the memory it was loaded from without copying it.
+
+        Usage example:
+
+        Indexer<Header> index;
+        index.insert("foo/", "foo/bar.txt", header);
+        index.finalize();
+
+        for (auto entry : index.getFolder("foo/"))
+        {
+            // entry.name: "bar.txt", entry.header: header
+        }
+    */
 
     template <typename Header>
     class Indexer
     {
     public:
-        struct Folder
+        struct Entry
+        {
+            std::string name; // name in the folder; folder names end with '/'
+            const Header& header;
+        };
+
+        class Folder
         {
-            std::map<std::string, Header *> headers;
+        protected:
+            const Indexer* m_indexer;
+            const u32* m_begin;
+            const u32* m_end;
+
+        public:
+            class Iterator
+            {
+            protected:
+                const Indexer* m_indexer;
+                const u32* m_current;
+
+            public:
+                Iterator(const Indexer* indexer, const u32* current)
+                    : m_indexer(indexer)
+                    , m_current(current)
+                {
+                }
+
+                Entry operator * () const
+                {
+                    return m_indexer->getEntry(*m_current);
+                }
+
+                Iterator& operator ++ ()
+                {
+                    ++m_current;
+                    return *this;
+                }
+
+                bool operator != (const Iterator& other) const
+                {
+                    return m_current != other.m_current;
+                }
+            };
+
+            Folder(const Indexer* indexer, const u32* begin, const u32* end)
+                : m_indexer(indexer)
+                , m_begin(begin)
+                , m_end(end)
+            {
+            }
+
+            Iterator begin() const
+            {
+                return Iterator(m_indexer, m_begin);
+            }
+
+            Iterator end() const
+            {
+                return Iterator(m_indexer, m_end);
+            }
+
+            size_t size() const
+            {
+                return size_t(m_end - m_begin);
+            }
+
+            bool empty() const
+            {
+                return m_begin == m_end;
+            }
         };
 
     protected:
-        std::map<std::string, Folder> folders;
-        std::map<std::string, Header> headers;
+        struct Range
+        {
+            u32 begin;
+            u32 end;
+        };
+
+        NameTable m_names;          // full path of every header
+        NameTable m_folder_names;   // folders which have children
+
+        std::vector<Header> m_headers;
+        std::vector<u32> m_parents;  // folder of every header
+        std::vector<u32> m_children; // header indices, grouped by folder and sorted by name
+        std::vector<Range> m_ranges; // children of every folder
+
+        detail::Array<Header> m_headers_view;
+        detail::Array<u32> m_parents_view;
+        detail::Array<u32> m_children_view;
+        detail::Array<Range> m_ranges_view;
+
+        Entry getEntry(u32 index) const
+        {
+            // the name in the folder is the full path without the folder name
+            const size_t prefix = m_folder_names.getLength(m_parents_view[index]);
+            const char* name = m_names.getName(index) + prefix;
+            const size_t length = m_names.getLength(index) - prefix;
+            return Entry { std::string(name, length), m_headers_view[index] };
+        }
 
     public:
+        size_t size() const
+        {
+            return m_headers_view.size;
+        }
+
+        // reserve space for the given number of headers and characters in their names
+        void reserve(size_t count, size_t characters = 0)
+        {
+            m_names.reserve(count, characters);
+            m_headers.reserve(count);
+            m_parents.reserve(count);
+        }
+
         void insert(const std::string& foldername, const std::string& filename, const Header& header)
         {
-            Header* ptr = &headers[filename];
-            *ptr = header;
-            folders[foldername].headers.emplace(filename, ptr);
+            bool inserted;
+            u32 index = m_names.insert(filename.data(), filename.length(), inserted);
+
+            if (!inserted)
+            {
+                m_headers[index] = header;
+                return;
+            }
+
+            u32 parent = m_folder_names.insert(foldername.data(), foldername.length(), inserted);
+
+            m_headers.push_back(header);
+            m_parents.push_back(parent);
+
+            m_headers_view.set(m_headers);
+            m_parents_view.set(m_parents);
+            m_ranges_view = detail::Array<Range>();
         }
 
-        const Folder* getFolder(const std::string& pathname) const
+        void finalize()
         {
-            const Folder* result = nullptr; // default: not found
+            const size_t count = m_headers.size();
+            const size_t folders = m_folder_names.size();
+
+            // counting sort by folder
+            m_ranges.assign(folders, Range { 0, 0 });
+
+            for (u32 parent : m_parents)
+            {
+                ++m_ranges[parent].end;
+            }
+
+            u32 offset = 0;
+            for (Range& range : m_ranges)
+            {
+                range.begin = offset;
+                offset += range.end;
+                range.end = range.begin;
+            }
+
+            m_children.resize(count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                m_children[m_ranges[m_parents[i]].end++] = u32(i);
+            }
 
-            auto i = folders.find(pathname);
-            if (i != folders.end())
+            // sort the children of every folder by name
+            for (const Range& range : m_ranges)
             {
-                result = &i->second;
+                std::sort(m_children.begin() + range.begin, m_children.begin() + range.end, [this] (u32 a, u32 b)
+                {
+                    return m_names.less(a, b);
+                });
             }
 
-            return result;
+            m_children_view.set(m_children);
+            m_ranges_view.set(m_ranges);
+        }
+
+        Folder getFolder(const std::string& pathname) const
+        {
+            u32 index = m_folder_names.find(pathname.data(), pathname.length());
+            if (index >= m_ranges_view.size)
+            {
+                // not found
+                return Folder(this, nullptr, nullptr);
+            }
+
+            const Range& range = m_ranges_view[index];
+            const u32* children = m_children_view.data;
+            return Folder(this, children + range.begin, children + range.end);
         }
 
         const Header* getHeader(const std::string& filename) const
         {
-            const Header* result = nullptr; // default: not found
+            u32 index = m_names.find(filename.data(), filename.length());
+            if (index >= m_headers_view.size)
+            {
+                // not found
+                return nullptr;
+            }
+
+            return &m_headers_view[index];
+        }
+
+        // save the finalized index
+        void save(Stream& stream) const
+        {
+            static_assert(std::is_trivially_copyable<Header>::value, "Header must be trivially copyable.");
+
+            m_names.save(stream);
+            m_folder_names.save(stream);
+            m_headers_view.save(stream);
+            m_parents_view.save(stream);
+            m_children_view.save(stream);
+            m_ranges_view.save(stream);
+        }
+
+        // load a finalized index; the memory must be 8 byte aligned and outlive the index
+        bool load(ConstMemory memory)
+        {
+            static_assert(std::is_trivially_copyable<Header>::value, "Header must be trivially copyable.");
+
+            bool status = m_names.load(memory) && m_folder_names.load(memory) &&
+                          m_headers_view.load(memory) && m_parents_view.load(memory) &&
+                          m_children_view.load(memory) && m_ranges_view.load(memory);
+
+            // validate so that a damaged index cannot cause out of bounds access
+            const size_t count = m_headers_view.size;
+            status = status && m_names.size() == count && m_parents_view.size == count &&
+                     m_children_view.size == count && m_ranges_view.size == m_folder_names.size();
+
+            for (size_t i = 0; status && i < count; ++i)
+            {
+                const u32 parent = m_parents_view[i];
+                status = parent < m_folder_names.size() &&
+                         m_folder_names.getLength(parent) <= m_names.getLength(u32(i)) &&
+                         m_children_view[i] < count;
+            }
+
+            for (size_t i = 0; status && i < m_ranges_view.size; ++i)
+            {
+                const Range& range = m_ranges_view[i];
+                status = range.begin <= range.end && range.end <= count;
+            }
 
-            auto i = headers.find(filename);
-            if (i != headers.end())
+            if (!status)
             {
-                result = &i->second;
+                *this = Indexer();
             }
 
-            return result;
+            return status;
         }
     };
 
@@ -0,0 +1,67 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <mutex>
+#include <functional>
+#include <mango/core/memory.hpp>
+
+namespace mango {
+namespace filesystem {
+
+    // -----------------------------------------------------------------
+    // VirtualMemoryDeferred
+    // -----------------------------------------------------------------
+
+    /*
+        Memory which is decompressed on the first access to it's contents; used
+        for the compression formats which can only be decompressed as a whole. The
+        size is known without decompressing so opening a file and querying it's size
+        is cheap. The decompression errors are reported at the first access.
+    */
+
+    class VirtualMemoryDeferred : public mango::VirtualMemory
+    {
+    public:
+        using DecodeFunc = std::function<void(u8* dest)>;
+
+    protected:
+        u8* m_buffer;
+        const u8* m_delete_source;
+        mutable DecodeFunc m_decode;
+        mutable std::once_flag m_once;
+
+        void materialize(u64 offset, u64 size) const override
+        {
+            MANGO_UNREFERENCED(offset);
+            MANGO_UNREFERENCED(size);
+
+            std::call_once(m_once, [this]
+            {
+                m_decode(m_buffer);
+                m_decode = nullptr;
+            });
+        }
+
+    public:
+        // the decode function writes size bytes into dest; delete_source is an optional
+        // buffer (eg. decrypted compressed data) owned by the memory object
+        VirtualMemoryDeferred(size_t size, const u8* delete_source, DecodeFunc decode)
+            : m_buffer(new u8[size])
+            , m_delete_source(delete_source)
+            , m_decode(std::move(decode))
+        {
+            m_memory = ConstMemory(m_buffer, size);
+        }
+
+        ~VirtualMemoryDeferred()
+        {
+            delete [] m_buffer;
+            delete [] m_delete_source;
+        }
+    };
+
+} // namespace filesystem
+} // namespace mango
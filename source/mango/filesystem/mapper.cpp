@@ -4,7 +4,10 @@
 */
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#include <exception>
 #include <mango/core/string.hpp>
+#include <mango/core/thread.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
 
@@ -16,16 +19,17 @@ namespace filesystem {
     // -----------------------------------------------------------------
 
 #ifdef MANGO_ENABLE_ARCHIVE_ZIP
-    AbstractMapper* createMapperZIP(ConstMemory parent, const std::string& password);
+    AbstractMapper* createMapperZIP(ConstMemory parent, const std::string& password, u64 time);
 #endif
 #ifdef MANGO_ENABLE_ARCHIVE_RAR
-    AbstractMapper* createMapperRAR(ConstMemory parent, const std::string& password);
+    AbstractMapper* createMapperRAR(ConstMemory parent, const std::string& password, u64 time);
 #endif
 #ifdef MANGO_ENABLE_ARCHIVE_MGX
-    AbstractMapper* createMapperMGX(ConstMemory parent, const std::string& password);
+    AbstractMapper* createMapperMGX(ConstMemory parent, const std::string& password, u64 time);
 #endif
 
-    using CreateMapperFunc = AbstractMapper* (*)(ConstMemory, const std::string&);
+    // time is the modification time of the container file; zero when it is not a native file
+    using CreateMapperFunc = AbstractMapper* (*)(ConstMemory, const std::string&, u64);
 
     struct MapperExtension
     {
@@ -44,9 +48,9 @@ namespace filesystem {
         {
         }
 
-        AbstractMapper* createMapper(ConstMemory memory, const std::string& password) const
+        AbstractMapper* createMapper(ConstMemory memory, const std::string& password, u64 time) const
         {
-            AbstractMapper* mapper = createMapperFunc(memory, password);
+            AbstractMapper* mapper = createMapperFunc(memory, password, time);
             return mapper;
         }
     };
@@ -132,6 +136,95 @@ namespace filesystem {
         }
     }
 
+    // -----------------------------------------------------------------
+    // AbstractMapper
+    // -----------------------------------------------------------------
+
+    void AbstractMapper::walk(FileIndex& index, const std::string& pathname, const WalkFilter& filter)
+    {
+        // serial walk for the mappers which list folders cheaply (the archives)
+        std::vector<std::string> folders(1);
+
+        while (!folders.empty())
+        {
+            const std::string folder = folders.back();
+            folders.pop_back();
+
+            FileIndex current;
+            getIndex(current, pathname + folder);
+
+            for (const FileInfo& node : current)
+            {
+                const std::string name = folder + node.name;
+
+                if (node.isDirectory() && !node.isContainer())
+                {
+                    if (!filter.folder || filter.folder(name))
+                    {
+                        index.files.emplace_back(name, node.size, node.flags);
+                        folders.push_back(name);
+                    }
+                }
+                else if (!filter.file || filter.file(name))
+                {
+                    index.files.emplace_back(name, node.size, node.flags);
+                }
+            }
+        }
+    }
+
+    void AbstractMapper::map(const std::vector<std::string>& filenames, const MapIndexCallback& callback)
+    {
+        ConcurrentQueue queue("mapper.map");
+
+        // the first exception thrown by the callback; rethrown when all of the files are processed
+        std::exception_ptr exception;
+        std::mutex mutex;
+
+        for (size_t i = 0; i < filenames.size(); ++i)
+        {
+            queue.enqueue([this, i, &filenames, &callback, &exception, &mutex]
+            {
+                std::unique_ptr<VirtualMemory> memory;
+                Status status;
+
+                try
+                {
+                    memory.reset(mmap(filenames[i]));
+
+                    // decompress in the worker instead of at the first access
+                    ConstMemory data = *memory;
+                    MANGO_UNREFERENCED(data);
+                }
+                catch (const std::exception& e)
+                {
+                    memory.reset();
+                    status.setError(e.what());
+                }
+
+                try
+                {
+                    callback(i, std::move(memory), status);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!exception)
+                    {
+                        exception = std::current_exception();
+                    }
+                }
+            });
+        }
+
+        queue.wait();
+
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+
     // -----------------------------------------------------------------
     // Mapper
     // -----------------------------------------------------------------
@@ -224,8 +317,9 @@ namespace filesystem {
 
                 if (m_mapper->isFile(container))
                 {
+                    u64 time = m_mapper->getTime(container);
                     m_parent_memory = m_mapper->mmap(container);
-                    mapper = extension.createMapper(*m_parent_memory, password);
+                    mapper = extension.createMapper(*m_parent_memory, password, time);
                     m_mappers.emplace_back(mapper);
                     m_mapper = mapper;
 
@@ -262,7 +356,7 @@ namespace filesystem {
             if (n != std::string::npos)
             {
                 // found a container interface; let's create it
-                AbstractMapper* mapper = extension.createMapper(memory, password);
+                AbstractMapper* mapper = extension.createMapper(memory, password, 0);
                 m_mappers.emplace_back(mapper);
                 return mapper;
             }
@@ -5,6 +5,8 @@
 #include <mango/core/core.hpp>
 #include <mango/filesystem/filesystem.hpp>
 #include <mango/image/fourcc.hpp>
+#include <list>
+#include <unordered_map>
 #include "indexer.hpp"
 
 #ifdef MANGO_ENABLE_ARCHIVE_MGX
@@ -14,7 +16,49 @@ namespace
     using namespace mango;
     namespace fs = mango::filesystem;
 
+    constexpr u32 mgx_version = 1; // the newest version which can be read
     constexpr u64 mgx_header_size = 24;
+    constexpr u32 mgx_dictionary_flag = 0x100;
+
+    // -----------------------------------------------------------------
+    // DictionaryRegistry
+    // -----------------------------------------------------------------
+
+    // dictionaries which are not embedded in the containers, indexed by id
+
+    class DictionaryRegistry
+    {
+    protected:
+        std::mutex m_mutex;
+        std::unordered_map<u32, std::vector<u8>> m_dictionaries;
+
+    public:
+        void insert(ConstMemory content)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_dictionaries[getDictionaryID(content)] = std::vector<u8>(content.address, content.address + content.size);
+        }
+
+        SharedObject<CompressionDictionary> create(u32 id, Compressor::Method method)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            auto i = m_dictionaries.find(id);
+            if (i == m_dictionaries.end())
+            {
+                MANGO_EXCEPTION("[mapper.mgx] Dictionary %08x is not registered.", id);
+            }
+
+            const std::vector<u8>& content = i->second;
+            return createDictionary(method, ConstMemory(content.data(), content.size()));
+        }
+    };
+
+    DictionaryRegistry& getDictionaryRegistry()
+    {
+        static DictionaryRegistry registry;
+        return registry;
+    }
 
     struct Block
     {
@@ -37,7 +81,6 @@ namespace
         u32 checksum;
         bool is_compressed;
         std::vector<Segment> segments;
-        std::string filename;
 
         bool isCompressed() const
         {
@@ -60,6 +103,7 @@ namespace
         ConstMemory m_memory;
         fs::Indexer<FileHeader> m_folders;
         std::vector<Block> m_blocks;
+        std::shared_ptr<CompressionDictionary> m_dictionary;
 
         HeaderMGX(ConstMemory memory)
             : m_memory(memory)
@@ -86,13 +130,16 @@ namespace
             }
 
             u32 version = p.read32();
+            if (version > mgx_version)
+            {
+                MANGO_EXCEPTION("[mapper.mgx] Unsupported version (%d)", version);
+            }
+
             u64 block_offset = p.read64();
             u64 file_offset = p.read64();
 
             read_blocks(memory.address + block_offset);
             read_files(memory.address + file_offset);
-
-            MANGO_UNREFERENCED(version);
         }
 
         void read_blocks(LittleEndianConstPointer p)
@@ -115,6 +162,30 @@ namespace
             }
 
             u32 magic2 = p.read32();
+            if (magic2 == u32_mask('m', 'g', 'x', 'd'))
+            {
+                u32 id = p.read32();
+                Compressor::Method method = Compressor::Method(p.read32());
+                u64 offset = p.read64();
+                u64 size = p.read64();
+
+                if (size)
+                {
+                    if (size > m_memory.size || offset > m_memory.size - size)
+                    {
+                        MANGO_EXCEPTION("[mapper.mgx] Dictionary is outside of parent memory.");
+                    }
+
+                    m_dictionary = createDictionary(method, ConstMemory(m_memory.address + offset, size_t(size)));
+                }
+                else
+                {
+                    m_dictionary = getDictionaryRegistry().create(id, method);
+                }
+
+                magic2 = p.read32();
+            }
+
             if (magic2 != u32_mask('m', 'g', 'x', '2'))
             {
                 MANGO_EXCEPTION("[mapper.mgx] Incorrect block terminator (%x)", magic2);
@@ -165,18 +236,199 @@ namespace
                     fs::getPath(filename.substr(0, length - 1)) :
                     fs::getPath(filename);
 
-                header.filename = filename.substr(folder.length());
                 m_folders.insert(folder, filename, header);
             }
 
+            m_folders.finalize();
+
             u32 magic3 = p.read32();
             if (magic3 != u32_mask('m', 'g', 'x', '3'))
             {
                 MANGO_EXCEPTION("[mapper.mgx] Incorrect block terminator (%x)", magic3);
             }
         }
+
+        void decompress(const Block& block, Memory dest) const
+        {
+            ConstMemory src(m_memory.address + block.offset, size_t(block.compressed));
+
+            if (block.method & mgx_dictionary_flag)
+            {
+                if (!m_dictionary)
+                {
+                    MANGO_EXCEPTION("[mapper.mgx] Block requires a dictionary.");
+                }
+
+                m_dictionary->decompress(dest, src);
+            }
+            else
+            {
+                Compressor compressor = getCompressor(Compressor::Method(block.method));
+                compressor.decompress(dest, src);
+            }
+        }
     };
 
+    // -----------------------------------------------------------------
+    // BlockCache
+    // -----------------------------------------------------------------
+
+    /*
+        LRU cache of decompressed blocks which are shared by small files; the files
+        are mapped as slices of the cached block. The cache is shared by all MGX
+        mappers so that the memory budget is global. The mappers use unique keys
+        and purge their blocks when they are destroyed.
+
+        The mapped files keep a reference to the block so an evicted block stays
+        alive until the last file using it is unmapped. Only one thread decompresses
+        a block; the other threads requesting it wait for the result.
+    */
+
+    class BlockCache
+    {
+    protected:
+        struct Entry
+        {
+            std::once_flag once;
+            std::shared_ptr<u8> data;
+            size_t size = 0;
+            std::list<u64>::iterator lru;
+        };
+
+        std::mutex m_mutex;
+        std::unordered_map<u64, std::shared_ptr<Entry>> m_entries;
+        std::list<u64> m_lru; // most recently used first
+        size_t m_budget = 64 * 1024 * 1024;
+        size_t m_bytes = 0;
+        u64 m_hits = 0;
+        u64 m_misses = 0;
+        u64 m_evictions = 0;
+        u32 m_next_id = 0;
+
+        void evict()
+        {
+            auto it = m_lru.end();
+            while (m_bytes > m_budget && it != m_lru.begin())
+            {
+                --it;
+
+                auto i = m_entries.find(*it);
+                if (!i->second->data)
+                {
+                    // the block is being decompressed
+                    continue;
+                }
+
+                m_bytes -= i->second->size;
+                m_entries.erase(i);
+                it = m_lru.erase(it);
+                ++m_evictions;
+            }
+        }
+
+    public:
+        u64 createKey()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return u64(++m_next_id) << 32;
+        }
+
+        template <typename Decode>
+        std::shared_ptr<u8> get(u64 key, size_t size, Decode decode)
+        {
+            std::shared_ptr<Entry> entry;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                auto i = m_entries.find(key);
+                if (i != m_entries.end())
+                {
+                    entry = i->second;
+                    m_lru.splice(m_lru.begin(), m_lru, entry->lru);
+                    ++m_hits;
+                }
+                else
+                {
+                    entry = std::make_shared<Entry>();
+                    m_lru.push_front(key);
+                    entry->lru = m_lru.begin();
+                    m_entries.emplace(key, entry);
+                    ++m_misses;
+                }
+            }
+
+            // if decode() throws the next request will try again
+            std::call_once(entry->once, [&]
+            {
+                std::shared_ptr<u8> data(new u8[size], std::default_delete<u8[]>());
+                decode(data.get());
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                entry->data = data;
+                entry->size = size;
+
+                auto i = m_entries.find(key);
+                if (i != m_entries.end() && i->second == entry)
+                {
+                    m_bytes += size;
+                    evict();
+                }
+            });
+
+            return entry->data;
+        }
+
+        void purge(u64 key)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (auto it = m_lru.begin(); it != m_lru.end(); )
+            {
+                if ((*it >> 32) == (key >> 32))
+                {
+                    auto i = m_entries.find(*it);
+                    if (i->second->data)
+                    {
+                        m_bytes -= i->second->size;
+                    }
+                    m_entries.erase(i);
+                    it = m_lru.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
+        void setBudget(size_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_budget = bytes;
+            evict();
+        }
+
+        fs::MGXCacheStatistics getStatistics()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            fs::MGXCacheStatistics statistics;
+            statistics.hits = m_hits;
+            statistics.misses = m_misses;
+            statistics.evictions = m_evictions;
+            statistics.bytes = m_bytes;
+            statistics.budget = m_budget;
+            return statistics;
+        }
+    };
+
+    BlockCache& getBlockCache()
+    {
+        static BlockCache cache;
+        return cache;
+    }
+
 } // namespace
 
 namespace mango {
@@ -190,6 +442,7 @@ namespace filesystem {
     {
     protected:
         const u8* m_delete_address;
+        std::shared_ptr<u8> m_block;
 
     public:
         VirtualMemoryMGX(const u8* address, const u8* delete_address, size_t size)
@@ -198,12 +451,222 @@ namespace filesystem {
             m_memory = ConstMemory(address, size);
         }
 
+        // slice of a cached block
+        VirtualMemoryMGX(std::shared_ptr<u8> block, size_t offset, size_t size)
+            : m_delete_address(nullptr)
+            , m_block(std::move(block))
+        {
+            m_memory = ConstMemory(m_block.get() + offset, size);
+        }
+
         ~VirtualMemoryMGX()
         {
             delete [] m_delete_address;
         }
     };
 
+    // -----------------------------------------------------------------
+    // VirtualMemoryMGXSegments
+    // -----------------------------------------------------------------
+
+    // A file which is stored in one or more segments, of which at least one is
+    // compressed. The segments are decompressed when the range they cover is accessed;
+    // segments requested together are decompressed in parallel. Each segment is claimed
+    // by one thread which decodes it without holding a lock; a segment which fails to
+    // decode is claimed again at the next access so the error is reported every time.
+
+    class VirtualMemoryMGXSegments : public mango::VirtualMemory
+    {
+    protected:
+        struct Range
+        {
+            const Block* block;
+            FileHeader::Segment segment;
+            u64 offset; // in the file
+        };
+
+        enum : int
+        {
+            PENDING,
+            DECODING,
+            READY
+        };
+
+        const HeaderMGX& m_header;
+        u8* m_buffer;
+        std::vector<Range> m_ranges;
+
+        mutable std::unique_ptr<std::atomic<int>[]> m_state;
+        mutable std::atomic<size_t> m_remaining;
+
+        void decode(const Range& range) const
+        {
+            const Block& block = *range.block;
+            const FileHeader::Segment& segment = range.segment;
+            u8* x = m_buffer + range.offset;
+
+            if (block.method)
+            {
+                if (block.uncompressed == segment.size && segment.offset == 0)
+                {
+                    // segment is full-block so we can decode directly w/o intermediate buffer
+                    Memory dest(x, size_t(block.uncompressed));
+                    m_header.decompress(block, dest);
+                }
+                else
+                {
+                    Buffer dest(size_t(block.uncompressed));
+                    m_header.decompress(block, dest);
+                    std::memcpy(x, Memory(dest).address + segment.offset, segment.size);
+                }
+            }
+            else
+            {
+                // no compression
+                std::memcpy(x, m_header.m_memory.address + block.offset + segment.offset, segment.size);
+            }
+        }
+
+        // decodes a claimed range
+        void decode(size_t index) const
+        {
+            try
+            {
+                decode(m_ranges[index]);
+            }
+            catch (...)
+            {
+                m_state[index].store(PENDING, std::memory_order_release);
+                throw;
+            }
+
+            m_state[index].store(READY, std::memory_order_release);
+            m_remaining.fetch_sub(1, std::memory_order_release);
+        }
+
+        void decode(const std::vector<size_t>& claimed) const
+        {
+            if (claimed.size() == 1)
+            {
+                decode(claimed[0]);
+            }
+            else if (claimed.size() > 1)
+            {
+                std::vector<std::exception_ptr> errors(claimed.size());
+
+                ConcurrentQueue q("mgx.decompressor", Priority::HIGH);
+
+                for (size_t i = 0; i < claimed.size(); ++i)
+                {
+                    q.enqueue([this, &claimed, &errors, i]
+                    {
+                        try
+                        {
+                            decode(claimed[i]);
+                        }
+                        catch (...)
+                        {
+                            errors[i] = std::current_exception();
+                        }
+                    });
+                }
+
+                q.wait();
+
+                for (auto& error : errors)
+                {
+                    if (error)
+                    {
+                        std::rethrow_exception(error);
+                    }
+                }
+            }
+        }
+
+        void materialize(u64 offset, u64 size) const override
+        {
+            if (!m_remaining.load(std::memory_order_acquire) || !size)
+                return;
+
+            // first segment which ends after the offset
+            size_t first = 0;
+            while (first < m_ranges.size() && m_ranges[first].offset + m_ranges[first].segment.size <= offset)
+            {
+                ++first;
+            }
+
+            size_t last = first;
+            while (last < m_ranges.size() && m_ranges[last].offset < offset + size)
+            {
+                ++last;
+            }
+
+            for (;;)
+            {
+                std::vector<size_t> claimed;
+                bool busy = false;
+
+                for (size_t i = first; i < last; ++i)
+                {
+                    int state = PENDING;
+                    if (m_state[i].compare_exchange_strong(state, DECODING, std::memory_order_acquire))
+                    {
+                        claimed.push_back(i);
+                    }
+                    else if (state == DECODING)
+                    {
+                        busy = true;
+                    }
+                }
+
+                decode(claimed);
+
+                if (!busy)
+                    break;
+
+                // the rest of the ranges are decoded by other threads; a range which
+                // fails there is pending again and claimed on the next round
+                for (size_t i = first; i < last; ++i)
+                {
+                    while (m_state[i].load(std::memory_order_acquire) == DECODING)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        }
+
+    public:
+        VirtualMemoryMGXSegments(const HeaderMGX& header, const FileHeader& file)
+            : m_header(header)
+            , m_buffer(new u8[size_t(file.size)])
+        {
+            u64 offset = 0;
+
+            for (auto& segment : file.segments)
+            {
+                const Block& block = header.m_blocks[segment.block];
+                m_ranges.push_back({ &block, segment, offset });
+                offset += segment.size;
+            }
+
+            m_state.reset(new std::atomic<int>[m_ranges.size()]);
+            for (size_t i = 0; i < m_ranges.size(); ++i)
+            {
+                m_state[i].store(PENDING, std::memory_order_relaxed);
+            }
+
+            m_remaining = m_ranges.size();
+
+            m_memory = ConstMemory(m_buffer, size_t(file.size));
+        }
+
+        ~VirtualMemoryMGXSegments()
+        {
+            delete [] m_buffer;
+        }
+    };
+
     // -----------------------------------------------------------------
     // MapperMGX
     // -----------------------------------------------------------------
@@ -213,12 +676,19 @@ namespace filesystem {
     public:
         HeaderMGX m_header;
         std::string m_password;
+        u64 m_cache_key;
 
     public:
         MapperMGX(ConstMemory parent, const std::string& password)
             : m_header(parent)
             , m_password(password)
         {
+            m_cache_key = getBlockCache().createKey();
+        }
+
+        ~MapperMGX()
+        {
+            getBlockCache().purge(m_cache_key);
         }
 
         bool isFile(const std::string& filename) const override
@@ -233,27 +703,23 @@ namespace filesystem {
 
         void getIndex(FileIndex& index, const std::string& pathname) override
         {
-            const fs::Indexer<FileHeader>::Folder* ptrFolder = m_header.m_folders.getFolder(pathname);
-            if (ptrFolder)
+            for (auto entry : m_header.m_folders.getFolder(pathname))
             {
-                for (auto i : ptrFolder->headers)
-                {
-                    const FileHeader& header = *i.second;
+                const FileHeader& header = entry.header;
 
-                    u32 flags = 0;
+                u32 flags = 0;
 
-                    if (header.isFolder())
-                    {
-                        flags |= FileInfo::DIRECTORY;
-                    }
-
-                    if (header.isCompressed())
-                    {
-                        flags |= FileInfo::COMPRESSED;
-                    }
+                if (header.isFolder())
+                {
+                    flags |= FileInfo::DIRECTORY;
+                }
 
-                    index.emplace(header.filename, header.size, flags);
+                if (header.isCompressed())
+                {
+                    flags |= FileInfo::COMPRESSED;
                 }
+
+                index.emplace(entry.name, header.size, flags);
             }
         }
 
@@ -278,20 +744,23 @@ namespace filesystem {
 
                 if (file.isCompressed())
                 {
-                    if (segment.size != block.uncompressed && !file.isMultiSegment())
+                    if (segment.size != block.uncompressed)
                     {
-                        // a small file stored in one block with other small files
-                        // cache the decompressed buffers
-
-                        // TODO: decompression cache for small-file blocks
-                        // NOTE: this will fall-through into the generic compression case for now
-#if 0
-                        // simulate almost-zero-cost (AZC) decompression
-                        u8* ptr = new u8[file.size];
-                        std::memset(ptr, 0, file.size);
-                        VirtualMemoryMGX* vm = new VirtualMemoryMGX(ptr, ptr, file.size);
+                        // a small file stored in one block with other small files;
+                        // the decompressed block is cached for the other files in it
+
+                        if (u64(segment.offset) + file.size > block.uncompressed)
+                        {
+                            MANGO_EXCEPTION("[mapper.mgx] File \"%s\" is outside of it's block.", filename.c_str());
+                        }
+
+                        std::shared_ptr<u8> data = getBlockCache().get(m_cache_key | segment.block, size_t(block.uncompressed), [&] (u8* dest)
+                        {
+                            m_header.decompress(block, Memory(dest, size_t(block.uncompressed)));
+                        });
+
+                        VirtualMemoryMGX* vm = new VirtualMemoryMGX(data, segment.offset, size_t(file.size));
                         return vm;
-#endif
                     }
                 }
                 else
@@ -311,53 +780,9 @@ namespace filesystem {
                 }
             }
 
-            // generic compression case
-
-            u8* ptr = new u8[size_t(file.size)];
-            u8* x = ptr;
-
-            ConcurrentQueue q("mgx.decompessor", Priority::HIGH);
-
-            for (auto &segment : file.segments)
-            {
-                const Block& block = m_header.m_blocks[segment.block];
+            // generic compression case; the segments are decompressed on demand
 
-                if (block.method)
-                {
-                    Compressor compressor = getCompressor(Compressor::Method(block.method));
-                    ConstMemory src(m_header.m_memory.address + block.offset, size_t(block.compressed));
-
-                    q.enqueue([=, &block, &segment]
-                    {
-                        if (block.uncompressed == segment.size && segment.offset == 0)
-                        {
-                            // segment is full-block so we can decode directly w/o intermediate buffer
-                            Memory dest(x, size_t(block.uncompressed));
-                            compressor.decompress(dest, src);
-                        }
-                        else
-                        {
-                            Buffer dest(size_t(block.uncompressed));
-                            compressor.decompress(dest, src);
-                            std::memcpy(x, Memory(dest).address + segment.offset, segment.size);
-                        }
-                    });
-                }
-                else
-                {
-                    q.enqueue([=, &block, &segment]
-                    {
-                        // no compression
-                        std::memcpy(x, m_header.m_memory.address + block.offset + segment.offset, segment.size);
-                    });
-                }
-
-                x += segment.size;
-            }
-
-            q.wait();
-
-            VirtualMemoryMGX* vm = new VirtualMemoryMGX(ptr, ptr, size_t(file.size));
+            VirtualMemoryMGXSegments* vm = new VirtualMemoryMGXSegments(m_header, file);
             return vm;
         }
     };
@@ -366,12 +791,29 @@ namespace filesystem {
     // functions
     // -----------------------------------------------------------------
 
-    AbstractMapper* createMapperMGX(ConstMemory parent, const std::string& password)
+    AbstractMapper* createMapperMGX(ConstMemory parent, const std::string& password, u64 time)
     {
+        MANGO_UNREFERENCED(time);
+
         AbstractMapper* mapper = new MapperMGX(parent, password);
         return mapper;
     }
 
+    void setMGXCacheBudget(size_t bytes)
+    {
+        getBlockCache().setBudget(bytes);
+    }
+
+    MGXCacheStatistics getMGXCacheStatistics()
+    {
+        return getBlockCache().getStatistics();
+    }
+
+    void registerMGXDictionary(ConstMemory content)
+    {
+        getDictionaryRegistry().insert(content);
+    }
+
 } // namespace filesystem
 } // namespace mango
 
@@ -12,7 +12,11 @@
 #include <mango/core/pointer.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
+#include <mango/core/buffer.hpp>
+#include <mango/image/fourcc.hpp>
 #include "indexer.hpp"
+#include "indexcache.hpp"
+#include "lazymemory.hpp"
 
 #if defined(MANGO_ENABLE_ARCHIVE_RAR)
 
@@ -356,10 +360,9 @@ namespace
         u8   version;
         u8   method;
         bool    is_rar5;
-        std::string filename;
 
         bool folder;
-        const u8* data;
+        u64 offset; // offset of the data in the archive
 
         bool compressed() const
         {
@@ -370,9 +373,10 @@ namespace
             return method != 0x30;
         }
 
-        VirtualMemory* mmap() const
+        VirtualMemory* mmap(const u8* archive) const
         {
             VirtualMemory* memory;
+            const u8* data = archive + offset;
 
             if (!compressed())
             {
@@ -381,17 +385,20 @@ namespace
             }
             else
             {
-                size_t size = size_t(unpacked_size);
-                u8* buffer = new u8[size];
+                // decompressed on first access; the size is known without decompressing
+                const u8* input = data;
+                const u64 unpacked = unpacked_size;
+                const u64 packed = packed_size;
+                const u8 ver = version;
 
-                bool status = decompress(buffer, data, unpacked_size, packed_size, version);
-                if (!status)
+                memory = new mango::filesystem::VirtualMemoryDeferred(size_t(unpacked_size), nullptr, [=] (u8* dest)
                 {
-                    delete[] buffer;
-                    MANGO_EXCEPTION("[mapper.rar] Decompression failed.");
-                }
-
-                memory = new VirtualMemoryRAR(buffer, buffer, size);
+                    bool status = decompress(dest, input, unpacked, packed, ver);
+                    if (!status)
+                    {
+                        MANGO_EXCEPTION("[mapper.rar] Decompression failed.");
+                    }
+                });
             }
 
             return memory;
@@ -411,22 +418,62 @@ namespace filesystem {
     {
     public:
         std::string m_password;
-        std::vector<FileHeader> m_files;
+        const u8* m_address;
+        std::vector<std::pair<std::string, FileHeader>> m_files;
         Indexer<FileHeader> m_folders;
+        std::unique_ptr<VirtualMemory> m_index_memory; // cached index
         bool is_encrypted { false };
 
-        MapperRAR(ConstMemory parent, const std::string& password)
+        MapperRAR(ConstMemory parent, const std::string& password, u64 time)
             : m_password(password)
+            , m_address(parent.address)
         {
             const u8* start = parent.address;
             const u8* end = parent.address + parent.size;
 
             if (start)
             {
+                const u64 key = getIndexCacheKey(parent, time, u32_mask('r', 'a', 'r', '0'));
+
+                ConstMemory index;
+                m_index_memory = loadIndexCache(key, index);
+                if (m_index_memory && load(index))
+                {
+                    // the index is used directly from the cache
+                    return;
+                }
+
+                m_index_memory.reset();
                 parse(start, end);
+
+                if (key)
+                {
+                    MemoryStream stream;
+                    save(stream);
+                    storeIndexCache(key, stream);
+                }
             }
         }
 
+        void save(Stream& stream) const
+        {
+            const u64 flags = is_encrypted ? 1 : 0;
+            stream.write(&flags, sizeof(flags));
+            m_folders.save(stream);
+        }
+
+        bool load(ConstMemory memory)
+        {
+            if (memory.size < sizeof(u64))
+                return false;
+
+            u64 flags;
+            std::memcpy(&flags, memory.address, sizeof(flags));
+            is_encrypted = (flags & 1) != 0;
+
+            return m_folders.load(memory.slice(sizeof(u64)));
+        }
+
         ~MapperRAR()
         {
         }
@@ -453,19 +500,22 @@ namespace filesystem {
                 MANGO_EXCEPTION("[mapper.rar] Incorrect signature.");
             }
 
-            for (auto& header : m_files)
+            for (auto& file : m_files)
             {
-                std::string filename = header.filename;
+                std::string filename = file.first;
+                FileHeader& header = file.second;
+
                 while (!filename.empty())
                 {
                     std::string folder = getPath(filename.substr(0, filename.length() - 1));
 
-                    header.filename = filename.substr(folder.length());
                     m_folders.insert(folder, filename, header);
                     header.folder = true;
                     filename = folder;
                 }
             }
+
+            m_folders.finalize();
         }
 
         void parse_rar4(const u8* start, const u8* end)
@@ -497,14 +547,14 @@ namespace filesystem {
 
                             int dict_flags = (header.flags >> 5) & 7;
                             file.folder = (dict_flags == 7);
-                            file.data = p;
+                            file.offset = u64(p - m_address);
 
-                            file.filename = header.filename;
+                            std::string filename = header.filename;
                             if (file.folder)
                             {
-                                file.filename += "/";
+                                filename += "/";
                             }
-                            m_files.push_back(file);
+                            m_files.emplace_back(filename, file);
                         }
                         else
                         {
@@ -612,15 +662,14 @@ namespace filesystem {
             file.is_rar5 = true;
 
             file.folder = is_directory;
-            file.data = compressed_data.address;
+            file.offset = u64(compressed_data.address - m_address);
 
-            file.filename = filename;
             if (file.folder)
             {
-                file.filename += "/";
+                filename += "/";
             }
 
-            m_files.push_back(file);
+            m_files.emplace_back(filename, file);
         }
 
         void parse_rar5(const u8* start, const u8* end)
@@ -697,34 +746,30 @@ namespace filesystem {
 
         void getIndex(FileIndex& index, const std::string& pathname) override
         {
-            const Indexer<FileHeader>::Folder* ptrFolder = m_folders.getFolder(pathname);
-            if (ptrFolder)
+            for (auto entry : m_folders.getFolder(pathname))
             {
-                for (auto i : ptrFolder->headers)
-                {
-                    const FileHeader& header = *i.second;
+                const FileHeader& header = entry.header;
 
-                    u32 flags = 0;
-                    u64 size = header.unpacked_size;
+                u32 flags = 0;
+                u64 size = header.unpacked_size;
 
-                    if (header.folder)
-                    {
-                        flags |= FileInfo::DIRECTORY;
-                        size = 0;
-                    }
-
-                    if (header.compressed())
-                    {
-                        flags |= FileInfo::COMPRESSED;
-                    }
+                if (header.folder)
+                {
+                    flags |= FileInfo::DIRECTORY;
+                    size = 0;
+                }
 
-                    if (is_encrypted)
-                    {
-                        flags |= FileInfo::ENCRYPTED;
-                    }
+                if (header.compressed())
+                {
+                    flags |= FileInfo::COMPRESSED;
+                }
 
-                    index.emplace(header.filename, size, flags);
+                if (is_encrypted)
+                {
+                    flags |= FileInfo::ENCRYPTED;
                 }
+
+                index.emplace(entry.name, size, flags);
             }
         }
 
@@ -737,7 +782,7 @@ namespace filesystem {
             }
 
             const FileHeader& header = *ptrHeader;
-            return header.mmap();
+            return header.mmap(m_address);
         }
     };
 
@@ -745,9 +790,9 @@ namespace filesystem {
     // functions
     // -----------------------------------------------------------------
 
-    AbstractMapper* createMapperRAR(ConstMemory parent, const std::string& password)
+    AbstractMapper* createMapperRAR(ConstMemory parent, const std::string& password, u64 time)
     {
-        AbstractMapper* mapper = new MapperRAR(parent, password);
+        AbstractMapper* mapper = new MapperRAR(parent, password, time);
         return mapper;
     }
 
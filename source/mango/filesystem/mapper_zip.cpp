@@ -6,14 +6,16 @@
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/core/compress.hpp>
+#include <mango/core/buffer.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
+#include <mango/image/fourcc.hpp>
 #include "indexer.hpp"
+#include "indexcache.hpp"
+#include "lazymemory.hpp"
 
 #ifdef MANGO_ENABLE_ARCHIVE_ZIP
 
-#include "../../external/libdeflate/libdeflate.h"
-
 /*
 https://courses.cs.ut.ee/MTAT.07.022/2015_fall/uploads/Main/dmitri-report-f15-16.pdf
 
@@ -176,11 +178,10 @@ namespace
 		u32	external;          // external file attributes
 		u64	localOffset;       // relative offset of the local file header, ZIP64: 0xffffffff
 
-        std::string filename;      // filename is stored after the header
         bool        is_folder;     // if the last character of filename is "/", it is a folder
         Encryption  encryption;
 
-		bool read(LittleEndianConstPointer& p)
+		bool read(LittleEndianConstPointer& p, std::string& filename)
 		{
 			signature = p.read32();
             if (signature != 0x02014b50)
@@ -490,38 +491,9 @@ namespace
 
 	u64 zip_decompress(const u8* compressed, u8* uncompressed, u64 compressedLen, u64 uncompressedLen)
 	{
-        libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
-
-        size_t bytes_out = 0;
-        libdeflate_result result = libdeflate_deflate_decompress(decompressor,
-            compressed, size_t(compressedLen),
-            uncompressed, size_t(uncompressedLen), &bytes_out);
-
-        libdeflate_free_decompressor(decompressor);
-
-        const char* error = nullptr;
-        switch (result)
-        {
-            default:
-            case LIBDEFLATE_SUCCESS:
-                break;
-            case LIBDEFLATE_BAD_DATA:
-                error = "Bad data";
-                break;
-            case LIBDEFLATE_SHORT_OUTPUT:
-                error = "Short output";
-                break;
-            case LIBDEFLATE_INSUFFICIENT_SPACE:
-                error = "Insufficient space";
-                break;
-        }
-
-        if (error)
-        {
-            MANGO_EXCEPTION("[mapper.zip] %s.", error);
-        }
-
-        return bytes_out;
+        // the decompressor state is kept per thread by the deflate functions
+        return deflate::decompress(Memory(uncompressed, size_t(uncompressedLen)),
+                                   ConstMemory(compressed, size_t(compressedLen)));
     }
 
 } // namespace
@@ -561,39 +533,70 @@ namespace filesystem {
         ConstMemory m_parent_memory;
         std::string m_password;
         Indexer<FileHeader> m_folders;
+        std::unique_ptr<VirtualMemory> m_index_memory; // cached index
 
-        MapperZIP(ConstMemory parent, const std::string& password)
+        MapperZIP(ConstMemory parent, const std::string& password, u64 time)
             : m_parent_memory(parent)
             , m_password(password)
         {
             if (parent.address)
             {
-                DirEndRecord record(parent);
-                if (record.status())
+                const u64 key = getIndexCacheKey(parent, time, u32_mask('z', 'i', 'p', '0'));
+
+                ConstMemory index;
+                m_index_memory = loadIndexCache(key, index);
+                if (m_index_memory && m_folders.load(index))
+                {
+                    // the index is used directly from the cache
+                    return;
+                }
+
+                m_index_memory.reset();
+                parse(parent);
+
+                if (key)
                 {
-                    const int numFiles = int(record.numEntriesTotal);
+                    MemoryStream stream;
+                    m_folders.save(stream);
+                    storeIndexCache(key, stream);
+                }
+            }
+        }
+
+        void parse(ConstMemory parent)
+        {
+            DirEndRecord record(parent);
+            if (record.status())
+            {
+                const int numFiles = int(record.numEntriesTotal);
 
-                    // read file headers
-                    LittleEndianConstPointer p = parent.address + record.dirStartOffset;
+                // read file headers
+                LittleEndianConstPointer p = parent.address + record.dirStartOffset;
 
-                    for (int i = 0; i < numFiles; ++i)
+                // the central directory size bounds the number of headers (46 bytes minimum)
+                if (record.dirSize <= parent.size)
+                {
+                    m_folders.reserve(std::min(size_t(numFiles), size_t(record.dirSize / 46)), size_t(record.dirSize));
+                }
+
+                for (int i = 0; i < numFiles; ++i)
+                {
+                    FileHeader header;
+                    std::string filename;
+                    if (header.read(p, filename))
                     {
-                        FileHeader header;
-                        if (header.read(p))
+                        while (!filename.empty())
                         {
-                            std::string filename = header.filename;
-                            while (!filename.empty())
-                            {
-                                std::string folder = getPath(filename.substr(0, filename.length() - 1));
+                            std::string folder = getPath(filename.substr(0, filename.length() - 1));
 
-                                header.filename = filename.substr(folder.length());
-                                m_folders.insert(folder, filename, header);
-                                header.is_folder = true;
-                                filename = folder;
-                            }
+                            m_folders.insert(folder, filename, header);
+                            header.is_folder = true;
+                            filename = folder;
                         }
                     }
                 }
+
+                m_folders.finalize();
             }
         }
 
@@ -683,31 +686,24 @@ namespace filesystem {
 
                 case COMPRESSION_DEFLATE:
                 {
-                    const size_t uncompressed_size = size_t(header.uncompressedSize);
-                    u8* uncompressed_buffer = new u8[uncompressed_size];
-
-                    u64 outsize = zip_decompress(address, uncompressed_buffer, header.compressedSize, header.uncompressedSize);
+                    // decompressed on first access; the size is known without decompressing
+                    const u64 compressed_size = header.compressedSize;
+                    const u64 uncompressed_size = header.uncompressedSize;
 
-                    delete[] buffer;
-                    buffer = uncompressed_buffer;
-
-                    if (outsize != header.uncompressedSize)
+                    return new VirtualMemoryDeferred(size_t(uncompressed_size), buffer, [=] (u8* dest)
                     {
-                        // incorrect output size
-                        delete[] buffer;
-                        MANGO_EXCEPTION("[mapper.zip] Incorrect decompressed size.");
-                    }
-
-                    // use decode_buffer as memory map
-                    address = buffer;
-                    size = header.uncompressedSize;
-                    break;
+                        u64 outsize = zip_decompress(address, dest, compressed_size, uncompressed_size);
+                        if (outsize != uncompressed_size)
+                        {
+                            // incorrect output size
+                            MANGO_EXCEPTION("[mapper.zip] Incorrect decompressed size.");
+                        }
+                    });
                 }
 
                 case COMPRESSION_LZMA:
                 {
                     const size_t uncompressed_size = size_t(header.uncompressedSize);
-                    u8* uncompressed_buffer = new u8[uncompressed_size];
 
                     // parse LZMA compression header
                     p = address;
@@ -719,52 +715,34 @@ namespace filesystem {
                         MANGO_EXCEPTION("[mapper.zip] Incorrect LZMA header.");
                     }
                     address = p;
-                    u64 compressed_size = header.compressedSize - 4;
-
-                    lzma::decompress(Memory(uncompressed_buffer, size_t(header.uncompressedSize)),
-                                     ConstMemory(address, size_t(compressed_size)));
+                    const size_t compressed_size = size_t(header.compressedSize - 4);
 
-                    delete[] buffer;
-                    buffer = uncompressed_buffer;
-
-                    // use decode_buffer as memory map
-                    address = buffer;
-                    size = header.uncompressedSize;
-                    break;
+                    return new VirtualMemoryDeferred(uncompressed_size, buffer, [=] (u8* dest)
+                    {
+                        lzma::decompress(Memory(dest, uncompressed_size), ConstMemory(address, compressed_size));
+                    });
                 }
 
                 case COMPRESSION_PPMD:
                 {
-                    const std::size_t uncompressed_size = static_cast<std::size_t>(header.uncompressedSize);
-                    u8* uncompressed_buffer = new u8[uncompressed_size];
-
-                    ppmd8::decompress(Memory(uncompressed_buffer, size_t(header.uncompressedSize)),
-                                      ConstMemory(address, size_t(header.compressedSize)));
-
-                    delete[] buffer;
-                    buffer = uncompressed_buffer;
+                    const size_t compressed_size = size_t(header.compressedSize);
+                    const size_t uncompressed_size = size_t(header.uncompressedSize);
 
-                    // use decode_buffer as memory map
-                    address = buffer;
-                    size = header.uncompressedSize;
-                    break;
+                    return new VirtualMemoryDeferred(uncompressed_size, buffer, [=] (u8* dest)
+                    {
+                        ppmd8::decompress(Memory(dest, uncompressed_size), ConstMemory(address, compressed_size));
+                    });
                 }
 
                 case COMPRESSION_BZIP2:
                 {
-                    const std::size_t uncompressed_size = static_cast<std::size_t>(header.uncompressedSize);
-                    u8* uncompressed_buffer = new u8[uncompressed_size];
-
-                    bzip2::decompress(Memory(uncompressed_buffer, size_t(header.uncompressedSize)),
-                                      ConstMemory(address, size_t(header.compressedSize)));
-
-                    delete[] buffer;
-                    buffer = uncompressed_buffer;
+                    const size_t compressed_size = size_t(header.compressedSize);
+                    const size_t uncompressed_size = size_t(header.uncompressedSize);
 
-                    // use decode_buffer as memory map
-                    address = buffer;
-                    size = header.uncompressedSize;
-                    break;
+                    return new VirtualMemoryDeferred(uncompressed_size, buffer, [=] (u8* dest)
+                    {
+                        bzip2::decompress(Memory(dest, uncompressed_size), ConstMemory(address, compressed_size));
+                    });
                 }
 
                 case COMPRESSION_DEFLATE64:
@@ -801,34 +779,30 @@ namespace filesystem {
 
         void getIndex(FileIndex& index, const std::string& pathname) override
         {
-            const Indexer<FileHeader>::Folder* ptrFolder = m_folders.getFolder(pathname);
-            if (ptrFolder)
+            for (auto entry : m_folders.getFolder(pathname))
             {
-                for (auto i : ptrFolder->headers)
-                {
-                    const FileHeader& header = *i.second;
-
-                    u32 flags = 0;
-                    u64 size = header.uncompressedSize;
+                const FileHeader& header = entry.header;
 
-                    if (header.is_folder)
-                    {
-                        flags |= FileInfo::DIRECTORY;
-                        size = 0;
-                    }
+                u32 flags = 0;
+                u64 size = header.uncompressedSize;
 
-                    if (header.compression > 0)
-                    {
-                        flags |= FileInfo::COMPRESSED;
-                    }
+                if (header.is_folder)
+                {
+                    flags |= FileInfo::DIRECTORY;
+                    size = 0;
+                }
 
-                    if (header.encryption != ENCRYPTION_NONE)
-                    {
-                        flags |= FileInfo::ENCRYPTED;
-                    }
+                if (header.compression > 0)
+                {
+                    flags |= FileInfo::COMPRESSED;
+                }
 
-                    index.emplace(header.filename, size, flags);
+                if (header.encryption != ENCRYPTION_NONE)
+                {
+                    flags |= FileInfo::ENCRYPTED;
                 }
+
+                index.emplace(entry.name, size, flags);
             }
         }
 
@@ -849,9 +823,9 @@ namespace filesystem {
     // functions
     // -----------------------------------------------------------------
 
-    AbstractMapper* createMapperZIP(ConstMemory parent, const std::string& password)
+    AbstractMapper* createMapperZIP(ConstMemory parent, const std::string& password, u64 time)
     {
-        AbstractMapper* mapper = new MapperZIP(parent, password);
+        AbstractMapper* mapper = new MapperZIP(parent, password, time);
         return mapper;
     }
 
@@ -0,0 +1,426 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <mango/core/core.hpp>
+#include <mango/filesystem/filesystem.hpp>
+#include <mango/filesystem/mgx.hpp>
+#include <mango/image/fourcc.hpp>
+
+/*
+    MGX container layout (all values are little endian):
+
+    "mgx0"
+    block data
+
+    dictionary content          <- optional, when embedded
+
+    "mgx1"                      <- block_offset
+    u32 number of blocks
+    { u64 offset, u64 compressed size, u64 uncompressed size, u32 method } * blocks
+
+    "mgxd"                      <- optional (version 1)
+    u32 dictionary id
+    u32 method
+    u64 offset, u64 size        <- zero when the dictionary is not embedded
+
+    "mgx2"                      <- file_offset
+    u32 number of files
+    { u32 length, name, u64 size, u32 checksum, u32 segments,
+      { u32 block, u32 offset, u32 size } * segments } * files
+
+    "mgx3"                      <- container size - 24
+    u32 version
+    u64 block_offset
+    u64 file_offset
+
+    The offsets are relative to the start of the container. Folders are entries
+    with a name ending in '/' and no segments. The blocks compressed with the
+    dictionary have the dictionary flag set in the method.
+*/
+
+namespace
+{
+    using namespace mango;
+
+    constexpr u32 mgx_version = 1;
+    constexpr u32 mgx_dictionary_flag = 0x100;
+
+} // namespace
+
+namespace mango {
+namespace filesystem {
+
+    // -----------------------------------------------------------------
+    // MGXWriter
+    // -----------------------------------------------------------------
+
+    struct MGXWriter::PendingBlock
+    {
+        Buffer input;
+        Buffer output;
+        size_t compressed = 0;
+        u32 method = Compressor::NONE;
+        std::unique_ptr<FutureTask<void>> task;
+
+        ConstMemory data() const
+        {
+            return method ? ConstMemory(output.data(), compressed) : ConstMemory(input);
+        }
+    };
+
+    MGXWriter::MGXWriter(const std::string& filename, const MGXWriterOptions& options)
+        : m_file_stream(new FileStream(filename, Stream::WRITE))
+        , m_stream(*m_file_stream)
+        , m_base(0)
+        , m_options(options)
+    {
+        initialize();
+    }
+
+    MGXWriter::MGXWriter(Stream& stream, const MGXWriterOptions& options)
+        : m_stream(stream)
+        , m_base(stream.offset())
+        , m_options(options)
+    {
+        initialize();
+    }
+
+    void MGXWriter::initialize()
+    {
+        m_options.block_size = std::max(m_options.block_size, size_t(4096));
+        m_options.block_size = std::min(m_options.block_size, size_t(0x80000000));
+        m_options.small_file = std::min(m_options.small_file, m_options.block_size);
+
+        m_compressor = getCompressor(m_options.method);
+
+        if (m_options.dictionary.size)
+        {
+            m_dictionary = createDictionary(m_options.method, m_options.dictionary, m_options.level);
+        }
+
+        m_pending_limit = std::max(ThreadPool::getHardwareConcurrency() * 2, 4);
+
+        LittleEndianStream s = m_stream;
+        s.write32(u32_mask('m', 'g', 'x', '0'));
+    }
+
+    MGXWriter::~MGXWriter()
+    {
+        if (!m_finalized)
+        {
+            try
+            {
+                finalize();
+            }
+            catch (...)
+            {
+                // NOTE: call finalize() explicitly to see the errors
+            }
+        }
+
+        waitPending();
+    }
+
+    void MGXWriter::waitPending()
+    {
+        // the tasks reference the blocks and the compressor; they must complete
+        // before the blocks or the writer are released
+        for (auto& block : m_pending)
+        {
+            if (block->task)
+            {
+                block->task->wait();
+            }
+        }
+    }
+
+    void MGXWriter::addFolders(const std::string& filename)
+    {
+        for (size_t i = filename.find('/'); i != std::string::npos; i = filename.find('/', i + 1))
+        {
+            m_folders.insert(filename.substr(0, i + 1));
+        }
+    }
+
+    u32 MGXWriter::submit(std::unique_ptr<PendingBlock> block)
+    {
+        PendingBlock* ptr = block.get();
+        const Compressor& compressor = m_compressor;
+        const CompressionDictionary* dictionary = m_dictionary.get();
+        const int level = m_options.level;
+
+        // the block is owned by the pending queue before the task can reference it
+        m_pending.push_back(std::move(block));
+
+        if (compressor.method != Compressor::NONE && ptr->input.size() > 0)
+        {
+            ptr->task.reset(new FutureTask<void>([ptr, &compressor, dictionary, level]
+            {
+                const size_t size = ptr->input.size();
+                ptr->output.resize(compressor.bound(size));
+
+                size_t bytes = dictionary ?
+                    dictionary->compress(ptr->output, ptr->input) :
+                    compressor.compress(ptr->output, ptr->input, level);
+                if (bytes > 0 && bytes < size)
+                {
+                    ptr->compressed = bytes;
+                    ptr->method = compressor.method | (dictionary ? mgx_dictionary_flag : 0);
+                }
+                else
+                {
+                    // incompressible; store the block so that it can be mapped directly
+                    ptr->output.reset();
+                }
+            }));
+        }
+
+        while (m_pending.size() > m_pending_limit)
+        {
+            writeOldest();
+        }
+
+        return m_block_count++;
+    }
+
+    void MGXWriter::writeOldest()
+    {
+        std::unique_ptr<PendingBlock> block = std::move(m_pending.front());
+        m_pending.pop_front();
+
+        if (block->task)
+        {
+            try
+            {
+                // re-throws if the compressor failed
+                block->task->get();
+            }
+            catch (...)
+            {
+                // the container cannot be completed; discard the remaining blocks
+                m_finalized = true;
+                waitPending();
+                m_pending.clear();
+                throw;
+            }
+        }
+
+        ConstMemory data = block->data();
+
+        BlockEntry entry;
+        entry.offset = m_stream.offset() - m_base;
+        entry.compressed = data.size;
+        entry.uncompressed = block->input.size();
+        entry.method = block->method;
+        m_blocks.push_back(entry);
+
+        m_stream.write(data);
+
+        m_statistics.blocks++;
+        m_statistics.uncompressed += entry.uncompressed;
+        m_statistics.compressed += entry.compressed;
+    }
+
+    void MGXWriter::flushPack()
+    {
+        if (!m_pack)
+            return;
+
+        const u32 index = m_block_count;
+        for (size_t i : m_pack_files)
+        {
+            m_files[i].segments[0].block = index;
+        }
+
+        m_pack_files.clear();
+        submit(std::move(m_pack));
+    }
+
+    void MGXWriter::addFile(const std::string& filename, ConstMemory memory)
+    {
+        if (m_finalized)
+        {
+            MANGO_EXCEPTION("[mgx.writer] The container has been finalized or writing it has failed.");
+        }
+
+        if (filename.empty() || filename.back() == '/' || filename.front() == '/')
+        {
+            MANGO_EXCEPTION("[mgx.writer] Incorrect filename \"%s\".", filename.c_str());
+        }
+
+        addFolders(filename);
+
+        FileEntry entry;
+        entry.filename = filename;
+        entry.size = memory.size;
+        entry.checksum = crc32(0, memory);
+
+        if (memory.size < m_options.small_file)
+        {
+            if (m_pack && m_pack->input.size() + memory.size > m_options.block_size)
+            {
+                flushPack();
+            }
+
+            if (!m_pack)
+            {
+                m_pack.reset(new PendingBlock());
+                m_pack->input.reserve(m_options.block_size);
+            }
+
+            // the block index is patched when the pack is submitted
+            entry.segments.push_back({ 0, u32(m_pack->input.size()), u32(memory.size) });
+            m_pack->input.append(memory.address, memory.size);
+            m_pack_files.push_back(m_files.size());
+            m_files.push_back(entry);
+
+            if (m_pack->input.size() >= m_options.block_size)
+            {
+                flushPack();
+            }
+        }
+        else
+        {
+            for (size_t offset = 0; offset < memory.size; offset += m_options.block_size)
+            {
+                const size_t size = std::min(m_options.block_size, memory.size - offset);
+
+                std::unique_ptr<PendingBlock> block(new PendingBlock());
+                block->input.append(memory.address + offset, size);
+
+                u32 index = submit(std::move(block));
+                entry.segments.push_back({ index, 0, u32(size) });
+            }
+
+            m_files.push_back(entry);
+        }
+
+        m_statistics.files++;
+    }
+
+    void MGXWriter::addFile(const std::string& filename, const std::string& source)
+    {
+        File file(source);
+        addFile(filename, file);
+    }
+
+    void MGXWriter::addFolder(const std::string& foldername)
+    {
+        if (foldername.empty() || foldername.front() == '/')
+        {
+            MANGO_EXCEPTION("[mgx.writer] Incorrect folder name \"%s\".", foldername.c_str());
+        }
+
+        std::string name = foldername;
+        if (name.back() != '/')
+        {
+            name += '/';
+        }
+
+        addFolders(name);
+    }
+
+    void MGXWriter::finalize()
+    {
+        if (m_finalized)
+        {
+            MANGO_EXCEPTION("[mgx.writer] The container has already been finalized.");
+        }
+
+        m_finalized = true;
+
+        flushPack();
+
+        while (!m_pending.empty())
+        {
+            writeOldest();
+        }
+
+        LittleEndianStream s = m_stream;
+
+        // dictionary
+
+        u64 dictionary_offset = 0;
+        u64 dictionary_size = 0;
+
+        if (m_dictionary && m_options.embed_dictionary)
+        {
+            ConstMemory content = m_dictionary->content();
+            dictionary_offset = m_stream.offset() - m_base;
+            dictionary_size = content.size;
+            m_stream.write(content);
+        }
+
+        // blocks
+
+        const u64 block_offset = m_stream.offset() - m_base;
+
+        s.write32(u32_mask('m', 'g', 'x', '1'));
+        s.write32(u32(m_blocks.size()));
+
+        for (const BlockEntry& block : m_blocks)
+        {
+            s.write64(block.offset);
+            s.write64(block.compressed);
+            s.write64(block.uncompressed);
+            s.write32(block.method);
+        }
+
+        if (m_dictionary)
+        {
+            s.write32(u32_mask('m', 'g', 'x', 'd'));
+            s.write32(m_dictionary->id());
+            s.write32(m_options.method);
+            s.write64(dictionary_offset);
+            s.write64(dictionary_size);
+        }
+
+        // files (the block terminator is also the file section identifier)
+
+        const u64 file_offset = m_stream.offset() - m_base;
+
+        s.write32(u32_mask('m', 'g', 'x', '2'));
+        s.write32(u32(m_folders.size() + m_files.size()));
+
+        for (const std::string& folder : m_folders)
+        {
+            s.write32(u32(folder.length()));
+            s.write(folder.data(), folder.length());
+            s.write64(0);
+            s.write32(0);
+            s.write32(0);
+        }
+
+        for (const FileEntry& file : m_files)
+        {
+            s.write32(u32(file.filename.length()));
+            s.write(file.filename.data(), file.filename.length());
+            s.write64(file.size);
+            s.write32(file.checksum);
+            s.write32(u32(file.segments.size()));
+
+            for (const Segment& segment : file.segments)
+            {
+                s.write32(segment.block);
+                s.write32(segment.offset);
+                s.write32(segment.size);
+            }
+        }
+
+        // header (the file terminator is also the header identifier)
+
+        s.write32(u32_mask('m', 'g', 'x', '3'));
+        s.write32(mgx_version);
+        s.write64(block_offset);
+        s.write64(file_offset);
+    }
+
+    const MGXWriter::Statistics& MGXWriter::getStatistics() const
+    {
+        return m_statistics;
+    }
+
+} // namespace filesystem
+} // namespace mango
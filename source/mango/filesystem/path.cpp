@@ -3,6 +3,7 @@
     Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <algorithm>
+#include <mango/core/exception.hpp>
 #include <mango/filesystem/path.hpp>
 
 namespace mango {
@@ -50,6 +51,86 @@ namespace filesystem {
         return *m_mapper.get();
     }
 
+    FileIndex Path::walk(const WalkFilter& filter) const
+    {
+        FileIndex index;
+
+        AbstractMapper* mapper = *m_mapper;
+        if (mapper)
+        {
+            mapper->walk(index, m_mapper->basepath(), filter);
+        }
+
+        std::sort(index.files.begin(), index.files.end(), [] (const FileInfo& a, const FileInfo& b)
+        {
+            return a.name < b.name;
+        });
+
+        return index;
+    }
+
+    void Path::map(const std::vector<std::string>& filenames, const AbstractMapper::MapCallback& callback) const
+    {
+        AbstractMapper* mapper = *m_mapper;
+        if (!mapper)
+        {
+            MANGO_EXCEPTION("[Path] The path does not have a mapper.");
+        }
+
+        const std::string& basepath = m_mapper->basepath();
+
+        std::vector<std::string> names;
+        names.reserve(filenames.size());
+
+        for (const std::string& filename : filenames)
+        {
+            names.push_back(basepath + filename);
+        }
+
+        mapper->map(names, [&] (size_t index, std::unique_ptr<VirtualMemory> memory, const Status& status)
+        {
+            callback(filenames[index], std::move(memory), status);
+        });
+    }
+
+    std::vector<std::unique_ptr<VirtualMemory>> Path::map(const std::vector<std::string>& filenames) const
+    {
+        std::vector<std::unique_ptr<VirtualMemory>> memory(filenames.size());
+        std::vector<Status> status(filenames.size());
+
+        AbstractMapper* mapper = *m_mapper;
+        if (!mapper)
+        {
+            MANGO_EXCEPTION("[Path] The path does not have a mapper.");
+        }
+
+        const std::string& basepath = m_mapper->basepath();
+
+        std::vector<std::string> names;
+        names.reserve(filenames.size());
+
+        for (const std::string& filename : filenames)
+        {
+            names.push_back(basepath + filename);
+        }
+
+        mapper->map(names, [&] (size_t index, std::unique_ptr<VirtualMemory> result, const Status& result_status)
+        {
+            memory[index] = std::move(result);
+            status[index] = result_status;
+        });
+
+        for (const Status& s : status)
+        {
+            if (!s)
+            {
+                MANGO_EXCEPTION("%s", s.info.c_str());
+            }
+        }
+
+        return memory;
+    }
+
     // -----------------------------------------------------------------
     // filename manipulation functions
     // -----------------------------------------------------------------
@@ -0,0 +1,789 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <mango/core/exception.hpp>
+#include <mango/core/thread.hpp>
+#include <mango/filesystem/file.hpp>
+#include "../bufferpool.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <poll.h>
+        #include <sys/mman.h>
+        #include <sys/syscall.h>
+        #include <sys/eventfd.h>
+        #include <linux/io_uring.h>
+        #if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+            #define MANGO_ENABLE_IO_URING
+        #endif
+    #endif
+#endif
+
+namespace
+{
+    using namespace mango;
+    using namespace mango::filesystem;
+
+    // the pooled buffers kept for reuse
+    constexpr size_t reader_pool_limit = 64 * 1024 * 1024;
+
+    struct ReadRequest
+    {
+        std::string filename;
+        AsyncFileReader::Callback callback;
+
+        u8* dest;           // caller's memory or nullptr
+        size_t capacity;    // caller's memory size or pooled buffer capacity
+        u64 offset;
+
+        int file = -1;
+        u8* buffer = nullptr;   // pooled buffer
+        size_t size = 0;        // bytes to read
+        size_t bytes = 0;       // bytes read
+        Status status;
+
+        struct iovec vec;
+
+        ReadRequest(const std::string& filename, AsyncFileReader::Callback callback, u8* dest, size_t capacity, u64 offset)
+            : filename(filename)
+            , callback(std::move(callback))
+            , dest(dest)
+            , capacity(capacity)
+            , offset(offset)
+        {
+        }
+
+        ~ReadRequest()
+        {
+            close();
+        }
+
+        void close()
+        {
+            if (file != -1)
+            {
+                ::close(file);
+                file = -1;
+            }
+        }
+
+        bool open()
+        {
+            if (file != -1)
+            {
+                return true;
+            }
+
+            file = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file == -1)
+            {
+                status.setError("[AsyncFileReader] open(\"%s\") failed: %s", filename.c_str(), std::strerror(errno));
+                return false;
+            }
+
+            struct stat s;
+            if (::fstat(file, &s) == -1)
+            {
+                status.setError("[AsyncFileReader] fstat(\"%s\") failed: %s", filename.c_str(), std::strerror(errno));
+                return false;
+            }
+
+            const u64 filesize = u64(s.st_size);
+            u64 available = offset < filesize ? filesize - offset : 0;
+            if (dest)
+            {
+                available = std::min(available, u64(capacity));
+            }
+
+            if (available > u64(std::numeric_limits<size_t>::max()))
+            {
+                status.setError("[AsyncFileReader] \"%s\" is too large.", filename.c_str());
+                return false;
+            }
+
+            size = size_t(available);
+            return true;
+        }
+
+        u8* address() const
+        {
+            return dest ? dest : buffer;
+        }
+
+        void allocate(ReadBufferPool& pool)
+        {
+            if (!dest)
+            {
+                buffer = pool.acquire(size, capacity);
+            }
+        }
+
+        // blocking read of the remaining data
+        void read()
+        {
+            while (bytes < size)
+            {
+                ssize_t result = ::pread(file, address() + bytes, size - bytes, off_t(offset + bytes));
+                if (result < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+
+                    status.setError("[AsyncFileReader] read(\"%s\") failed: %s", filename.c_str(), std::strerror(errno));
+                    return;
+                }
+
+                if (result == 0)
+                {
+                    // the file was truncated after it was opened
+                    break;
+                }
+
+                bytes += size_t(result);
+            }
+        }
+    };
+
+#if defined(MANGO_ENABLE_IO_URING)
+
+    // -----------------------------------------------------------------
+    // IOUring
+    // -----------------------------------------------------------------
+
+    /*
+        Minimal io_uring interface with the raw system calls; the submission and
+        completion queues are owned by one thread. The thread submits the reads and
+        wakes up on their completions or when new requests are posted (the eventfd is
+        polled with the ring).
+    */
+
+    class IOUring
+    {
+    protected:
+        int m_ring = -1;
+        int m_event = -1;
+
+        void* m_sq_ptr = MAP_FAILED;
+        void* m_cq_ptr = MAP_FAILED;
+        size_t m_sq_bytes = 0;
+        size_t m_cq_bytes = 0;
+
+        io_uring_sqe* m_sqes = nullptr;
+        size_t m_sqes_bytes = 0;
+
+        u32* m_sq_head;
+        u32* m_sq_tail;
+        u32* m_sq_array;
+        u32 m_sq_mask;
+
+        u32* m_cq_head;
+        u32* m_cq_tail;
+        u32 m_cq_mask;
+        io_uring_cqe* m_cqes;
+
+        u32 m_unsubmitted = 0;
+
+    public:
+        IOUring(u32 entries)
+        {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+
+            m_ring = int(::syscall(__NR_io_uring_setup, entries, &params));
+            if (m_ring < 0)
+            {
+                m_ring = -1;
+                return;
+            }
+
+            m_sq_bytes = params.sq_off.array + params.sq_entries * sizeof(u32);
+            m_cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+            const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single)
+            {
+                m_sq_bytes = std::max(m_sq_bytes, m_cq_bytes);
+                m_cq_bytes = m_sq_bytes;
+            }
+
+            m_sq_ptr = ::mmap(nullptr, m_sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+            if (m_sq_ptr == MAP_FAILED)
+            {
+                close();
+                return;
+            }
+
+            if (single)
+            {
+                m_cq_ptr = m_sq_ptr;
+            }
+            else
+            {
+                m_cq_ptr = ::mmap(nullptr, m_cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+                if (m_cq_ptr == MAP_FAILED)
+                {
+                    close();
+                    return;
+                }
+            }
+
+            m_sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+            void* sqes = ::mmap(nullptr, m_sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+            {
+                close();
+                return;
+            }
+
+            m_sqes = reinterpret_cast<io_uring_sqe*>(sqes);
+
+            u8* sq = reinterpret_cast<u8*>(m_sq_ptr);
+            m_sq_head = reinterpret_cast<u32*>(sq + params.sq_off.head);
+            m_sq_tail = reinterpret_cast<u32*>(sq + params.sq_off.tail);
+            m_sq_array = reinterpret_cast<u32*>(sq + params.sq_off.array);
+            m_sq_mask = *reinterpret_cast<u32*>(sq + params.sq_off.ring_mask);
+
+            u8* cq = reinterpret_cast<u8*>(m_cq_ptr);
+            m_cq_head = reinterpret_cast<u32*>(cq + params.cq_off.head);
+            m_cq_tail = reinterpret_cast<u32*>(cq + params.cq_off.tail);
+            m_cq_mask = *reinterpret_cast<u32*>(cq + params.cq_off.ring_mask);
+            m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            m_event = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (m_event == -1)
+            {
+                close();
+                return;
+            }
+        }
+
+        ~IOUring()
+        {
+            close();
+        }
+
+        bool isOpen() const
+        {
+            return m_ring != -1;
+        }
+
+        void close()
+        {
+            if (m_sqes)
+            {
+                ::munmap(m_sqes, m_sqes_bytes);
+                m_sqes = nullptr;
+            }
+
+            if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+            {
+                ::munmap(m_cq_ptr, m_cq_bytes);
+            }
+
+            if (m_sq_ptr != MAP_FAILED)
+            {
+                ::munmap(m_sq_ptr, m_sq_bytes);
+            }
+
+            m_sq_ptr = MAP_FAILED;
+            m_cq_ptr = MAP_FAILED;
+
+            if (m_event != -1)
+            {
+                ::close(m_event);
+                m_event = -1;
+            }
+
+            if (m_ring != -1)
+            {
+                ::close(m_ring);
+                m_ring = -1;
+            }
+        }
+
+        // the caller must not have more entries in flight than the ring was created with
+        io_uring_sqe* prepare(u8 opcode, int fd, u64 user_data)
+        {
+            const u32 tail = *m_sq_tail;
+            const u32 index = tail & m_sq_mask;
+
+            io_uring_sqe* sqe = &m_sqes[index];
+            std::memset(sqe, 0, sizeof(io_uring_sqe));
+            sqe->opcode = opcode;
+            sqe->fd = fd;
+            sqe->user_data = user_data;
+
+            m_sq_array[index] = index;
+            __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+            ++m_unsubmitted;
+
+            return sqe;
+        }
+
+        void prepareRead(ReadRequest* request)
+        {
+            request->vec.iov_base = request->address() + request->bytes;
+            request->vec.iov_len = request->size - request->bytes;
+
+            io_uring_sqe* sqe = prepare(IORING_OP_READV, request->file, u64(reinterpret_cast<uintptr_t>(request)));
+            sqe->addr = u64(reinterpret_cast<uintptr_t>(&request->vec));
+            sqe->len = 1;
+            sqe->off = request->offset + request->bytes;
+        }
+
+        void preparePoll()
+        {
+            io_uring_sqe* sqe = prepare(IORING_OP_POLL_ADD, m_event, 0);
+            sqe->poll32_events = POLLIN;
+        }
+
+        // submit the prepared entries and wait for at least one completion
+        bool submit()
+        {
+            for (;;)
+            {
+                int result = int(::syscall(__NR_io_uring_enter, m_ring, m_unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+                if (result >= 0)
+                {
+                    m_unsubmitted -= std::min(u32(result), m_unsubmitted);
+                    return true;
+                }
+
+                if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                {
+                    return false;
+                }
+            }
+        }
+
+        template <typename Func>
+        void complete(Func func)
+        {
+            u32 head = *m_cq_head;
+            const u32 tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+
+            for ( ; head != tail; ++head)
+            {
+                const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+                func(cqe.user_data, cqe.res);
+            }
+
+            __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        void signal()
+        {
+            u64 value = 1;
+            ssize_t result = ::write(m_event, &value, sizeof(value));
+            MANGO_UNREFERENCED(result);
+        }
+
+        void reset()
+        {
+            u64 value;
+            ssize_t result = ::read(m_event, &value, sizeof(value));
+            MANGO_UNREFERENCED(result);
+        }
+    };
+
+#endif // defined(MANGO_ENABLE_IO_URING)
+
+} // namespace
+
+namespace mango {
+namespace filesystem {
+
+    // -----------------------------------------------------------------
+    // ReaderContext
+    // -----------------------------------------------------------------
+
+    struct ReaderContext
+    {
+        ReadEngine engine;
+        u32 depth;
+        ReadBufferPool pool;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        size_t pending = 0;
+
+        // the blocking reads in the ThreadPool; at most depth of them are in progress
+        std::deque<ReadRequest*> blocking;
+        u32 running = 0;
+
+#if defined(MANGO_ENABLE_IO_URING)
+        std::unique_ptr<IOUring> ring;
+        std::thread thread;
+        std::deque<ReadRequest*> waiting;  // files not opened yet
+        std::deque<ReadRequest*> requests; // opened files waiting to be submitted
+        u32 opened = 0; // files being opened, waiting, in flight or in the callback
+        bool stop = false;
+        bool failed = false;
+#endif
+
+        // declared last so that it is destroyed first; it waits for the tasks
+        ConcurrentQueue queue;
+
+        ReaderContext(ReadEngine engine, u32 depth)
+            : engine(ReadEngine::THREADPOOL)
+            , depth(std::max(depth, 1u))
+            , pool(reader_pool_limit)
+            , queue("file.reader")
+        {
+#if defined(MANGO_ENABLE_IO_URING)
+            if (engine != ReadEngine::THREADPOOL)
+            {
+                ring.reset(new IOUring(this->depth + 1));
+                if (ring->isOpen())
+                {
+                    this->engine = ReadEngine::IO_URING;
+                    thread = std::thread([this] { run(); });
+                }
+                else
+                {
+                    ring.reset();
+                }
+            }
+#else
+            MANGO_UNREFERENCED(engine);
+#endif
+        }
+
+        ~ReaderContext()
+        {
+            wait();
+
+#if defined(MANGO_ENABLE_IO_URING)
+            if (ring)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stop = true;
+                }
+
+                ring->signal();
+                thread.join();
+            }
+#endif
+        }
+
+        void read(ReadRequest* request)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++pending;
+
+#if defined(MANGO_ENABLE_IO_URING)
+            if (ring && !failed)
+            {
+                // the ring thread opens the files only as fast as they are read
+                // so that the number of open files remains bounded
+                waiting.push_back(request);
+                ring->signal();
+                return;
+            }
+#endif
+
+            readBlocking(request);
+        }
+
+        // the mutex must be locked by the caller
+        void readBlocking(ReadRequest* request)
+        {
+            if (running >= depth)
+            {
+                // read by the first task to finish
+                blocking.push_back(request);
+                return;
+            }
+
+            ++running;
+
+            queue.enqueue([this, request]
+            {
+                ReadRequest* current = request;
+
+                while (current)
+                {
+                    if (current->open() && current->size)
+                    {
+                        if (!current->address())
+                        {
+                            current->allocate(pool);
+                        }
+
+                        current->read();
+                    }
+
+                    complete(current);
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    current = nullptr;
+
+                    if (!blocking.empty())
+                    {
+                        current = blocking.front();
+                        blocking.pop_front();
+                    }
+                    else
+                    {
+                        --running;
+                    }
+                }
+            });
+        }
+
+        void complete(ReadRequest* request)
+        {
+            request->close();
+
+            ConstMemory memory;
+            if (request->status)
+            {
+                memory = ConstMemory(request->address(), request->bytes);
+            }
+
+            request->callback(request->filename, memory, request->status);
+
+            pool.release(request->buffer, request->capacity);
+            delete request;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!--pending)
+            {
+                condition.notify_all();
+            }
+        }
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return pending == 0; });
+        }
+
+#if defined(MANGO_ENABLE_IO_URING)
+
+        void open(ReadRequest* request)
+        {
+            queue.enqueue([this, request]
+            {
+                const bool success = request->open() && request->size;
+
+                {
+                    // the ring is signaled under the lock as it is closed once the reads complete
+                    std::lock_guard<std::mutex> lock(mutex);
+
+                    if (success && !failed)
+                    {
+                        // the buffer is allocated when the read is submitted
+                        requests.push_back(request);
+                        ring->signal();
+                        return;
+                    }
+
+                    --opened;
+                    ring->signal();
+                }
+
+                if (success)
+                {
+                    // the ring failed while the file was being opened
+                    request->allocate(pool);
+                    request->read();
+                }
+
+                complete(request);
+            });
+        }
+
+        void run()
+        {
+            std::deque<ReadRequest*> ready; // requests to (re)submit
+            std::vector<ReadRequest*> admitted;
+            u32 inflight = 0;
+            bool polling = false;
+
+            for (;;)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+
+                    while (!waiting.empty() && opened < depth * 2)
+                    {
+                        admitted.push_back(waiting.front());
+                        waiting.pop_front();
+                        ++opened;
+                    }
+
+                    while (!requests.empty() && ready.size() + inflight < depth)
+                    {
+                        ready.push_back(requests.front());
+                        requests.pop_front();
+                    }
+
+                    if (stop && !opened && waiting.empty())
+                    {
+                        break;
+                    }
+                }
+
+                for (ReadRequest* request : admitted)
+                {
+                    open(request);
+                }
+
+                admitted.clear();
+
+                if (!polling)
+                {
+                    ring->preparePoll();
+                    polling = true;
+                }
+
+                while (!ready.empty() && inflight < depth)
+                {
+                    ReadRequest* request = ready.front();
+                    ready.pop_front();
+
+                    if (!request->address())
+                    {
+                        request->allocate(pool);
+                    }
+
+                    ring->prepareRead(request);
+                    ++inflight;
+                }
+
+                if (!ring->submit())
+                {
+                    if (!inflight)
+                    {
+                        // the ring is unusable; the remaining reads are blocking
+                        break;
+                    }
+
+                    // the kernel owns the buffers of the reads in flight until they complete
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+
+                ring->complete([&] (u64 user_data, s32 result)
+                {
+                    if (!user_data)
+                    {
+                        ring->reset();
+                        polling = false;
+                        return;
+                    }
+
+                    ReadRequest* request = reinterpret_cast<ReadRequest*>(uintptr_t(user_data));
+                    --inflight;
+
+                    if (result == -EINTR || result == -EAGAIN)
+                    {
+                        ready.push_back(request);
+                        return;
+                    }
+
+                    if (result < 0)
+                    {
+                        request->status.setError("[AsyncFileReader] read(\"%s\") failed: %s", request->filename.c_str(), std::strerror(-result));
+                    }
+                    else if (result > 0)
+                    {
+                        request->bytes += size_t(result);
+                        if (request->bytes < request->size)
+                        {
+                            // short read; continue from where it ended
+                            ready.push_back(request);
+                            return;
+                        }
+                    }
+
+                    // result == 0: the file was truncated after it was opened
+                    request->close();
+
+                    queue.enqueue([this, request]
+                    {
+                        complete(request);
+
+                        // the buffer has been released; the next file can be opened
+                        std::lock_guard<std::mutex> lock(mutex);
+                        --opened;
+                        ring->signal();
+                    });
+                });
+            }
+
+            // serve the remaining requests with blocking reads; the files which are
+            // being opened are read by the tasks opening them
+            std::lock_guard<std::mutex> lock(mutex);
+            failed = true;
+
+            ready.insert(ready.end(), requests.begin(), requests.end());
+            ready.insert(ready.end(), waiting.begin(), waiting.end());
+            requests.clear();
+            waiting.clear();
+
+            for (ReadRequest* request : ready)
+            {
+                readBlocking(request);
+            }
+        }
+
+#endif // defined(MANGO_ENABLE_IO_URING)
+    };
+
+    // -----------------------------------------------------------------
+    // AsyncFileReader
+    // -----------------------------------------------------------------
+
+    AsyncFileReader::AsyncFileReader(ReadEngine engine, u32 depth)
+        : m_context(new ReaderContext(engine, depth))
+    {
+    }
+
+    AsyncFileReader::~AsyncFileReader()
+    {
+        delete m_context;
+    }
+
+    ReadEngine AsyncFileReader::engine() const
+    {
+        return m_context->engine;
+    }
+
+    void AsyncFileReader::read(const std::string& filename, Callback callback)
+    {
+        m_context->read(new ReadRequest(filename, std::move(callback), nullptr, 0, 0));
+    }
+
+    void AsyncFileReader::read(const std::string& filename, Memory dest, u64 offset, Callback callback)
+    {
+        m_context->read(new ReadRequest(filename, std::move(callback), dest.address, dest.size, offset));
+    }
+
+    void AsyncFileReader::wait()
+    {
+        m_context->wait();
+    }
+
+} // namespace filesystem
+} // namespace mango
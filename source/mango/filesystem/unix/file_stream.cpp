@@ -8,12 +8,17 @@
 #endif
 
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/filesystem/file.hpp>
+#include "../writebuffer.hpp"
 
 namespace mango {
 namespace filesystem {
@@ -27,17 +32,108 @@ namespace filesystem {
 		FILE* m_file;
         std::string m_filename;
 
+        // buffered writing
+        int m_fd = -1;
+        bool m_direct = false;  // opened for direct I/O
+        bool m_direct_enabled = false;
+        std::unique_ptr<WriteBuffer> m_buffer;
+
         FileHandle(const std::string& filename, const char* mode)
             : m_file(std::fopen(filename.c_str(), mode))
             , m_filename(filename)
 		{
 		}
 
+        FileHandle(const std::string& filename, const FileBuffering& buffering)
+            : m_file(nullptr)
+            , m_filename(filename)
+        {
+            const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+#if defined(O_DIRECT)
+            if (buffering.direct)
+            {
+                // not all file systems support direct I/O
+                m_fd = ::open(filename.c_str(), flags | O_DIRECT, 0666);
+                m_direct = m_fd != -1;
+                m_direct_enabled = m_direct;
+            }
+#endif
+
+            if (m_fd == -1)
+            {
+                m_fd = ::open(filename.c_str(), flags, 0666);
+                if (m_fd == -1)
+                {
+                    MANGO_EXCEPTION("[FileStream] open(\"%s\") failed: %s", filename.c_str(), std::strerror(errno));
+                }
+            }
+
+#if defined(F_NOCACHE)
+            if (buffering.direct)
+            {
+                // no alignment requirements
+                ::fcntl(m_fd, F_NOCACHE, 1);
+            }
+#endif
+
+            m_buffer.reset(new WriteBuffer(buffering.size, buffering.write_behind, m_direct,
+                [this] (const u8* data, size_t size, u64 offset)
+            {
+                pwrite(data, size, offset);
+            }));
+        }
+
 		~FileHandle()
 		{
-            std::fclose(m_file);
+            m_buffer.reset();
+
+            if (m_file)
+            {
+                std::fclose(m_file);
+            }
+
+            if (m_fd != -1)
+            {
+                ::close(m_fd);
+            }
 		}
 
+        void pwrite(const u8* data, size_t size, u64 offset)
+        {
+#if defined(O_DIRECT)
+            if (m_direct)
+            {
+                // direct I/O requires aligned writes; the unaligned ones go through the page cache
+                const bool aligned = !((offset | size | reinterpret_cast<uintptr_t>(data)) & 4095);
+                if (aligned != m_direct_enabled)
+                {
+                    const int flags = ::fcntl(m_fd, F_GETFL);
+                    ::fcntl(m_fd, F_SETFL, aligned ? flags | O_DIRECT : flags & ~O_DIRECT);
+                    m_direct_enabled = aligned;
+                }
+            }
+#endif
+
+            while (size > 0)
+            {
+                ssize_t result = ::pwrite(m_fd, data, size, off_t(offset));
+                if (result < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+
+                    MANGO_EXCEPTION("[FileStream] write(\"%s\") failed: %s", m_filename.c_str(), std::strerror(errno));
+                }
+
+                data += result;
+                size -= size_t(result);
+                offset += u64(result);
+            }
+        }
+
         const std::string& filename() const
         {
             return m_filename;
@@ -102,8 +198,45 @@ namespace filesystem {
 		m_handle = new FileHandle(filename, mode);
     }
 
+    FileStream::FileStream(const std::string& filename, OpenMode openmode, const FileBuffering& buffering)
+        : m_handle(nullptr)
+    {
+       	switch (openmode)
+        {
+   	        case READ:
+                m_handle = new FileHandle(filename, "rb");
+                if (m_handle->m_file)
+                {
+                    std::setvbuf(m_handle->m_file, nullptr, _IOFBF, buffering.size);
+                }
+                break;
+
+   	        case WRITE:
+                m_handle = new FileHandle(filename, buffering);
+                m_put_ptr = m_handle->m_buffer->begin();
+                m_put_end = m_handle->m_buffer->end();
+           	    break;
+
+            default:
+	            MANGO_EXCEPTION("[FileStream] Incorrect OpenMode.");
+                break;
+        }
+    }
+
     FileStream::~FileStream()
     {
+        if (m_handle->m_buffer)
+        {
+            try
+            {
+                flush();
+            }
+            catch (...)
+            {
+                // the errors are reported only when flush() is called explicitly
+            }
+        }
+
 		delete m_handle;
     }
 
@@ -112,18 +245,67 @@ namespace filesystem {
         return m_handle->filename();
     }
 
+    void FileStream::flush()
+    {
+        if (m_handle->m_buffer)
+        {
+            m_put_ptr = m_handle->m_buffer->flush(m_put_ptr);
+            m_put_end = m_handle->m_buffer->end();
+        }
+        else
+        {
+            std::fflush(m_handle->m_file);
+        }
+    }
+
     u64 FileStream::size() const
     {
+        if (m_handle->m_buffer)
+        {
+            return m_handle->m_buffer->size(m_put_ptr);
+        }
+
 		return m_handle->size();
     }
 
     u64 FileStream::offset() const
     {
+        if (m_handle->m_buffer)
+        {
+            return m_handle->m_buffer->offset(m_put_ptr);
+        }
+
 		return m_handle->offset();
     }
 
     void FileStream::seek(s64 distance, SeekMode mode)
     {
+        if (m_handle->m_buffer)
+        {
+            u64 base = 0;
+
+            switch (mode)
+            {
+                case BEGIN:
+                    break;
+
+                case CURRENT:
+                    base = offset();
+                    break;
+
+                case END:
+                    base = size();
+                    break;
+
+                default:
+                    MANGO_EXCEPTION("[FileStream] Invalid seek mode.");
+            }
+
+            flush();
+            m_handle->m_buffer->seek(u64(std::max(s64(0), s64(base) + distance)));
+            return;
+        }
+
         int method;
 
         switch (mode)
@@ -149,11 +331,23 @@ namespace filesystem {
 
     void FileStream::read(void* dest, u64 size)
     {
+        if (m_handle->m_buffer)
+        {
+            MANGO_EXCEPTION("[FileStream] The stream is opened for writing.");
+        }
+
 		m_handle->read(dest, size);
     }
 
     void FileStream::write(const void* data, u64 size)
     {
+        if (m_handle->m_buffer)
+        {
+            m_put_ptr = m_handle->m_buffer->write(m_put_ptr, data, size);
+            m_put_end = m_handle->m_buffer->end();
+            return;
+        }
+
 		m_handle->write(data, size);
     }
 
@@ -4,9 +4,12 @@
 */
 #include <mango/core/exception.hpp>
 #include <mango/core/string.hpp>
+#include <mango/core/thread.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
 
+#include <cstring>
+#include <mutex>
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -40,12 +43,14 @@ namespace
         int m_file;
 		size_t m_size;
 		void* m_address;
+        u64 m_offset; // file offset of the memory
 
     public:
         FileMemory(const std::string& filename, u64 x_offset, u64 x_size)
             : m_file(-1)
             , m_size(0)
             , m_address(nullptr)
+            , m_offset(x_offset)
         {
             m_file = open(filename.c_str(), O_RDONLY);
 
@@ -103,6 +108,78 @@ namespace
             }
         }
 
+        void advise(AccessHint hint, u64 offset, u64 size) const override
+        {
+            offset = std::min(offset, u64(m_memory.size));
+            size = std::min(size, m_memory.size - offset);
+
+            if (!m_address || !size)
+            {
+                return;
+            }
+
+            // madvise() needs a page aligned address
+            const uintptr_t page_mask = uintptr_t(get_pagesize() - 1);
+            const uintptr_t start = uintptr_t(m_memory.address + offset);
+            void* address = reinterpret_cast<void*>(start & ~page_mask);
+            const size_t length = size_t(start + size - (start & ~page_mask));
+
+            const off_t file_offset = off_t(m_offset + offset);
+            const off_t file_length = off_t(size);
+
+            MANGO_UNREFERENCED(file_offset);
+            MANGO_UNREFERENCED(file_length);
+
+            switch (hint)
+            {
+                case AccessHint::NORMAL:
+                    ::madvise(address, length, MADV_NORMAL);
+#if defined(POSIX_FADV_NORMAL)
+                    ::posix_fadvise(m_file, file_offset, file_length, POSIX_FADV_NORMAL);
+#endif
+                    break;
+
+                case AccessHint::SEQUENTIAL:
+                    ::madvise(address, length, MADV_SEQUENTIAL);
+#if defined(POSIX_FADV_SEQUENTIAL)
+                    ::posix_fadvise(m_file, file_offset, file_length, POSIX_FADV_SEQUENTIAL);
+#endif
+                    break;
+
+                case AccessHint::RANDOM:
+                    ::madvise(address, length, MADV_RANDOM);
+#if defined(POSIX_FADV_RANDOM)
+                    ::posix_fadvise(m_file, file_offset, file_length, POSIX_FADV_RANDOM);
+#endif
+                    break;
+
+                case AccessHint::WILLNEED:
+                    // the page cache read-ahead is started without waiting for it
+#if defined(POSIX_FADV_WILLNEED)
+                    ::posix_fadvise(m_file, file_offset, file_length, POSIX_FADV_WILLNEED);
+#endif
+                    ::madvise(address, length, MADV_WILLNEED);
+                    break;
+
+                case AccessHint::DONTNEED:
+                    // the mapping is read-only so the pages are simply read again when needed
+                    ::madvise(address, length, MADV_DONTNEED);
+#if defined(POSIX_FADV_DONTNEED)
+                    ::posix_fadvise(m_file, file_offset, file_length, POSIX_FADV_DONTNEED);
+#endif
+                    break;
+
+                case AccessHint::POPULATE:
+#if defined(MADV_POPULATE_READ)
+                    // same as MAP_POPULATE for an existing mapping (Linux 5.14)
+                    if (!::madvise(address, length, MADV_POPULATE_READ))
+                        break;
+#endif
+                    VirtualMemory::advise(hint, offset, size);
+                    break;
+            }
+        }
+
         ~FileMemory()
         {
             if (m_address)
@@ -171,6 +248,20 @@ namespace
             return is;
         }
 
+        u64 getTime(const std::string& filename) const override
+        {
+            u64 time = 0;
+            std::string testname = m_basepath + filename;
+
+            struct stat s;
+            if (::stat(testname.c_str(), &s) == 0)
+            {
+                time = u64(s.st_mtime);
+            }
+
+            return time;
+        }
+
 #if defined(MANGO_PLATFORM_OSX) || defined(MANGO_PLATFORM_IOS) || defined(MANGO_PLATFORM_BSD)
 
         void getIndex(FileIndex& index, const std::string& pathname) override
@@ -232,6 +323,142 @@ namespace
 
 #endif
 
+        void walk(FileIndex& index, const std::string& pathname, const WalkFilter& filter) override
+        {
+            const std::string fullname = m_basepath + pathname;
+
+            // the folders are opened relative to the root so that the path is resolved once
+            const int root = ::open(fullname.empty() ? "." : fullname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (root < 0)
+            {
+                // Unable to open directory.
+                return;
+            }
+
+            std::mutex mutex;
+            ConcurrentQueue queue("mapper.walk");
+
+            std::function<void(const std::string&)> scan;
+
+            // the entries of a folder are examined in chunks so that huge folders are
+            // scanned in parallel as well
+            struct Entry
+            {
+                std::string name;
+                u8 type;
+            };
+
+            auto examine = [&] (const std::string folder, std::shared_ptr<DIR> dir, const Entry* entries, size_t count)
+            {
+                FileIndex local;
+                const int fd = ::dirfd(dir.get());
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const std::string& name = entries[i].name;
+                    const std::string filename = folder + name;
+
+                    struct stat s;
+                    bool directory = entries[i].type == DT_DIR;
+                    bool descend = directory;
+
+                    if (entries[i].type == DT_UNKNOWN || entries[i].type == DT_LNK)
+                    {
+                        // the type is not known without stat; symbolic links are followed
+                        // but not descended into so that link cycles cannot loop the walk
+                        if (::fstatat(fd, name.c_str(), &s, 0) != 0)
+                            continue;
+
+                        struct stat link;
+                        bool is_link = entries[i].type == DT_LNK ||
+                            (::fstatat(fd, name.c_str(), &link, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(link.st_mode));
+
+                        directory = S_ISDIR(s.st_mode);
+                        descend = directory && !is_link;
+                    }
+
+                    if (directory)
+                    {
+                        const std::string subfolder = filename + "/";
+                        if (filter.folder && !filter.folder(subfolder))
+                            continue;
+
+                        local.files.emplace_back(subfolder, 0, FileInfo::DIRECTORY);
+
+                        if (descend)
+                        {
+                            queue.enqueue([&, subfolder]
+                            {
+                                scan(subfolder);
+                            });
+                        }
+                    }
+                    else
+                    {
+                        if (filter.file && !filter.file(filename))
+                            continue;
+
+                        // the size is only needed for the files which pass the filter
+                        if (entries[i].type != DT_UNKNOWN && entries[i].type != DT_LNK)
+                        {
+                            if (::fstatat(fd, name.c_str(), &s, 0) != 0)
+                                continue;
+                        }
+
+                        local.emplace(filename, u64(s.st_size), 0);
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                index.files.insert(index.files.end(), local.files.begin(), local.files.end());
+            };
+
+            scan = [&] (const std::string& folder)
+            {
+                const int fd = folder.empty() ? ::dup(root) :
+                    ::openat(root, folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (fd < 0)
+                    return;
+
+                DIR* dirp = ::fdopendir(fd);
+                if (!dirp)
+                {
+                    ::close(fd);
+                    return;
+                }
+
+                std::shared_ptr<DIR> dir(dirp, ::closedir);
+                auto entries = std::make_shared<std::vector<Entry>>();
+
+                while (dirent* dp = ::readdir(dirp))
+                {
+                    // skip "." and ".."
+                    if (!std::strcmp(dp->d_name, ".") || !std::strcmp(dp->d_name, ".."))
+                        continue;
+
+                    entries->push_back({ dp->d_name, u8(dp->d_type) });
+                }
+
+                const size_t chunk = 2048;
+                const size_t count = entries->size();
+
+                for (size_t i = chunk; i < count; i += chunk)
+                {
+                    queue.enqueue([&, folder, dir, entries, i, chunk, count]
+                    {
+                        examine(folder, dir, entries->data() + i, std::min(chunk, count - i));
+                    });
+                }
+
+                examine(folder, dir, entries->data(), std::min(chunk, count));
+            };
+
+            scan("");
+            queue.wait();
+
+            ::close(root);
+        }
+
         VirtualMemory* mmap(const std::string& filename) override
         {
             VirtualMemory* memory = new FileMemory(m_basepath + filename, 0, 0);
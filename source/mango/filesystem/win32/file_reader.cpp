@@ -0,0 +1,275 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <limits>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <mango/core/string.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/thread.hpp>
+#include <mango/filesystem/file.hpp>
+#include "../bufferpool.hpp"
+
+namespace
+{
+    using namespace mango;
+    using namespace mango::filesystem;
+
+    // the pooled buffers kept for reuse
+    constexpr size_t reader_pool_limit = 64 * 1024 * 1024;
+
+    struct ReadRequest
+    {
+        std::string filename;
+        AsyncFileReader::Callback callback;
+
+        u8* dest;           // caller's memory or nullptr
+        size_t capacity;    // caller's memory size or pooled buffer capacity
+        u64 offset;
+
+        HANDLE file = INVALID_HANDLE_VALUE;
+        u8* buffer = nullptr;   // pooled buffer
+        size_t size = 0;        // bytes to read
+        size_t bytes = 0;       // bytes read
+        Status status;
+
+        ReadRequest(const std::string& filename, AsyncFileReader::Callback callback, u8* dest, size_t capacity, u64 offset)
+            : filename(filename)
+            , callback(std::move(callback))
+            , dest(dest)
+            , capacity(capacity)
+            , offset(offset)
+        {
+        }
+
+        ~ReadRequest()
+        {
+            if (file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(file);
+            }
+        }
+
+        bool open()
+        {
+            file = CreateFileW(u16_fromBytes(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                status.setError("[AsyncFileReader] CreateFileW(\"%s\") failed.", filename.c_str());
+                return false;
+            }
+
+            LARGE_INTEGER integer;
+            if (!GetFileSizeEx(file, &integer))
+            {
+                status.setError("[AsyncFileReader] GetFileSizeEx(\"%s\") failed.", filename.c_str());
+                return false;
+            }
+
+            const u64 filesize = u64(integer.QuadPart);
+            u64 available = offset < filesize ? filesize - offset : 0;
+            if (dest)
+            {
+                available = std::min(available, u64(capacity));
+            }
+
+            if (available > u64(std::numeric_limits<size_t>::max()))
+            {
+                status.setError("[AsyncFileReader] \"%s\" is too large.", filename.c_str());
+                return false;
+            }
+
+            size = size_t(available);
+            return true;
+        }
+
+        u8* address() const
+        {
+            return dest ? dest : buffer;
+        }
+
+        void read(ReadBufferPool& pool)
+        {
+            if (!dest)
+            {
+                buffer = pool.acquire(size, capacity);
+            }
+
+            while (bytes < size)
+            {
+                const u64 position = offset + bytes;
+
+                OVERLAPPED overlapped = { 0 };
+                overlapped.Offset = DWORD(position);
+                overlapped.OffsetHigh = DWORD(position >> 32);
+
+                DWORD request = DWORD(std::min(size - bytes, size_t(0x40000000)));
+                DWORD result = 0;
+
+                if (!ReadFile(file, address() + bytes, request, &result, &overlapped))
+                {
+                    status.setError("[AsyncFileReader] ReadFile(\"%s\") failed.", filename.c_str());
+                    return;
+                }
+
+                if (!result)
+                {
+                    // the file was truncated after it was opened
+                    break;
+                }
+
+                bytes += size_t(result);
+            }
+        }
+    };
+
+} // namespace
+
+namespace mango {
+namespace filesystem {
+
+    // -----------------------------------------------------------------
+    // ReaderContext
+    // -----------------------------------------------------------------
+
+    struct ReaderContext
+    {
+        u32 depth;
+        ReadBufferPool pool;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        size_t pending = 0;
+
+        // at most depth of the reads are in progress; the rest are waiting here
+        std::deque<ReadRequest*> blocking;
+        u32 running = 0;
+
+        // declared last so that it is destroyed first; it waits for the tasks
+        ConcurrentQueue queue;
+
+        ReaderContext(u32 depth)
+            : depth(std::max(depth, 1u))
+            , pool(reader_pool_limit)
+            , queue("file.reader")
+        {
+        }
+
+        ~ReaderContext()
+        {
+            wait();
+        }
+
+        void read(ReadRequest* request)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++pending;
+
+            if (running >= depth)
+            {
+                // read by the first task to finish
+                blocking.push_back(request);
+                return;
+            }
+
+            ++running;
+
+            queue.enqueue([this, request]
+            {
+                ReadRequest* current = request;
+
+                while (current)
+                {
+                    process(current);
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    current = nullptr;
+
+                    if (!blocking.empty())
+                    {
+                        current = blocking.front();
+                        blocking.pop_front();
+                    }
+                    else
+                    {
+                        --running;
+                    }
+                }
+            });
+        }
+
+        // read the file and call the callback
+        void process(ReadRequest* request)
+        {
+            if (request->open())
+            {
+                request->read(pool);
+            }
+
+            ConstMemory memory;
+            if (request->status)
+            {
+                memory = ConstMemory(request->address(), request->bytes);
+            }
+
+            request->callback(request->filename, memory, request->status);
+
+            pool.release(request->buffer, request->capacity);
+            delete request;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!--pending)
+            {
+                condition.notify_all();
+            }
+        }
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return pending == 0; });
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // AsyncFileReader
+    // -----------------------------------------------------------------
+
+    AsyncFileReader::AsyncFileReader(ReadEngine engine, u32 depth)
+        : m_context(new ReaderContext(depth))
+    {
+        // the reads are blocking in the ThreadPool
+        MANGO_UNREFERENCED(engine);
+    }
+
+    AsyncFileReader::~AsyncFileReader()
+    {
+        delete m_context;
+    }
+
+    ReadEngine AsyncFileReader::engine() const
+    {
+        return ReadEngine::THREADPOOL;
+    }
+
+    void AsyncFileReader::read(const std::string& filename, Callback callback)
+    {
+        m_context->read(new ReadRequest(filename, std::move(callback), nullptr, 0, 0));
+    }
+
+    void AsyncFileReader::read(const std::string& filename, Memory dest, u64 offset, Callback callback)
+    {
+        m_context->read(new ReadRequest(filename, std::move(callback), dest.address, dest.size, offset));
+    }
+
+    void AsyncFileReader::wait()
+    {
+        m_context->wait();
+    }
+
+} // namespace filesystem
+} // namespace mango
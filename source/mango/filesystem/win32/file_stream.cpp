@@ -2,9 +2,11 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <memory>
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/filesystem/file.hpp>
+#include "../writebuffer.hpp"
 
 namespace mango {
 namespace filesystem {
@@ -18,17 +20,98 @@ namespace filesystem {
         std::string m_filename;
 		HANDLE m_handle;
 
+        // buffered writing
+        bool m_direct = false;
+        HANDLE m_buffered = INVALID_HANDLE_VALUE; // for the unaligned writes with m_direct
+        std::unique_ptr<WriteBuffer> m_buffer;
+
 		FileHandle(const std::string& filename, HANDLE handle)
 		    : m_filename(filename)
             , m_handle(handle)
 		{
 		}
 
+        FileHandle(const std::string& filename, const FileBuffering& buffering)
+            : m_filename(filename)
+            , m_handle(INVALID_HANDLE_VALUE)
+        {
+            const std::wstring name = u16_fromBytes(filename);
+
+            if (buffering.direct)
+            {
+                // the handle is shared so that it can be reopened with buffering for unaligned writes
+                m_handle = CreateFileW(name.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                    CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, NULL);
+                m_direct = m_handle != INVALID_HANDLE_VALUE;
+            }
+
+            if (m_handle == INVALID_HANDLE_VALUE)
+            {
+                m_handle = CreateFileW(name.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+                if (m_handle == INVALID_HANDLE_VALUE)
+                {
+                    MANGO_EXCEPTION("[FileStream] CreateFileW() failed.");
+                }
+            }
+
+            m_buffer.reset(new WriteBuffer(buffering.size, buffering.write_behind, m_direct,
+                [this] (const u8* data, size_t size, u64 offset)
+            {
+                pwrite(data, size, offset);
+            }));
+        }
+
 		~FileHandle()
 		{
+            m_buffer.reset();
+
+            if (m_buffered != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_buffered);
+            }
+
             CloseHandle(m_handle);
 		}
 
+        void pwrite(const u8* data, size_t size, u64 offset)
+        {
+            HANDLE handle = m_handle;
+
+            if (m_direct && ((offset | size | reinterpret_cast<uintptr_t>(data)) & 4095))
+            {
+                // unbuffered I/O requires aligned writes; the unaligned ones are written with buffering
+                if (m_buffered == INVALID_HANDLE_VALUE)
+                {
+                    m_buffered = ReOpenFile(m_handle, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0);
+                    if (m_buffered == INVALID_HANDLE_VALUE)
+                    {
+                        MANGO_EXCEPTION("[FileStream] ReOpenFile() failed.");
+                    }
+                }
+
+                handle = m_buffered;
+            }
+
+            while (size > 0)
+            {
+                OVERLAPPED overlapped = { 0 };
+                overlapped.Offset = DWORD(offset);
+                overlapped.OffsetHigh = DWORD(offset >> 32);
+
+                DWORD request = DWORD(std::min(size, size_t(0x40000000)));
+                DWORD bytes_written = 0;
+
+                if (!WriteFile(handle, data, request, &bytes_written, &overlapped))
+                {
+                    MANGO_EXCEPTION("[FileStream] WriteFile() failed.");
+                }
+
+                data += bytes_written;
+                size -= size_t(bytes_written);
+                offset += u64(bytes_written);
+            }
+        }
+
         const std::string& filename() const
         {
             return m_filename;
@@ -112,8 +195,50 @@ namespace filesystem {
 		m_handle = new FileHandle(filename, handle);
     }
 
+    FileStream::FileStream(const std::string& filename, OpenMode mode, const FileBuffering& buffering)
+        : m_handle(nullptr)
+    {
+        switch (mode)
+        {
+            case READ:
+            {
+                // the reads are buffered by the operating system
+                HANDLE handle = CreateFileW(u16_fromBytes(filename).c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+                if (handle == INVALID_HANDLE_VALUE)
+                {
+                    MANGO_EXCEPTION("[FileStream] CreateFileW() failed.");
+                }
+
+                m_handle = new FileHandle(filename, handle);
+                break;
+            }
+
+            case WRITE:
+                m_handle = new FileHandle(filename, buffering);
+                m_put_ptr = m_handle->m_buffer->begin();
+                m_put_end = m_handle->m_buffer->end();
+                break;
+
+            default:
+                MANGO_EXCEPTION("[FileStream] Incorrect OpenMode.");
+                break;
+        }
+    }
+
     FileStream::~FileStream()
     {
+        if (m_handle->m_buffer)
+        {
+            try
+            {
+                flush();
+            }
+            catch (...)
+            {
+                // the errors are reported only when flush() is called explicitly
+            }
+        }
+
 		delete m_handle;
     }
 
@@ -122,18 +247,67 @@ namespace filesystem {
         return m_handle->filename();
     }
 
+    void FileStream::flush()
+    {
+        if (m_handle->m_buffer)
+        {
+            m_put_ptr = m_handle->m_buffer->flush(m_put_ptr);
+            m_put_end = m_handle->m_buffer->end();
+        }
+        else
+        {
+            FlushFileBuffers(m_handle->m_handle);
+        }
+    }
+
     u64 FileStream::size() const
     {
+        if (m_handle->m_buffer)
+        {
+            return m_handle->m_buffer->size(m_put_ptr);
+        }
+
         return m_handle->size();
     }
 
     u64 FileStream::offset() const
     {
+        if (m_handle->m_buffer)
+        {
+            return m_handle->m_buffer->offset(m_put_ptr);
+        }
+
         return m_handle->offset();
     }
 
     void FileStream::seek(s64 distance, SeekMode mode)
     {
+        if (m_handle->m_buffer)
+        {
+            u64 base = 0;
+
+            switch (mode)
+            {
+                case BEGIN:
+                    break;
+
+                case CURRENT:
+                    base = offset();
+                    break;
+
+                case END:
+                    base = size();
+                    break;
+
+                default:
+                    MANGO_EXCEPTION("[FileStream] Invalid seek mode.");
+            }
+
+            flush();
+            m_handle->m_buffer->seek(u64(std::max(s64(0), s64(base) + distance)));
+            return;
+        }
+
         DWORD method;
 
         switch (mode)
@@ -159,11 +333,23 @@ namespace filesystem {
 
     void FileStream::read(void* dest, u64 size)
     {
+        if (m_handle->m_buffer)
+        {
+            MANGO_EXCEPTION("[FileStream] The stream is opened for writing.");
+        }
+
 		m_handle->read(dest, size);
     }
 
     void FileStream::write(const void* data, u64 size)
     {
+        if (m_handle->m_buffer)
+        {
+            m_put_ptr = m_handle->m_buffer->write(m_put_ptr, data, size);
+            m_put_end = m_handle->m_buffer->end();
+            return;
+        }
+
 		m_handle->write(data, size);
     }
 
@@ -152,6 +152,20 @@ namespace
             return is;
         }
 
+        u64 getTime(const std::string& filename) const override
+        {
+            u64 time = 0;
+
+            struct __stat64 s;
+
+            if (_wstat64(u16_fromBytes(m_basepath + filename).c_str(), &s) == 0)
+            {
+                time = u64(s.st_mtime);
+            }
+
+            return time;
+        }
+
         void getIndex(FileIndex& index, const std::string& pathname) override
         {
             std::wstring filespec = u16_fromBytes(m_basepath + pathname + "*");
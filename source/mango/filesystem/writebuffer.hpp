@@ -0,0 +1,267 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <mango/core/configure.hpp>
+#include <mango/core/memory.hpp>
+
+namespace mango {
+namespace filesystem {
+
+    // -----------------------------------------------------------------
+    // WriteBuffer
+    // -----------------------------------------------------------------
+
+    /*
+        Large aligned write buffer for the buffered FileStream. The stream fills the
+        buffer through it's put area (see Stream::put()) and hands the full buffers to
+        the WriteBuffer which writes them at their file offset. With write-behind the
+        buffers are written in a background thread while the next one is being filled;
+        the write errors of the thread are rethrown to the stream at the next write or
+        flush.
+
+        The buffer size is a multiple of 4 KB and the full buffers are written at
+        offsets which are multiples of the buffer size (unless the stream is seeked)
+        so that the writes satisfy the alignment requirements of unbuffered I/O.
+    */
+
+    class WriteBuffer : protected NonCopyable
+    {
+    public:
+        // write size bytes at offset; throws on failure
+        using WriteFunc = std::function<void(const u8* data, size_t size, u64 offset)>;
+
+    protected:
+        struct Block
+        {
+            u8* data;
+            size_t size;
+            u64 offset;
+        };
+
+        WriteFunc m_write;
+        size_t m_size;
+        bool m_bypass;
+
+        std::vector<u8*> m_buffers;
+        u8* m_current;
+        u64 m_position; // file offset of the current buffer
+        u64 m_extent = 0; // end of the written data
+
+        // write-behind
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::deque<Block> m_queue;
+        std::vector<u8*> m_free;
+        std::exception_ptr m_error;
+        bool m_stop = false;
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            for (;;)
+            {
+                m_condition.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty())
+                {
+                    break;
+                }
+
+                Block block = m_queue.front();
+                lock.unlock();
+
+                std::exception_ptr error;
+                try
+                {
+                    m_write(block.data, block.size, block.offset);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+
+                lock.lock();
+
+                if (error && !m_error)
+                {
+                    m_error = error;
+                }
+
+                m_queue.pop_front();
+                m_free.push_back(block.data);
+                m_condition.notify_all();
+            }
+        }
+
+        // rethrow the first error of the background writes; the lock must be held
+        void check()
+        {
+            if (m_error)
+            {
+                std::exception_ptr error = m_error;
+                m_error = nullptr;
+                std::rethrow_exception(error);
+            }
+        }
+
+        void submit(size_t bytes)
+        {
+            const u64 offset = m_position;
+
+            m_position += bytes;
+            m_extent = std::max(m_extent, m_position);
+
+            if (!m_thread.joinable())
+            {
+                m_write(m_current, bytes, offset);
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            check();
+
+            m_queue.push_back({ m_current, bytes, offset });
+            m_condition.notify_all();
+
+            m_condition.wait(lock, [this] { return !m_free.empty(); });
+            m_current = m_free.back();
+            m_free.pop_back();
+        }
+
+    public:
+        // large writes bypass the buffer unless the writes must be aligned (the source memory
+        // is not aligned) or they are written behind (the copy is cheaper than waiting)
+        WriteBuffer(size_t size, bool write_behind, bool aligned, WriteFunc write)
+            : m_write(std::move(write))
+            , m_size(std::max(size_t(4096), (size + 4095) & ~size_t(4095)))
+            , m_bypass(!aligned && !write_behind)
+            , m_position(0)
+        {
+            const size_t count = write_behind ? 2 : 1;
+            for (size_t i = 0; i < count; ++i)
+            {
+                m_buffers.push_back(reinterpret_cast<u8*>(aligned_malloc(m_size, Alignment(4096))));
+            }
+
+            m_current = m_buffers[0];
+
+            if (write_behind)
+            {
+                m_free.push_back(m_buffers[1]);
+                m_thread = std::thread([this] { run(); });
+            }
+        }
+
+        ~WriteBuffer()
+        {
+            if (m_thread.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stop = true;
+                    m_condition.notify_all();
+                }
+
+                m_thread.join();
+            }
+
+            for (u8* buffer : m_buffers)
+            {
+                aligned_free(buffer);
+            }
+        }
+
+        // put area of the current buffer
+        u8* begin() const
+        {
+            return m_current;
+        }
+
+        u8* end() const
+        {
+            return m_current + m_size;
+        }
+
+        u64 offset(const u8* ptr) const
+        {
+            return m_position + u64(ptr - m_current);
+        }
+
+        u64 size(const u8* ptr) const
+        {
+            return std::max(m_extent, offset(ptr));
+        }
+
+        // append data to the buffer which is filled up to ptr; returns the new fill position
+        u8* write(u8* ptr, const void* data, u64 size)
+        {
+            const u8* source = reinterpret_cast<const u8*>(data);
+
+            while (size > 0)
+            {
+                if (ptr == m_current && size >= m_size && m_bypass)
+                {
+                    // the buffer is empty; write the data directly
+                    m_write(source, size_t(size), m_position);
+                    m_position += size;
+                    m_extent = std::max(m_extent, m_position);
+                    break;
+                }
+
+                const size_t bytes = size_t(std::min(size, u64(end() - ptr)));
+                std::memcpy(ptr, source, bytes);
+
+                ptr += bytes;
+                source += bytes;
+                size -= bytes;
+
+                if (ptr == end())
+                {
+                    submit(m_size);
+                    ptr = m_current;
+                }
+            }
+
+            return ptr;
+        }
+
+        // write the buffer and wait for the background writes; returns the new fill position
+        u8* flush(u8* ptr)
+        {
+            const size_t bytes = size_t(ptr - m_current);
+            if (bytes)
+            {
+                submit(bytes);
+            }
+
+            if (m_thread.joinable())
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] { return m_queue.empty(); });
+                check();
+            }
+
+            return m_current;
+        }
+
+        // the buffer must be flushed
+        void seek(u64 position)
+        {
+            m_position = position;
+        }
+    };
+
+} // namespace filesystem
+} // namespace mango
@@ -954,7 +954,8 @@ namespace
 
     // block decode
 
-    void directBlockDecode(const TextureCompressionInfo& info, const Surface& surface, ConstMemory memory, int xblocks, int yblocks)
+    void directBlockDecode(const TextureCompressionInfo& info, const Surface& surface, ConstMemory memory,
+                           int xblocks, int yblocks, const CancellationToken& cancellation)
     {
         const u8* data = memory.address;
 
@@ -973,23 +974,26 @@ namespace
             ystride = -ystride;
         }
 
-        ConcurrentQueue queue;
+        const size_t bytes_per_row = size_t(xblocks) * info.width * info.height * surface.format.bytes();
 
-        for (int y = 0; y < yblocks; ++y)
+        parallel_for_rows(yblocks, bytes_per_row, [&] (int y0, int y1)
         {
-            queue.enqueue([&] (u8* image, const u8* data)
+            for (int y = y0; y < y1; ++y)
             {
+                if (cancellation.isCancelled())
+                    break;
+
+                u8* dest = image + y * ystride;
+                const u8* src = data + y * info.bytes * xblocks;
+
                 for (int x = 0; x < xblocks; ++x)
                 {
-                    info.decode(info, image, data, stride);
-                    image += xstride;
-                    data += info.bytes;
+                    info.decode(info, dest, src, stride);
+                    dest += xstride;
+                    src += info.bytes;
                 }
-            }, image, data);
-
-            image += ystride;
-            data += info.bytes * xblocks;
-        }
+            }
+        });
     }
 
     void directSurfaceDecode(const TextureCompressionInfo& info, const Surface& surface, ConstMemory memory)
@@ -1117,7 +1121,8 @@ namespace mango
         *this = *info;
     }
 
-    TextureCompressionStatus TextureCompressionInfo::decompress(const Surface& surface, ConstMemory memory) const
+    TextureCompressionStatus TextureCompressionInfo::decompress(const Surface& surface, ConstMemory memory,
+                                                                const CancellationToken& cancellation) const
     {
         TextureCompressionStatus status;
 
@@ -1154,12 +1159,12 @@ namespace mango
             // mode: block
             if (direct)
             {
-                directBlockDecode(*this, surface, memory, xblocks, yblocks);
+                directBlockDecode(*this, surface, memory, xblocks, yblocks, cancellation);
             }
             else
             {
                 Bitmap bitmap(xblocks * width, yblocks * height, format);
-                directBlockDecode(*this, bitmap, memory, xblocks, yblocks);
+                directBlockDecode(*this, bitmap, memory, xblocks, yblocks, cancellation);
 
                 // NOTE: The compressed image is always rounded to the block size. When the image
                 //       origin is at bottom, mirroring will leave padding pixels on the top.
@@ -1170,6 +1175,11 @@ namespace mango
             }
         }
 
+        if (cancellation.isCancelled())
+        {
+            status.setError("Decoding cancelled.");
+        }
+
         status.direct = direct;
 
         return status;
@@ -1185,18 +1195,18 @@ namespace mango
             return status;
         }
 
-        ConcurrentQueue queue;
-
         u8* address = memory.address;
 
         const int xblocks = ceil_div(surface.width, width);
         const int yblocks = ceil_div(surface.height, height);
 
-        for (int y = 0; y < yblocks; ++y)
+        // block encoding is expensive; a single row of blocks is worth a task
+        parallel_for(0, yblocks, 1, [&] (int y0, int y1)
         {
-            queue.enqueue([this, y, xblocks, &surface, address]
+            Bitmap temp(width, height, format);
+
+            for (int y = y0; y < y1; ++y)
             {
-                Bitmap temp(width, height, format);
                 u8* data = address + y * xblocks * bytes;
 
                 for (int x = 0; x < xblocks; ++x)
@@ -1208,8 +1218,8 @@ namespace mango
                     encode(*this, data, image, temp.stride);
                     data += bytes;
                 }
-            });
-        }
+            }
+        });
 
         return status;
     }
@@ -275,9 +275,15 @@ namespace mango
         {
             status.setError("[WARNING] ImageDecoder::decode() is not supported for this extension.");
         }
+        else if (options.cancellation.isCancelled())
+        {
+            status.setError("[ImageDecoder] Decoding cancelled.");
+        }
         else
         {
+            m_interface->cancellation = options.cancellation;
             status = m_interface->decode(dest, options.palette, level, depth, face);
+            m_interface->cancellation = CancellationToken();
         }
 
         return status;
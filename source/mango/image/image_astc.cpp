@@ -151,7 +151,7 @@ namespace
 
             if (info.compression != TextureCompression::NONE)
             {
-                TextureCompressionStatus cs = info.decompress(dest, m_data);
+                TextureCompressionStatus cs = info.decompress(dest, m_data, cancellation);
 
                 status.info = cs.info;
                 status.success = cs.success;
@@ -1107,7 +1107,7 @@ namespace
             if (m_header.pixelFormat.fourCC)
             {
                 TextureCompressionInfo info = fourcc_to_compression(m_header.pixelFormat.fourCC);
-                TextureCompressionStatus cs = info.decompress(dest, imageMemory);
+                TextureCompressionStatus cs = info.decompress(dest, imageMemory, cancellation);
 
                 status.info = cs.info;
                 status.success = cs.success;
@@ -1116,7 +1116,7 @@ namespace
             else if (compression != TextureCompression::NONE)
             {
                 TextureCompressionInfo info = compression;
-                TextureCompressionStatus cs = info.decompress(dest, imageMemory);
+                TextureCompressionStatus cs = info.decompress(dest, imageMemory, cancellation);
 
                 status.info = cs.info;
                 status.success = cs.success;
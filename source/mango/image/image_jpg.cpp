@@ -54,7 +54,7 @@ namespace
             MANGO_UNREFERENCED(depth);
             MANGO_UNREFERENCED(face);
 
-            ImageDecodeStatus status = m_parser.decode(dest);
+            ImageDecodeStatus status = m_parser.decode(dest, cancellation);
             return status;
         }
     };
@@ -687,7 +687,7 @@ namespace
 
             if (info.compression != TextureCompression::NONE)
             {
-                TextureCompressionStatus cs = info.decompress(dest, data);
+                TextureCompressionStatus cs = info.decompress(dest, data, cancellation);
 
                 status.info = cs.info;
                 status.success = cs.success;
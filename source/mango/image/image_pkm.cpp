@@ -164,7 +164,7 @@ namespace
             }
 
             TextureCompressionInfo info = header.compression;
-            TextureCompressionStatus cs = info.decompress(dest, m_data);
+            TextureCompressionStatus cs = info.decompress(dest, m_data, cancellation);
 
             status.info = cs.info;
             status.success = cs.success;
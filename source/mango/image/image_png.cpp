@@ -1328,6 +1328,8 @@ namespace
 
         void blend(Surface& d, Surface& s, Palette* palette);
 
+        CancellationToken m_cancellation;
+
         int getBytesPerLine(int width) const
         {
             return m_channels * ((m_color_state.bits * width + 7) / 8);
@@ -1347,7 +1349,7 @@ namespace
         ~ParserPNG();
 
         const ImageHeader& getHeader();
-        ImageDecodeStatus decode(const Surface& dest, Palette* palette);
+        ImageDecodeStatus decode(const Surface& dest, Palette* palette, const CancellationToken& cancellation);
     };
 
     // ------------------------------------------------------------
@@ -2105,6 +2107,9 @@ namespace
             // color conversion
             for (int y = 0; y < height; ++y)
             {
+                if (m_cancellation.isCancelled())
+                    return;
+
                 convert(m_color_state, width, image, buffer + 1);
                 image += stride;
                 buffer += bytes_per_line;
@@ -2124,6 +2129,9 @@ namespace
 
             for (int y = 0; y < height; ++y)
             {
+                if (m_cancellation.isCancelled())
+                    return;
+
                 // filtering
                 filter(buffer, prev, bytes_per_line);
 
@@ -2137,10 +2145,12 @@ namespace
         }
     }
 
-    ImageDecodeStatus ParserPNG::decode(const Surface& dest, Palette* ptr_palette)
+    ImageDecodeStatus ParserPNG::decode(const Surface& dest, Palette* ptr_palette, const CancellationToken& cancellation)
     {
         ImageDecodeStatus status;
 
+        m_cancellation = cancellation;
+
         m_compressed.reset();
 
         parse();
@@ -2217,6 +2227,17 @@ namespace
         // process image
         process(image, width, height, stride, buffer);
 
+        // NOTE: the inflate is a single call which can't be interrupted; the token
+        //       is polled for every scanline in the filtering / color conversion
+        if (m_cancellation.isCancelled())
+        {
+            m_cancellation = CancellationToken();
+            status.setError("[ImageDecoder.PNG] Decoding cancelled.");
+            return status;
+        }
+
+        m_cancellation = CancellationToken();
+
         if (m_number_of_frames > 0)
         {
             Surface d(dest, m_frame.xoffset, m_frame.yoffset, width, height);
@@ -2527,21 +2548,21 @@ namespace
             if (direct)
             {
                 // direct decoding
-                status = m_parser.decode(dest, nullptr);
+                status = m_parser.decode(dest, nullptr, cancellation);
             }
             else
             {
                 if (ptr_palette && header.palette)
                 {
                     // direct decoding with palette
-                    status = m_parser.decode(dest, ptr_palette);
+                    status = m_parser.decode(dest, ptr_palette, cancellation);
                     direct = true;
                 }
                 else
                 {
                     // indirect
                     Bitmap temp(header.width, header.height, header.format);
-                    status = m_parser.decode(temp, nullptr);
+                    status = m_parser.decode(temp, nullptr, cancellation);
                     dest.blit(0, 0, temp);
                 }
             }
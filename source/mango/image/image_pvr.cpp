@@ -659,7 +659,7 @@ namespace
 
             if (m_pvr_header.m_info.compression != TextureCompression::NONE)
             {
-                TextureCompressionStatus cs = m_pvr_header.m_info.decompress(dest, data);
+                TextureCompressionStatus cs = m_pvr_header.m_info.decompress(dest, data, cancellation);
 
                 status.info = cs.info;
                 status.success = cs.success;
@@ -330,35 +330,18 @@ namespace mango
 
         Blitter blitter(dest.format, source.format);
 
-#if 0
-        const int slice = 96;
+        const size_t bytes_per_row = size_t(rect.width) * std::max(dest.format.bytes(), source.format.bytes());
 
-        if (ThreadPool::getHardwareConcurrency() > 2 && rect.height >= slice * 2)
+        parallel_for_rows(rect.height, bytes_per_row, [&] (int y0, int y1)
         {
-            ConcurrentQueue queue("blit", Priority::HIGH);
+            BlitRect temp = rect;
 
-            for (int y = 0; y < rect.height; y += slice)
-            {
-                queue.enqueue([=, &blitter]
-                {
-                    int y0 = y;
-                    int y1 = std::min(y + slice, rect.height);
-
-                    BlitRect temp = rect;
-
-                    temp.dest.address += y0 * rect.dest.stride;
-                    temp.src.address += y0 * rect.src.stride;
-                    temp.height = y1 - y0;
+            temp.dest.address += y0 * rect.dest.stride;
+            temp.src.address += y0 * rect.src.stride;
+            temp.height = y1 - y0;
 
-                    blitter.convert(temp);
-                });
-            }
-        }
-        else
-#endif        
-        {
-            blitter.convert(rect);
-        }
+            blitter.convert(temp);
+        });
     }
 
     void Surface::xflip() const
@@ -393,6 +393,7 @@ namespace jpeg {
         std::string m_ycbcr_name;
 
         const Surface* m_surface;
+        CancellationToken m_cancellation;
 
         int width;  // Image width, does include alignment
         int height; // Image height, does include alignment
@@ -474,7 +475,7 @@ namespace jpeg {
         Parser(ConstMemory memory);
         ~Parser();
 
-        ImageDecodeStatus decode(const Surface& target);
+        ImageDecodeStatus decode(const Surface& target, const CancellationToken& cancellation = CancellationToken());
     };
 
     // ----------------------------------------------------------------------------
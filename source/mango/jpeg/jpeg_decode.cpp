@@ -1248,6 +1248,11 @@ namespace jpeg {
                 break;
             }
 
+            if (m_cancellation.isCancelled())
+            {
+                break;
+            }
+
             u16 marker = uload16be(p);
             p += 2;
 
@@ -1667,7 +1672,7 @@ namespace jpeg {
         debugPrint("  Decoder: %s\n", id.c_str());
     }
 
-    ImageDecodeStatus Parser::decode(const Surface& target)
+    ImageDecodeStatus Parser::decode(const Surface& target, const CancellationToken& cancellation)
     {
         ImageDecodeStatus status;
 
@@ -1726,6 +1731,7 @@ namespace jpeg {
 
         // set decoding target surface
         m_surface = &target;
+        m_cancellation = cancellation;
 
         std::unique_ptr<Bitmap> temp;
 
@@ -1738,6 +1744,16 @@ namespace jpeg {
 
         parse(scan_memory, true);
 
+        if (m_cancellation.isCancelled())
+        {
+            m_cancellation = CancellationToken();
+            blockVector.resize(0);
+            status.setError("[ImageDecoder.JPEG] Decoding cancelled.");
+            return status;
+        }
+
+        m_cancellation = CancellationToken();
+
         if (!header)
         {
             status.setError(header.info);
@@ -1830,6 +1846,9 @@ namespace jpeg {
 
         for (int y = 0; y < height; ++y)
         {
+            if (m_cancellation.isCancelled())
+                return;
+
             u8* image = m_surface->address<u8>(0, y);
 
             for (int x = 0; x < width; ++x)
@@ -1931,6 +1950,9 @@ namespace jpeg {
 
         for (int y = 0; y < ymcu_last; ++y)
         {
+            if (m_cancellation.isCancelled())
+                return;
+
             u8* dest = image;
             image += ystride;
 
@@ -1974,6 +1996,9 @@ namespace jpeg {
 
             for (int y = 0; y < ymcu; y += N)
             {
+                if (m_cancellation.isCancelled())
+                    break;
+
                 const int y0 = y;
                 const int y1 = std::min(y + N, ymcu);
                 const int count = (y1 - y0) * xmcu;
@@ -2011,6 +2036,9 @@ namespace jpeg {
                 // enqueue task
                 queue.enqueue([=]
                 {
+                    if (m_cancellation.isCancelled())
+                        return;
+
                     AlignedStorage<s16> data(JPEG_MAX_SAMPLES_IN_MCU);
 
                     DecodeState state = decodeState;
@@ -2067,6 +2095,9 @@ namespace jpeg {
 
         for (int i = 0; i < mcus; ++i)
         {
+            if (i % xmcu == 0 && m_cancellation.isCancelled())
+                return;
+
             decodeState.decode(data, &decodeState);
             handleRestart();
             data += blocks_in_mcu * 64;
@@ -2110,6 +2141,9 @@ namespace jpeg {
                 // enqueue task
                 queue.enqueue([=]
                 {
+                    if (m_cancellation.isCancelled())
+                        return;
+
                     DecodeState state = decodeState;
                     state.buffer.ptr = p;
 
@@ -2137,6 +2171,9 @@ namespace jpeg {
 
             for (int i = 0; i < mcus; ++i)
             {
+                if (i % xmcu == 0 && m_cancellation.isCancelled())
+                    return;
+
                 decodeState.decode(data, &decodeState);
                 data += blocks_in_mcu * 64;
             }
@@ -2182,6 +2219,9 @@ namespace jpeg {
                 // enqueue task
                 queue.enqueue([=]
                 {
+                    if (m_cancellation.isCancelled())
+                        return;
+
                     DecodeState state = decodeState;
                     state.buffer.ptr = p;
 
@@ -2235,6 +2275,9 @@ namespace jpeg {
 
             for (int y = 0; y < ys; ++y)
             {
+                if (m_cancellation.isCancelled())
+                    return;
+
                 int mcu_yoffset = (y >> vsf) * xmcu;
                 int block_yoffset = ((y & VMask) << hsf) + scan_offset;
 
@@ -2302,6 +2345,9 @@ namespace jpeg {
 
         for (int y = y0; y < y1; ++y)
         {
+            if (m_cancellation.isCancelled())
+                break;
+
             u8* dest = image + y * ystride;
 
             if (y == ymcu_last)